@@ -107,12 +107,14 @@ static opl_timer_t timer2 = { 3125, 0, 0, 0 };
 
 static bool audio_was_initialized = 0;
 
+// the OPL state is only touched by the game loop and the audio IRQ, both on core 0, so a single lock which keeps the
+// audio IRQ out serves for both mutexes
 static inline void Pico_LockMutex(mutex_t *mutex) {
-    
+    I_PicoSoundLock();
 }
 
 static inline void Pico_UnlockMutex(mutex_t *mutex) {
-
+    I_PicoSoundUnlock();
 }
 
 // Advance time by the specified number of samples, invoking any
@@ -287,12 +289,37 @@ void OPL_Pico_Mix_callback(audio_buffer_t *audio_buffer)
 //#endif
 }
 
+#if PD_MUSIC_BENCH
+// render music directly into the given buffer rather than via the audio producer, for the offline music benchmark;
+// returns false once there are no more callbacks scheduled, i.e. a non looping song has finished
+bool OPL_Pico_RenderOffline(int16_t *samples, unsigned int sample_count)
+{
+    mem_buffer_t mem_buffer = {
+            .size = sample_count * 4,
+            .bytes = (uint8_t *)samples,
+    };
+    audio_buffer_t audio_buffer = {
+            .buffer = &mem_buffer,
+            .max_sample_count = sample_count,
+    };
+    OPL_Pico_Mix_callback(&audio_buffer);
+    Pico_LockMutex(&callback_queue_mutex);
+    bool playing = !OPL_Queue_IsEmpty(callback_queue);
+    Pico_UnlockMutex(&callback_queue_mutex);
+    return playing;
+}
+#endif
+
 static void OPL_Pico_Shutdown(void)
 {
     if (audio_was_initialized)
     {
         I_PicoSoundSetMusicGenerator(NULL);
         OPL_Queue_Destroy(callback_queue);
+#if USE_EMU8950_OPL
+        OPL_delete(emu8950_opl);
+        emu8950_opl = NULL;
+#endif
         audio_was_initialized = 0;
     }
 }
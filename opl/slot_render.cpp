@@ -3,6 +3,7 @@
  * Copyright (C) 2021-2022 Graham Sanderson
  */
 #include "slot_render.h"
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
 
@@ -190,9 +191,15 @@ static INLINE int16_t calc_sample(const SLOT_RENDER *slot, uint32_t index, int16
 #endif
     uint16_t att = h + slot->eg_out_tll_lsl3 + am;
     int16_t t = exp_table[att&0xff];
+#if !PICO_ON_DEVICE
+    // the shift can reach 32, which (unlike the ARM register shift) isn't zero on x86, so be explicit
+    uint32_t shift = (att>>8)&127;
+    int16_t res = shift < 16 ? t >> shift : 0;
+#else
     // note we're really just bit clearing the original top bit 15 ..
     // todo presumably the & is ignored on ARM?
     int16_t res = t >> ((att>>8)&127);
+#endif
     if (!res) return res; // maybe make things more compatible
 #if EMU8950_LINEAR_NEG_NOT_NOT
     return ((att & 0x8000) ? -res : res) << 1;
@@ -394,11 +401,134 @@ template <bool PM> void alg1_am0_fn(SLOT_RENDER *slot, uint32_t& pm_phase, uint3
     slot->buffer[s] += val + slot->mod_buffer[s];
 }
 
+#if EMU8950_SLOT_RENDER_SIMD
+int slot_render_simd = 1;
+
+// the SIMD path renders SLOT_RENDER_LANES samples at a time between envelope updates (during which eg_out_tll_lsl3 is
+// constant), as fixed width loops over lanes which the compiler vectorizes (-O3). there is no gather on SSE2/NEON, so
+// to keep the per lane lookups down, the wave table is pre-merged per waveform, and the exp_table lookup, shift and sign
+// handling of calc_sample are folded into a single table
+#define SLOT_RENDER_LANES 8
+
+// wave_lanes[ws][index] = wav_or_table_lookup[ws][index >> (PG_BITS - 2)] | logsin_table[index & (PG_WIDTH / 2 - 1)]
+static uint16_t wave_lanes[4][PG_WIDTH];
+// exp_lanes[(att & 0xfff) | ((att & 0x8000) >> 3)] = calc_sample result for att with bits 12-14 clear (otherwise 0)
+static int16_t exp_lanes[0x2000];
+
+static struct lane_tables {
+    lane_tables();
+} lane_tables;
+
+lane_tables::lane_tables() {
+    for (int ws = 0; ws < 4; ws++) {
+        for (uint32_t index = 0; index < PG_WIDTH; index++) {
+            wave_lanes[ws][index] = wav_or_table_lookup[ws][index >> (PG_BITS - 2)] | logsin_table[index & (PG_WIDTH / 2 - 1)];
+        }
+    }
+    for (uint32_t i = 0; i < sizeof(exp_lanes) / sizeof(exp_lanes[0]); i++) {
+        uint16_t att = (i & 0xfff) | ((i & 0x1000) << 3);
+        int16_t res = exp_table[att & 0xff] >> ((att >> 8) & 15);
+#if EMU8950_LINEAR_NEG_NOT_NOT
+        exp_lanes[i] = res ? ((att & 0x8000) ? -res : res) << 1 : 0;
+#else
+        exp_lanes[i] = res ? ((att & 0x8000) ? ~res : res) << 1 : 0;
+#endif
+    }
+}
+
+template<bool PM> static INLINE void advance_phaseN(SLOT_RENDER *slot, uint32_t &pm_phase, uint32_t *pg_out) {
+    uint32_t phase = slot->pg_phase;
+    if (PM) {
+        for (int i = 0; i < SLOT_RENDER_LANES; i++) {
+            pm_phase = (pm_phase + PM_DPHASE) & (PM_DP_WIDTH - 1);
+            int8_t pm = slot->efix_pm_table[pm_phase >> (PM_DP_BITS - PM_PG_BITS)];
+            phase += slot->efix_pg_pm_x_fnum3ff + pm * slot->efix_pg_phase_multiplier;
+            pg_out[i] = phase;
+        }
+    } else {
+        for (int i = 0; i < SLOT_RENDER_LANES; i++) {
+            pg_out[i] = phase + (i + 1) * slot->efix_pg_pm_x_fnum3ff;
+        }
+        phase += SLOT_RENDER_LANES * slot->efix_pg_pm_x_fnum3ff;
+    }
+    // masking once at the end is the same as masking every sample as the mask is 2^n-1
+    slot->pg_phase = phase & (DP_WIDTH * 2 - 1);
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) {
+        pg_out[i] = (pg_out[i] & (DP_WIDTH * 2 - 1)) >> (DP_BASE_BITS + 1);
+    }
+}
+
+template<bool AM> static INLINE void calc_sampleN(const SLOT_RENDER *slot, const uint32_t *index, uint32_t s, int32_t *out) {
+    const uint16_t *wave = wave_lanes[slot->patch->WS & 3];
+    uint32_t att[SLOT_RENDER_LANES];
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) {
+        att[i] = wave[index[i] & (PG_WIDTH - 1)] + (uint32_t)slot->eg_out_tll_lsl3;
+        if (AM) att[i] += slot->lfo_am_buffer_lsl3[s + i];
+    }
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) {
+        // bits 12-14 set means a shift of 16 or more, i.e. zero
+        out[i] = (att[i] & 0x7000) ? 0 : exp_lanes[(att[i] & 0xfff) | ((att[i] & 0x8000) >> 3)];
+    }
+}
+
+template<bool PM, bool AM> void mod_fb0_fnN(SLOT_RENDER *slot, uint32_t& pm_phase, uint32_t s) {
+    uint32_t pg_out[SLOT_RENDER_LANES];
+    int32_t val[SLOT_RENDER_LANES];
+    advance_phaseN<PM>(slot, pm_phase, pg_out);
+    calc_sampleN<AM>(slot, pg_out, s, val);
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) slot->mod_buffer[s + i] = (int16_t)val[i];
+}
+
+template<bool PM, bool AM> void alg0_fnN(SLOT_RENDER *slot, uint32_t& pm_phase, uint32_t s) {
+    uint32_t pg_out[SLOT_RENDER_LANES];
+    int32_t val[SLOT_RENDER_LANES];
+    advance_phaseN<PM>(slot, pm_phase, pg_out);
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) pg_out[i] += slot->mod_buffer[s + i];
+    calc_sampleN<AM>(slot, pg_out, s, val);
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) slot->buffer[s + i] += val[i];
+}
+
+template<bool PM, bool AM> void alg1_fnN(SLOT_RENDER *slot, uint32_t& pm_phase, uint32_t s) {
+    uint32_t pg_out[SLOT_RENDER_LANES];
+    int32_t val[SLOT_RENDER_LANES];
+    advance_phaseN<PM>(slot, pm_phase, pg_out);
+    calc_sampleN<AM>(slot, pg_out, s, val);
+    for (int i = 0; i < SLOT_RENDER_LANES; i++) slot->buffer[s + i] += val[i] + slot->mod_buffer[s + i];
+}
+
+// render whole groups of samples with fnN up to (but not including) the next envelope update, returning the new s
+template<typename FN> static INLINE uint32_t slot_render_runs(FN&& fnN, SLOT_RENDER *slot, uint32_t &pm_phase, uint32_t s, uint32_t nsamples,
+                                                             uint32_t &eg_counter, uint32_t eg_shift_mask) {
+    if (slot_render_simd) {
+        // eg_counter is never near wrapping (bit 31 is set on entry, and we render far fewer than 2^30 samples)
+        while (s + SLOT_RENDER_LANES <= nsamples && (eg_counter & eg_shift_mask) + SLOT_RENDER_LANES <= eg_shift_mask) {
+            fnN(slot, pm_phase, s);
+            eg_counter += SLOT_RENDER_LANES;
+            s += SLOT_RENDER_LANES;
+        }
+    }
+    return s;
+}
+#endif
+
+#if EMU8950_SLOT_RENDER_SIMD
+#define SLOT_RENDER_FNN(fnN) , fnN
+#else
+#define SLOT_RENDER_FNN(fnN)
+#endif
+
+// slots with feedback depend on the previous sample so are always rendered one sample at a time
+static INLINE uint32_t slot_render_runs(std::nullptr_t, SLOT_RENDER *slot, uint32_t &pm_phase, uint32_t s, uint32_t nsamples,
+                                        uint32_t &eg_counter, uint32_t eg_shift_mask) {
+    return s;
+}
+
 #if PICO_ON_DEVICE
 extern "C" uint32_t test_slot_asm(SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint fn);
 #endif
 
-template <int F_NUM, typename F> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
+// fn renders a single sample; fnN (if not nullptr) renders SLOT_RENDER_LANES samples with no envelope update between them
+template <int F_NUM, typename F, typename FN = std::nullptr_t> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase, FN&& fnN = nullptr) {
     // factored out as it is constant per call
     slot->efix_pg_phase_multiplier = ml_table[slot->patch->ML] << slot->blk;
     uint32_t efix_pg_pm_x_fnum3ff = (slot->fnum & 0x3ff) * slot->efix_pg_phase_multiplier;
@@ -508,6 +638,8 @@ template <int F_NUM, typename F> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER
             fn(slot, pm_phase, s++);
         } else {
             for (; s < nsamples; s++) {
+                s = slot_render_runs(fnN, slot, pm_phase, s, nsamples, eg_counter, eg_shift_mask);
+                if (s == nsamples) break;
 #if DUMPO
                 if (hack_ch == 17 && s == 12) breako();
 #endif
@@ -545,6 +677,8 @@ template <int F_NUM, typename F> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER
             }
         } else {
             for (; s < nsamples; s++) {
+                s = slot_render_runs(fnN, slot, pm_phase, s, nsamples, eg_counter, eg_shift_mask);
+                if (s == nsamples) break;
                 if (unlikely((++eg_counter & eg_shift_mask) == 0)) {
                     slot->eg_out = static_cast<int16_t>(std::min(EG_MUTE, slot->eg_out + (int) eg_step_table[
                             (eg_counter >> slot->eg_shift) & 7]));
@@ -571,6 +705,8 @@ template <int F_NUM, typename F> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER
         uint32_t eg_shift_mask = slot->eg_rate_h > 0 ? (1 << slot->eg_shift) - 1 : 0xffffffff;
         uint8_t *eg_step_table = get_decay_step_table(slot);
         for (; s < nsamples; s++) {
+            s = slot_render_runs(fnN, slot, pm_phase, s, nsamples, eg_counter, eg_shift_mask);
+            if (s == nsamples) break;
             if (unlikely((++eg_counter & eg_shift_mask) == 0)) {
                 slot->eg_out = static_cast<int16_t>(std::min(EG_MUTE, slot->eg_out + (int)eg_step_table[(eg_counter >> slot->eg_shift)&7]));
 #if EMU8950_LINEAR_END_OF_NOTE_OPTIMIZATION
@@ -602,14 +738,14 @@ template<bool PM> uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t
             slot->nine_minus_FB = 9 - slot->patch->FB;
             return slot_envelope_loop<6+PM>(mod_am1_fb1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
         } else {
-            return slot_envelope_loop<2+PM>(mod_am1_fb0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+            return slot_envelope_loop<2+PM>(mod_am1_fb0_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((mod_fb0_fnN<PM, true>)));
         }
     } else {
         if (slot->patch->FB) {
             slot->nine_minus_FB = 9 - slot->patch->FB;
             return slot_envelope_loop<4+PM>(mod_am0_fb1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
         } else {
-            return slot_envelope_loop<0+PM>(mod_am0_fb0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+            return slot_envelope_loop<0+PM>(mod_am0_fb0_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((mod_fb0_fnN<PM, false>)));
         }
     }
 }
@@ -623,9 +759,9 @@ extern "C" uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t nsampl
 
 template<bool PM> uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
     if (slot->patch->AM) {
-        return slot_envelope_loop<10+PM>(alg0_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+        return slot_envelope_loop<10+PM>(alg0_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((alg0_fnN<PM, true>)));
     } else {
-        return slot_envelope_loop<8+PM>(alg0_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+        return slot_envelope_loop<8+PM>(alg0_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((alg0_fnN<PM, false>)));
     }
 }
 
@@ -639,9 +775,9 @@ extern "C" uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t n
 template<bool PM> uint32_t slot_car_linear_alg1(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
 
     if (slot->patch->AM) {
-        return slot_envelope_loop<14+PM>(alg1_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+        return slot_envelope_loop<14+PM>(alg1_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((alg1_fnN<PM, true>)));
     } else {
-        return slot_envelope_loop<12+PM>(alg1_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+        return slot_envelope_loop<12+PM>(alg1_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase SLOT_RENDER_FNN((alg1_fnN<PM, false>)));
     }
 }
 
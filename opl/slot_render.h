@@ -8,6 +8,20 @@
 extern "C" {
 #endif
 #include <stdint.h>
+
+#ifndef EMU8950_SLOT_RENDER_SIMD
+// host only: render slots without feedback several samples at a time in a form the compiler can vectorize (SSE2/NEON),
+// bit exact with the scalar path
+#if EMU8950_SLOT_RENDER && EMU8950_NO_WAVE_TABLE_MAP && !PICO_ON_DEVICE && !EMU8950_NIT_PICKS
+#define EMU8950_SLOT_RENDER_SIMD 1
+#endif
+#endif
+
+#if EMU8950_SLOT_RENDER_SIMD
+// non zero to use the vectorized path; may be cleared at runtime for comparison with the scalar path
+extern int slot_render_simd;
+#endif
+
 #define EG_BITS 9
 #define EG_MUTE ((1 << EG_BITS) - 1)
 #define EG_MAX (0x1f0) // 93dB
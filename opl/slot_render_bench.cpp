@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2021-2022 Graham Sanderson
+ */
+// Host only benchmark/check for slot_render.cpp: renders a fixed pseudo random set of voices (modulator + carrier slot
+// pairs) through both the scalar and the vectorized path, fails if their output differs by a single bit, and reports
+// how many voices per second each path renders.
+#include "slot_render.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if !EMU8950_SLOT_RENDER_SIMD
+#error slot_render_bench requires EMU8950_SLOT_RENDER_SIMD
+#endif
+
+typedef void OPL;
+extern "C" uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase);
+extern "C" uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase);
+extern "C" uint32_t slot_car_linear_alg1(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase);
+
+#define VOICE_COUNT 256
+#define BLOCK_COUNT 64
+#define BLOCK_SAMPLES 128 // a typical audio buffer worth
+#define OPL_RATE 49716
+
+struct voice {
+    OPL_PATCH patch[2];
+    SLOT_RENDER slot[2];
+    bool alg1;
+};
+
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t next_rand(uint32_t range) {
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return (rand_state >> 8) % range;
+}
+
+// steady voices are held notes with no envelope changes, which is the bulk of what is rendered for real music, and
+// the best case for the vectorized path; other voices are random to exercise every envelope and slot function
+static void make_voice(voice &v, bool steady) {
+    memset(&v, 0, sizeof(v));
+    v.alg1 = next_rand(2);
+    for (int i = 0; i < 2; i++) {
+        OPL_PATCH &p = v.patch[i];
+        SLOT_RENDER &slot = v.slot[i];
+        p.FB = i == 0 && next_rand(2) ? next_rand(8) : 0; // only the modulator has feedback
+        p.EG = next_rand(2);
+        p.ML = next_rand(16);
+        p.AR = next_rand(16);
+        p.DR = next_rand(16);
+        p.SL = next_rand(16);
+        p.RR = next_rand(16);
+        p.AM = next_rand(2);
+        p.PM = next_rand(2);
+        p.WS = next_rand(4);
+        slot.patch = &p;
+        slot.eg_state = next_rand(RELEASE + 1);
+        if (steady) {
+            slot.eg_state = SUSTAIN;
+            p.EG = 1;
+            p.FB = 0;
+        }
+        slot.rks = next_rand(16);
+        slot.eg_out = slot.eg_state == ATTACK ? EG_MUTE : next_rand(EG_MUTE);
+        slot.tll = next_rand(0x80);
+        slot.fnum = next_rand(1024);
+        slot.blk = next_rand(8);
+        slot.pg_phase = next_rand(DP_WIDTH) * 2;
+        slot.pm_mode = next_rand(2);
+        // same as commit_slot_update_eg_only in slot_render.cpp
+        int p_rate;
+        switch (slot.eg_state) {
+            case ATTACK: p_rate = p.AR; break;
+            case DECAY: p_rate = p.DR; break;
+            case SUSTAIN: p_rate = p.EG ? 0 : p.RR; break;
+            default: p_rate = p.RR; break;
+        }
+        if (p_rate) {
+            slot.eg_rate_h = std::min(15, p_rate + (slot.rks >> 2));
+            slot.eg_rate_l = slot.rks & 3;
+            if (slot.eg_state == ATTACK) {
+                slot.eg_shift = (0 < slot.eg_rate_h && slot.eg_rate_h < 12) ? (12 - slot.eg_rate_h) : 0;
+            } else {
+                slot.eg_shift = (slot.eg_rate_h < 12) ? (12 - slot.eg_rate_h) : 0;
+            }
+        }
+    }
+}
+
+// renders all the voices, returning a hash of all the output and the final slot state
+static uint32_t render(const std::vector<voice> &initial, double &seconds) {
+    std::vector<voice> voices(initial);
+    static uint8_t lfo_am_buffer_lsl3[BLOCK_SAMPLES];
+    static int16_t mod_buffer[BLOCK_SAMPLES];
+    static int32_t buffer[BLOCK_SAMPLES];
+    uint32_t eg_counter = 0x80000000u;
+    uint32_t pm_phase = 0;
+    uint32_t hash = 0;
+    seconds = 0;
+    for (int b = 0; b < BLOCK_COUNT; b++) {
+        for (int s = 0; s < BLOCK_SAMPLES; s++) {
+            lfo_am_buffer_lsl3[s] = ((b * BLOCK_SAMPLES + s) / 64 % 27) << 3;
+        }
+        memset(buffer, 0, sizeof(buffer));
+        auto t0 = std::chrono::steady_clock::now();
+        for (auto &v : voices) {
+            for (auto &slot : v.slot) {
+                // these would have been fixed up for the chip as a whole by emu8950
+                slot.patch = &v.patch[&slot - v.slot];
+                slot.lfo_am_buffer_lsl3 = lfo_am_buffer_lsl3;
+                slot.mod_buffer = mod_buffer;
+                slot.buffer = buffer;
+            }
+            uint32_t s_mod = slot_mod_linear(nullptr, &v.slot[0], BLOCK_SAMPLES, eg_counter, pm_phase);
+            if (s_mod != BLOCK_SAMPLES) {
+                memset(mod_buffer + s_mod, 0, (BLOCK_SAMPLES - s_mod) * 2);
+            }
+            uint32_t s_alg;
+            if (v.alg1) {
+                s_alg = slot_car_linear_alg1(nullptr, &v.slot[1], BLOCK_SAMPLES, eg_counter, pm_phase);
+                for (uint32_t s = s_alg; s < BLOCK_SAMPLES; s++) {
+                    buffer[s] += mod_buffer[s];
+                }
+            } else {
+                slot_car_linear_alg0(nullptr, &v.slot[1], BLOCK_SAMPLES, eg_counter, pm_phase);
+            }
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        for (const auto &sample : buffer) {
+            hash = hash * 31 + (uint32_t)sample;
+        }
+        pm_phase = (pm_phase + PM_DPHASE * BLOCK_SAMPLES) & (PM_DP_WIDTH - 1);
+        eg_counter += BLOCK_SAMPLES;
+    }
+    for (const auto &v : voices) {
+        for (const auto &slot : v.slot) {
+            hash = hash * 31 + slot.eg_state;
+            hash = hash * 31 + (uint16_t)slot.eg_out;
+            hash = hash * 31 + slot.pg_phase;
+            hash = hash * 31 + (uint32_t)slot.output[0];
+            hash = hash * 31 + (uint32_t)slot.output[1];
+        }
+    }
+    return hash;
+}
+
+static bool run_voices(const char *name, bool steady, int repeats) {
+    std::vector<voice> voices(VOICE_COUNT);
+    for (auto &v : voices) make_voice(v, steady);
+    double best[2] = {1e9, 1e9};
+    uint32_t hash[2];
+    for (int r = 0; r < repeats; r++) {
+        for (int simd = 0; simd < 2; simd++) {
+            slot_render_simd = simd;
+            double seconds;
+            hash[simd] = render(voices, seconds);
+            best[simd] = std::min(best[simd], seconds);
+        }
+        if (hash[0] != hash[1]) {
+            printf("%s: MISMATCH scalar hash %08x simd hash %08x\n", name, hash[0], hash[1]);
+            return false;
+        }
+    }
+    double voice_seconds = (double)VOICE_COUNT * BLOCK_COUNT * BLOCK_SAMPLES / OPL_RATE;
+    for (int simd = 0; simd < 2; simd++) {
+        printf("%s %6s: %8.0f voices/s (%.0fx realtime voices) hash %08x\n", name, simd ? "simd" : "scalar",
+               VOICE_COUNT * BLOCK_COUNT / best[simd], voice_seconds / best[simd], hash[simd]);
+    }
+    printf("%s speedup %.2fx\n", name, best[0] / best[1]);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int repeats = argc > 1 ? atoi(argv[1]) : 10;
+    if (!run_voices("random", false, repeats)) return 1;
+    if (!run_voices("steady", true, repeats)) return 1;
+    return 0;
+}
@@ -2110,6 +2110,23 @@ void D_DoomMain (void)
     }
 #endif
 
+#if PD_MUSIC_BENCH
+    // headless music benchmark build; render all the music offline then quit
+    S_MusicBench();
+#endif
+
+#if PD_SFX_BENCH
+    // headless sfx mixer benchmark build; mix all the sfx offline then quit
+    S_SfxBench();
+#endif
+
+#if PD_BENCH
+    // headless benchmark build; play back the demo without frame pacing then quit with the pd_render frame stats
+    singledemo = true;
+    G_TimeDemo (PD_BENCH_DEMO);
+    D_DoomLoop ();  // never returns
+#endif
+
     if (gameaction != ga_loadgame )
     {
 	if (autostart || netgame)
@@ -106,7 +106,7 @@ thinker_t *Z_ThinkMallocImpl(int size);
 void Z_ThinkFree(thinker_t *thinker);
 static inline void *Z_ThinkMalloc(int size, int tag, void *user) {
     assert(!user);
-    assert(tag == PU_LEVEL);
+    assert(tag == PU_LEVEL || tag == PU_LEVSPEC); // pool blocks are PU_LEVEL, which is freed along with PU_LEVSPEC
     return Z_ThinkMallocImpl(size);
 }
 #endif
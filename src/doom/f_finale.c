@@ -226,9 +226,6 @@ void F_Ticker (void)
         if (gameepisode == 3)
             S_StartMusic(mus_bunny);
     }
-#if PICO_ON_DEVICE
-    I_UpdateSound();
-#endif
 }
 
 
@@ -94,6 +94,9 @@ void	G_DoCompleted (void);
 void	G_DoVictory (void); 
 void	G_DoWorldDone (void); 
 void	G_DoSaveGame (void); 
+#if PICO_ON_DEVICE && !NO_USE_SAVE
+static void G_SaveGameProgress(void);
+#endif
  
 // Gamestate the last time G_Ticker was called.
 
@@ -974,6 +977,10 @@ void G_Ticker (void)
 	if (playeringame[i] && players[i].playerstate == PST_REBORN) 
 	    G_DoReborn (i);
 
+#if PICO_ON_DEVICE && !NO_USE_SAVE
+    G_SaveGameProgress();
+#endif
+
     // do things to change the game state
     while (gameaction != ga_nothing)
     {
@@ -1809,6 +1816,13 @@ void G_DoLoadGame (void) {
     // draw the pattern into the back screen
     R_FillBackScreen ();
 #endif
+#if PICO_ON_DEVICE && !NO_USE_SAVE
+    // loading is a pause anyway, so get the erasing for the next save out of the way now
+    if (!netgame)
+    {
+        while (P_SaveGameFlashPreEraseStep());
+    }
+#endif
 #endif
 }
  
@@ -1840,6 +1854,37 @@ G_SaveGame
     sendsave = true;
 }
 
+#if PICO_ON_DEVICE && !NO_USE_SAVE
+// advance any background flash write of a save, reporting its progress
+static void G_SaveGameProgress(void)
+{
+    static char save_message[24];
+    static int last_progress = -1;
+    int progress = P_SaveGameFlashWriteStep();
+
+    if (progress < 0)
+    {
+        last_progress = -1;
+        // erase a sector at a time for the next save while nothing is moving
+        if ((paused || menuactive) && !netgame)
+        {
+            P_SaveGameFlashPreEraseStep();
+        }
+        return;
+    }
+    if (progress == 100)
+    {
+        players[consoleplayer].message = DEH_String(GGSAVED);
+    }
+    else if (last_progress < 0 || progress / 25 != last_progress / 25)
+    {
+        M_snprintf(save_message, sizeof(save_message), "saving game... %d%%", progress);
+        players[consoleplayer].message = save_message;
+    }
+    last_progress = progress;
+}
+#endif
+
 void G_DoSaveGame (void) 
 {
 #if !NO_USE_SAVE
@@ -1903,7 +1948,10 @@ void G_DoSaveGame (void)
 #endif
     printf("SAVE GAME SIZE %d\n", (int)(bo.cur - save_buffer));
 #if PICO_ON_DEVICE
-    if (!P_SaveGameWriteFlashSlot(savegameslot, save_buffer, (int)(bo.cur - save_buffer), save_buffer - 4096)) {
+    if (P_SaveGameStartFlashSlotWrite(savegameslot, save_buffer, (int)(bo.cur - save_buffer))) {
+        // G_Ticker reports progress as the write continues in the background
+        resume = false;
+    } else if (!P_SaveGameWriteFlashSlot(savegameslot, save_buffer, (int)(bo.cur - save_buffer), save_buffer - 4096)) {
         M_StartMessage("There was not enough space to save the game.\nWould you like to clear this slot and\n try saving again in a different slot?\n\npress y or n.",save_game_clear,true);
         resume = false;
     }
@@ -2606,6 +2654,21 @@ boolean G_CheckDemoStatus (void)
         float fps = ((float) gametic * TICRATE) / realtics;
 	I_Error ("timed %i gametics in %i realtics (%f fps)",
                  gametic, realtics, fps);
+#endif
+#if PD_FRAME_STATS
+        pd_frame_stats_report();
+#if Z_ZONE_STATS
+        Z_ReportStats();
+#if USE_THINKER_POOL
+        P_ReportThinkerPoolStats();
+#endif
+#endif
+#if USE_SIGHT_CACHE
+        P_ReportSightCacheStats();
+#endif
+#if PD_BENCH
+        exit(0); // headless, so there is no exit screen to show
+#endif
 #endif
     }
 
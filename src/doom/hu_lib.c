@@ -44,6 +44,9 @@ void HUlib_clearTextLine(hu_textline_t* t)
     t->len = 0;
     t->l[0] = 0;
     t->needsupdate = true;
+#if DOOM_TINY
+    t->span.serial = 0;
+#endif
 }
 
 void
@@ -74,6 +77,9 @@ HUlib_addCharToTextLine
 	t->l[t->len++] = ch;
 	t->l[t->len] = 0;
 	t->needsupdate = 4;
+#if DOOM_TINY
+	t->span.serial = 0;
+#endif
 	return true;
     }
 
@@ -87,6 +93,9 @@ boolean HUlib_delCharFromTextLine(hu_textline_t* t)
     {
 	t->l[--t->len] = 0;
 	t->needsupdate = 4;
+#if DOOM_TINY
+	t->span.serial = 0;
+#endif
 	return true;
     }
 
@@ -103,6 +112,11 @@ HUlib_drawTextLine
     int			x;
     unsigned char	c;
 
+#if DOOM_TINY
+    // the text is unchanged unless the span was invalidated, so we can reuse last frame's entries
+    if (V_ReusePatchSpan(&l->span, drawcursor))
+	return;
+#endif
     // draw the new stuff
     x = l->x;
     for (i=0;i<l->len;i++)
@@ -132,6 +146,9 @@ HUlib_drawTextLine
     {
 	V_DrawPatchDirect(x, l->y, vpatch_n(l->f, '_' - l->sc));
     }
+#if DOOM_TINY
+    V_EndPatchSpan(&l->span);
+#endif
 }
 
 
@@ -21,6 +21,9 @@
 
 // We are referring to patches.
 #include "r_defs.h"
+#if DOOM_TINY
+#include "v_video.h"
+#endif
 
 // font stuff
 #define HU_CHARERASE	KEY_BACKSPACE
@@ -48,6 +51,10 @@ typedef struct
     // whether this line needs to be udpated
     int		needsupdate;	      
 
+#if DOOM_TINY
+    // patch list entries from the last draw, reused until the text changes
+    vpatchspan_t span;
+#endif
 } hu_textline_t;
 
 
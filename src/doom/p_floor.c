@@ -39,8 +39,13 @@
 //
 // Move a plane (floor or ceiling) and check for crushing
 //
+#if USE_SIGHT_CACHE
+static result_e
+T_MovePlaneHeights
+#else
 result_e
 T_MovePlane
+#endif
 ( sector_t*	sector,
   fixed_t	speed,
   fixed_t	dest,
@@ -196,6 +201,32 @@ T_MovePlane
     return ok;
 }
 
+#if USE_SIGHT_CACHE
+result_e
+T_MovePlane
+( sector_t*	sector,
+  fixed_t	speed,
+  fixed_t	dest,
+  boolean	crush,
+  int		floorOrCeiling,
+  int		direction )
+{
+    sectorheight_t	floor = sector->rawfloorheight;
+    sectorheight_t	ceiling = sector->rawceilingheight;
+    result_e	res;
+
+    res = T_MovePlaneHeights(sector, speed, dest, crush, floorOrCeiling, direction);
+
+    // any sight check result may depend on this sector's heights; a
+    // blocked or crushed move puts them back, so only a real change counts
+    // (P_ChangeSector does no sight checks, so this can wait until now)
+    if (sector->rawfloorheight != floor || sector->rawceilingheight != ceiling)
+	P_InvalidateSightCache();
+
+    return res;
+}
+#endif
+
 
 //
 // MOVE A FLOOR TO IT'S DESTINATION (UP OR DOWN)
@@ -271,7 +302,7 @@ EV_DoFloor
 	
 	// new floor thinker
 	rtn = 1;
-	floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	floor = Z_ThinkMalloc (sizeof(*floor), PU_LEVSPEC, 0);
 	P_AddThinker (&floor->thinker);
 	sec->specialdata = ptr_to_shortptr(floor);
 	floor->thinker.function = ThinkF_T_MoveFloor;
@@ -474,7 +505,7 @@ EV_BuildStairs
 	
 	// new floor thinker
 	rtn = 1;
-	floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	floor = Z_ThinkMalloc (sizeof(*floor), PU_LEVSPEC, 0);
 	P_AddThinker (&floor->thinker);
 	sec->specialdata = ptr_to_shortptr(floor);
 	floor->thinker.function = ThinkF_T_MoveFloor;
@@ -530,7 +561,7 @@ EV_BuildStairs
 					
 		sec = tsec;
 		secnum = newsecnum;
-		floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+		floor = Z_ThinkMalloc (sizeof(*floor), PU_LEVSPEC, 0);
 
 		P_AddThinker (&floor->thinker);
 
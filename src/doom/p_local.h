@@ -66,6 +66,12 @@
 
 // both the head and tail of the thinker list
 extern	thinker_t	thinkercap;	
+#if USE_THINKER_CLASS_LISTS
+// sector specials are on their own list, so thinkercap only has mobjs
+extern	thinker_t	specialthinkercap;
+#else
+#define specialthinkercap thinkercap
+#endif
 
 
 void P_InitThinkers (void);
@@ -232,6 +238,14 @@ boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
 void	P_SlideMove (mobj_t* mo);
 boolean P_CheckSight (mobj_t* t1, mobj_t* t2);
+#if USE_SIGHT_CACHE
+void	P_InvalidateSightCache (void);
+#if PD_FRAME_STATS
+void	P_ReportSightCacheStats (void);
+#endif
+#else
+#define P_InvalidateSightCache() ((void)0)
+#endif
 void 	P_UseLines (player_t* player);
 
 boolean P_ChangeSector (sector_t* sector, boolean crunch);
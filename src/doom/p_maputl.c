@@ -603,6 +603,7 @@ const uint8_t bitcount8_table[256] = {
         8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
 };
 #endif
+
 //
 // P_BlockLinesIterator
 // The validcount flags are used to avoid checking lines
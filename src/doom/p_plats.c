@@ -161,7 +161,7 @@ EV_DoPlat
 	
 	// Find lowest & highest floors around sector
 	rtn = 1;
-	plat = Z_Malloc( sizeof(*plat), PU_LEVSPEC, 0);
+	plat = Z_ThinkMalloc( sizeof(*plat), PU_LEVSPEC, 0);
 	P_AddThinker(&plat->thinker);
 		
 	plat->type = type;
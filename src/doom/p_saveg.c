@@ -280,6 +280,72 @@ static void saveg_write_maybe(uint32_t val, uint32_t static_val, saveg_writer wr
     }
 }
 #endif
+
+// Variable length codes used by the v2 compressed format: exp-Golomb for small values, zig-zag of that for small
+// signed values, and fixed_t as a signed whole part + optional 16 bit fraction (positions and heights are often whole)
+#if LOAD_COMPRESSED
+static uint saveg_read_gamma(void) {
+    uint n = 0;
+    while (!saveg_read_bit()) n++;
+    return ((1u << n) | (n ? saveg_read_bits(n) : 0)) - 1;
+}
+
+static int saveg_read_signed(void) {
+    return from_zig((int)saveg_read_gamma());
+}
+
+static fixed_t saveg_read_fixed_delta(fixed_t base) {
+    uint32_t delta = ((uint32_t)saveg_read_signed()) << FRACBITS;
+    if (saveg_read_bit()) delta |= saveg_read_bits(FRACBITS);
+    return (fixed_t)((uint32_t)base + delta);
+}
+
+static int saveg_read_maybe_signed(int static_val, const char *desc) {
+    int rc = saveg_read_bit() ? static_val + saveg_read_signed() : static_val;
+    xprintf("  %s %08x\n", desc, rc);
+    return rc;
+}
+
+static fixed_t saveg_read_maybe_fixed(fixed_t static_val, const char *desc) {
+    fixed_t rc = saveg_read_bit() ? saveg_read_fixed_delta(static_val) : static_val;
+    xprintf("  %s %08x\n", desc, rc);
+    return rc;
+}
+#endif
+#if SAVE_COMPRESSED
+static void saveg_write_gamma(uint value) {
+    assert(value < (1u << 24));
+    value++;
+    uint n = 31 - __builtin_clz(value);
+    saveg_write_bits(0, n);
+    saveg_write_bit(1);
+    if (n) saveg_write_bits(value & ((1u << n) - 1), n);
+}
+
+static void saveg_write_signed(int value) {
+    saveg_write_gamma(to_zig(value));
+}
+
+static void saveg_write_fixed_delta(fixed_t value, fixed_t base) {
+    uint32_t delta = (uint32_t)value - (uint32_t)base;
+    saveg_write_signed(((int32_t)delta) >> FRACBITS);
+    uint frac = delta & (FRACUNIT - 1);
+    saveg_write_bit(frac != 0);
+    if (frac) saveg_write_bits(frac, FRACBITS);
+}
+
+static void saveg_write_maybe_signed(int val, int static_val, const char *desc) {
+    xprintf("  %s %08x %08x\n", desc, val, static_val);
+    saveg_write_bit(val != static_val);
+    if (val != static_val) saveg_write_signed(val - static_val);
+}
+
+static void saveg_write_maybe_fixed(fixed_t val, fixed_t static_val, const char *desc) {
+    xprintf("  %s %08x %08x\n", desc, val, static_val);
+    saveg_write_bit(val != static_val);
+    if (val != static_val) saveg_write_fixed_delta(val, static_val);
+}
+#endif
 // Pad to 4-byte boundaries
 
 static void saveg_read_pad(void)
@@ -350,13 +416,84 @@ static void saveg_writep(const void *p)
 #if !LOAD_COMPRESSED
 #define saveg_read_enum() saveg_read32()
 #else
-#define saveg_read_enum() saveg_read8();
+#define saveg_read_enum() saveg_read_gamma()
 #endif
 #if !SAVE_COMPRESSED
 #define saveg_write_enum(x) saveg_write32(x)
 #else
-#define saveg_write_enum(x) saveg_write8(x)
+#define saveg_write_enum(x) saveg_write_gamma(x)
+#endif
+
+// Thinker fields are mostly equal or close to something known when loading (the sector's original heights in
+// the WHD, the default speeds etc.), so the compressed format stores them as a difference from that base value
+
+#if LOAD_COMPRESSED || SAVE_COMPRESSED
+#define sector_base_floorheight(sec) (whd_sectors[(sec) - sectors].floorheight << FRACBITS)
+#define sector_base_ceilingheight(sec) (whd_sectors[(sec) - sectors].ceilingheight << FRACBITS)
+#define sector_base_lightlevel(sec) (whd_sectors[(sec) - sectors].lightlevel)
+
+static uint saveg_sector_bits(void) {
+    return numsectors > 1 ? 32 - __builtin_clz(numsectors - 1) : 1;
+}
+#else
+#define sector_base_floorheight(sec) 0
+#define sector_base_ceilingheight(sec) 0
+#define sector_base_lightlevel(sec) 0
+#endif
+
+static fixed_t saveg_read_fixed(fixed_t base)
+{
+#if !LOAD_COMPRESSED
+    return saveg_read32();
+#else
+    return saveg_read_fixed_delta(base);
+#endif
+}
+
+static void saveg_write_fixed(fixed_t value, fixed_t base)
+{
+#if !SAVE_COMPRESSED
+    saveg_write32(value);
+#else
+    saveg_write_fixed_delta(value, base);
+#endif
+}
+
+static int saveg_read_int(int base)
+{
+#if !LOAD_COMPRESSED
+    return saveg_read32();
+#else
+    return base + saveg_read_signed();
+#endif
+}
+
+static void saveg_write_int(int value, int base)
+{
+#if !SAVE_COMPRESSED
+    saveg_write32(value);
+#else
+    saveg_write_signed(value - base);
+#endif
+}
+
+static sector_t *saveg_read_sector(void)
+{
+#if !LOAD_COMPRESSED
+    return &sectors[saveg_read32()];
+#else
+    return &sectors[saveg_read_bits(saveg_sector_bits())];
+#endif
+}
+
+static void saveg_write_sector(sector_t *sector)
+{
+#if !SAVE_COMPRESSED
+    saveg_write32(sector - sectors);
+#else
+    saveg_write_bits(sector - sectors, saveg_sector_bits());
 #endif
+}
 //
 // Structure read/write functions
 //
@@ -459,6 +596,156 @@ static void saveg_write_thinker_t(thinker_t *str)
     saveg_write_think_t(str->function);
 }
 
+#if LOAD_COMPRESSED || SAVE_COMPRESSED
+// In the compressed format each mobj starts with a mask of which groups of fields differ from the mobj's spawn
+// state (or the map's WHD data); only those are stored. The mobj types and these masks repeat a lot, so both are
+// huffman coded, with per save codes stored ahead of the mobjs in the form th_read_simple_decoder reads.
+// On the shareware IWAD this makes saves 1.5-2.3 times smaller than v1: level starts go from 1104-4432 bytes to
+// 676-1888 (E1M1 1104 -> 704), and a save 4000 tics into DEMO1 (E1M5) from 3875 to 2590 bytes.
+enum {
+    SMD_MOVED = 1,          // x/y differ from the spawn point
+    SMD_OFF_FLOOR = 2,      // z isn't floorz
+    SMD_ANGLE = 4,          // angle differs from the spawn angle (non static mobjs only)
+    SMD_MOMENTUM = 8,       // (non static mobjs only)
+    SMD_TICS = 16,          // tics differ from the state's duration
+    SMD_STATE = 32,         // state isn't the spawn state
+    SMD_FLAGS = 64,         // flags differ from the mobjinfo flags
+    SMD_OTHER = 128,        // (non static mobjs only) height, floorz, ceilingz, radius, health, movedir, movecount,
+                            // reactiontime, threshold or player differ from their defaults
+};
+
+#define SAVEG_HUFF_MAX_CODE_LENGTH 15
+#define SAVEG_HUFF_DECODER_SIZE (1 + SAVEG_HUFF_MAX_CODE_LENGTH * 2 + 128)
+
+// mobjs are mostly still in spawn order, so spawnpoints are stored relative to the previous one
+static int saveg_last_spawnpoint;
+#endif
+
+#if LOAD_COMPRESSED
+static th_decoder saveg_type_decoder;
+static th_decoder saveg_mask_decoder;
+#endif
+
+#if SAVE_COMPRESSED
+typedef struct {
+    uint16_t count[256];
+    uint16_t code[256];
+    uint8_t length[256]; // 0 if the symbol isn't used, or is the only one used
+} saveg_huff_encoder_t;
+
+static saveg_huff_encoder_t *saveg_type_encoder;
+static saveg_huff_encoder_t *saveg_mask_encoder;
+
+// make canonical huffman codes for the counted symbols, assigned in the same order as th_create_decoder
+static void saveg_huff_build(saveg_huff_encoder_t *h) {
+    uint8_t symbols[256];
+    int n = 0;
+    for (int s = 0; s < 256; s++) {
+        if (h->count[s]) symbols[n++] = s;
+    }
+    memset(h->length, 0, sizeof(h->length));
+    if (n < 2) return;
+    // leaves then internal nodes
+    uint32_t *weight = Z_Malloc((2 * n - 1) * (sizeof(uint32_t) + sizeof(int16_t)), PU_STATIC, 0);
+    int16_t *parent = (int16_t *)(weight + 2 * n - 1);
+    for (uint shift = 0; ; shift++) {
+        for (int i = 0; i < n; i++) {
+            // flatten the counts further each time the codes come out too long
+            weight[i] = ((h->count[symbols[i]] - 1u) >> shift) + 1;
+        }
+        for (int i = 0; i < 2 * n - 1; i++) parent[i] = -1;
+        int nodes = n;
+        while (nodes < 2 * n - 1) {
+            int a = -1, b = -1;
+            for (int i = 0; i < nodes; i++) {
+                if (parent[i] >= 0) continue;
+                if (a < 0 || weight[i] < weight[a]) {
+                    b = a;
+                    a = i;
+                } else if (b < 0 || weight[i] < weight[b]) {
+                    b = i;
+                }
+            }
+            weight[nodes] = weight[a] + weight[b];
+            parent[a] = parent[b] = nodes++;
+        }
+        int max_length = 0;
+        for (int i = 0; i < n; i++) {
+            int length = 0;
+            for (int j = i; parent[j] >= 0; j = parent[j]) length++;
+            h->length[symbols[i]] = length;
+            if (length > max_length) max_length = length;
+        }
+        if (max_length <= SAVEG_HUFF_MAX_CODE_LENGTH) break;
+    }
+    Z_Free(weight);
+    uint code = 0;
+    for (int length = 1; length <= SAVEG_HUFF_MAX_CODE_LENGTH; length++) {
+        for (int s = 0; s < 256; s++) {
+            if (h->length[s] == length) h->code[s] = code++;
+        }
+        code <<= 1;
+    }
+}
+
+static void saveg_write_huff_table(const saveg_huff_encoder_t *h) {
+    int min = -1, max = 0;
+    uint min_cl = SAVEG_HUFF_MAX_CODE_LENGTH, max_cl = 0;
+    for (int s = 0; s < 256; s++) {
+        if (!h->count[s]) continue;
+        if (min < 0) min = s;
+        max = s;
+        if (h->length[s] < min_cl) min_cl = h->length[s];
+        if (h->length[s] > max_cl) max_cl = h->length[s];
+    }
+    saveg_write_bit(min >= 0);
+    if (min < 0) return;
+    saveg_write_bit(0); // no group8
+    saveg_write8(min);
+    saveg_write8(max);
+    if (min == max) return;
+    saveg_write_bits(min_cl, 4);
+    saveg_write_bits(max_cl, 4);
+    uint bit_count = min_cl == max_cl ? 0 : 32 - __builtin_clz(max_cl - min_cl);
+    for (int s = min; s <= max; s++) {
+        saveg_write_bit(h->length[s] != 0);
+        if (h->length[s] && bit_count) saveg_write_bits(h->length[s] - min_cl, bit_count);
+    }
+}
+
+static void saveg_write_huff(const saveg_huff_encoder_t *h, uint symbol) {
+    assert(h->count[symbol]);
+    // the decoder reads codes msb first
+    for (int i = h->length[symbol] - 1; i >= 0; i--) {
+        saveg_write_bit((h->code[symbol] >> i) & 1);
+    }
+}
+
+// as a list of gaps between set bits, since only a few flags usually change
+static void saveg_write_flag_changes(uint32_t changes) {
+    saveg_write_gamma(__builtin_popcount(changes));
+    int last = -1;
+    while (changes) {
+        int bit = __builtin_ctz(changes);
+        saveg_write_gamma(bit - last - 1);
+        changes &= changes - 1;
+        last = bit;
+    }
+}
+#endif
+
+#if LOAD_COMPRESSED
+static uint32_t saveg_read_flag_changes(void) {
+    uint32_t changes = 0;
+    int last = -1;
+    for (uint n = saveg_read_gamma(); n; n--) {
+        last += saveg_read_gamma() + 1;
+        changes |= 1u << last;
+    }
+    return changes;
+}
+#endif
+
 //
 // mobj_t
 //
@@ -469,13 +756,15 @@ static mobj_t *saveg_read_mobj_t()
 
     mobj_t *str;
 #if LOAD_COMPRESSED
-    int type = saveg_read8();
+    int type = th_decode(saveg_type_decoder, sg_bi);
     int size = mobj_flags_is_static(mobjinfo[type].flags) ? sizeof(mobj_t) : sizeof(mobjfull_t);
     str = Z_ThinkMalloc (size, PU_LEVEL, 0);
     // these are needed for decoding early
     str->type = type;
-    str->spawnpoint = saveg_read16();
+    saveg_last_spawnpoint += 1 + saveg_read_signed();
+    str->spawnpoint = saveg_last_spawnpoint;
     str->flags = mobjinfo[str->type].flags; // we need MF_DECORATION, but only change modified bits later anyway
+    uint mask = th_decode(saveg_mask_decoder, sg_bi);
 #else
     str = Z_ThinkMalloc (sizeof(mobjfull_t), PU_LEVEL, 0);
 #endif
@@ -492,9 +781,9 @@ static mobj_t *saveg_read_mobj_t()
     // fixed_t y;
     str->xy.y = saveg_read32();
 #else
-    if (saveg_read_bit()) {
-        str->xy.x = saveg_read32();
-        str->xy.y = saveg_read32();
+    if (mask & SMD_MOVED) {
+        str->xy.x = saveg_read_fixed_delta(spawnpoint_mapthing(str->spawnpoint).x << FRACBITS);
+        str->xy.y = saveg_read_fixed_delta(spawnpoint_mapthing(str->spawnpoint).y << FRACBITS);
         xprintf("  xy explicit %08x, %08x\n", str->xy.x, str->xy.y);
     } else {
         str->xy.x = spawnpoint_mapthing(str->spawnpoint).x << FRACBITS;
@@ -517,23 +806,27 @@ static mobj_t *saveg_read_mobj_t()
     str->z = saveg_read32();
 #else
     if (!mobj_is_static(str)) {
-        mobj_full(str)->height = saveg_read_maybe(mobj_info(str)->height,
-                                                       saveg_read32, "height");
-        mobj_full(str)->floorz = saveg_read_maybe(sector_floorheight(mobj_sector(str)), saveg_read_low_zeros, "floorz");
-        mobj_full(str)->ceilingz = saveg_read_maybe(sector_ceilingheight(mobj_sector(str)), saveg_read_low_zeros, "ceilingz");
+        mobj_full(str)->height = mobj_info(str)->height;
+        mobj_full(str)->floorz = sector_floorheight(mobj_sector(str));
+        mobj_full(str)->ceilingz = sector_ceilingheight(mobj_sector(str));
+        if (mask & SMD_OTHER) {
+            mobj_full(str)->height = saveg_read_maybe_fixed(mobj_full(str)->height, "height");
+            mobj_full(str)->floorz = saveg_read_maybe_fixed(mobj_full(str)->floorz, "floorz");
+            mobj_full(str)->ceilingz = saveg_read_maybe_fixed(mobj_full(str)->ceilingz, "ceilingz");
+        }
     }
 
-    if (!saveg_read_bit()) {
-        // 0 floor
+    if (!(mask & SMD_OFF_FLOOR)) {
+        // floor
         str->z = mobj_floorz(str);
         xprintf("  on floor z %08x\n", str->z);
     } else if (!saveg_read_bit()) {
-        // 10 ceiling
+        // 0 ceiling
         str->z = mobj_ceilingz(str) - mobj_height(str);
         xprintf("  on ceiling z %08x\n", str->z);
     } else {
-        // 11 arbitrary
-        str->z = saveg_read32();
+        // 1 arbitrary
+        str->z = saveg_read_fixed_delta(mobj_floorz(str));
         xprintf("  explicit z %08x\n", str->z);
     }
 #endif
@@ -551,8 +844,8 @@ static mobj_t *saveg_read_mobj_t()
     fixed_t angle = saveg_read32();
 #else
     if (!mobj_is_static(str)) {
-        mobj_full(str)->angle = saveg_read_maybe(spawnpoint_mapthing(str->spawnpoint).angle << FRACBITS,
-                                                  saveg_read_low_zeros, "angle");
+        mobj_full(str)->angle = (mask & SMD_ANGLE) ? (angle_t)saveg_read_low_zeros() :
+                                ANG45 * (spawnpoint_mapthing(str->spawnpoint).angle / 45);
     }
 #endif
 
@@ -592,10 +885,15 @@ static mobj_t *saveg_read_mobj_t()
     fixed_t momz = saveg_read32();
 #else
     if (!mobj_is_static(str)) {
-        mobj_full(str)->radius = saveg_read_maybe(mobj_info(str)->radius, saveg_read32, "radius");
-        mobj_full(str)->momx = saveg_read_maybe(0, saveg_read32, "momx");
-        mobj_full(str)->momy = saveg_read_maybe(0, saveg_read32, "momy");
-        mobj_full(str)->momz = saveg_read_maybe(0, saveg_read32, "momz");
+        mobj_full(str)->radius = (mask & SMD_OTHER) ? saveg_read_maybe_fixed(mobj_info(str)->radius, "radius") :
+                                 mobj_info(str)->radius;
+        if (mask & SMD_MOMENTUM) {
+            mobj_full(str)->momx = saveg_read_fixed_delta(0);
+            mobj_full(str)->momy = saveg_read_fixed_delta(0);
+            mobj_full(str)->momz = saveg_read_fixed_delta(0);
+        } else {
+            mobj_full(str)->momx = mobj_full(str)->momy = mobj_full(str)->momz = 0;
+        }
     }
 #endif
 
@@ -635,8 +933,6 @@ static mobj_t *saveg_read_mobj_t()
 #if !LOAD_COMPRESSED
     // int tics;
     str->tics = saveg_read32();
-#else
-    str->tics = saveg_read_maybe(-1, (saveg_reader)saveg_read8, "tics");
 #endif
 
 #if !LOAD_COMPRESSED
@@ -647,16 +943,18 @@ static mobj_t *saveg_read_mobj_t()
     str->state_num = saveg_read32();
 #endif
 #else
-    // todo fewer bits?
-    str->state_num = saveg_read_maybe(mobj_info(str)->spawnstate, (saveg_reader)saveg_read16, "state");
+    str->state_num = mobj_info(str)->spawnstate;
+    if (mask & SMD_STATE) str->state_num += saveg_read_signed();
+    // tics are stored relative to the state's duration, so come after it
+    str->tics = (mask & SMD_TICS) ? (int)saveg_read_gamma() - 1 : state_tics(mobj_state(str));
 #endif
 
     // int flags;
 #if !LOAD_COMPRESSED
     str->flags = saveg_read32();
 #else
-    // note we already set these to mobj_info()->flags above hence str->flags as default
-    str->flags = saveg_read_maybe(str->flags, saveg_read32, "flags");
+    // note we already set these to mobj_info()->flags above
+    if (mask & SMD_FLAGS) str->flags ^= saveg_read_flag_changes();
 #endif
     if (mobjinfo[str->type].flags & MF_DECORATION) {
         str->flags |= MF_DECORATION;
@@ -681,13 +979,19 @@ static mobj_t *saveg_read_mobj_t()
     }
 #else
     if (!mobj_is_static(str)) {
-        mobj_full(str)->health = saveg_read_maybe(mobj_info(str)->spawnhealth, (saveg_reader)saveg_read16, "health");
-        mobj_full(str)->movedir = saveg_read_bits(3);
-        // todo just curioous want this is
-        mobj_full(str)->movecount = saveg_read_maybe(0, saveg_read32, "move");
-        mobj_full(str)->reactiontime = saveg_read_maybe( mobj_info(str)->reactiontime, (saveg_reader)saveg_read8,
-                          "reaction");
-        mobj_full(str)->threshold = saveg_read_maybe(0, (saveg_reader)saveg_read8, "threshold");
+        if (mask & SMD_OTHER) {
+            mobj_full(str)->health = saveg_read_maybe_signed(mobj_info(str)->spawnhealth, "health");
+            mobj_full(str)->movedir = saveg_read_maybe_signed(0, "movedir");
+            mobj_full(str)->movecount = saveg_read_maybe_signed(0, "move");
+            mobj_full(str)->reactiontime = saveg_read_maybe_signed(mobj_info(str)->reactiontime, "reaction");
+            mobj_full(str)->threshold = saveg_read_maybe_signed(0, "threshold");
+        } else {
+            mobj_full(str)->health = mobj_info(str)->spawnhealth;
+            mobj_full(str)->movedir = 0;
+            mobj_full(str)->movecount = 0;
+            mobj_full(str)->reactiontime = mobj_info(str)->reactiontime;
+            mobj_full(str)->threshold = 0;
+        }
     }
 #endif
 
@@ -698,7 +1002,7 @@ static mobj_t *saveg_read_mobj_t()
 #else
     int lastlook;
     if (!mobj_is_static(str)) {
-        pl = saveg_read_bit() ? saveg_read_bits(2) + 1 : 0;
+        pl = (mask & SMD_OTHER) && saveg_read_bit() ? saveg_read_bits(2) + 1 : 0;
         xprintf("PL %d\n", pl);
         lastlook = saveg_read_bits(2);
         xprintf("LL %d\n", lastlook);
@@ -742,12 +1046,45 @@ static mobj_t *saveg_read_mobj_t()
     return str;
 }
 
+#if SAVE_COMPRESSED
+static uint saveg_mobj_delta_mask(mobj_t *str) {
+    uint mask = 0;
+    if (str->xy.x != (spawnpoint_mapthing(str->spawnpoint).x << FRACBITS) ||
+        str->xy.y != (spawnpoint_mapthing(str->spawnpoint).y << FRACBITS)) {
+        mask |= SMD_MOVED;
+    }
+    if (str->z != mobj_floorz(str)) mask |= SMD_OFF_FLOOR;
+    if (str->tics != state_tics(mobj_state(str))) mask |= SMD_TICS;
+    if (mobj_state_num(str) != mobj_info(str)->spawnstate) mask |= SMD_STATE;
+    if (str->flags != mobj_info(str)->flags) mask |= SMD_FLAGS;
+    if (!mobj_is_static(str)) {
+        mobjfull_t *full = mobj_full(str);
+        if (full->angle != ANG45 * (spawnpoint_mapthing(str->spawnpoint).angle / 45)) mask |= SMD_ANGLE;
+        if (full->momx || full->momy || full->momz) mask |= SMD_MOMENTUM;
+        if (full->height != mobj_info(str)->height ||
+            full->floorz != sector_floorheight(mobj_sector(str)) ||
+            full->ceilingz != sector_ceilingheight(mobj_sector(str)) ||
+            full->radius != mobj_info(str)->radius ||
+            full->health != mobj_info(str)->spawnhealth ||
+            full->movedir || full->movecount ||
+            full->reactiontime != mobj_info(str)->reactiontime ||
+            full->threshold || full->sp_player) {
+            mask |= SMD_OTHER;
+        }
+    }
+    return mask;
+}
+#endif
+
 static void saveg_write_mobj_t(mobj_t *str)
 {
 #if SAVE_COMPRESSED
     // needed to decode other things
-    saveg_write8(str->type);
-    saveg_write16(str->spawnpoint);
+    saveg_write_huff(saveg_type_encoder, str->type);
+    saveg_write_signed(str->spawnpoint - saveg_last_spawnpoint - 1);
+    saveg_last_spawnpoint = str->spawnpoint;
+    uint mask = saveg_mobj_delta_mask(str);
+    saveg_write_huff(saveg_mask_encoder, mask);
 #endif
 
     // thinker_t thinker;
@@ -760,18 +1097,15 @@ static void saveg_write_mobj_t(mobj_t *str)
     // fixed_t y;
     saveg_write32(str->xy.y);
 #else
-    if (str->xy.x == (spawnpoint_mapthing(str->spawnpoint).x << FRACBITS) &&
-        str->xy.y == (spawnpoint_mapthing(str->spawnpoint).y << FRACBITS)) {
-        saveg_write_bit(0);
+    if (!(mask & SMD_MOVED)) {
         xprintf("Unmoved %d %08x,%08x\n", str->spawnpoint, str->xy.x, str->xy.y);
     } else {
-        saveg_write_bit(1);
         xprintf("Moved %d %08x,%08x %08x,%08x\n", str->spawnpoint, str->xy.x, str->xy.y, spawnpoint_mapthing(str->spawnpoint).x << FRACBITS, spawnpoint_mapthing(str->spawnpoint).y << FRACBITS);
         // fixed_t x;
-        saveg_write32(str->xy.x);
+        saveg_write_fixed_delta(str->xy.x, spawnpoint_mapthing(str->spawnpoint).x << FRACBITS);
 
         // fixed_t y;
-        saveg_write32(str->xy.y);
+        saveg_write_fixed_delta(str->xy.y, spawnpoint_mapthing(str->spawnpoint).y << FRACBITS);
     }
 #endif
 
@@ -781,22 +1115,21 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->z);
 #else
     // height is needed for decode of on ceiling
-    if (!mobj_is_static(str)) {
-        saveg_write_maybe(mobj_height(str), mobj_info(str)->height, saveg_write32, "height");
-        saveg_write_maybe(mobj_floorz(str), sector_floorheight(mobj_sector(str)), saveg_write_low_zeros, "floorz");
-        saveg_write_maybe(mobj_ceilingz(str), sector_ceilingheight(mobj_sector(str)), saveg_write_low_zeros, "ceilingz");
+    if (mask & SMD_OTHER) {
+        saveg_write_maybe_fixed(mobj_height(str), mobj_info(str)->height, "height");
+        saveg_write_maybe_fixed(mobj_floorz(str), sector_floorheight(mobj_sector(str)), "floorz");
+        saveg_write_maybe_fixed(mobj_ceilingz(str), sector_ceilingheight(mobj_sector(str)), "ceilingz");
     }
 
     // fixed_t z;
-    if (str->z == mobj_floorz(str)) {
-        saveg_write_bit(0);
+    if (!(mask & SMD_OFF_FLOOR)) {
         xprintf("  on the floor %08x\n", str->z);
     } else if (str->z == mobj_ceilingz(str) - mobj_height(str)) {
-        saveg_write_bits(1, 2);
+        saveg_write_bit(0);
         xprintf("  on the ceiling %08x\n", str->z);
     } else {
-        saveg_write_bits(3, 2);
-        saveg_write32(str->z);
+        saveg_write_bit(1);
+        saveg_write_fixed_delta(str->z, mobj_floorz(str));
     }
 #endif
 
@@ -812,9 +1145,8 @@ static void saveg_write_mobj_t(mobj_t *str)
 #if !SAVE_COMPRESSED
     saveg_write32(mobj_is_static(str) ? 0 : (int)mobj_full(str)->angle);
 #else
-    if (!mobj_is_static(str)) {
-        saveg_write_maybe(mobj_full(str)->angle, spawnpoint_mapthing(str->spawnpoint).angle << FRACBITS,
-                          saveg_write_low_zeros, "angle");
+    if (mask & SMD_ANGLE) {
+        saveg_write_low_zeros(mobj_full(str)->angle);
     }
 #endif
 
@@ -871,11 +1203,13 @@ static void saveg_write_mobj_t(mobj_t *str)
         saveg_write32(mobj_full(str)->momz);
     }
 #else
-    if (!mobj_is_static(str)) {
-        saveg_write_maybe(mobj_radius(str), mobj_info(str)->radius, saveg_write32, "radius");
-        saveg_write_maybe(mobj_full(str)->momx, 0, saveg_write32, "momx");
-        saveg_write_maybe(mobj_full(str)->momy, 0, saveg_write32, "momy");
-        saveg_write_maybe(mobj_full(str)->momz, 0, saveg_write32, "momz");
+    if (mask & SMD_OTHER) {
+        saveg_write_maybe_fixed(mobj_radius(str), mobj_info(str)->radius, "radius");
+    }
+    if (mask & SMD_MOMENTUM) {
+        saveg_write_fixed_delta(mobj_full(str)->momx, 0);
+        saveg_write_fixed_delta(mobj_full(str)->momy, 0);
+        saveg_write_fixed_delta(mobj_full(str)->momz, 0);
     }
 #endif
 
@@ -897,23 +1231,22 @@ static void saveg_write_mobj_t(mobj_t *str)
     // int tics;
 #if !SAVE_COMPRESSED
     saveg_write32(str->tics);
-#else
-    saveg_write_maybe(str->tics, -1, (saveg_writer) saveg_write8, "tics");
 #endif
 
     // state_t* state;
 #if !SAVE_COMPRESSED
     saveg_write32(mobj_state_num(str));
 #else
-    // todo fewer bits?
-    saveg_write_maybe(mobj_state_num(str), mobj_info(str)->spawnstate, (saveg_writer) saveg_write16, "state");
+    if (mask & SMD_STATE) saveg_write_signed(mobj_state_num(str) - mobj_info(str)->spawnstate);
+    // tics are stored relative to the state's duration, so come after it
+    if (mask & SMD_TICS) saveg_write_gamma(str->tics + 1);
 #endif
 
 #if !SAVE_COMPRESSED
     saveg_write32(str->flags & ~MF_DECORATION);
 #else
     // int flags;
-    saveg_write_maybe(str->flags, mobj_info(str)->flags, saveg_write32, "flags");
+    if (mask & SMD_FLAGS) saveg_write_flag_changes(str->flags ^ mobj_info(str)->flags);
 #endif
 
     if (mobj_is_static(str)) {
@@ -963,13 +1296,13 @@ static void saveg_write_mobj_t(mobj_t *str)
         // int threshold;
         saveg_write32(mobj_full(str)->threshold);
 #else
-        saveg_write_maybe(mobj_full(str)->health, mobj_info(str)->spawnhealth, (saveg_writer) saveg_write16, "health");
-        saveg_write_bits(mobj_full(str)->movedir, 3);
-        // todo just curioous want this is
-        saveg_write_maybe(mobj_full(str)->movecount, 0, saveg_write32, "move");
-        saveg_write_maybe(mobj_full(str)->reactiontime, mobj_info(str)->reactiontime, (saveg_writer) saveg_write8,
-                          "reaction");
-        saveg_write_maybe(mobj_full(str)->threshold, 0, (saveg_writer) saveg_write8, "threshold");
+        if (mask & SMD_OTHER) {
+            saveg_write_maybe_signed(mobj_full(str)->health, mobj_info(str)->spawnhealth, "health");
+            saveg_write_maybe_signed(mobj_full(str)->movedir, 0, "movedir");
+            saveg_write_maybe_signed(mobj_full(str)->movecount, 0, "move");
+            saveg_write_maybe_signed(mobj_full(str)->reactiontime, mobj_info(str)->reactiontime, "reaction");
+            saveg_write_maybe_signed(mobj_full(str)->threshold, 0, "threshold");
+        }
 #endif
 
         // struct player_s* player;
@@ -988,7 +1321,8 @@ static void saveg_write_mobj_t(mobj_t *str)
 #if !SAVE_COMPRESSED
             saveg_write32(0);
 #else
-            if (!mobj_is_static(str)) {
+            // a player implies SMD_OTHER, so we only need to say there isn't one if that is set anyway
+            if (mask & SMD_OTHER) {
                 xprintf("PL (0)\n");
                 saveg_write_bit(0);
             }
@@ -1394,8 +1728,6 @@ static void saveg_write_player_t(player_t *str)
 
 static void saveg_read_ceiling_t(ceiling_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
@@ -1403,33 +1735,28 @@ static void saveg_read_ceiling_t(ceiling_t *str)
     str->type = saveg_read_enum();
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // fixed_t bottomheight;
-    str->bottomheight = saveg_read32();
+    str->bottomheight = saveg_read_fixed(sector_base_floorheight(str->sector));
 
     // fixed_t topheight;
-    str->topheight = saveg_read32();
+    str->topheight = saveg_read_fixed(sector_base_ceilingheight(str->sector));
 
     // fixed_t speed;
-    str->speed = saveg_read32();
+    str->speed = saveg_read_fixed(CEILSPEED);
 
     // boolean crush;
     str->crush = saveg_read_boolean();
 
     // int direction;
-    str->direction = saveg_read32();
+    str->direction = saveg_read_int(0);
 
     // int tag;
-    str->tag = saveg_read32();
+    str->tag = saveg_read_int(str->sector->tag);
 
     // int olddirection;
-    str->olddirection = saveg_read32();
+    str->olddirection = saveg_read_int(0);
 }
 
 static void saveg_write_ceiling_t(ceiling_t *str)
@@ -1440,33 +1767,29 @@ static void saveg_write_ceiling_t(ceiling_t *str)
     // ceiling_e type;
     saveg_write_enum(str->type);
 
-#if !SAVE_COMPRESSED
     // sector_t* sector;
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // fixed_t bottomheight;
-    saveg_write32(str->bottomheight);
+    saveg_write_fixed(str->bottomheight, sector_base_floorheight(str->sector));
 
     // fixed_t topheight;
-    saveg_write32(str->topheight);
+    saveg_write_fixed(str->topheight, sector_base_ceilingheight(str->sector));
 
     // fixed_t speed;
-    saveg_write32(str->speed);
+    saveg_write_fixed(str->speed, CEILSPEED);
 
     // boolean crush;
     saveg_write_boolean(str->crush);
 
     // int direction;
-    saveg_write32(str->direction);
+    saveg_write_int(str->direction, 0);
 
     // int tag;
-    saveg_write32(str->tag);
+    saveg_write_int(str->tag, str->sector->tag);
 
     // int olddirection;
-    saveg_write32(str->olddirection);
+    saveg_write_int(str->olddirection, 0);
 }
 
 //
@@ -1475,35 +1798,29 @@ static void saveg_write_ceiling_t(ceiling_t *str)
 
 static void saveg_read_vldoor_t(vldoor_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
     // vldoor_e type;
     str->type = saveg_read_enum();
 
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    // sector_t* sector;
+    str->sector = saveg_read_sector();
 
     // fixed_t topheight;
-    str->topheight = saveg_read32();
+    str->topheight = saveg_read_fixed(sector_base_ceilingheight(str->sector));
 
     // fixed_t speed;
-    str->speed = saveg_read32();
+    str->speed = saveg_read_fixed(VDOORSPEED);
 
     // int direction;
-    str->direction = saveg_read32();
+    str->direction = saveg_read_int(0);
 
     // int topwait;
-    str->topwait = saveg_read32();
+    str->topwait = saveg_read_int(VDOORWAIT);
 
     // int topcountdown;
-    str->topcountdown = saveg_read32();
+    str->topcountdown = saveg_read_int(0);
 }
 
 static void saveg_write_vldoor_t(vldoor_t *str)
@@ -1515,22 +1832,22 @@ static void saveg_write_vldoor_t(vldoor_t *str)
     saveg_write_enum(str->type);
 
     // sector_t* sector;
-    saveg_write32(str->sector - sectors);
+    saveg_write_sector(str->sector);
 
     // fixed_t topheight;
-    saveg_write32(str->topheight);
+    saveg_write_fixed(str->topheight, sector_base_ceilingheight(str->sector));
 
     // fixed_t speed;
-    saveg_write32(str->speed);
+    saveg_write_fixed(str->speed, VDOORSPEED);
 
     // int direction;
-    saveg_write32(str->direction);
+    saveg_write_int(str->direction, 0);
 
     // int topwait;
-    saveg_write32(str->topwait);
+    saveg_write_int(str->topwait, VDOORWAIT);
 
     // int topcountdown;
-    saveg_write32(str->topcountdown);
+    saveg_write_int(str->topcountdown, 0);
 }
 
 //
@@ -1539,8 +1856,6 @@ static void saveg_write_vldoor_t(vldoor_t *str)
 
 static void saveg_read_floormove_t(floormove_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
@@ -1551,27 +1866,26 @@ static void saveg_read_floormove_t(floormove_t *str)
     str->crush = saveg_read_boolean();
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // int direction;
-    str->direction = saveg_read32();
+    str->direction = saveg_read_int(0);
 
     // int newspecial;
-    str->newspecial = saveg_read32();
+    str->newspecial = saveg_read_int(0);
 
     // short texture;
+#if !LOAD_COMPRESSED
     str->texture = saveg_read16();
+#else
+    str->texture = saveg_read_int(str->sector->floorpic);
+#endif
 
     // fixed_t floordestheight;
-    str->floordestheight = saveg_read32();
+    str->floordestheight = saveg_read_fixed(sector_base_floorheight(str->sector));
 
     // fixed_t speed;
-    str->speed = saveg_read32();
+    str->speed = saveg_read_fixed(FLOORSPEED);
 }
 
 static void saveg_write_floormove_t(floormove_t *str)
@@ -1586,26 +1900,26 @@ static void saveg_write_floormove_t(floormove_t *str)
     saveg_write_boolean(str->crush);
 
     // sector_t* sector;
-#if !SAVE_COMPRESSED
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // int direction;
-    saveg_write32(str->direction);
+    saveg_write_int(str->direction, 0);
 
     // int newspecial;
-    saveg_write32(str->newspecial);
+    saveg_write_int(str->newspecial, 0);
 
     // short texture;
+#if !SAVE_COMPRESSED
     saveg_write16(str->texture);
+#else
+    saveg_write_int(str->texture, str->sector->floorpic);
+#endif
 
     // fixed_t floordestheight;
-    saveg_write32(str->floordestheight);
+    saveg_write_fixed(str->floordestheight, sector_base_floorheight(str->sector));
 
     // fixed_t speed;
-    saveg_write32(str->speed);
+    saveg_write_fixed(str->speed, FLOORSPEED);
 }
 
 //
@@ -1614,33 +1928,26 @@ static void saveg_write_floormove_t(floormove_t *str)
 
 static void saveg_read_plat_t(plat_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // fixed_t speed;
-    str->speed = saveg_read32();
+    str->speed = saveg_read_fixed(PLATSPEED);
 
     // fixed_t low;
-    str->low = saveg_read32();
+    str->low = saveg_read_fixed(sector_base_floorheight(str->sector));
 
     // fixed_t high;
-    str->high = saveg_read32();
+    str->high = saveg_read_fixed(sector_base_floorheight(str->sector));
 
     // int wait;
-    str->wait = saveg_read32();
+    str->wait = saveg_read_int(TICRATE * PLATWAIT);
 
     // int count;
-    str->count = saveg_read32();
+    str->count = saveg_read_int(0);
 
     // plat_e status;
     str->status = saveg_read_enum();
@@ -1652,7 +1959,7 @@ static void saveg_read_plat_t(plat_t *str)
     str->crush = saveg_read_boolean();
 
     // int tag;
-    str->tag = saveg_read32();
+    str->tag = saveg_read_int(str->sector->tag);
 
     // plattype_e type;
     str->type = saveg_read_enum();
@@ -1664,26 +1971,22 @@ static void saveg_write_plat_t(plat_t *str)
     saveg_write_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !SAVE_COMPRESSED
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // fixed_t speed;
-    saveg_write32(str->speed);
+    saveg_write_fixed(str->speed, PLATSPEED);
 
     // fixed_t low;
-    saveg_write32(str->low);
+    saveg_write_fixed(str->low, sector_base_floorheight(str->sector));
 
     // fixed_t high;
-    saveg_write32(str->high);
+    saveg_write_fixed(str->high, sector_base_floorheight(str->sector));
 
     // int wait;
-    saveg_write32(str->wait);
+    saveg_write_int(str->wait, TICRATE * PLATWAIT);
 
     // int count;
-    saveg_write32(str->count);
+    saveg_write_int(str->count, 0);
 
     // plat_e status;
     saveg_write_enum(str->status);
@@ -1695,7 +1998,7 @@ static void saveg_write_plat_t(plat_t *str)
     saveg_write_boolean(str->crush);
 
     // int tag;
-    saveg_write32(str->tag);
+    saveg_write_int(str->tag, str->sector->tag);
 
     // plattype_e type;
     saveg_write_enum(str->type);
@@ -1707,33 +2010,26 @@ static void saveg_write_plat_t(plat_t *str)
 
 static void saveg_read_lightflash_t(lightflash_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // int count;
-    str->count = saveg_read32();
+    str->count = saveg_read_int(0);
 
     // int maxlight;
-    str->maxlight = saveg_read32();
+    str->maxlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int minlight;
-    str->minlight = saveg_read32();
+    str->minlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int maxtime;
-    str->maxtime = saveg_read32();
+    str->maxtime = saveg_read_int(64);
 
     // int mintime;
-    str->mintime = saveg_read32();
+    str->mintime = saveg_read_int(7);
 }
 
 static void saveg_write_lightflash_t(lightflash_t *str)
@@ -1742,26 +2038,22 @@ static void saveg_write_lightflash_t(lightflash_t *str)
     saveg_write_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !SAVE_COMPRESSED
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // int count;
-    saveg_write32(str->count);
+    saveg_write_int(str->count, 0);
 
     // int maxlight;
-    saveg_write32(str->maxlight);
+    saveg_write_int(str->maxlight, sector_base_lightlevel(str->sector));
 
     // int minlight;
-    saveg_write32(str->minlight);
+    saveg_write_int(str->minlight, sector_base_lightlevel(str->sector));
 
     // int maxtime;
-    saveg_write32(str->maxtime);
+    saveg_write_int(str->maxtime, 64);
 
     // int mintime;
-    saveg_write32(str->mintime);
+    saveg_write_int(str->mintime, 7);
 }
 
 //
@@ -1770,33 +2062,26 @@ static void saveg_write_lightflash_t(lightflash_t *str)
 
 static void saveg_read_strobe_t(strobe_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // int count;
-    str->count = saveg_read32();
+    str->count = saveg_read_int(0);
 
     // int minlight;
-    str->minlight = saveg_read32();
+    str->minlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int maxlight;
-    str->maxlight = saveg_read32();
+    str->maxlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int darktime;
-    str->darktime = saveg_read32();
+    str->darktime = saveg_read_int(SLOWDARK);
 
     // int brighttime;
-    str->brighttime = saveg_read32();
+    str->brighttime = saveg_read_int(STROBEBRIGHT);
 }
 
 static void saveg_write_strobe_t(strobe_t *str)
@@ -1805,26 +2090,22 @@ static void saveg_write_strobe_t(strobe_t *str)
     saveg_write_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !SAVE_COMPRESSED
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // int count;
-    saveg_write32(str->count);
+    saveg_write_int(str->count, 0);
 
     // int minlight;
-    saveg_write32(str->minlight);
+    saveg_write_int(str->minlight, sector_base_lightlevel(str->sector));
 
     // int maxlight;
-    saveg_write32(str->maxlight);
+    saveg_write_int(str->maxlight, sector_base_lightlevel(str->sector));
 
     // int darktime;
-    saveg_write32(str->darktime);
+    saveg_write_int(str->darktime, SLOWDARK);
 
     // int brighttime;
-    saveg_write32(str->brighttime);
+    saveg_write_int(str->brighttime, STROBEBRIGHT);
 }
 
 //
@@ -1833,27 +2114,20 @@ static void saveg_write_strobe_t(strobe_t *str)
 
 static void saveg_read_glow_t(glow_t *str)
 {
-    int sector;
-
     // thinker_t thinker;
     saveg_read_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !LOAD_COMPRESSED
-    sector = saveg_read32();
-#else
-    sector = saveg_read16();
-#endif
-    str->sector = &sectors[sector];
+    str->sector = saveg_read_sector();
 
     // int minlight;
-    str->minlight = saveg_read32();
+    str->minlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int maxlight;
-    str->maxlight = saveg_read32();
+    str->maxlight = saveg_read_int(sector_base_lightlevel(str->sector));
 
     // int direction;
-    str->direction = saveg_read32();
+    str->direction = saveg_read_int(0);
 }
 
 static void saveg_write_glow_t(glow_t *str)
@@ -1862,20 +2136,16 @@ static void saveg_write_glow_t(glow_t *str)
     saveg_write_thinker_t(&str->thinker);
 
     // sector_t* sector;
-#if !SAVE_COMPRESSED
-    saveg_write32(str->sector - sectors);
-#else
-    saveg_write16(str->sector - sectors);
-#endif
+    saveg_write_sector(str->sector);
 
     // int minlight;
-    saveg_write32(str->minlight);
+    saveg_write_int(str->minlight, sector_base_lightlevel(str->sector));
 
     // int maxlight;
-    saveg_write32(str->maxlight);
+    saveg_write_int(str->maxlight, sector_base_lightlevel(str->sector));
 
     // int direction;
-    saveg_write32(str->direction);
+    saveg_write_int(str->direction, 0);
 }
 
 //
@@ -1883,7 +2153,7 @@ static void saveg_write_glow_t(glow_t *str)
 //
 
 #if LOAD_COMPRESSED || SAVE_COMPRESSED
-#define LOAD_SAVE_VERSION 1
+#define LOAD_SAVE_VERSION 2 // 2: mobjs and specials delta coded against spawn state / WHD data
 
 static uint32_t calc_wad_hash() {
     uint32_t hash = LOAD_SAVE_VERSION;
@@ -2304,6 +2574,26 @@ void P_ArchiveThinkers (void)
 {
     thinker_t*		th;
 
+#if SAVE_COMPRESSED
+    saveg_huff_encoder_t *encoders = Z_Malloc(2 * sizeof(saveg_huff_encoder_t), PU_STATIC, 0);
+    memset(encoders, 0, 2 * sizeof(saveg_huff_encoder_t));
+    saveg_type_encoder = &encoders[0];
+    saveg_mask_encoder = &encoders[1];
+    for (th = thinker_next(&thinkercap) ; th != &thinkercap ; th=thinker_next(th))
+    {
+        if (th->function == ThinkF_P_MobjThinker)
+        {
+            saveg_type_encoder->count[((mobj_t *)th)->type]++;
+            saveg_mask_encoder->count[saveg_mobj_delta_mask((mobj_t *)th)]++;
+        }
+    }
+    saveg_huff_build(saveg_type_encoder);
+    saveg_huff_build(saveg_mask_encoder);
+    saveg_write_huff_table(saveg_type_encoder);
+    saveg_write_huff_table(saveg_mask_encoder);
+    saveg_last_spawnpoint = -1;
+#endif
+
     // save off the current thinkers
     for (th = thinker_next(&thinkercap) ; th != &thinkercap ; th=thinker_next(th))
     {
@@ -2328,6 +2618,7 @@ void P_ArchiveThinkers (void)
     saveg_write8(tc_end);
 #else
     saveg_write_bit(1);
+    Z_Free(encoders);
 #endif
 }
 
@@ -2356,8 +2647,27 @@ void P_UnArchiveThinkers (void)
 
 	currentthinker = next;
     }
+#if USE_THINKER_CLASS_LISTS
+    currentthinker = thinker_next(&specialthinkercap);
+    while (currentthinker != &specialthinkercap)
+    {
+	next = thinker_next(currentthinker);
+	Z_ThinkFree (currentthinker);
+	currentthinker = next;
+    }
+#endif
     P_InitThinkers ();
-    
+
+#if LOAD_COMPRESSED
+    uint16_t *decoders = Z_Malloc(2 * SAVEG_HUFF_DECODER_SIZE * sizeof(uint16_t) + 512, PU_STATIC, 0);
+    uint8_t *tmp = (uint8_t *)(decoders + 2 * SAVEG_HUFF_DECODER_SIZE);
+    saveg_type_decoder = decoders;
+    th_read_simple_decoder(sg_bi, decoders, SAVEG_HUFF_DECODER_SIZE, tmp, 512);
+    saveg_mask_decoder = decoders + SAVEG_HUFF_DECODER_SIZE;
+    th_read_simple_decoder(sg_bi, decoders + SAVEG_HUFF_DECODER_SIZE, SAVEG_HUFF_DECODER_SIZE, tmp, 512);
+    saveg_last_spawnpoint = -1;
+#endif
+
     // read in saved thinkers
     while (1)
     {
@@ -2399,7 +2709,9 @@ void P_UnArchiveThinkers (void)
 	    mobj->thinker.function = ThinkF_P_MobjThinker;
 	    P_AddThinker (&mobj->thinker);
     }
-
+#if LOAD_COMPRESSED
+    Z_Free(decoders);
+#endif
 }
 
 
@@ -2454,7 +2766,7 @@ void P_ArchiveSpecials (void)
     int			i;
 
     // save off the current thinkers
-    for (th = thinker_next(&thinkercap) ; th != &thinkercap ; th=thinker_next(th))
+    for (th = thinker_next(&specialthinkercap) ; th != &specialthinkercap ; th=thinker_next(th))
     {
 	if (th->function == ThinkF_NULL)
 	{
@@ -2561,7 +2873,7 @@ void P_UnArchiveSpecials (void)
 			
 	  case tc_ceiling:
 	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, 0);
+	    ceiling = Z_ThinkMalloc (sizeof(*ceiling), PU_LEVEL, 0);
         saveg_read_ceiling_t(ceiling);
 	    ceiling->sector->specialdata = ptr_to_shortptr(ceiling);
 
@@ -2574,7 +2886,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_door:
 	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, 0);
+	    door = Z_ThinkMalloc (sizeof(*door), PU_LEVEL, 0);
             saveg_read_vldoor_t(door);
 	    door->sector->specialdata = ptr_to_shortptr(door);
 	    door->thinker.function = ThinkF_T_VerticalDoor;
@@ -2583,7 +2895,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_floor:
 	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, 0);
+	    floor = Z_ThinkMalloc (sizeof(*floor), PU_LEVEL, 0);
             saveg_read_floormove_t(floor);
 	    floor->sector->specialdata = ptr_to_shortptr(floor);
 	    floor->thinker.function = ThinkF_T_MoveFloor;
@@ -2592,7 +2904,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_plat:
 	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, 0);
+	    plat = Z_ThinkMalloc (sizeof(*plat), PU_LEVEL, 0);
             saveg_read_plat_t(plat);
 	    plat->sector->specialdata = ptr_to_shortptr(plat);
 
@@ -2605,7 +2917,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_flash:
 	    saveg_read_pad();
-	    flash = Z_Malloc (sizeof(*flash), PU_LEVEL, 0);
+	    flash = Z_ThinkMalloc (sizeof(*flash), PU_LEVEL, 0);
             saveg_read_lightflash_t(flash);
 	    flash->thinker.function = ThinkF_T_LightFlash;
 	    P_AddThinker (&flash->thinker);
@@ -2613,7 +2925,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_strobe:
 	    saveg_read_pad();
-	    strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, 0);
+	    strobe = Z_ThinkMalloc (sizeof(*strobe), PU_LEVEL, 0);
             saveg_read_strobe_t(strobe);
 	    strobe->thinker.function = ThinkF_T_StrobeFlash;
 	    P_AddThinker (&strobe->thinker);
@@ -2621,7 +2933,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_glow:
 	    saveg_read_pad();
-	    glow = Z_Malloc (sizeof(*glow), PU_LEVEL, 0);
+	    glow = Z_ThinkMalloc (sizeof(*glow), PU_LEVEL, 0);
             saveg_read_glow_t(glow);
 	    glow->thinker.function = ThinkF_T_Glow;
 	    P_AddThinker (&glow->thinker);
@@ -2637,11 +2949,13 @@ void P_UnArchiveSpecials (void)
 }
 
 #if PICO_ON_DEVICE
+#include <stddef.h>
 #include "w_wad.h"
 #include "picoflash.h"
 #include "hardware/sync.h"
 #include "hardware/address_mapped.h"
 #include "hardware/timer.h"
+#include "pico/multicore.h"
 #include "picodoom.h"
 
 const uint8_t *get_end_of_flash(void) {
@@ -2658,167 +2972,341 @@ const uint8_t *get_end_of_flash(void) {
     return end_of_flash;
 }
 
-void P_SaveGameGetExistingFlashSlotAddresses(flash_slot_info_t *slots, int count) {
-    const uint8_t *index = get_end_of_flash() - 4;
-    int i;
-    const uint8_t *limit = whd_map_base + whdheader->size;
-    for(i=0;i<count;i++) {
-        bool ok = false;
-        if (index[0] == 0x53 && index[1] >= i && index[1] < count) {
-            int size = index[2] + (index[3] << 8);
-            const uint8_t *start = index - size - 4;
-            if (start >= limit &&
-                start[0] == 0xb7 &&
-                start[1] == index[1] &&
-                start[2] == (uint8_t)(size ^ 0x55) &&
-                start[3] == (uint8_t)((size>>8) ^ 0xaa)) {
-                ok = true;
-                for(;i<index[1];i++) {
-                    slots[i].data = 0;
-                    slots[i].size = 0;
-                }
-                slots[i].data = start + 4;
-                slots[i].size = size;
-                index = start - 4;
-//                printf("SLOT %d %s %p->%p (+%04x)\n", i, slots[i].data, slots[i].data-4, slots[i].data-4 + slots[i].size+8, slots[i].size+8);
-            }
+// Save slots are kept in a log of records in the flash between the end of the WHD and the end of flash. Each save
+// is written as a new record starting on a fresh 4K sector, in the first free sectors after the most recently written
+// record (wrapping round to the start), so erases are spread evenly over the whole area, and no other slot ever has to
+// be moved. The valid record with the highest sequence number for a slot is the current one for that slot; older
+// ones are free to be overwritten. The sector with a record's header is written last, so a save interrupted by
+// power loss leaves a record with a missing or bad header and CRC, and the previous save for the slot is used.
+// Clearing a slot writes an empty record.
+#define MAX_SLOTS 8
+#define SAVE_RECORD_MAGIC 0x31475344 // "DSG1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t slot;
+    uint32_t size; // of the data following the header
+    uint32_t crc; // of the above (except magic) and the data
+} save_record_header_t;
+
+static struct {
+    boolean valid;
+    const save_record_header_t *records[MAX_SLOTS]; // current record for each slot (which may be empty)
+    uint32_t next_sequence;
+    const uint8_t *head; // sector after the most recently written record
+    int max_record_sectors; // of the current records, used as the expected size of the next one
+    // sectors known to be erased, where the next record is expected to go (see P_SaveGameFlashPreEraseStep)
+    const uint8_t *pre_erase_start;
+    int pre_erased_sectors;
+} save_log;
+
+static uint32_t save_crc32(uint32_t crc, const uint8_t *data, uint size) {
+    static const uint32_t nibble_table[16] = {
+            0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+            0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    crc = ~crc;
+    while (size--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ nibble_table[crc & 15];
+        crc = (crc >> 4) ^ nibble_table[crc & 15];
+    }
+    return ~crc;
+}
+
+static uint32_t save_record_crc(const save_record_header_t *header, const uint8_t *data) {
+    uint32_t crc = save_crc32(0, (const uint8_t *)&header->sequence, offsetof(save_record_header_t, crc) - offsetof(save_record_header_t, sequence));
+    return save_crc32(crc, data, header->size);
+}
+
+static inline int save_record_sectors(uint size) {
+    return (sizeof(save_record_header_t) + size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+}
+
+static const uint8_t *save_log_start(void) {
+    return (const uint8_t *)(((uintptr_t)(whd_map_base + whdheader->size) + FLASH_SECTOR_SIZE - 1) & ~(uintptr_t)(FLASH_SECTOR_SIZE - 1));
+}
+
+static void save_write_finish(void);
+
+static void save_log_scan(void) {
+    // anyone looking at the log waits for a background write to complete
+    save_write_finish();
+    if (save_log.valid) return;
+    memset(&save_log, 0, sizeof(save_log));
+    const uint8_t *start = save_log_start();
+    const uint8_t *end = get_end_of_flash();
+    save_log.head = start;
+    for (const uint8_t *sector = start; sector < end; sector += FLASH_SECTOR_SIZE) {
+        const save_record_header_t *header = (const save_record_header_t *)sector;
+        if (header->magic != SAVE_RECORD_MAGIC || header->slot >= MAX_SLOTS ||
+            header->size > end - sector - sizeof(save_record_header_t)) {
+            continue;
+        }
+        const save_record_header_t *current = save_log.records[header->slot];
+        // no point checking the CRC of records which aren't newer than one we already have
+        if (current && header->sequence <= current->sequence) continue;
+        if (save_record_crc(header, (const uint8_t *)(header + 1)) != header->crc) continue;
+        save_log.records[header->slot] = header;
+        if (header->sequence >= save_log.next_sequence) {
+            save_log.next_sequence = header->sequence + 1;
+            save_log.head = sector + save_record_sectors(header->size) * FLASH_SECTOR_SIZE;
+            if (save_log.head >= end) save_log.head = start;
         }
-        if (!ok) break;
     }
-    for(;i<count;i++) {
-        slots[i].data = 0;
-        slots[i].size = 0;
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        if (save_log.records[i] && save_record_sectors(save_log.records[i]->size) > save_log.max_record_sectors) {
+            save_log.max_record_sectors = save_record_sectors(save_log.records[i]->size);
+        }
     }
+    save_log.valid = true;
 }
 
-typedef struct {
-    const uint8_t *dest;
-    const uint8_t *src;
-    int size;
-} flash_write_element;
-
-static void __no_inline_not_in_flash_func(write_flash_elements)(const flash_write_element *elements, int num, const uint8_t *low_dest, const uint8_t *high_dest, uint8_t *buffer4k, bool forwards) {
-    static_assert(FLASH_SECTOR_SIZE == 4096, "");
-    const uint8_t *first_sector = (const uint8_t *)(((uintptr_t)low_dest)&~(FLASH_SECTOR_SIZE-1));
-    const uint8_t *last_sector = (const uint8_t *)(((uintptr_t)high_dest-1)&~(FLASH_SECTOR_SIZE-1));
-//    for(int i=0;i<num;i++) {
-//        if (elements[i].dest < low_dest || elements[i].dest+elements[i].size > high_dest) {
-//            panic("bad ranges");
-//        }
-//    }
-
-//    uint32_t save = spin_lock_blocking(spin_lock_instance(PICO_SPINLOCK_ID_HARDWARE_CLAIM));
-    for(const uint8_t *sector = forwards ? first_sector : last_sector;
-            forwards ? sector <= last_sector : sector >= first_sector;
-            sector += forwards ? FLASH_SECTOR_SIZE : -FLASH_SECTOR_SIZE) {
-        memcpy(buffer4k, sector, FLASH_SECTOR_SIZE);
-//        printf("SAVE/ERASE %08x + %04x\n", sector, FLASH_SECTOR_SIZE);
-        for(int i=0;i<num;i++) {
-            const uint8_t *to = sector;
-            int from_offset = sector - elements[i].dest;
-            int size = FLASH_SECTOR_SIZE;
-            if (from_offset < 0) {
-                size += from_offset;
-                to -= from_offset;
-                from_offset = 0;
-            }
-            if (from_offset + size > elements[i].size) {
-                size = elements[i].size - from_offset;
-            }
-            if (size > 0) {
-//                printf("  WRITE %p (%p+%04x) + %04x at %p (%p+%04x)\n", elements[i].src + from_offset, elements[i].src, from_offset, size, to, sector, to-sector);
-//                hard_assert( to >= sector && to + size - sector <= FLASH_SECTOR_SIZE);
-                memmove(buffer4k + (to - sector), elements[i].src + from_offset, size);
+// returns the end of the last current record overlapping the range, or NULL if there is none
+static const uint8_t *save_log_live_overlap(const uint8_t *from, const uint8_t *to) {
+    const uint8_t *overlap_end = NULL;
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        const uint8_t *record = (const uint8_t *)save_log.records[i];
+        if (record) {
+            const uint8_t *record_end = record + save_record_sectors(save_log.records[i]->size) * FLASH_SECTOR_SIZE;
+            if (record < to && record_end > from && record_end > overlap_end) {
+                overlap_end = record_end;
             }
         }
-        uint32_t save = save_and_disable_interrupts();
-        picoflash_sector_program((uintptr_t)sector - XIP_BASE, buffer4k);
-        restore_interrupts(save);
     }
-//    spin_unlock(spin_lock_instance(PICO_SPINLOCK_ID_HARDWARE_CLAIM), save);
+    return overlap_end;
+}
+
+// find the first run of the given number of sectors without any current records in it, starting at the head
+static const uint8_t *save_log_find_space(int sectors) {
+    const uint8_t *start = save_log_start();
+    const uint8_t *end = get_end_of_flash();
+    const uint8_t *candidate = save_log.head;
+    int size = sectors * FLASH_SECTOR_SIZE;
+    // each time round we move forward at least one sector, so once we have covered the whole area, there is no space
+    for (int skipped = 0; skipped < end - start; ) {
+        if (candidate + size > end) {
+            // records don't wrap
+            skipped += end - candidate;
+            candidate = start;
+            continue;
+        }
+        const uint8_t *overlap_end = save_log_live_overlap(candidate, candidate + size);
+        if (!overlap_end) return candidate;
+        skipped += overlap_end - candidate;
+        candidate = overlap_end < end ? overlap_end : start;
+    }
+    return NULL;
 }
 
-boolean __noinline P_SaveGameWriteFlashSlot(int slot, const uint8_t *buffer, uint size, uint8_t *buffer4k) {
-#define MAX_SLOTS 8
-#define SLOT_OVERHEAD 8
-    flash_slot_info_t slots[MAX_SLOTS];
-    P_SaveGameGetExistingFlashSlotAddresses(slots, count_of(slots));
-    int used = 0;
-    const uint8_t *prev_slot_bottom = get_end_of_flash();
-    int last_slot = 0;
-    for(int i=0;i< count_of(slots);i++) {
-        if (slots[i].data) {
-            if (i < slot) {
-                prev_slot_bottom = slots[i].data - 4;
-            }
-            if (i != slot) {
-                used += SLOT_OVERHEAD + slots[i].size;
-            }
-            last_slot = i;
+void P_SaveGameGetExistingFlashSlotAddresses(flash_slot_info_t *slots, int count) {
+    save_log_scan();
+    for(int i=0;i<count;i++) {
+        const save_record_header_t *header = i < MAX_SLOTS ? save_log.records[i] : NULL;
+        if (header && header->size) {
+            slots[i].data = (const uint8_t *)(header + 1);
+            slots[i].size = header->size;
+        } else {
+            slots[i].data = 0;
+            slots[i].size = 0;
         }
     }
-    const uint8_t *limit = whd_map_base + whdheader->size;
-    int freespace = (get_end_of_flash() - limit) - used;
-//    printf("SPACE %d, required %d\n", freespace, size + SLOT_OVERHEAD);
-    if (freespace < size + SLOT_OVERHEAD) {
+}
+
+// core 1 runs from flash, so it is parked in RAM while XIP is disabled for erasing/programming
+static void __no_inline_not_in_flash_func(write_flash_sector)(const uint8_t *sector, const uint8_t *buffer4k) {
+    static_assert(FLASH_SECTOR_SIZE == 4096, "");
+    multicore_lockout_start_blocking();
+    uint32_t save = save_and_disable_interrupts();
+    picoflash_sector_program((uintptr_t)sector - XIP_BASE, buffer4k);
+    restore_interrupts(save);
+    multicore_lockout_end_blocking();
+}
+
+static void __no_inline_not_in_flash_func(erase_flash_sector)(const uint8_t *sector) {
+    multicore_lockout_start_blocking();
+    uint32_t save = save_and_disable_interrupts();
+    picoflash_sector_erase((uintptr_t)sector - XIP_BASE);
+    restore_interrupts(save);
+    multicore_lockout_end_blocking();
+}
+
+static void __no_inline_not_in_flash_func(program_flash_pages)(const uint8_t *dest, const uint8_t *data, uint size) {
+    multicore_lockout_start_blocking();
+    uint32_t save = save_and_disable_interrupts();
+    picoflash_page_program((uintptr_t)dest - XIP_BASE, data, size);
+    restore_interrupts(save);
+    multicore_lockout_end_blocking();
+}
+
+// find space for a new record for the slot, and fill in its header; returns NULL if there is no space
+static const uint8_t *save_record_begin(int slot, const uint8_t *buffer, uint size, save_record_header_t *header) {
+    const uint8_t *dest = save_log_find_space(save_record_sectors(size));
+//    printf("SAVE slot %d size %d -> %p (+%d sectors)\n", slot, size, dest, save_record_sectors(size));
+    if (dest) {
+        header->magic = SAVE_RECORD_MAGIC;
+        header->sequence = save_log.next_sequence;
+        header->slot = slot;
+        header->size = size;
+        header->crc = save_record_crc(header, buffer);
+    }
+    return dest;
+}
+
+boolean __noinline P_SaveGameWriteFlashSlot(int slot, const uint8_t *buffer, uint size, uint8_t *buffer4k) {
+    save_log_scan();
+    if (slot < 0 || slot >= MAX_SLOTS) return false;
+    if (!buffer) {
+        // nothing to do if the slot is already empty
+        if (!save_log.records[slot] || !save_log.records[slot]->size) return true;
+        size = 0;
+    }
+    save_record_header_t header;
+    const uint8_t *dest = save_record_begin(slot, buffer, size, &header);
+    if (!dest) {
         return false;
     }
+    int sectors = save_record_sectors(size);
     pd_start_save_pause();
-//    printf("Need to add %p->%p (+%04x)\n", prev_slot_bottom - 4 - size, prev_slot_bottom, size + 8);
-    if (last_slot > slot) {
-        assert(slots[last_slot.data]);
-        const uint8_t *from_top = slots[slot].data ? slots[slot].data - 4 : prev_slot_bottom;
-        const uint8_t *from_bottom = slots[last_slot].data - 4;
-        const uint8_t *to_top = prev_slot_bottom;
-        if (buffer) to_top -= size + SLOT_OVERHEAD;
-        assert(from_top - from_bottom > 0);
-        flash_write_element element = {
-                .size = from_top - from_bottom,
-                .dest = to_top - (from_top - from_bottom),
-                .src = from_bottom
-        };
-//        printf("Need to move %p->%p (+%04x) to %p->%p\n", from_bottom, from_top, element.size, to_top - element.size, to_top);
-        write_flash_elements(&element, 1, to_top - element.size, to_top, buffer4k, to_top < from_top);
-    }
-    if (buffer) {
-        uint8_t high_marker[] = {
-                0x53, (uint8_t) slot, size & 0xff, (size >> 8) & 0xff
-        };
-        uint8_t low_marker[] = {
-                0xb7, (uint8_t) slot, 0x55 ^ (size & 0xff), 0xaa ^ ((size >> 8) & 0xff)
-        };
-
-        flash_write_element elements[3] = {
-                {
-                        .dest = prev_slot_bottom - 4,
-                        .src = high_marker,
-                        .size = 4,
-                },
-                {
-                        .dest = prev_slot_bottom - 4 - size,
-                        .src = buffer,
-                        .size = (int) size,
-                },
-                {
-                        .dest = prev_slot_bottom - 8 - size,
-                        .src = low_marker,
-                        .size = 4,
-                }
-        };
-        write_flash_elements(elements, count_of(elements), prev_slot_bottom - 8 - size, prev_slot_bottom, buffer4k,
-                             true);
-    } else if (slot == last_slot && slots[slot].data) {
-//        printf("Nuking slot %d\n", slot);
-        uint8_t dummy[4] = {0};
-        flash_write_element element = {
-                .size = 4,
-                .dest = slots[slot].data + slots[slot].size,
-                .src = dummy
-        };
-        write_flash_elements(&element, 1, element.dest, element.dest+4, buffer4k, true);
+    // write backwards, so the sector with the header is written last
+    for(int i = sectors - 1; i >= 0; i--) {
+        memset(buffer4k, 0xff, FLASH_SECTOR_SIZE);
+        int offset = i * FLASH_SECTOR_SIZE - (int)sizeof(header); // offset in the data of the start of this sector
+        uint8_t *to = buffer4k;
+        if (!i) {
+            memcpy(to, &header, sizeof(header));
+            to += sizeof(header);
+            offset = 0;
+        }
+        int n = (int)size - offset;
+        if (n > buffer4k + FLASH_SECTOR_SIZE - to) n = buffer4k + FLASH_SECTOR_SIZE - to;
+        if (n > 0) memcpy(to, buffer + offset, n);
+        write_flash_sector(dest + i * FLASH_SECTOR_SIZE, buffer4k);
     }
+    save_log.valid = false;
     pd_end_save_pause();
     return true;
 }
 
+// Background writes: the record is copied into a zone buffer, then written one step at a time from G_Ticker, each
+// step being either a sector erase (unless it was erased beforehand by P_SaveGameFlashPreEraseStep) or the
+// programming of a few pages, so the game doesn't pause while saving. The sectors are still written last to first so
+// the header goes in last.
+#define SAVE_WRITE_STEP_BYTES 1024 // about 3ms of programming
+#define SAVE_WRITE_ZONE_HEADROOM 4096 // don't stage a write if it would leave the zone with less than this free
+
+static struct {
+    uint8_t *staged; // header, data and 0xff padding to a whole number of pages, or NULL if there is no write
+    const uint8_t *dest;
+    int size; // of staged
+    int sector; // index in the record of the sector being written
+    int offset; // of the next page to program in the sector, or -1 if it needs erasing first
+    int steps;
+    int total_steps;
+} save_write;
+
+static int save_write_sector_size(int sector) {
+    int size = save_write.size - sector * FLASH_SECTOR_SIZE;
+    return size < FLASH_SECTOR_SIZE ? size : FLASH_SECTOR_SIZE;
+}
+
+static boolean flash_sector_erased(const uint8_t *sector) {
+    const uint32_t *words = (const uint32_t *)sector;
+    for (uint i = 0; i < FLASH_SECTOR_SIZE / 4; i++) {
+        if (words[i] != 0xffffffff) return false;
+    }
+    return true;
+}
+
+static boolean save_log_sector_pre_erased(const uint8_t *sector) {
+    return save_log.pre_erase_start && sector >= save_log.pre_erase_start &&
+           sector < save_log.pre_erase_start + save_log.pre_erased_sectors * FLASH_SECTOR_SIZE;
+}
+
+// Erasing a sector takes about 45ms typically (up to 400ms) with interrupts disabled and core 1 locked out, which
+// can't be hidden in a tic. So while nothing is going on (after loading a game, or in the menu/paused after a save),
+// the sectors the next record is expected to go in (those for one the size of the largest current record) are erased
+// a sector per call, and a background write then only has to program them.
+boolean P_SaveGameFlashPreEraseStep(void) {
+    if (save_write.staged) return false;
+    save_log_scan();
+    if (!save_log.max_record_sectors) return false;
+    if (!save_log.pre_erase_start) {
+        save_log.pre_erase_start = save_log_find_space(save_log.max_record_sectors);
+        if (!save_log.pre_erase_start) return false;
+    }
+    if (save_log.pre_erased_sectors == save_log.max_record_sectors) return false;
+    const uint8_t *sector = save_log.pre_erase_start + save_log.pre_erased_sectors * FLASH_SECTOR_SIZE;
+    if (!flash_sector_erased(sector)) {
+        erase_flash_sector(sector);
+    }
+    save_log.pre_erased_sectors++;
+    return save_log.pre_erased_sectors < save_log.max_record_sectors;
+}
+
+boolean P_SaveGameStartFlashSlotWrite(int slot, const uint8_t *buffer, uint size) {
+    save_log_scan();
+    if (slot < 0 || slot >= MAX_SLOTS) return false;
+    int staged_size = (sizeof(save_record_header_t) + size + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+    if (Z_LargestFree() < staged_size + SAVE_WRITE_ZONE_HEADROOM) {
+        return false;
+    }
+    save_record_header_t header;
+    const uint8_t *dest = save_record_begin(slot, buffer, size, &header);
+    if (!dest) {
+        return false;
+    }
+    uint8_t *staged = Z_Malloc(staged_size, PU_STATIC, 0);
+    memcpy(staged, &header, sizeof(header));
+    memcpy(staged + sizeof(header), buffer, size);
+    memset(staged + sizeof(header) + size, 0xff, staged_size - sizeof(header) - size);
+    save_write.staged = staged;
+    save_write.dest = dest;
+    save_write.size = staged_size;
+    save_write.sector = (staged_size - 1) / FLASH_SECTOR_SIZE;
+    save_write.offset = save_log_sector_pre_erased(dest + save_write.sector * FLASH_SECTOR_SIZE) ? 0 : -1;
+    save_write.steps = 0;
+    save_write.total_steps = 0;
+    for (int i = 0; i <= save_write.sector; i++) {
+        save_write.total_steps += !save_log_sector_pre_erased(dest + i * FLASH_SECTOR_SIZE) +
+                (save_write_sector_size(i) + SAVE_WRITE_STEP_BYTES - 1) / SAVE_WRITE_STEP_BYTES;
+    }
+    return true;
+}
+
+int P_SaveGameFlashWriteStep(void) {
+    if (!save_write.staged) return -1;
+    const uint8_t *sector = save_write.dest + save_write.sector * FLASH_SECTOR_SIZE;
+    if (save_write.offset < 0) {
+        erase_flash_sector(sector);
+        save_write.offset = 0;
+    } else {
+        int sector_size = save_write_sector_size(save_write.sector);
+        int n = sector_size - save_write.offset;
+        if (n > SAVE_WRITE_STEP_BYTES) n = SAVE_WRITE_STEP_BYTES;
+        program_flash_pages(sector + save_write.offset,
+                            save_write.staged + save_write.sector * FLASH_SECTOR_SIZE + save_write.offset, n);
+        save_write.offset += n;
+        if (save_write.offset == sector_size) {
+            if (!save_write.sector) {
+                Z_Free(save_write.staged);
+                save_write.staged = NULL;
+                save_log.valid = false;
+                return 100;
+            }
+            save_write.sector--;
+            save_write.offset = save_log_sector_pre_erased(sector - FLASH_SECTOR_SIZE) ? 0 : -1;
+        }
+    }
+    save_write.steps++;
+    return save_write.steps * 100 / save_write.total_steps;
+}
+
+static void save_write_finish(void) {
+    while (save_write.staged) {
+        P_SaveGameFlashWriteStep();
+    }
+}
+
 #endif
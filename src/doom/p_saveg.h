@@ -47,6 +47,15 @@ typedef struct {
 void P_SaveGameGetExistingFlashSlotAddresses(flash_slot_info_t *slots, int count);
 // can pass null to clear a slot
 boolean P_SaveGameWriteFlashSlot(int slot, const uint8_t *buffer, uint size, uint8_t *buffer4k);
+// start writing a slot in the background from a copy of the buffer; returns false if there isn't the flash or
+// zone space to do so (P_SaveGameWriteFlashSlot can be used instead)
+boolean P_SaveGameStartFlashSlotWrite(int slot, const uint8_t *buffer, uint size);
+// do the next step of a background write, returning the percentage complete (100 when it has just finished),
+// or -1 if there is no write in progress
+int P_SaveGameFlashWriteStep(void);
+// erase one of the sectors the next save is expected to be written to, so a background write of it only has to
+// program; returns true if there are more to erase. does nothing while a background write is in progress
+boolean P_SaveGameFlashPreEraseStep(void);
 #endif
 char *P_SaveGameFile(int slot);
 
@@ -1045,6 +1045,7 @@ P_SetupLevel
 
     // UNUSED W_Profile ();
     P_InitThinkers ();
+    P_InvalidateSightCache ();
 
 #if !NO_USE_RELOAD
     // if working with a devlopment map, reload it
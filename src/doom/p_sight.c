@@ -40,6 +40,61 @@ fixed_t		t2y;
 
 int		sightcounts[2];
 
+#if USE_SIGHT_CACHE
+// The result of a sight check only depends on the two eye/target
+// positions and on the sector heights along the way (line flags and
+// geometry are fixed for the level), so remember the last few results
+// keyed by position, and throw them all away whenever a plane's height
+// changes. A monster and its target standing still then only walk the
+// BSP once.
+#define SIGHT_CACHE_SIZE 16
+
+typedef struct
+{
+    fixed_t	x1, y1, eyez;
+    fixed_t	x2, y2, z2, z2top;
+    uint16_t	epoch;
+    boolean	result;
+} sightcache_t;
+
+static sightcache_t	sightcache[SIGHT_CACHE_SIZE];
+static uint16_t		sightcache_epoch = 1;
+#if PD_FRAME_STATS
+static uint32_t		sightcache_hits, sightcache_misses, sightcache_invalidations;
+#endif
+
+void P_InvalidateSightCache (void)
+{
+#if PD_FRAME_STATS
+    sightcache_invalidations++;
+#endif
+    if (!++sightcache_epoch)
+    {
+	// wrapped; make sure no stale entry can match again
+	memset(sightcache, 0, sizeof(sightcache));
+	sightcache_epoch = 1;
+    }
+}
+
+static inline sightcache_t *P_SightCacheSlot (fixed_t x1, fixed_t y1,
+					      fixed_t x2, fixed_t y2)
+{
+    uint32_t h = (uint32_t)(x1 ^ (y1 * 3) ^ (x2 * 5) ^ (y2 * 7));
+    h ^= h >> 16;
+    h ^= h >> 8;
+    return &sightcache[h & (SIGHT_CACHE_SIZE - 1)];
+}
+
+#if PD_FRAME_STATS
+void P_ReportSightCacheStats (void)
+{
+    uint32_t total = sightcache_hits + sightcache_misses;
+    printf("sight cache: %d hits %d misses (%d%% hit rate), %d invalidations\n", (int)sightcache_hits,
+           (int)sightcache_misses, total ? (int)(sightcache_hits * 100ull / total) : 0, (int)sightcache_invalidations);
+}
+#endif
+#endif
+
 
 //
 // P_DivlineSide
@@ -339,6 +394,25 @@ P_CheckSight
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 
+#if USE_SIGHT_CACHE
+    fixed_t eyez = t1->z + mobj_height(t1) - (mobj_height(t1)>>2);
+    fixed_t z2top = t2->z + mobj_height(t2);
+    sightcache_t *sc = P_SightCacheSlot(t1->xy.x, t1->xy.y, t2->xy.x, t2->xy.y);
+    if (sc->epoch == sightcache_epoch &&
+        sc->x1 == t1->xy.x && sc->y1 == t1->xy.y && sc->eyez == eyez &&
+        sc->x2 == t2->xy.x && sc->y2 == t2->xy.y &&
+        sc->z2 == t2->z && sc->z2top == z2top)
+    {
+#if PD_FRAME_STATS
+	sightcache_hits++;
+#endif
+	return sc->result;
+    }
+#if PD_FRAME_STATS
+    sightcache_misses++;
+#endif
+#endif
+
     line_check_reset();
     validcount++;
 	
@@ -354,7 +428,19 @@ P_CheckSight
     strace.dy = t2->xy.y - t1->xy.y;
 
     // the head node is the last node output
+#if USE_SIGHT_CACHE
+    sc->x1 = t1->xy.x;
+    sc->y1 = t1->xy.y;
+    sc->eyez = eyez;
+    sc->x2 = t2->xy.x;
+    sc->y2 = t2->xy.y;
+    sc->z2 = t2->z;
+    sc->z2top = z2top;
+    sc->epoch = sightcache_epoch;
+    return sc->result = P_CrossBSPNode (numnodes-1);
+#else
     return P_CrossBSPNode (numnodes-1);	
+#endif
 }
 
 
@@ -42,9 +42,67 @@ int	leveltime;
 thinker_t thinkercap;
 thinker_t *thinkertail;
 
+#if USE_THINKER_CLASS_LISTS
+// sector specials are kept on their own list. we record the order in which mobjs and specials were added to
+// the two lists (which is the order vanilla runs them in) as runs of consecutive thinkers of the same class
+thinker_t specialthinkercap;
+static thinker_t *specialthinkertail;
+
+#define THINKER_RUN_SPECIAL 0x8000u
+#define THINKER_RUN_COUNT_MASK 0x7fffu
+static uint16_t *thinker_runs;
+static int thinker_run_count;
+static int thinker_run_capacity;
+
+#if THINKER_CLASS_LISTS_CHECK
+// every thinker in the order of the original single list, to check that P_RunThinkers runs them in the same order
+static thinker_t **thinker_check_order;
+static int thinker_check_count;
+static int thinker_check_capacity;
+#endif
+#endif
+
 #if USE_THINKER_POOL
-#define MAX_THINKER_POOLS 2
+// object sizes which are pooled (see Z_ThinkMallocImpl below), and how many slots there are in each block. types of the
+// same size share the pool (and slot count) of the first entry.
+//
+// the slot counts come from the level start populations of the shareware IWAD (E1M1-E1M9, skill 3):
+// - mobjs: 42-229 mobj_t and 13-141 mobjfull_t per level, so full blocks waste at most 7 slots per pool
+// - lighting specials (which live for the whole level): 2-13 of the 20 byte (on device) fireflicker_t/glow_t and 0-13
+//   of the 28 byte lightflash_t/strobe_t per level. 7 slots gives the lowest cost for the worst level (296 and 408
+//   bytes including zone headers, vs 336 and 464 for 8 slots)
+// - movers are only spawned during play, so their counts can't be derived from the level data (no shareware sector
+//   spawns a door at level start); they are few and short lived, so smaller blocks waste less in partially empty ones
+// P_ReportThinkerPoolStats (Z_ZONE_STATS) reports the peak counts during play to check these against
+typedef struct {
+    uint16_t size;
+    uint8_t slots; // <= 8
+} thinker_pool_type_t;
+
+static const thinker_pool_type_t thinker_pool_types[] = {
+        { sizeof(mobj_t), 8 },
+        { sizeof(mobjfull_t), 8 },
+        { sizeof(fireflicker_t), 7 },
+        { sizeof(lightflash_t), 7 },
+        { sizeof(strobe_t), 7 },
+        { sizeof(glow_t), 7 },
+        { sizeof(vldoor_t), 4 },
+        { sizeof(plat_t), 4 },
+        { sizeof(ceiling_t), 4 },
+        { sizeof(floormove_t), 4 },
+};
+#define MAX_THINKER_POOLS count_of(thinker_pool_types)
+static_assert(MAX_THINKER_POOLS <= 16, ""); // type is a nibble in pool_info
 static shortptr_t thinker_pool[MAX_THINKER_POOLS];
+
+#if Z_ZONE_STATS
+static struct {
+    uint16_t objects;
+    uint16_t max_objects;
+    uint16_t blocks;
+    uint16_t max_blocks;
+} thinker_pool_stats[MAX_THINKER_POOLS];
+#endif
 #endif
 
 //
@@ -54,20 +112,79 @@ void P_InitThinkers (void)
 {
     thinkercap.sp_next = thinker_to_shortptr(&thinkercap);
     thinkertail = &thinkercap;
+#if USE_THINKER_CLASS_LISTS
+    specialthinkercap.sp_next = thinker_to_shortptr(&specialthinkercap);
+    specialthinkertail = &specialthinkercap;
+    thinker_run_count = 0;
+#if THINKER_CLASS_LISTS_CHECK
+    thinker_check_count = 0;
+#endif
+#endif
 #if USE_THINKER_POOL
     memset(thinker_pool, 0, sizeof(thinker_pool));
+#if Z_ZONE_STATS
+    for (int i = 0; i < MAX_THINKER_POOLS; i++) {
+        thinker_pool_stats[i].objects = thinker_pool_stats[i].blocks = 0;
+    }
+#endif
 #endif
 }
 
 
 
 
+#if USE_THINKER_CLASS_LISTS
+static void add_thinker_run(uint16_t class_bit) {
+    if (thinker_run_count && (thinker_runs[thinker_run_count - 1] & THINKER_RUN_SPECIAL) == class_bit) {
+        assert((thinker_runs[thinker_run_count - 1] & THINKER_RUN_COUNT_MASK) < THINKER_RUN_COUNT_MASK);
+        thinker_runs[thinker_run_count - 1]++;
+        return;
+    }
+    if (thinker_run_count == thinker_run_capacity) {
+        int capacity = thinker_run_capacity ? thinker_run_capacity * 2 : 16;
+        uint16_t *runs = Z_Malloc(capacity * sizeof(uint16_t), PU_STATIC, 0);
+        if (thinker_runs) {
+            memcpy(runs, thinker_runs, thinker_run_count * sizeof(uint16_t));
+            Z_Free(thinker_runs);
+        }
+        thinker_runs = runs;
+        thinker_run_capacity = capacity;
+    }
+    thinker_runs[thinker_run_count++] = class_bit | 1;
+}
+
+#if THINKER_CLASS_LISTS_CHECK
+static void add_thinker_check(thinker_t *thinker) {
+    if (thinker_check_count == thinker_check_capacity) {
+        thinker_check_capacity = thinker_check_capacity ? thinker_check_capacity * 2 : 256;
+        thinker_check_order = I_Realloc(thinker_check_order, thinker_check_capacity * sizeof(thinker_t *));
+    }
+    thinker_check_order[thinker_check_count++] = thinker;
+}
+#endif
+#endif
+
 //
 // P_AddThinker
 // Adds a new thinker at the end of the list.
 //
 void P_AddThinker (thinker_t* thinker)
 {
+#if USE_THINKER_CLASS_LISTS
+#if THINKER_CLASS_LISTS_CHECK
+    add_thinker_check(thinker);
+#endif
+    // note mobjs have their function set before they are added, and sector specials never become mobjs
+    if (thinker->function != ThinkF_P_MobjThinker) {
+        assert(thinker_next(specialthinkertail) == &specialthinkercap);
+        thinker->sp_next = specialthinkertail->sp_next;
+        specialthinkertail->sp_next = thinker_to_shortptr(thinker);
+        specialthinkertail = thinker;
+        add_thinker_run(THINKER_RUN_SPECIAL);
+        return;
+    }
+    add_thinker_run(0);
+#endif
     assert(thinker_next(thinkertail) == &thinkercap);
     thinker->sp_next = thinkertail->sp_next;
     thinkertail->sp_next = thinker_to_shortptr(thinker);
@@ -97,9 +214,46 @@ void P_AllocateThinker (thinker_t*	thinker)
 
 
 
+static void run_thinker(thinker_t *currentthinker) {
+    switch (currentthinker->function) {
+        case ThinkF_NULL:
+            break;
+        case ThinkF_T_MoveCeiling:
+            T_MoveCeiling((ceiling_t *) currentthinker);
+            break;
+        case ThinkF_T_VerticalDoor:
+            T_VerticalDoor((vldoor_t *) currentthinker);
+            break;
+        case ThinkF_T_PlatRaise:
+            T_PlatRaise((plat_t *) currentthinker);
+            break;
+        case ThinkF_T_FireFlicker:
+            T_FireFlicker((fireflicker_t *) currentthinker);
+            break;
+        case ThinkF_T_LightFlash:
+            T_LightFlash((lightflash_t *) currentthinker);
+            break;
+        case ThinkF_T_StrobeFlash:
+            T_StrobeFlash((strobe_t *) currentthinker);
+            break;
+        case ThinkF_T_MoveFloor:
+            T_MoveFloor((floormove_t *) currentthinker);
+            break;
+        case ThinkF_T_Glow:
+            T_Glow((glow_t *) currentthinker);
+            break;
+        case ThinkF_P_MobjThinker:
+            P_MobjThinker((mobj_t *) currentthinker);
+            break;
+        default:
+            I_Error("Unexpected thinker");
+    }
+}
+
 //
 // P_RunThinkers
 //
+#if !USE_THINKER_CLASS_LISTS
 void P_RunThinkers (void)
 {
     thinker_t *prevthinker, *currentthinker;
@@ -115,44 +269,85 @@ void P_RunThinkers (void)
             }
             Z_ThinkFree(currentthinker);
         } else {
-            switch (currentthinker->function) {
-                case ThinkF_NULL:
-                    break;
-                case ThinkF_T_MoveCeiling:
-                    T_MoveCeiling((ceiling_t *) currentthinker);
-                    break;
-                case ThinkF_T_VerticalDoor:
-                    T_VerticalDoor((vldoor_t *) currentthinker);
-                    break;
-                case ThinkF_T_PlatRaise:
-                    T_PlatRaise((plat_t *) currentthinker);
-                    break;
-                case ThinkF_T_FireFlicker:
-                    T_FireFlicker((fireflicker_t *) currentthinker);
-                    break;
-                case ThinkF_T_LightFlash:
-                    T_LightFlash((lightflash_t *) currentthinker);
-                    break;
-                case ThinkF_T_StrobeFlash:
-                    T_StrobeFlash((strobe_t *) currentthinker);
-                    break;
-                case ThinkF_T_MoveFloor:
-                    T_MoveFloor((floormove_t *) currentthinker);
-                    break;
-                case ThinkF_T_Glow:
-                    T_Glow((glow_t *) currentthinker);
-                    break;
-                case ThinkF_P_MobjThinker:
-                    P_MobjThinker((mobj_t *) currentthinker);
-                    break;
-                default:
-                    I_Error("Unexpected thinker");
-            }
+            run_thinker(currentthinker);
             prevthinker = currentthinker;
         }
         currentthinker = thinker_next(prevthinker);
     }
 }
+#else
+// runs the thinkers a run of the same class at a time from the mobj and sector special lists, in the same order as
+// the single list, freeing removed ones as it goes
+void P_RunThinkers (void)
+{
+    thinker_t *prevthinker[2] = { &thinkercap, &specialthinkercap };
+    thinker_t **tail[2] = { &thinkertail, &specialthinkertail };
+#if THINKER_CLASS_LISTS_CHECK
+    int check_index = 0;
+#endif
+    int r = 0;
+    int n = 0; // number of thinkers already run in run r
+    while (r < thinker_run_count) {
+        int special = (thinker_runs[r] & THINKER_RUN_SPECIAL) != 0;
+        // note the count of the current run may go up as we go if new thinkers are added
+        while (n < (thinker_runs[r] & THINKER_RUN_COUNT_MASK)) {
+            thinker_t *currentthinker = thinker_next(prevthinker[special]);
+#if THINKER_CLASS_LISTS_CHECK
+            if (check_index >= thinker_check_count || thinker_check_order[check_index] != currentthinker) {
+                I_Error("Thinker %d out of order", check_index);
+            }
+#endif
+            if (currentthinker->function == ThinkF_REMOVED) {
+                // time to remove it
+                prevthinker[special]->sp_next = currentthinker->sp_next;
+                if (*tail[special] == currentthinker) {
+                    *tail[special] = prevthinker[special];
+                }
+                Z_ThinkFree(currentthinker);
+                thinker_runs[r]--;
+#if THINKER_CLASS_LISTS_CHECK
+                thinker_check_count--;
+                memmove(thinker_check_order + check_index, thinker_check_order + check_index + 1,
+                        (thinker_check_count - check_index) * sizeof(thinker_t *));
+#endif
+            } else {
+                if (special) {
+                    run_thinker(currentthinker);
+                } else {
+                    P_MobjThinker((mobj_t *) currentthinker);
+                }
+                prevthinker[special] = currentthinker;
+                n++;
+#if THINKER_CLASS_LISTS_CHECK
+                check_index++;
+#endif
+            }
+        }
+        if (n) {
+            r++;
+            n = 0;
+            continue;
+        }
+        // the run is now empty, so remove it
+        thinker_run_count--;
+        memmove(thinker_runs + r, thinker_runs + r + 1, (thinker_run_count - r) * sizeof(uint16_t));
+        if (r && r < thinker_run_count && !((thinker_runs[r - 1] ^ thinker_runs[r]) & THINKER_RUN_SPECIAL)) {
+            // the runs either side are of the same class, so merge them, carrying on after the part of the
+            // merged run we already ran
+            r--;
+            n = thinker_runs[r] & THINKER_RUN_COUNT_MASK;
+            thinker_runs[r] += thinker_runs[r + 1] & THINKER_RUN_COUNT_MASK;
+            thinker_run_count--;
+            memmove(thinker_runs + r + 1, thinker_runs + r + 2, (thinker_run_count - r - 1) * sizeof(uint16_t));
+        }
+    }
+#if THINKER_CLASS_LISTS_CHECK
+    if (check_index != thinker_check_count) {
+        I_Error("Ran %d of %d thinkers", check_index, thinker_check_count);
+    }
+#endif
+}
+#endif
 
 
 
@@ -196,7 +391,8 @@ void P_Ticker (void)
 // the Z_Zone malloc overhead (8 bytes) by simple pooling.
 //
 // We use one memory object allocation "block" to store up to 8 slots of the same
-// size. (we only do this for known sizes).
+// size. (we only do this for the sizes in thinker_pool_types, each of which
+// has its own number of slots per block).
 //
 // There is actually a padding byte spare in the malloc header (which we use
 // for a 8 entry bit set for which of the block's slots are free)
@@ -217,26 +413,19 @@ void P_Ticker (void)
 
 #if USE_THINKER_POOL
 static int thinker_pool_type(int size) {
-    switch (size) {
-        case sizeof(mobj_t):
-            return 0;
-        case sizeof(mobjfull_t):
-            return 1;
-        default:
-            return -1;
+    for (int type = 0; type < MAX_THINKER_POOLS; type++) {
+        if (thinker_pool_types[type].size == size) return type;
     }
+    return -1;
 }
 
-static int thinker_pool_object_size(int type) {
-    switch (type) {
-        case 0:
-            return sizeof(mobj_t);
-        case 1:
-            return sizeof(mobjfull_t);
-        default:
-            I_Error("what?");
-            return 0;
-    }
+static inline int thinker_pool_object_size(int type) {
+    return thinker_pool_types[type].size;
+}
+
+// bit set with all the block's slots free
+static inline uint8_t thinker_pool_all_free(int type) {
+    return (1u << thinker_pool_types[type].slots) - 1;
 }
 
 static inline thinker_t *thinker_n(void *obj, int n, int size) {
@@ -252,25 +441,36 @@ thinker_t *Z_ThinkMallocImpl(int size) {
         memset(thinker, 0, size);
         return thinker;
     }
+#if Z_ZONE_STATS
+    if (++thinker_pool_stats[type].objects > thinker_pool_stats[type].max_objects) {
+        thinker_pool_stats[type].max_objects = thinker_pool_stats[type].objects;
+    }
+#endif
     if (!thinker_pool[type]) {
         // we don't have any partial pools, so allocate into new pool
-        void *block = Z_Malloc(size * 8, PU_LEVEL, 0);
+        int slots = thinker_pool_types[type].slots;
+        void *block = Z_Malloc(size * slots, PU_LEVEL, 0);
         thinker_pool[type] = ptr_to_shortptr(block);
         uint8_t *bitset = Z_ObjectExtra(block);
         // all free but first
-        *bitset = 0xfe;
+        *bitset = thinker_pool_all_free(type) & ~1u;
         thinker_t *thinker = (thinker_t *)block;
         memset(thinker, 0, size);
         thinker->pool_info = (type << 4u) | 0x8;
         // pointer to next free pool (none) in the last free thinker
-        thinker_n(block, 7, size)->sp_next = 0;
+        thinker_n(block, slots - 1, size)->sp_next = 0;
+#if Z_ZONE_STATS
+        if (++thinker_pool_stats[type].blocks > thinker_pool_stats[type].max_blocks) {
+            thinker_pool_stats[type].max_blocks = thinker_pool_stats[type].blocks;
+        }
+#endif
 //        printf("Pool %d @ %p, allocating new block slot %d %02x (free) = %p pi %02x\n", size, block, 0, *bitset, thinker, thinker->pool_info);
         return thinker;
     }
     void *block = shortptr_to_ptr(thinker_pool[type]);
     uint8_t *bitset = Z_ObjectExtra(block);
     int slot = __builtin_ctz(*bitset);
-    assert(slot >= 0 && slot < 8);
+    assert(slot >= 0 && slot < thinker_pool_types[type].slots);
     thinker_t *thinker = thinker_n(block, slot, size);
     memset(thinker, 0, size);
     // indicate that this thinker is in a pool (and where)
@@ -294,7 +494,7 @@ void dump_chain(int type, int size) {
         uint8_t *current_bitset = Z_ObjectExtra(cur_block);
         printf("-> %p(%02x) ", cur_block, *current_bitset);
         int highest_free_slot = 31 - __builtin_clz(*current_bitset);
-        assert(highest_free_slot >=0 && highest_free_slot < 8);
+        assert(highest_free_slot >=0 && highest_free_slot < thinker_pool_types[type].slots);
         cur_block = shortptr_to_ptr(thinker_n(cur_block, highest_free_slot, size)->sp_next);
     }
     printf("\n");
@@ -311,10 +511,13 @@ void Z_ThinkFree(thinker_t *thinker) {
     assert(thinker->pool_info & 0x8);
     int type = thinker->pool_info >> 4;
     int slot = thinker->pool_info & 0x7;
-    assert(type <= MAX_THINKER_POOLS);
+    assert(type < MAX_THINKER_POOLS);
 
     int size = thinker_pool_object_size(type);
     void *block = ((void *)thinker) - slot * size;
+#if Z_ZONE_STATS
+    thinker_pool_stats[type].objects--;
+#endif
     uint8_t *bitset = Z_ObjectExtra(block);
     assert(!(*bitset & (1u << slot)));
 //    printf("Pool %d @ %p, freeing slot %d %02x (free) = %p pi %02x\n", size, block, slot, *bitset, thinker, thinker->pool_info);
@@ -331,7 +534,7 @@ void Z_ThinkFree(thinker_t *thinker) {
         next_pool = thinker_n(block, highest_free_slot, size)->sp_next;
     }
     *bitset |= 1u << slot;
-    if (*bitset == 0xff) {
+    if (*bitset == thinker_pool_all_free(type)) {
         // we need to unlink
 //        *bitset &= ~(1u << slot);
 //        dump_chain(type, size);
@@ -350,6 +553,9 @@ void Z_ThinkFree(thinker_t *thinker) {
             cur_block = shortptr_to_ptr(*pprev);
         }
         Z_Free(block);
+#if Z_ZONE_STATS
+        thinker_pool_stats[type].blocks--;
+#endif
     } else {
         if (*bitset < (2u << slot)) {
             // we are now the highest free bit, and should hold the forward pointer
@@ -359,4 +565,16 @@ void Z_ThinkFree(thinker_t *thinker) {
     }
 //    dump_chain(type, size);
 }
+
+#if Z_ZONE_STATS
+void P_ReportThinkerPoolStats(void) {
+    for (int type = 0; type < MAX_THINKER_POOLS; type++) {
+        int slots = thinker_pool_stats[type].blocks * thinker_pool_types[type].slots;
+        printf("thinker pool %d (size %d x %d): %d objects in %d blocks (%d%% occupied), peak %d objects in %d blocks\n",
+               type, thinker_pool_types[type].size, thinker_pool_types[type].slots, thinker_pool_stats[type].objects,
+               thinker_pool_stats[type].blocks, slots ? thinker_pool_stats[type].objects * 100 / slots : 0,
+               thinker_pool_stats[type].max_objects, thinker_pool_stats[type].max_blocks);
+    }
+}
+#endif
 #endif
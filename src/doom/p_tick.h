@@ -28,6 +28,10 @@
 // Carries out all thinking of monsters and players.
 void P_Ticker (void);
 
+#if USE_THINKER_POOL && Z_ZONE_STATS
+// print the occupancy of the thinker pool blocks
+void P_ReportThinkerPoolStats(void);
+#endif
 
 
 #endif
@@ -33,10 +33,6 @@
 // State.
 #include "doomstat.h"
 #include "r_state.h"
-#if PICO_ON_DEVICE
-#include "i_sound.h"
-#include "pico/time.h"
-#endif
 //#include "r_local.h"
 
 
@@ -549,14 +545,6 @@ void R_RenderBSPNode (int bspnum, node_coord_t *bbox)
         return;
     }
 
-#if PICO_ON_DEVICE
-    static int t0;
-    uint32_t t = time_us_32();
-    if ((t - t0) > 3000) {
-        I_UpdateSound();
-        t0 = t;
-    }
-#endif
     bsp = &nodes[bspnum];
 
     // Decide which side the view point is on.
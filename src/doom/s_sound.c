@@ -752,6 +752,201 @@ void S_StopMusic(void)
     }
 }
 
+#if PD_MUSIC_BENCH
+#include "pico/time.h"
+#include "i_picosound.h"
+
+// render the next sample_count stereo samples of music straight from the OPL emulator; returns false once nothing is
+// left scheduled (i.e. the non looping song has finished)
+extern bool OPL_Pico_RenderOffline(int16_t *samples, unsigned int sample_count);
+
+// the build points this at the checked in golden file in the source tree, so the result doesn't depend on the cwd
+#ifndef PD_MUSIC_GOLDEN_FILE
+#define PD_MUSIC_GOLDEN_FILE "pd_music_golden.txt"
+#endif
+
+#define MUSIC_BENCH_SAMPLES 1024
+// stop runaway songs (e.g. ones with no end of track) after 10 minutes
+#define MUSIC_BENCH_MAX_SAMPLES (PICO_SOUND_SAMPLE_FREQ * 600)
+
+typedef struct {
+    char name[9];
+    uint32_t hash;
+    uint32_t samples;
+} music_golden_t;
+
+// headless regression check of the musx decoder and OPL emulator: renders every music lump in the WAD to PCM as fast
+// as possible, reporting the real-time factor for each, and compares a hash of the output with the golden hashes in
+// PD_MUSIC_GOLDEN_FILE (or $PD_MUSIC_GOLDEN). every track starts from a freshly reset OPL chip, so its hash doesn't
+// depend on the tracks before it. a missing golden file or track fails the run, unless -recordgolden is
+// given, in which case the golden file is (re)written from this run instead
+void S_MusicBench(void)
+{
+    static int16_t samples[MUSIC_BENCH_SAMPLES * 2];
+    static music_golden_t golden[NUMMUSIC];
+    int golden_count = 0;
+    int mismatches = 0;
+    uint64_t total_samples = 0, total_us = 0;
+    const char *golden_name = getenv("PD_MUSIC_GOLDEN");
+    if (!golden_name) golden_name = PD_MUSIC_GOLDEN_FILE;
+    FILE *golden_file;
+    if (M_CheckParm("-recordgolden"))
+    {
+        golden_file = fopen(golden_name, "w");
+        if (!golden_file)
+        {
+            I_Error("S_MusicBench: can't write %s", golden_name);
+        }
+    }
+    else
+    {
+        golden_file = fopen(golden_name, "r");
+        if (!golden_file)
+        {
+            I_Error("S_MusicBench: can't read %s (use -recordgolden to create it)", golden_name);
+        }
+        while (golden_count < NUMMUSIC && fscanf(golden_file, "%8s %x %u", golden[golden_count].name,
+                                                 &golden[golden_count].hash, &golden[golden_count].samples) == 3)
+        {
+            golden_count++;
+        }
+        fclose(golden_file);
+        golden_file = NULL;
+    }
+
+    for (int i = mus_None + 1; i < NUMMUSIC; i++)
+    {
+        char namebuf[9];
+        M_snprintf(namebuf, sizeof(namebuf), "d_%s", DEH_String(S_music[i].name));
+        lumpindex_t lumpnum = W_CheckNumForName(namebuf);
+        if (lumpnum < 0) continue;
+
+        // I_StopSong only keys the notes off, so without a reset the release tails and register state of one track
+        // would leak into the next
+        I_ResetMusic();
+        // the hashes must not depend on the configured volume
+        I_SetMusicVolume(127);
+
+        void *handle = I_RegisterSong(W_CacheLumpNum(lumpnum, PU_STATIC), W_LumpLength(lumpnum));
+        I_PlaySong(handle, false);
+        uint32_t hash = 0x811c9dc5; // FNV-1a
+        uint32_t sample_count = 0;
+        uint64_t t0 = time_us_64();
+        bool playing;
+        do
+        {
+            playing = OPL_Pico_RenderOffline(samples, MUSIC_BENCH_SAMPLES);
+            for (int s = 0; s < MUSIC_BENCH_SAMPLES * 2; s++)
+            {
+                hash = (hash ^ (uint16_t)samples[s]) * 0x01000193;
+            }
+            sample_count += MUSIC_BENCH_SAMPLES;
+        } while (playing && sample_count < MUSIC_BENCH_MAX_SAMPLES);
+        uint64_t us = time_us_64() - t0;
+        I_StopSong();
+        I_UnRegisterSong(handle);
+        W_ReleaseLumpNum(lumpnum);
+
+        total_samples += sample_count;
+        total_us += us;
+        float seconds = sample_count / (float)PICO_SOUND_SAMPLE_FREQ;
+        const char *result = "recorded";
+        if (golden_file)
+        {
+            fprintf(golden_file, "%s %08x %u\n", namebuf, hash, sample_count);
+        }
+        else
+        {
+            result = "MISSING";
+            for (int g = 0; g < golden_count; g++)
+            {
+                if (!strcasecmp(golden[g].name, namebuf))
+                {
+                    result = golden[g].hash == hash && golden[g].samples == sample_count ? "ok" : "MISMATCH";
+                    break;
+                }
+            }
+            if (strcmp(result, "ok")) mismatches++;
+        }
+        printf("%-8s %7.2fs hash %08x %6.1fx realtime %s\n", namebuf, seconds, hash,
+               us ? seconds * 1000000.0f / us : 0.0f, result);
+    }
+    if (total_us)
+    {
+        printf("total %.2fs of music at %.1fx realtime (%.1f%% of a core)\n", total_samples / (float)PICO_SOUND_SAMPLE_FREQ,
+               total_samples * 1000000.0f / PICO_SOUND_SAMPLE_FREQ / total_us,
+               total_us * 100.0f * PICO_SOUND_SAMPLE_FREQ / 1000000.0f / total_samples);
+    }
+    if (golden_file)
+    {
+        fclose(golden_file);
+        printf("wrote golden hashes to %s\n", golden_name);
+    }
+    else if (mismatches)
+    {
+        printf("%d tracks differ from %s (use -recordgolden after an intended change in output)\n", mismatches,
+               golden_name);
+        exit(1);
+    }
+    exit(0);
+}
+#endif
+
+#if PD_SFX_BENCH
+#include "pico/time.h"
+#include "i_picosound.h"
+
+// the same as the audio producer's buffers
+#define SFX_BENCH_SAMPLES 1024
+
+// headless benchmark of the sfx mixer: plays every sfx in the WAD, keeping all of the mixer's channels busy with varying
+// separation, and reports the cost of mixing each audio buffer along with a hash of the output to compare between builds
+void S_SfxBench(void)
+{
+    static int16_t samples[SFX_BENCH_SAMPLES * 2];
+    int next_sfx = 1;
+    uint32_t hash = 0x811c9dc5; // FNV-1a
+    uint32_t buffers = 0, max_us = 0;
+    uint64_t total_us = 0;
+    bool playing;
+
+    do
+    {
+        for (int ch = 0; ch < NUM_SOUND_CHANNELS && next_sfx < NUMSFX; ch++)
+        {
+            if (I_SoundIsPlaying(ch)) continue;
+            while (next_sfx < NUMSFX)
+            {
+                should_be_const sfxinfo_t *sfx = &S_sfx[next_sfx++];
+                char namebuf[9];
+                M_snprintf(namebuf, sizeof(namebuf), "ds%s", DEH_String(sfx->link ? sfx->link->name : sfx->name));
+                lumpindex_t lumpnum = W_CheckNumForName(namebuf);
+                if (lumpnum < 0) continue;
+                sfx_mut(sfx)->lumpnum = lumpnum;
+                I_StartSound(sfx, ch, 127, (ch * 254) / (NUM_SOUND_CHANNELS - 1), NORM_PITCH);
+                break;
+            }
+        }
+        uint64_t t0 = time_us_64();
+        playing = I_PicoSoundMixSfxOffline(samples, SFX_BENCH_SAMPLES);
+        uint32_t us = (uint32_t)(time_us_64() - t0);
+        total_us += us;
+        max_us = MAX(max_us, us);
+        buffers++;
+        for (int s = 0; s < SFX_BENCH_SAMPLES * 2; s++)
+        {
+            hash = (hash ^ (uint16_t)samples[s]) * 0x01000193;
+        }
+    } while (playing || next_sfx < NUMSFX);
+
+    float buffer_us = SFX_BENCH_SAMPLES * 1000000.0f / PICO_SOUND_SAMPLE_FREQ;
+    printf("%u buffers of %d samples: %.1fus average, %uus max per buffer (%.2f%% of a core) hash %08x\n",
+           buffers, SFX_BENCH_SAMPLES, total_us / (float)buffers, max_us,
+           total_us * 100.0f / (buffer_us * buffers), hash);
+    exit(0);
+}
+#endif
+
 #if 1
 void test_next_sound() {
     static int snd_idx = 0;
@@ -84,6 +84,15 @@ void S_ResumeSound(void);
 void S_UpdateSounds(mobj_t *listener);
 
 void S_SetMusicVolume(int volume);
+
+#if PD_MUSIC_BENCH
+// render every music lump offline, checking against golden hashes; never returns
+void S_MusicBench(void);
+#endif
+#if PD_SFX_BENCH
+// mix every sfx offline, reporting the mixing cost per audio buffer; never returns
+void S_SfxBench(void);
+#endif
 void S_SetSfxVolume(int volume);
 
 extern int snd_channels;
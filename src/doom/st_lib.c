@@ -71,6 +71,7 @@ STlib_initNum
     n->oldnum	= 0;
 #else
     n->cached = 9999;
+    n->span.serial = 0;
 #endif
     n->width	= width;
     n->num	= num;
@@ -93,8 +94,10 @@ STlib_drawNum
     int		numdigits = n->width;
     int		num = *n->num;
 
-    int		w = vpatch_width(resolve_vpatch_handle(vpatch_n(n->p, 0)));
+    int		w;
+#if !DOOM_TINY
     int		h = vpatch_height(resolve_vpatch_handle(vpatch_n(n->p, 0)));
+#endif
     int		x = n->x;
     
     int		neg;
@@ -107,6 +110,12 @@ STlib_drawNum
     else num = n->cached;
 #endif
 
+#if DOOM_TINY
+    // the digits only change when the number does, so we can reuse last frame's entries
+    if (V_ReusePatchSpan(&n->span, num))
+        return;
+#endif
+    w = vpatch_width(resolve_vpatch_handle(vpatch_n(n->p, 0)));
     neg = num < 0;
 
     if (neg)
@@ -131,7 +140,12 @@ STlib_drawNum
 
     // if non-number, do not draw it
     if (num == 1994)
+    {
+#if DOOM_TINY
+        V_EndPatchSpan(&n->span);
+#endif
 	return;
+    }
 
     x = n->x;
 
@@ -150,6 +164,9 @@ STlib_drawNum
     // draw a minus sign if necessary
     if (neg)
 	V_DrawPatch(x - 8, n->y, sttminus);
+#if DOOM_TINY
+    V_EndPatchSpan(&n->span);
+#endif
 }
 
 
@@ -214,6 +231,7 @@ STlib_initMultIcon
     i->oldinum 	= -1;
 #else
     i->cached = -1;
+    i->span.serial = 0;
 #endif
     i->inum	= inum;
     i->on	= on;
@@ -257,8 +275,10 @@ STlib_updateMultIcon
     // stbar wipe support - we need to be able to redraw and old status bar value
     if (refresh || mi->cached==-1) mi->cached = (int8_t)*mi->inum;
     else inum = mi->cached;
-    if (*mi->on && inum!=-1)
+    if (*mi->on && inum!=-1 && !V_ReusePatchSpan(&mi->span, inum)) {
         V_DrawPatch(mi->x, mi->y, mi->p[inum]);
+        V_EndPatchSpan(&mi->span);
+    }
 #endif
 }
 
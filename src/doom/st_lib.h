@@ -23,6 +23,9 @@
 
 // We are referring to patches.
 #include "r_defs.h"
+#if DOOM_TINY
+#include "v_video.h"
+#endif
 
 //
 // Typedefs of widgets
@@ -55,6 +58,8 @@ typedef struct
     vpatch_sequence_t p;
 #if DOOM_TINY
     int16_t cached;
+    // patch list entries from the last draw, reused while the number is unchanged
+    vpatchspan_t span;
 #endif
 #if !DOOM_TINY
     // user data
@@ -103,6 +108,8 @@ typedef struct
 
 #if DOOM_TINY
     int8_t cached;
+    // patch list entries from the last draw, reused while the icon is unchanged
+    vpatchspan_t span;
 #endif
 #if !DOOM_TINY
     // user data
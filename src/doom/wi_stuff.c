@@ -1623,9 +1623,6 @@ void WI_Ticker(void)
 	WI_updateNoState();
 	break;
     }
-#if PICO_ON_DEVICE
-    I_UpdateSound();
-#endif
 }
 
 typedef void (*load_callback_t)(vpatchname_t lumpname, vpatch_handle_small_t *variable);
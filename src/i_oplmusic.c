@@ -683,6 +683,8 @@ static void I_OPL_SetMusicVolume(int volume)
         return;
     }
 
+    OPL_Lock();
+
     // Internal state variable.
 
     current_music_volume = volume;
@@ -700,6 +702,8 @@ static void I_OPL_SetMusicVolume(int volume)
             SetChannelVolume(&channels[i], channels[i].volume_base, false);
         }
     }
+
+    OPL_Unlock();
 }
 
 static void VoiceKeyOff(opl_voice_t *voice)
@@ -1540,6 +1544,8 @@ static void I_OPL_PlaySong(void *handle, boolean looping)
 
     file = handle;
 
+    OPL_Lock();
+
     // Allocate track data.
 
     tracks = malloc(MIDI_NumTracks(file) * sizeof(opl_track_data_t));
@@ -1572,6 +1578,8 @@ static void I_OPL_PlaySong(void *handle, boolean looping)
     // behavior of the DMX library, and some of the higher-level code in
     // s_sound.c relies on this.
     OPL_SetPaused(0);
+
+    OPL_Unlock();
 }
 
 static void I_OPL_PauseSong(void)
@@ -1583,6 +1591,8 @@ static void I_OPL_PauseSong(void)
         return;
     }
 
+    OPL_Lock();
+
     // Pause OPL callbacks.
 
     OPL_SetPaused(1);
@@ -1598,6 +1608,8 @@ static void I_OPL_PauseSong(void)
             VoiceKeyOff(&voices[i]);
         }
     }
+
+    OPL_Unlock();
 }
 
 static void I_OPL_ResumeSong(void)
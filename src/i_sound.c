@@ -30,6 +30,7 @@
 
 #include "gusconf.h"
 #include "i_sound.h"
+#include "i_system.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
@@ -445,6 +446,22 @@ void I_ShutdownMusic(void)
 
 }
 
+#if PD_MUSIC_BENCH
+// shut down and re-initialize the music module, so that the next song starts from a freshly reset OPL chip rather
+// than inheriting the register state and release tails of the previous one
+void I_ResetMusic(void)
+{
+    if (music_module != NULL)
+    {
+        music_module->Shutdown();
+        if (!music_module->Init())
+        {
+            I_Error("I_ResetMusic: music module failed to re-initialize");
+        }
+    }
+}
+#endif
+
 void I_SetMusicVolume(int volume)
 {
     if (active_music_module != NULL)
@@ -250,6 +250,9 @@ typedef struct
 
 void I_InitMusic(void);
 void I_ShutdownMusic(void);
+#if PD_MUSIC_BENCH
+void I_ResetMusic(void);
+#endif
 void I_SetMusicVolume(int volume);
 void I_PauseSong(void);
 void I_ResumeSong(void);
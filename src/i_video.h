@@ -130,6 +130,7 @@ enum {
 extern uint8_t next_video_type;
 extern uint8_t next_frame_index; // next frame_index to be picked up by the diplsau
 extern uint8_t next_overlay_index;
+extern uint8_t next_overlay_sequence; // incremented for each overlay list rendered
 #if !DEMO1_ONLY
 extern uint8_t *next_video_scroll;
 #endif
@@ -12,7 +12,6 @@
 #include "hardware/gpio.h"
 #include "pico/divider.h"
 #include "image_decoder.h"
-#include <set>
 extern "C" {
 #include "doom/d_main.h"
 #include "doom/r_data.h"
@@ -36,6 +35,8 @@ extern "C" {
 #if !PICO_FRANTIC_GREYSCALE
 #if PICO_ON_DEVICE
 #define USE_CORE1_FOR_FLATS 1
+// core1 decodes flats we expect to need into the flat cache while it waits for core0 to finish the BSP walk
+#define USE_CORE1_FOR_FLAT_PREFETCH 1
 #endif
 #define USE_CORE1_FOR_REGULAR 1
 #define MULTICORE_RENDERING 1
@@ -50,8 +51,7 @@ extern "C" {
 //#define DEBUG_DECODER 1
 //#define DEBUG_DECODER_BUFFERS 1
 //#define DEBUG_COMPOSITE 1
-// we wake up core1 during rendering whole rendering part of game loop.. during
-// this time it can do sound updates (since the main core is clearly not)
+// we wake up core1 during rendering whole rendering part of game loop
 #if MULTICORE_RENDERING
 semaphore_t core1_wake, core0_done, core1_done;
 #endif
@@ -68,7 +68,6 @@ static int16_t sub_gamestate;
 // todo look at using scratch RAM for local linked lists/buffers (we sort of have this with stack)
 
 CU_REGISTER_DEBUG_PINS(flat_decode, patch_decode, full_render, render_thing, render_flat, start_end)
-extern uint8_t restart_song_state;
 
 //CU_SELECT_DEBUG_PINS(patch_decode)
 //CU_SELECT_DEBUG_PINS(render_thing)
@@ -77,10 +76,234 @@ extern uint8_t restart_song_state;
 
 #if !PICO_ON_DEVICE
 #include "../whd_gen/statsomizer.h"
+#endif
 
-std::set<int> textures, patches;
-statsomizer tex_count("texcount"), patch_count("patchcount");
-statsomizer patch_decoder_size("patch decoder size");
+#if PD_RENDER_INSTRUMENT
+// host only counts of what the renderer is fed, kept to fixed size bitsets and counters so they don't distort the
+// frame timings they are gathered alongside. categories are picked at runtime from a comma separated
+// $PD_RENDER_INSTRUMENT (e.g. "sources,columns" or "all"); with none picked each site costs one untaken branch
+#include <cstring>
+static_assert(!PICO_ON_DEVICE, "");
+static_assert(PD_FRAME_STATS, "PD_RENDER_INSTRUMENT is reported by pd_frame_stats_report()");
+enum {
+    PD_INSTRUMENT_SOURCES = 1,  // distinct textures and patches drawn from each frame
+    PD_INSTRUMENT_COLUMNS = 2,  // regular and masked columns (and the pixels they cover) each frame
+    PD_INSTRUMENT_DECODERS = 4, // size of each patch decoder built
+};
+static unsigned int pd_instrument_categories;
+static struct {
+    // a bit per dc_source.real_id taken as a uint16_t, so textures are in the bottom half and patches in the top
+    uint32_t sources[65536 / 32];
+    int columns, column_pixels;
+    int masked_columns, masked_pixels;
+    // patch decoders built: bucket n counts those of 2^(n-1) to 2^n - 1 hwords
+    int decoder_buckets[17];
+    int decoder_min_hwords, decoder_max_hwords;
+    long decoder_hwords;
+} pd_instrument;
+static statsomizer pd_instrument_texture_stats("unique textures", true);
+static statsomizer pd_instrument_patch_stats("unique patches", true);
+static statsomizer pd_instrument_column_stats("regular columns", true);
+static statsomizer pd_instrument_column_pixel_stats("regular pixels", true);
+static statsomizer pd_instrument_masked_stats("masked columns", true);
+static statsomizer pd_instrument_masked_pixel_stats("masked pixels", true);
+
+static void pd_instrument_init() {
+    static const struct {
+        const char *name;
+        unsigned int categories;
+    } category_names[] = {
+            {"sources",  PD_INSTRUMENT_SOURCES},
+            {"columns",  PD_INSTRUMENT_COLUMNS},
+            {"decoders", PD_INSTRUMENT_DECODERS},
+            {"all",      ~0u},
+    };
+    const char *env = getenv("PD_RENDER_INSTRUMENT");
+    if (!env) return;
+    char *list = strdup(env);
+    for (char *name = strtok(list, ","); name; name = strtok(nullptr, ",")) {
+        unsigned int i;
+        for (i = 0; i < count_of(category_names) && strcmp(name, category_names[i].name); i++);
+        if (i < count_of(category_names)) {
+            pd_instrument_categories |= category_names[i].categories;
+        } else {
+            printf("PD_RENDER_INSTRUMENT: unknown category '%s'\n", name);
+        }
+    }
+    free(list);
+}
+
+static inline void pd_instrument_source(int real_id) {
+    uint16_t bit = (uint16_t)real_id;
+    pd_instrument.sources[bit >> 5] |= 1u << (bit & 31u);
+}
+
+// called for every decoder built, so kept to plain counters (no statsomizer lock or sample vector)
+static void pd_instrument_decoder(int hwords) {
+    int bucket = hwords ? 32 - __builtin_clz((unsigned int)hwords) : 0;
+    pd_instrument.decoder_buckets[std::min(bucket, (int)count_of(pd_instrument.decoder_buckets) - 1)]++;
+    if (!pd_instrument.decoder_hwords || hwords < pd_instrument.decoder_min_hwords) pd_instrument.decoder_min_hwords = hwords;
+    pd_instrument.decoder_max_hwords = std::max(pd_instrument.decoder_max_hwords, hwords);
+    pd_instrument.decoder_hwords += hwords;
+}
+
+static void pd_instrument_end_frame() {
+    if (pd_instrument_categories & PD_INSTRUMENT_SOURCES) {
+        int textures = 0, patches = 0;
+        for (unsigned int i = 0; i < count_of(pd_instrument.sources) / 2; i++) {
+            textures += __builtin_popcount(pd_instrument.sources[i]);
+            patches += __builtin_popcount(pd_instrument.sources[i + count_of(pd_instrument.sources) / 2]);
+        }
+        pd_instrument_texture_stats.record(textures);
+        pd_instrument_patch_stats.record(patches);
+        memset(pd_instrument.sources, 0, sizeof(pd_instrument.sources));
+    }
+    if (pd_instrument_categories & PD_INSTRUMENT_COLUMNS) {
+        pd_instrument_column_stats.record(pd_instrument.columns);
+        pd_instrument_column_pixel_stats.record(pd_instrument.column_pixels);
+        pd_instrument_masked_stats.record(pd_instrument.masked_columns);
+        pd_instrument_masked_pixel_stats.record(pd_instrument.masked_pixels);
+        pd_instrument.columns = pd_instrument.column_pixels = 0;
+        pd_instrument.masked_columns = pd_instrument.masked_pixels = 0;
+    }
+}
+
+static void pd_instrument_report() {
+    if (!pd_instrument_categories) return;
+    printf("pd_render instrumentation:\n");
+    if (pd_instrument_categories & PD_INSTRUMENT_SOURCES) {
+        pd_instrument_texture_stats.print_summary();
+        pd_instrument_patch_stats.print_summary();
+    }
+    if (pd_instrument_categories & PD_INSTRUMENT_COLUMNS) {
+        pd_instrument_column_stats.print_summary();
+        pd_instrument_column_pixel_stats.print_summary();
+        pd_instrument_masked_stats.print_summary();
+        pd_instrument_masked_pixel_stats.print_summary();
+    }
+    if (pd_instrument_categories & PD_INSTRUMENT_DECODERS) {
+        int count = 0;
+        for (int n : pd_instrument.decoder_buckets) count += n;
+        printf("%20s: min=%d max=%d avg=%d count=%d total=%ld\n", "patch decoder hwords", pd_instrument.decoder_min_hwords,
+               pd_instrument.decoder_max_hwords, count ? (int) (pd_instrument.decoder_hwords / count) : 0, count,
+               pd_instrument.decoder_hwords);
+        for (unsigned int i = 0; i < count_of(pd_instrument.decoder_buckets); i++) {
+            if (pd_instrument.decoder_buckets[i]) {
+                printf("%20s  %5d-%-5d: %d\n", "", i ? 1 << (i - 1) : 0, (1 << i) - 1, pd_instrument.decoder_buckets[i]);
+            }
+        }
+    }
+}
+#define PD_INSTRUMENT(category, statement) do { if (pd_instrument_categories & (category)) { statement; } } while (0)
+#else
+#define PD_INSTRUMENT(category, statement) ((void)0)
+#endif
+
+#if PD_FRAME_STATS
+// host only per frame timing of the render pipeline phases; each frame is written as a CSV row (so two builds can be
+// diffed) and pd_frame_stats_report() prints the min/max/p50/p99 summary at the end of the run
+#include <chrono>
+static_assert(!PICO_ON_DEVICE, "");
+enum pd_frame_phase {
+    PD_PHASE_INSERT,       // pd_begin_frame -> pd_end_frame (BSP, column insert/clip)
+    PD_PHASE_PREDRAW,      // fuzz reclip, flat cache setup, predraw_visplanes
+    PD_PHASE_VISPLANES,    // draw_visplanes
+    PD_PHASE_REGULAR,      // re_sort_regular_columns_by_fd_num, draw_regular_columns
+    PD_PHASE_FUZZ,         // draw_fuzz_columns
+    PD_PHASE_OVERLAYS,     // status bar, hud, menu etc.
+    PD_PHASE_COUNT
+};
+static statsomizer pd_phase_stats[PD_PHASE_COUNT] = {
+        statsomizer("insert ns", true),
+        statsomizer("predraw_visplanes ns", true),
+        statsomizer("draw_visplanes ns", true),
+        statsomizer("draw_regular ns", true),
+        statsomizer("draw_fuzz ns", true),
+        statsomizer("overlays ns", true),
+};
+static statsomizer pd_frame_time_stats("frame ns", true);
+static statsomizer pd_column_stats("columns", true);
+static statsomizer pd_visplane_stats("visplanes", true);
+static statsomizer pd_flat_decode_stats("flat decodes", true);
+static statsomizer pd_patch_decoder_stats("patch decoder builds", true);
+static statsomizer pd_patch_decoder_hit_stats("patch decoder hits", true);
+static std::chrono::steady_clock::time_point pd_phase_t0;
+static int pd_phase_ns[PD_PHASE_COUNT];
+static int pd_frame_flat_decodes;
+static int pd_frame_patch_decoder_builds;
+static int pd_frame_patch_decoder_hits;
+static FILE *pd_frame_stats_csv;
+
+static void pd_frame_stats_phase_end(pd_frame_phase phase) {
+    auto now = std::chrono::steady_clock::now();
+    pd_phase_ns[phase] = (int)std::chrono::duration_cast<std::chrono::nanoseconds>(now - pd_phase_t0).count();
+    pd_phase_t0 = now;
+}
+
+static void pd_frame_stats_init() {
+    const char *name = getenv("PD_FRAME_STATS_CSV");
+    pd_frame_stats_csv = fopen(name ? name : "pd_frame_stats.csv", "w");
+    if (pd_frame_stats_csv) {
+        fprintf(pd_frame_stats_csv, "frame,gametic,insert_ns,predraw_visplanes_ns,draw_visplanes_ns,draw_regular_ns,"
+                                    "draw_fuzz_ns,overlays_ns,total_ns,columns,visplanes,flat_decodes,patch_decoder_builds,"
+                                    "patch_decoder_hits\n");
+    }
+}
+
+static void pd_frame_stats_end_frame(int columns, int numvisplanes) {
+    int total = 0;
+    for (int i = 0; i < PD_PHASE_COUNT; i++) {
+        pd_phase_stats[i].record(pd_phase_ns[i]);
+        total += pd_phase_ns[i];
+    }
+    pd_frame_time_stats.record(total);
+    pd_column_stats.record(columns);
+    pd_visplane_stats.record(numvisplanes);
+    pd_flat_decode_stats.record(pd_frame_flat_decodes);
+    pd_patch_decoder_stats.record(pd_frame_patch_decoder_builds);
+    pd_patch_decoder_hit_stats.record(pd_frame_patch_decoder_hits);
+    if (pd_frame_stats_csv) {
+        fprintf(pd_frame_stats_csv, "%d,%d", pd_frame, gametic);
+        for (int i = 0; i < PD_PHASE_COUNT; i++) {
+            fprintf(pd_frame_stats_csv, ",%d", pd_phase_ns[i]);
+        }
+        fprintf(pd_frame_stats_csv, ",%d,%d,%d,%d,%d,%d\n", total, columns, numvisplanes, pd_frame_flat_decodes,
+                pd_frame_patch_decoder_builds, pd_frame_patch_decoder_hits);
+    }
+    pd_frame_flat_decodes = pd_frame_patch_decoder_builds = pd_frame_patch_decoder_hits = 0;
+}
+
+extern "C" void pd_frame_stats_report() {
+    printf("pd_render frame stats over %d frames:\n", pd_frame_time_stats.count);
+    for (auto &s : pd_phase_stats) s.print_summary();
+    pd_frame_time_stats.print_summary();
+    pd_column_stats.print_summary();
+    pd_visplane_stats.print_summary();
+    pd_flat_decode_stats.print_summary();
+    pd_patch_decoder_stats.print_summary();
+    pd_patch_decoder_hit_stats.print_summary();
+    const pd_render_stats_t *rs = pd_get_render_stats();
+    printf("high water: columns=%d flat slots min=%d patch decoder hwords=%d; dropped sprite columns=%d other columns=%d in %d frames\n",
+           rs->max_columns, rs->min_flat_slots, rs->max_patch_decoder_hwords,
+           (int)rs->dropped_sprite_columns, (int)rs->dropped_columns, (int)rs->uncovered_frames);
+    printf("patch decoder cache: hits=%d misses=%d evictions=%d retained=%d (%d hwords moved)\n",
+           (int)rs->patch_decoder_hits, (int)rs->patch_decoder_misses, (int)rs->patch_decoder_evictions,
+           (int)rs->patch_decoder_retained, (int)rs->patch_decoder_retained_hwords);
+    printf("flat cache: decodes=%d prefetches=%d prefetch hits=%d\n", (int)rs->flat_decodes,
+           (int)rs->flat_prefetches, (int)rs->flat_prefetch_hits);
+#if PD_RENDER_INSTRUMENT
+    pd_instrument_report();
+#endif
+    if (pd_frame_stats_csv) {
+        fclose(pd_frame_stats_csv);
+        pd_frame_stats_csv = nullptr;
+    }
+}
+#define PD_STATS_PHASE_END(phase) pd_frame_stats_phase_end(phase)
+#define PD_STATS_INCREMENT(counter) (counter++)
+#else
+#define PD_STATS_PHASE_END(phase) ((void)0)
+#define PD_STATS_INCREMENT(counter) ((void)0)
 #endif
 
 #if PICO_ON_DEVICE
@@ -96,7 +319,6 @@ extern "C" {
 #include "w_wad.h"
 #include "z_zone.h"
 #include "doom/r_plane.h"
-void I_UpdateSound(void);
 }
 void draw_cast_sprite(int sprite_lump);
 #pragma GCC push_options
@@ -109,8 +331,10 @@ static uint8_t post_wipecount;
 
 // todo these are only needed temporarily, so stack or "tmp buffer"
 static uint16_t flat_decoder_buf[WHD_FLAT_DECODER_MAX_SIZE];
-static uint8_t flat_decoder_tmp[WHD_FLAT_DECODER_MAX_SIZE];
-#define PATCH_DECODER_HASH_SIZE 128
+static uint8_t __aligned(4) flat_decoder_tmp[WHD_FLAT_DECODER_MAX_SIZE]; // also used for the symbol table
+static_assert(WHD_FLAT_DECODER_MAX_SIZE >= 256 * sizeof(uint16_t), "");
+#define PATCH_DECODER_HASH_BITS 7
+#define PATCH_DECODER_HASH_SIZE (1u << PATCH_DECODER_HASH_BITS)
 static_assert(__builtin_popcount(PATCH_DECODER_HASH_SIZE)==1, "");
 static int16_t patch_hash_offsets[PATCH_DECODER_HASH_SIZE];
 #define PATCH_DECODER_CIRCULAR_BUFFER_SIZE (2048-256)
@@ -186,9 +410,6 @@ static uint8_t render_overlay_index;
 static_assert(NO_USE_DC_COLORMAP, "");
 static_assert(USE_ROWAD, ""); // don't want things moving!
 
-#define SHOW_COLUMN_STATS 0
-#define SHOW_COSTLY_DATA_STATS 0
-
 // we always want to collapse range of iscale and dda
 #define SHIFT 7
 #define DOWN_SHIFT(x) ((x) >> SHIFT) // only used for texturemid
@@ -274,18 +495,6 @@ static_assert(sizeof(pd_column) == sizeof(flat_run) * 2, ""); // we pack two int
 static __aligned(4) int16_t column_heads[SCREENWIDTH * 2];
 #define fuzzy_column_heads (&column_heads[SCREENWIDTH])
 
-static void SafeUpdateSound() {
-    boolean save = false;
-    if (get_core_num()) {
-        save = interp_in_use;
-        // setting this causes the scanline code to save/restore the interp settings
-        interp_in_use = true;
-    }
-    I_UpdateSound();
-    if (get_core_num()) {
-        interp_in_use = save;
-    }
-}
 
 static bool column_is_psprite(const pd_column &c) {
     return c.scale == 0;
@@ -330,21 +539,59 @@ static uint8_t __aligned(4) list_buffer[RENDER_COL_MAX * sizeof(pd_column) + 64*
 static uint8_t *last_list_buffer_limit = list_buffer + sizeof(list_buffer);
 //static_assert(text_font_cpy > list_buffer, "");
 #define MAX_CACHED_FLATS (sizeof(list_buffer) / 4096)
+// flat cache slots are addressed downwards from cached_flat0 (the top of the space left over after the columns), and
+// persist from frame to frame (and across wipes) until overwritten by columns or the work area
 static uint8_t cached_flat_picnum[MAX_CACHED_FLATS];
+// (low 8 bits of) the frame number each slot was last used in, for LRU replacement
+static uint8_t cached_flat_used[MAX_CACHED_FLATS];
 static uint8_t cached_flat_slots;
 static uint8_t *cached_flat0;
+#if USE_CORE1_FOR_FLAT_PREFETCH
+static_assert(MAX_CACHED_FLATS <= 32, "");
+// slots which were filled by prefetch and haven't been used yet
+static uint32_t cached_flat_prefetched;
+#define MAX_PREFETCH_FLATS 8
+static uint8_t flat_prefetch_picnums[MAX_PREFETCH_FLATS];
+static uint8_t flat_prefetch_count;
+// set by core0 to stop core1 starting another prefetch (and core0 then waits for core1 to no longer be busy)
+static volatile bool flat_prefetch_stop;
+static volatile bool flat_prefetch_busy;
+// core0 must not allocate a column at or beyond this index while core1 is decoding a flat into the slot above it
+static volatile int16_t flat_prefetch_fence = INT16_MAX;
+// core1 only starts a prefetch if core0 is at least this many columns below the fence
+#define FLAT_PREFETCH_FENCE_MARGIN 64
+static void predict_flats();
+#endif
 static int16_t render_col_count;
 #define render_cols ((pd_column *)list_buffer)
 #define flat_runs ((flat_run *)list_buffer)
 static int16_t render_col_free;
+// the column budget for this frame (we mustn't squeeze the flat cache below one slot)
+static int16_t render_col_limit = RENDER_COL_MAX;
+// walls and sprites are inserted interleaved during the BSP walk, so the number of wall columns still expected this
+// frame (predicted from the last one) is held back from sprites; running out of columns for walls leaves black gaps
+static int16_t render_wall_col_reserve;
+static int16_t render_wall_col_count;
+// minimum wall reserve, and the extra reserve after a frame which ran out of columns
+#define RENDER_COL_RESERVE (SCREENWIDTH * 2)
+// sprites with a smaller scale than this count as distant
+#define DISTANT_SPRITE_SCALE (FRACUNIT / 4)
+static pd_render_stats_t render_stats;
+static uint16_t patch_decoder_hwords_in_use;
 
 static int16_t alloc_pd_column(int x) {
     if (render_col_free < 0) {
-        if (render_col_count == RENDER_COL_MAX) {
+        if (render_col_count >= render_col_limit) {
             assert(x>=0 && x<SCREENWIDTH);
             not_fully_covered_cols[x/(4*32)] |= 1u << ((x/4)&31);
+            render_stats.dropped_columns++;
             return -1;
         }
+#if USE_CORE1_FOR_FLAT_PREFETCH
+        while (render_col_count >= flat_prefetch_fence) {
+            tight_loop_contents(); // core1 is decoding a flat into the memory we want; it won't be long
+        }
+#endif
         render_col_free = render_col_count++;
         render_cols[render_col_free].next = -1;
     }
@@ -771,16 +1018,17 @@ void pd_begin_frame() {
     render_frame_buffer = nullptr;
 #if 0 && !PICO_ON_DEVICE
     printf("BEGIN FRAME %d rfb %p\n", render_frame_index, render_frame_buffer);
+#endif
+    pd_frame++;
+#if USE_CORE1_FOR_FLAT_PREFETCH
+    predict_flats();
+    flat_prefetch_stop = false;
 #endif
 #if MULTICORE_RENDERING
     sem_release(&core1_wake);
 #endif
 
     reset_framedrawables();
-#if !PICO_ON_DEVICE
-    textures.clear();
-    patches.clear();
-#endif
 #if DUMP_SORTING
     if (0) printf("BEGIN FRAME\n");
 #endif
@@ -792,7 +1040,22 @@ void pd_begin_frame() {
     not_fully_covered_yh = SCREENHEIGHT - 1;
     render_col_count = 0;
     render_col_free = -1;
-    pd_frame++;
+    // the column budget is whatever is left of list_buffer after one flat slot, using the same limits as pd_end_frame
+    // (it is possible for wipestate to change before then, in which case pd_end_frame has to discard columns)
+    uint8_t *list_buffer_limit = list_buffer + count_of(list_buffer);
+    if (wipestate) list_buffer_limit -= 4096;
+    list_buffer_limit = std::min(list_buffer_limit, last_list_buffer_limit);
+    render_col_limit = (int16_t)std::min((int)RENDER_COL_MAX, (int)((list_buffer_limit - 4096 - list_buffer) / sizeof(pd_column)));
+    // reserve as many wall columns as the last frame used (more if it ran out of columns)
+    int wall_col_reserve = std::max((int)render_stats.wall_columns, RENDER_COL_RESERVE);
+    if (render_stats.column_limit && render_stats.columns >= render_stats.column_limit) {
+        wall_col_reserve += RENDER_COL_RESERVE;
+    }
+    render_wall_col_reserve = (int16_t)std::min(wall_col_reserve, (int)render_col_limit);
+    render_wall_col_count = 0;
+#if PD_FRAME_STATS
+    pd_phase_t0 = std::chrono::steady_clock::now();
+#endif
     DEBUG_PINS_CLR(start_end, 1);
 }
 
@@ -840,6 +1103,12 @@ void pd_init() {
 #endif
     memset(patch_hash_offsets, -1, sizeof(patch_hash_offsets));
     patch_decoder_circular_buf_write_limit = PATCH_DECODER_CIRCULAR_BUFFER_SIZE;
+#if PD_FRAME_STATS
+    pd_frame_stats_init();
+#endif
+#if PD_RENDER_INSTRUMENT
+    pd_instrument_init();
+#endif
 }
 
 void pd_add_span() {
@@ -878,6 +1147,7 @@ void pd_add_column(pd_column_type type) {
     // todo it would be nice to defer filling this in in case we are entirely clipped - let's get some stats on that
     int rc_index = alloc_pd_column(dc_x);
     if (rc_index < 0) return;
+    if (type != PDCOL_MASKED) render_wall_col_count++;
     render_cols[rc_index].yl = dc_yl;
     render_cols[rc_index].yh = dc_yh;
     assert(render_cols[rc_index].yl >= 0 && render_cols[rc_index].yl < SCREENHEIGHT && render_cols[rc_index].yh >= 0 && render_cols[rc_index].yh < SCREENHEIGHT);
@@ -902,59 +1172,30 @@ void pd_add_column(pd_column_type type) {
     render_cols[rc_index].fd_num = dc_source.fd_num;
     render_cols[rc_index].col_hi = TO_COL_HI(dc_source.col);
     render_cols[rc_index].col_lo = TO_COL_LO(dc_source.col);
-#if !PICO_ON_DEVICE
-    if (dc_source.real_id < 0) {
-        // patch
-        patches.insert(-dc_source.real_id);
-    } else {
-        assert(dc_source.real_id < numtextures);
-        textures.insert(dc_source.real_id);
-    }
-#endif
+    PD_INSTRUMENT(PD_INSTRUMENT_SOURCES, pd_instrument_source(dc_source.real_id));
+    PD_INSTRUMENT(PD_INSTRUMENT_COLUMNS, (pd_instrument.columns++, pd_instrument.column_pixels += count + 1));
     push_down_x(dc_x, rc_index);
+}
 
-#if SHOW_COLUMN_STATS
-    fixed_t frac;
-    fixed_t fracstep;
-
-    auto &p = unique_columns[dc_source];
-    column_count++;
-    // Framebuffer destination address.
-    // Use ylookup LUT to avoid multiply with ScreenWidth.
-    // Use columnofs LUT for subwindows?
-    //    dest = ylookup[dc_yl] + columnofs[dc_x];
-
-    // Determine scaling,
-    //  which is the only mapping to be done.
-    fracstep = dc_iscale;
-    fixed_t frac0 = frac = dc_texturemid + (dc_yl - centery) * fracstep;
-
-    // Inner loop that does the actual texture mapping,
-    //  e.g. a DDA-lile scaling.
-    // This is as fast as it gets.
-    do {
-#if SHOW_COSTLY_DATA_STATS
-        unique_column_source_pixels.insert(&dc_source[(frac >> FRACBITS) & 127]);
-#endif
-        frac += fracstep;
-    } while (count--);
-
-    if (frac < frac0) {
-        assert(false);
-        std::swap(frac, frac0);
-    }
-
-    if (p.first == 0 && p.second == 0) {
-        p.first = frac0;
-        p.second = frac;
-    } else {
-        p.first = std::min(p.first, frac0);
-        p.second = std::max(p.second, frac);
-    }
-#endif
+// decide whether to drop (rather than add) sprite columns because they would eat into the columns still reserved for
+// walls; a missing sprite column is less noticeable than a missing wall column
+static bool sprite_columns_over_budget(int seg_count) {
+    if (!(pd_flag & 1)) {
+        // only world sprites are dropped; masked mid textures are part of the walls, and the player sprites are always
+        // drawn
+        return false;
+    }
+    int reserve = std::max(0, render_wall_col_reserve - render_wall_col_count);
+    // nearer sprites may use half of the wall reserve, so distant ones go first
+    if (pd_scale >= DISTANT_SPRITE_SCALE) reserve /= 2;
+    return seg_count > render_col_limit - render_col_count - reserve;
 }
 
 void pd_add_masked_columns(uint8_t *ys, int seg_count) {
+    if (sprite_columns_over_budget(seg_count)) {
+        render_stats.dropped_sprite_columns += seg_count;
+        return;
+    }
     // --- VALIDATION AND CLAMPING
     fixed_t iscale;
 #if FORCE_ISCALE
@@ -1003,15 +1244,8 @@ void pd_add_masked_columns(uint8_t *ys, int seg_count) {
     render_cols[rc_index].fd_num = dc_source.fd_num;
     render_cols[rc_index].col_hi = TO_COL_HI(dc_source.col);
     render_cols[rc_index].col_lo = TO_COL_LO(dc_source.col);
-#if !PICO_ON_DEVICE
-    if (dc_source.real_id < 0) {
-        // patch
-        patches.insert(-dc_source.real_id);
-    } else {
-        assert(dc_source.real_id < numtextures);
-        textures.insert(dc_source.real_id);
-    }
-#endif
+    PD_INSTRUMENT(PD_INSTRUMENT_SOURCES, pd_instrument_source(dc_source.real_id));
+    PD_INSTRUMENT(PD_INSTRUMENT_COLUMNS, (pd_instrument.masked_columns++, pd_instrument.masked_pixels += ys[1] - ys[0] + 1));
     fixed_t texturemid = dc_texturemid - (ys[2] << FRACBITS);
     if (texturemid < MINI) texturemid = MINI;
     if (texturemid > MAXI) texturemid = MAXI;
@@ -1027,6 +1261,7 @@ void pd_add_masked_columns(uint8_t *ys, int seg_count) {
         render_cols[rc_index].yl = ys[i * 3];
         render_cols[rc_index].yh = ys[i * 3 + 1];
         assert(render_cols[rc_index].yl >= 0 && render_cols[rc_index].yl < SCREENHEIGHT && render_cols[rc_index].yh >= 0 && render_cols[rc_index].yh < SCREENHEIGHT);
+        PD_INSTRUMENT(PD_INSTRUMENT_COLUMNS, (pd_instrument.masked_columns++, pd_instrument.masked_pixels += ys[i * 3 + 1] - ys[i * 3] + 1));
         texturemid = dc_texturemid - (ys[i*3 + 2] << FRACBITS);
         if (texturemid < MINI) texturemid = MINI;
         if (texturemid > MAXI) texturemid = MAXI;
@@ -1038,46 +1273,6 @@ void pd_add_masked_columns(uint8_t *ys, int seg_count) {
     } else {
         push_down_x(dc_x, first_index);
     }
-
-#if SHOW_COLUMN_STATS
-    fixed_t frac;
-    fixed_t fracstep;
-
-    auto &p = unique_columns[dc_source];
-    column_count++;
-    // Framebuffer destination address.
-    // Use ylookup LUT to avoid multiply with ScreenWidth.
-    // Use columnofs LUT for subwindows?
-    //    dest = ylookup[dc_yl] + columnofs[dc_x];
-
-    // Determine scaling,
-    //  which is the only mapping to be done.
-    fracstep = dc_iscale;
-    fixed_t frac0 = frac = dc_texturemid + (dc_yl - centery) * fracstep;
-
-    // Inner loop that does the actual texture mapping,
-    //  e.g. a DDA-lile scaling.
-    // This is as fast as it gets.
-    do {
-#if SHOW_COSTLY_DATA_STATS
-        unique_column_source_pixels.insert(&dc_source[(frac >> FRACBITS) & 127]);
-#endif
-        frac += fracstep;
-    } while (count--);
-
-    if (frac < frac0) {
-        assert(false);
-        std::swap(frac, frac0);
-    }
-
-    if (p.first == 0 && p.second == 0) {
-        p.first = frac0;
-        p.second = frac;
-    } else {
-        p.first = std::min(p.first, frac0);
-        p.second = std::max(p.second, frac);
-    }
-#endif
 }
 
 static int lightlevel(int visplane) {
@@ -1210,6 +1405,7 @@ static int translate_picnum(int picnum) {
 static uint8_t *decode_flat_to_slot(int cache_slot, int picnum) {
     uint8_t *flat_data = cached_flat0 - cache_slot * 4096;
     DEBUG_PINS_SET(flat_decode, 1);
+    PD_STATS_INCREMENT(pd_frame_flat_decodes);
     uint16_t *pos = flat_decoder_buf;
     uint pos_size = count_of(flat_decoder_buf);
     uint16_t *rp_decoder = flat_decoder_buf;
@@ -1230,13 +1426,28 @@ static uint8_t *decode_flat_to_slot(int cache_slot, int picnum) {
         pos = read_raw_pixels_decoder(&bi, pos, pos_size, flat_decoder_tmp, count_of(flat_decoder_tmp));
     }
     assert(pos < flat_decoder_buf + count_of(flat_decoder_buf));
-    th_make_prefix_length_table(rp_decoder, flat_decoder_tmp);
+    // flats with short codes (few colors) can decode two pixels at a time from a symbol table
+    bool use_symbol_table = th_use_symbol_table(rp_decoder);
+    const uint16_t *symbol_table = (const uint16_t *)flat_decoder_tmp;
+    if (use_symbol_table) {
+        th_make_symbol_table(rp_decoder, (uint16_t *)flat_decoder_tmp);
+    } else {
+        th_make_prefix_length_table(rp_decoder, flat_decoder_tmp);
+    }
     wait_for_input(100000);
     bool have_same = th_bit(&bi);
     if (!have_same) {
         uint8_t *p = flat_data;
-        for (int y = 0; y < 4096; y++) {
-            *p++ = th_decode_table_special(rp_decoder, flat_decoder_tmp, &bi);
+        if (use_symbol_table) {
+            for (int y = 0; y < 4096; y += 2) {
+                uint pixels = th_decode_symbol_table_2(symbol_table, &bi);
+                *p++ = (uint8_t)pixels;
+                *p++ = (uint8_t)(pixels >> 8);
+            }
+        } else {
+            for (int y = 0; y < 4096; y++) {
+                *p++ = th_decode_table_special(rp_decoder, flat_decoder_tmp, &bi);
+            }
         }
     } else {
         for (int x = 0; x < 64; x++) {
@@ -1249,6 +1460,12 @@ static uint8_t *decode_flat_to_slot(int cache_slot, int picnum) {
                 for (int i = 0; i < 16; i++) {
                     a[i] = b[i];
                 }
+            } else if (use_symbol_table) {
+                for (int y = 0; y < 64; y += 2) {
+                    uint pixels = th_decode_symbol_table_2(symbol_table, &bi);
+                    *p++ = (uint8_t)pixels;
+                    *p++ = (uint8_t)(pixels >> 8);
+                }
             } else {
                 for (int y = 0; y < 64; y++) {
                     *p++ = th_decode_table_special(rp_decoder, flat_decoder_tmp, &bi);
@@ -1259,10 +1476,120 @@ static uint8_t *decode_flat_to_slot(int cache_slot, int picnum) {
     }
 //                    printf("Pass %d, caching slot %d pic (%d)\n", pass, cache_slot, picnum);
     cached_flat_picnum[cache_slot] = picnum;
+    cached_flat_used[cache_slot] = (uint8_t)pd_frame;
+#if USE_CORE1_FOR_FLAT_PREFETCH
+    cached_flat_prefetched &= ~(1u << cache_slot);
+#endif
     DEBUG_PINS_CLR(flat_decode, 1);
     return flat_data;
 }
 
+static int find_cached_flat(int picnum, int slots) {
+    for (int cache_slot = 0; cache_slot < slots; cache_slot++) {
+        if (cached_flat_picnum[cache_slot] == picnum) {
+            return cache_slot;
+        }
+    }
+    return -1;
+}
+
+// returns the least recently used of the first slots slots, or -1 if none was last used at least min_age frames ago
+static int lru_flat_slot(int slots, int min_age) {
+    int lru_slot = -1;
+    int lru_age = min_age - 1;
+    for (int cache_slot = 0; cache_slot < slots; cache_slot++) {
+        // unused slots count as the oldest
+        int age = cached_flat_picnum[cache_slot] == 0xff ? 256 : (uint8_t)(pd_frame - cached_flat_used[cache_slot]);
+        if (age > lru_age) {
+            lru_age = age;
+            lru_slot = cache_slot;
+        }
+    }
+    return lru_slot;
+}
+
+static uint8_t *use_cached_flat(int cache_slot) {
+    cached_flat_used[cache_slot] = (uint8_t)pd_frame;
+#if USE_CORE1_FOR_FLAT_PREFETCH
+    if (cached_flat_prefetched & (1u << cache_slot)) {
+        cached_flat_prefetched &= ~(1u << cache_slot);
+        render_stats.flat_prefetch_hits++;
+    }
+#endif
+    return cached_flat0 - cache_slot * 4096;
+}
+
+#if USE_CORE1_FOR_FLAT_PREFETCH
+static void add_flat_prediction(int picnum) {
+    picnum = translate_picnum(picnum);
+    if (picnum == skyflatnum || flat_prefetch_count == MAX_PREFETCH_FLATS) return;
+    for (int i = 0; i < flat_prefetch_count; i++) {
+        if (flat_prefetch_picnums[i] == picnum) return;
+    }
+    flat_prefetch_picnums[flat_prefetch_count++] = picnum;
+}
+
+// called on core0 before waking core1; the flats of the sectors around the player are the ones likely to appear when
+// turning a corner or going through a door (last frame's visplane flats are still cached, and are protected by
+// the LRU from being replaced by these)
+static void predict_flats() {
+    flat_prefetch_count = 0;
+    if (gamestate != GS_LEVEL || !viewplayer || !viewplayer->mo || !cached_flat0) return;
+    sector_t *sec = mobj_sector(viewplayer->mo);
+    add_flat_prediction(sec->floorpic);
+    add_flat_prediction(sec->ceilingpic);
+    for (int i = 0; i < sec->linecount; i++) {
+        line_t *line = sector_line(sec, i);
+        if (!(line_flags(line) & ML_TWOSIDED)) continue;
+        sector_t *other = line_frontsector(line) == sec ? line_backsector(line) : line_frontsector(line);
+        add_flat_prediction(other->floorpic);
+        add_flat_prediction(other->ceilingpic);
+    }
+    // nearest first
+    std::reverse(flat_prefetch_picnums, flat_prefetch_picnums + flat_prefetch_count);
+}
+
+// called on core1 while waiting for core0 to finish the BSP walk; decodes at most one predicted flat
+static void prefetch_flat() {
+    flat_prefetch_busy = true;
+    __dmb();
+    while (flat_prefetch_count && !flat_prefetch_stop) {
+        int picnum = flat_prefetch_picnums[--flat_prefetch_count];
+        if (find_cached_flat(picnum, MAX_CACHED_FLATS) >= 0) continue;
+        // any slot above the columns will do, but don't replace anything used in the last frame
+        int cache_slot = lru_flat_slot((cached_flat0 - list_buffer) / 4096 + 1, 2);
+        if (cache_slot < 0) {
+            flat_prefetch_count = 0;
+            break;
+        }
+        uint8_t *flat_data = cached_flat0 - cache_slot * 4096;
+        flat_prefetch_fence = (int16_t)((flat_data - list_buffer) / sizeof(pd_column));
+        __dmb();
+        if (*(volatile int16_t *)&render_col_count + FLAT_PREFETCH_FENCE_MARGIN < flat_prefetch_fence) {
+            cached_flat_picnum[cache_slot] = 0xff;
+            decode_flat_to_slot(cache_slot, picnum);
+            cached_flat_used[cache_slot] = (uint8_t)(pd_frame - 1); // so it doesn't look like it was needed this frame
+            cached_flat_prefetched |= 1u << cache_slot;
+            render_stats.flat_prefetches++;
+        } else {
+            // core0 is already too close; it is likely using all the flat slots this frame
+            flat_prefetch_count = 0;
+        }
+        flat_prefetch_fence = INT16_MAX;
+        break;
+    }
+    flat_prefetch_busy = false;
+}
+
+static void stop_flat_prefetch() {
+    flat_prefetch_stop = true;
+    __dmb();
+    while (flat_prefetch_busy) {
+        tight_loop_contents();
+    }
+}
+#endif
+
 static void flush_visplanes(int8_t *flatnum_next, int numvisplanes) {
 //    printf("FRAME %d %d\n", pd_frame, numvisplanes);
     angle_t angle = (viewangle + x_to_viewangle(0)) >> ANGLETOFINESHIFT;
@@ -1274,7 +1601,6 @@ static void flush_visplanes(int8_t *flatnum_next, int numvisplanes) {
     viewsinangle = FixedMul(distscale0, viewsinangle);
 #endif
     // two passes; first pass we try to reuse flats we have decoded
-    int cache_slot = 0;
     for(int pass=0;pass<2;pass++) {
         for (int i = 0; i < numvisplanes; i++) {
             int picnum = translate_picnum(visplanes[i].picnum);
@@ -1289,32 +1615,21 @@ static void flush_visplanes(int8_t *flatnum_next, int numvisplanes) {
             }
             if (any) {
 #if PICO_ON_DEVICE
-                restart_song_state |= 1; // we may not restart a song during this call because it may blow the stack
-                SafeUpdateSound();
-                restart_song_state &= ~1;
                 interp_init();
 #endif
 #if 0
                 source = (const uint8_t *) W_CacheLumpNum(firstflat + picnum, PU_STATIC);
 #else
-                uint8_t *flat_data = nullptr;
+                uint8_t *flat_data;
                 if (!pass) {
-                    for(cache_slot=0;cache_slot<cached_flat_slots;cache_slot++) {
-                        if (cached_flat_picnum[cache_slot] == picnum) {
-//                            printf("Pass %d, using slot %d pic (%d)\n", pass, cache_slot, picnum);
-                            flat_data = cached_flat0 - cache_slot * 4096;
-                        }
-                    }
-                    if (!flat_data) continue;
+                    int cache_slot = find_cached_flat(picnum, cached_flat_slots);
+                    if (cache_slot < 0) continue;
+//                    printf("Pass %d, using slot %d pic (%d)\n", pass, cache_slot, picnum);
+                    flat_data = use_cached_flat(cache_slot);
                 } else {
-                    cache_slot++;
                     assert(cached_flat_slots);
-                    if (cache_slot >= cached_flat_slots) {
-                        cache_slot = 0;
-                    }
-                }
-                if (!flat_data) {
-                    flat_data = decode_flat_to_slot(cache_slot, picnum);
+                    flat_data = decode_flat_to_slot(lru_flat_slot(cached_flat_slots, 0), picnum);
+                    render_stats.flat_decodes++;
                 }
 #endif
                 DEBUG_PINS_SET(render_flat, 2);
@@ -1600,9 +1915,17 @@ static inline void col_render(uint8_t *dest, uint count, const uint8_t *source,
 struct patch_hash_entry_header {
     uint16_t patch_num;
     int16_t next;
-    uint16_t size:15;
+    uint16_t size:13;
     uint16_t encoding:1;
+    // saturating count of uses since the write position last came past; entries with uses are kept rather than
+    // evicted (a CLOCK style approximation of LRU which also favors frequently used decoders)
+    uint16_t uses:2;
 };
+#define PATCH_DECODER_MAX_USES 3
+// retaining a decoder means moving it to the write position; cap how much one miss may move, beyond which used
+// decoders are evicted like any other, so a miss can't stall for long copying the buffer round
+#define PATCH_DECODER_MAX_RETAINED_HWORDS 256
+static_assert(PATCH_DECODER_CIRCULAR_BUFFER_SIZE < (1u << 13), "");
 
 struct patch_decode_info {
     const patch_t *patch;
@@ -1616,8 +1939,41 @@ struct patch_decode_info {
 #define PATCH_HASH_ENTRY_HEADER_HWORDS 3
 static_assert(sizeof(struct patch_hash_entry_header)==2 * PATCH_HASH_ENTRY_HEADER_HWORDS, "");
 static inline int patch_hash(int patch_num) {
-    // todo better hash
-    return patch_num & (PATCH_DECODER_HASH_SIZE - 1);
+    // fibonacci hash (the patches of a texture or sprite frame have consecutive numbers, which we want spread out)
+    return ((uint16_t)(patch_num * 40503u)) >> (16 - PATCH_DECODER_HASH_BITS);
+}
+
+// find the hash chain link which points at the entry at offset
+static int16_t *patch_hash_link(uint16_t patch_num, int offset) {
+    int16_t *last = &patch_hash_offsets[patch_hash(patch_num)];
+    while (*last != -1 && *last != offset) {
+        last = &((patch_hash_entry_header *) (patch_decoder_circular_buf + *last))->next;
+    }
+    assert(*last != -1);
+    return last;
+}
+
+// keep the (recently used) decoder at the write limit by moving it down to the write position, rather than evicting it
+static void retain_patch_decoder(patch_hash_entry_header *header, patch_decode_info *pdis, int pdi_count) {
+    uint16_t from = patch_decoder_circular_buf_write_limit;
+    uint16_t to = patch_decoder_circular_buf_write_pos;
+    uint16_t size = header->size;
+    header->uses--;
+    *patch_hash_link(header->patch_num, from) = (int16_t)to;
+    for (int p = 0; p < pdi_count; p++) {
+        if (pdis[p].decoder && pdis[p].header.patch_num == header->patch_num) {
+            pdis[p].decoder = patch_decoder_circular_buf + to + PATCH_HASH_ENTRY_HEADER_HWORDS;
+        }
+    }
+    // note header is invalid after this
+    memmove(patch_decoder_circular_buf + to, patch_decoder_circular_buf + from, size * 2);
+    patch_decoder_circular_buf_write_pos += size;
+    patch_decoder_circular_buf_write_limit += size;
+    if (patch_decoder_circular_buf_write_pos != patch_decoder_circular_buf_write_limit) {
+        patch_decoder_circular_buf[patch_decoder_circular_buf_write_pos] = 0; // we need a zero patch number to follow
+    }
+    render_stats.patch_decoder_retained++;
+    render_stats.patch_decoder_retained_hwords += size;
 }
 
 // returns positive for existing slot, inverted for where to put
@@ -1643,6 +1999,9 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
         data_index += ((uint8_t *) pdi.patch)[data_index * 2]; // skip over decoder metadata
         patch_hash_entry_header *header = (patch_hash_entry_header *)(patch_decoder_circular_buf + offset_or_inverse_slot);
         assert(header->patch_num == patch_num);
+        if (header->uses < PATCH_DECODER_MAX_USES) header->uses++;
+        render_stats.patch_decoder_hits++;
+        PD_STATS_INCREMENT(pd_frame_patch_decoder_hits);
         pdi.decoder = patch_decoder_circular_buf + offset_or_inverse_slot + PATCH_HASH_ENTRY_HEADER_HWORDS;
         pdi.header = *header;
 #if DECODER_DECODER_BUFFERS
@@ -1650,6 +2009,8 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
 #endif
     } else {
         DEBUG_PINS_SET(patch_decode, 1);
+        PD_STATS_INCREMENT(pd_frame_patch_decoder_builds);
+        if (!simple_path) render_stats.patch_decoder_misses++; // note core 1 never caches
         int space_needed = patch_decoder_size_needed(pdi.patch) + PATCH_HASH_ENTRY_HEADER_HWORDS;
 #if DEBUG_DECODER_BUFFERS
         printf("Need slot of size %d\n", space_needed);
@@ -1660,6 +2021,7 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
             pos = flat_decoder_buf;
             header = (patch_hash_entry_header*)pos;
         } else {
+            uint retained_hwords = 0;
             while (patch_decoder_circular_buf_write_pos >=
                    patch_decoder_circular_buf_write_limit - space_needed) {
                 if (patch_decoder_circular_buf_write_limit == PATCH_DECODER_CIRCULAR_BUFFER_SIZE) {
@@ -1669,24 +2031,28 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
                     // we need to advance
                     patch_hash_entry_header *header = (patch_hash_entry_header *) (patch_decoder_circular_buf +
                                                                                    patch_decoder_circular_buf_write_limit);
-                    if (header->patch_num) {
+                    if (header->patch_num && header->uses &&
+                        retained_hwords + header->size <= PATCH_DECODER_MAX_RETAINED_HWORDS) {
+                        // the decoder has been used since we last came past, so give it another lap
+                        retained_hwords += header->size;
+                        retain_patch_decoder(header, pdis, pdi_count);
+                    } else if (header->patch_num) {
                         // free the patch we now encounter
 #if DEBUG_DECODER_BUFFERS
                         printf("Freeing slot (%d) at %08x->%08x\n", header->patch_num, patch_decoder_circular_buf_write_limit, patch_decoder_circular_buf_write_limit + header->size);
 #endif
-                        uint slot = patch_hash(header->patch_num);
-                        int16_t *last = &patch_hash_offsets[slot];
-                        while (*last != -1 && *last != patch_decoder_circular_buf_write_limit) {
-                            last = &((patch_hash_entry_header *) (patch_decoder_circular_buf + *last))->next;
-                        }
-                        assert(*last != -1);
-                        *last = ((patch_hash_entry_header *) (patch_decoder_circular_buf + *last))->next;
+                        int16_t *last = patch_hash_link(header->patch_num, patch_decoder_circular_buf_write_limit);
+                        *last = header->next;
+                        patch_decoder_hwords_in_use -= header->size;
                         for (int p = 0; p < pdi_count; p++) {
                             if (pdis[p].header.patch_num == header->patch_num) {
                                 pdis[p].decoder = nullptr;
                             }
                         }
                         patch_decoder_circular_buf_write_limit += header->size;
+                        // the freed header may now be at the write position, in which case it must read as the end
+                        header->patch_num = 0;
+                        render_stats.patch_decoder_evictions++;
                     } else {
                         // we've reached the end of what was there
                         patch_decoder_circular_buf_write_limit = PATCH_DECODER_CIRCULAR_BUFFER_SIZE;
@@ -1705,6 +2071,7 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
             patch_hash_offsets[slot] = slot_offset;
         }
         header->patch_num = patch_num;
+        header->uses = 0;
         pos += PATCH_HASH_ENTRY_HEADER_HWORDS;
         pdi.decoder = pos;
         const uint8_t *sourcez = pdi.patch + data_index * 2 + 1;
@@ -1759,10 +2126,10 @@ static void get_patch_decoder(int patch_num, patch_decode_info* pdis, int pdi_po
             }
             assert(pos <= patch_decoder_circular_buf + PATCH_DECODER_CIRCULAR_BUFFER_SIZE - 1);
             header->size = pos + PATCH_HASH_ENTRY_HEADER_HWORDS - pdi.decoder;
-#if !PICO_ON_DEVICE
-            patch_decoder_size.record(header->size);
-#endif
+            PD_INSTRUMENT(PD_INSTRUMENT_DECODERS, pd_instrument_decoder(header->size));
             patch_decoder_circular_buf_write_pos += header->size;
+            patch_decoder_hwords_in_use += header->size;
+            render_stats.max_patch_decoder_hwords = std::max(render_stats.max_patch_decoder_hwords, patch_decoder_hwords_in_use);
             patch_decoder_circular_buf[patch_decoder_circular_buf_write_pos] = 0; // we need a zero patch number to follow
         }
         pdi.header = *header;
@@ -1859,11 +2226,6 @@ if (c.scale == 0) {
     const uint8_t *patch_decoder_table = get_patch_decoder_table(patch_num, pdi.decoder);
     for(int col = 0; col < pdi.w; col++) {
         i = col_heads[col];
-        if (!(col & 63) && get_core_num()) {
-            restart_song_state |= 1; // we may not restart a song during this call because it may blow the stack
-            SafeUpdateSound();
-            restart_song_state &= ~1;
-        }
         if (i != -1) {
             uint16_t col_offset = col_offsets[col];
             if (0xff == (col_offset >> 8)) {
@@ -2500,18 +2862,15 @@ void draw_fullscreen_background() {
             if (finalestage == F_STAGE_TEXT) {
                 int picnum = W_GetNumForName(finaleflat);
                 if (picnum) {
-                    int cache_slot;
-                    uint8_t *flat_data = 0;
-                    for (cache_slot = 0; cache_slot < cached_flat_slots; cache_slot++) {
-                        if (cached_flat_picnum[cache_slot] == picnum) {
-                            flat_data = cached_flat0 - cache_slot * 4096;
-                        }
-                    }
-                    if (!flat_data) {
-                        // just use slot 0
+                    uint8_t *flat_data;
+                    int cache_slot = find_cached_flat(picnum - firstflat, cached_flat_slots);
+                    if (cache_slot >= 0) {
+                        flat_data = use_cached_flat(cache_slot);
+                    } else {
                         assert(cached_flat_slots);
-                        cache_slot = 0;
+                        cache_slot = lru_flat_slot(cached_flat_slots, 0);
                         flat_data = decode_flat_to_slot(cache_slot, picnum - firstflat); // note this uses core1's data area, but it is not drawing flats at the moment
+                        render_stats.flat_decodes++;
                     }
                     // todo is this rotated 90 degress
                     for (int y = 0; y < SCREENHEIGHT; y++) {
@@ -2551,6 +2910,8 @@ void draw_fullscreen_background() {
     }
 }
 
+// only needed if we ran out of space for the flat cache during the frame (i.e. wipestate changed after the
+// column budget was calculated in pd_begin_frame)
 static void uh_oh_discard_columns(int render_col_limit) {
 //    memset(render_frame_buffer, 0xfc, SCREENWIDTH * MAIN_VIEWHEIGHT); // not quite right in clip
     for (int x = 0; x < SCREENWIDTH * 2; x++) { // >= SCREENWIDTH these are fuzzy columns
@@ -2576,13 +2937,47 @@ static void uh_oh_discard_columns(int render_col_limit) {
     }
 }
 
+static void update_render_stats() {
+    static uint32_t last_dropped_columns;
+    render_stats.columns = render_col_count;
+    render_stats.column_limit = render_col_limit;
+    render_stats.wall_columns = render_wall_col_count;
+    render_stats.max_columns = std::max(render_stats.max_columns, (uint16_t)render_col_count);
+    render_stats.flat_slots = cached_flat_slots;
+    if (!render_stats.min_flat_slots || cached_flat_slots < render_stats.min_flat_slots) {
+        render_stats.min_flat_slots = cached_flat_slots;
+    }
+    render_stats.patch_decoder_hwords = patch_decoder_hwords_in_use;
+    if (render_stats.dropped_columns != last_dropped_columns) {
+        render_stats.uncovered_frames++;
+        last_dropped_columns = render_stats.dropped_columns;
+    }
+}
+
+const pd_render_stats_t *pd_get_render_stats() {
+    return &render_stats;
+}
+
+void pd_reset_render_stats() {
+    render_stats.max_columns = render_stats.columns;
+    render_stats.min_flat_slots = render_stats.flat_slots;
+    render_stats.max_patch_decoder_hwords = render_stats.patch_decoder_hwords;
+    render_stats.dropped_sprite_columns = render_stats.dropped_columns = render_stats.uncovered_frames = 0;
+    render_stats.patch_decoder_hits = render_stats.patch_decoder_misses = 0;
+    render_stats.patch_decoder_evictions = render_stats.patch_decoder_retained = 0;
+    render_stats.patch_decoder_retained_hwords = 0;
+    render_stats.flat_decodes = render_stats.flat_prefetches = render_stats.flat_prefetch_hits = 0;
+}
+
 void pd_end_frame(int wipe_start) {
     DEBUG_PINS_SET(start_end, 2);
-#if !PICO_ON_DEVICE
-//    tex_count.record_print(textures.size());
-//    patch_count.record_print(patches.size());
-//    patch_decoder_size.print_summary();
-//    patch_decoder_size.reset();
+    PD_STATS_PHASE_END(PD_PHASE_INSERT);
+#if PD_FRAME_STATS
+    int stats_col_count = render_col_count;
+    int stats_visplane_count = lastvisplane ? lastvisplane - visplanes : 0;
+#endif
+#if PD_RENDER_INSTRUMENT
+    pd_instrument_end_frame();
 #endif
     // these were only clipped as they were inserted (so may be more obscured)
     reclip_fuzz_columns();
@@ -2612,10 +3007,27 @@ void pd_end_frame(int wipe_start) {
     if (wipestate) list_buffer_limit -= 4096;
     // we need to use the lower limit of this frame and the last since the final wipe frame may still be using the data
     uint8_t *this_time_limit = std::min(list_buffer_limit, last_list_buffer_limit);
+#if USE_CORE1_FOR_FLAT_PREFETCH
+    stop_flat_prefetch();
+#endif
     if (cached_flat0 != this_time_limit - 4096) {
-        // this should only happen coming in and out of wipe, so we trash all our flash slots
+        // this should only happen coming in and out of wipe; the flats themselves don't move, so renumber the slots
+        // (the slot given to the wipe is lost, and the one given back has no flat in it)
+        int shift = cached_flat0 ? (int)(cached_flat0 - (this_time_limit - 4096)) / 4096 : (int)MAX_CACHED_FLATS;
         cached_flat0 = this_time_limit - 4096;
-        memset(cached_flat_picnum, -1, sizeof(cached_flat_picnum));
+        // new slot i is old slot i + shift (iterating such that we read each old slot before overwriting it)
+        for (int j = 0; j < (int)MAX_CACHED_FLATS; j++) {
+            int i = shift > 0 ? j : (int)MAX_CACHED_FLATS - 1 - j;
+            if (i + shift >= 0 && i + shift < (int)MAX_CACHED_FLATS) {
+                cached_flat_picnum[i] = cached_flat_picnum[i + shift];
+                cached_flat_used[i] = cached_flat_used[i + shift];
+            } else {
+                cached_flat_picnum[i] = 0xff;
+            }
+        }
+#if USE_CORE1_FOR_FLAT_PREFETCH
+        cached_flat_prefetched = 0;
+#endif
     }
 //    printf("CF0 %p ll %p ttl %p overall %p\n", cached_flat0, list_buffer_limit, this_time_limit, list_buffer + sizeof(list_buffer));
     last_list_buffer_limit = list_buffer_limit;
@@ -2626,6 +3038,7 @@ void pd_end_frame(int wipe_start) {
         int render_col_limit = (cached_flat0 - list_buffer ) / sizeof(pd_column);
 //        printf("THIS IS A PROBLEM LIMIT TO %d cols\n", render_col_limit);
         new_cache_flat_slots = 1;
+        render_stats.dropped_columns += render_col_count - render_col_limit;
         uh_oh_discard_columns(render_col_limit);
     } else if (render_col_count == RENDER_COL_MAX) {
 #ifndef NDEBUG
@@ -2633,10 +3046,12 @@ void pd_end_frame(int wipe_start) {
         printf("OOPS MAXXED OUT %d\n", foo++);
 #endif
     }
-    for(int i=cached_flat_slots; i<new_cache_flat_slots; i++) {
+    // anything in the slots below was overwritten by this frame's columns
+    for(uint i=new_cache_flat_slots; i<MAX_CACHED_FLATS; i++) {
         cached_flat_picnum[i] = 0xff;
     }
     cached_flat_slots = new_cache_flat_slots;
+    update_render_stats();
 
     if (showing_help) {
         // bit hacky, but does the job (we don't want to draw anything at all when fully covered
@@ -2658,6 +3073,7 @@ void pd_end_frame(int wipe_start) {
     }
     // render the visplane identifiers, freeing up the visplane columns (which we will use below)
     int16_t fr_list = predraw_visplanes();
+    PD_STATS_PHASE_END(PD_PHASE_PREDRAW);
 
     // ... now we can be parallel
 #if !USE_CORE1_FOR_FLATS
@@ -2666,6 +3082,7 @@ void pd_end_frame(int wipe_start) {
     core1_fr_list = fr_list;
     sem_release(&core1_do_flats);
 #endif
+    PD_STATS_PHASE_END(PD_PHASE_VISPLANES);
     re_sort_regular_columns_by_fd_num();
 #if USE_CORE1_FOR_REGULAR
     sem_release(&core1_do_regular);
@@ -2682,7 +3099,9 @@ void pd_end_frame(int wipe_start) {
     sem_release(&core0_done);
     sem_acquire_blocking(&core1_done);
 #endif
+    PD_STATS_PHASE_END(PD_PHASE_REGULAR);
     draw_fuzz_columns();
+    PD_STATS_PHASE_END(PD_PHASE_FUZZ);
     DEBUG_PINS_CLR(full_render, 1);
     NetUpdate();
 
@@ -2833,6 +3252,7 @@ next_video_type = VIDEO_TYPE_DOUBLE;
 
     next_frame_index = render_frame_index;
     next_overlay_index = render_overlay_index;
+    next_overlay_sequence++;
     render_overlay_index ^= 1;
 #if !DEMO1_ONLY && !DOOM_LOWRES
     if (next_video_type == VIDEO_TYPE_SINGLE && gamestate != GS_FINALE) {
@@ -2844,6 +3264,10 @@ next_video_type = VIDEO_TYPE_DOUBLE;
 #endif
 
 //    sem_release(&render_frame_ready);
+#if PD_FRAME_STATS
+    pd_frame_stats_phase_end(PD_PHASE_OVERLAYS);
+    pd_frame_stats_end_frame(stats_col_count, stats_visplane_count);
+#endif
     DEBUG_PINS_CLR(start_end, 2);
 }
 
@@ -2852,22 +3276,22 @@ void pd_core1_loop() {
 #if PICO_ON_DEVICE
     sem_acquire_blocking(&core1_wake);
 #if USE_CORE1_FOR_FLATS
+#if USE_CORE1_FOR_FLAT_PREFETCH
     while (!sem_acquire_timeout_ms(&core1_do_flats, 1)) {
-        SafeUpdateSound();
+        prefetch_flat();
     }
+#else
+    sem_acquire_blocking(&core1_do_flats);
+#endif
     interp_in_use = true;
     draw_visplanes(core1_fr_list);
     interp_in_use = false;
 #if USE_CORE1_FOR_REGULAR
-    while (!sem_acquire_timeout_ms(&core1_do_regular, 1)) {
-        SafeUpdateSound();
-    }
+    sem_acquire_blocking(&core1_do_regular);
     draw_regular_columns(1);
 #endif
 #endif
-    while (!sem_acquire_timeout_ms(&core0_done, 1)) {
-        SafeUpdateSound();
-    }
+    sem_acquire_blocking(&core0_done);
 #endif
     sem_release(&core1_done);
 #endif
@@ -2902,8 +3326,9 @@ void pd_end_save_pause(void) {
     next_video_type = old_video_type;
 //    sem_release(&render_frame_ready);
     I_PicoSoundFade(true);
+    // the fade happens in the audio IRQ
     while (I_PicoSoundFading()) {
-        I_UpdateSound();
+        tight_loop_contents();
     }
 }
 
@@ -2916,6 +3341,8 @@ void th_bit_overrun(th_bit_input *bi) {
 }
 
 uint8_t *pd_get_work_area(uint32_t *size) {
+    // the flat cache lives in here too
+    memset(cached_flat_picnum, -1, sizeof(cached_flat_picnum));
     *size = last_list_buffer_limit - list_buffer;
     return list_buffer;
 }
@@ -32,6 +32,35 @@ void pd_start_save_pause(void);
 void pd_end_save_pause(void);
 const uint8_t *get_end_of_flash(void);
 #endif
+#if PD_FRAME_STATS
+void pd_frame_stats_report(void);
+#endif
+
+// column/flat cache/patch decoder budget telemetry
+typedef struct {
+    uint16_t columns;                  // columns used by the last frame
+    uint16_t column_limit;             // column budget of the last frame
+    uint16_t wall_columns;             // wall (and sky) columns used by the last frame
+    uint16_t max_columns;              // high water mark of columns
+    uint8_t flat_slots;                // flat cache slots left to the last frame
+    uint8_t min_flat_slots;            // low water mark of flat cache slots
+    uint16_t patch_decoder_hwords;     // patch decoder buffer in use
+    uint16_t max_patch_decoder_hwords; // high water mark of patch decoder buffer use
+    uint32_t dropped_sprite_columns;   // sprite columns dropped to leave the column budget to walls
+    uint32_t dropped_columns;          // other columns which didn't fit (leaving black gaps)
+    uint32_t uncovered_frames;         // frames which had black gaps
+    uint32_t patch_decoder_hits;       // patch decoders found in the (core 0) decoder cache
+    uint32_t patch_decoder_misses;     // patch decoders rebuilt into the decoder cache
+    uint32_t patch_decoder_evictions;  // patch decoders evicted from the decoder cache
+    uint32_t patch_decoder_retained;   // recently used patch decoders kept rather than evicted
+    uint32_t patch_decoder_retained_hwords; // hwords of decoder moved to retain them
+    uint32_t flat_decodes;             // flats decoded while drawing (i.e. on the critical path)
+    uint32_t flat_prefetches;          // flats decoded ahead of time by core1
+    uint32_t flat_prefetch_hits;       // prefetched flats which were then used
+} pd_render_stats_t;
+
+const pd_render_stats_t *pd_get_render_stats(void);
+void pd_reset_render_stats(void);
 extern int pd_flag;
 extern fixed_t pd_scale;
 #ifdef __cplusplus
@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <doom/sounds.h>
@@ -35,6 +37,11 @@
 #include "pico/audio_i2s.h"
 #include "pico/binary_info.h"
 #include "hardware/gpio.h"
+#if PICO_ON_DEVICE
+#include "hardware/interp.h"
+#include "hardware/irq.h"
+#include "pico/time.h"
+#endif
 
 #define ADPCM_BLOCK_SIZE 128
 #define ADPCM_SAMPLES_PER_BLOCK_SIZE 249
@@ -65,7 +72,48 @@ struct channel_s
     int8_t decompressed[ADPCM_SAMPLES_PER_BLOCK_SIZE];
 };
 
+// sfx are mixed MIX_CHUNK frames at a time into packed stereo accumulators, holding left + right * 65536, so that a
+// single multiply and add per channel per frame covers both sides. the low pass filter (which is linear, so can be run
+// on the mix rather than on each channel), and fade are then applied to the accumulated chunk in one pass
+#define MIX_CHUNK 64
+#if SOUND_LOW_PASS
+// channels share a filter when their sfx have the same sample rate; doom's sfx are nearly all 11025Hz
+#define MIX_FILTERS 2
+#else
+#define MIX_FILTERS 1
+#endif
+
+typedef struct {
+    uint32_t acc[MIX_CHUNK];
+#if SOUND_LOW_PASS
+    int32_t l, r;
+    uint8_t alpha256;
+#endif
+    bool used;
+} mix_filter_t;
+
+static mix_filter_t mix_filters[MIX_FILTERS];
+
 static struct audio_buffer_pool *producer_pool;
+#define PRODUCER_BUFFER_SAMPLES 1024
+
+#if PICO_ON_DEVICE
+// on the device buffers are filled from a low priority software IRQ on core 0, raised by a repeating timer at twice
+// the buffer rate, rather than only when the game loop gets around to calling I_UpdateSound. the game loop is also on
+// core 0, so masking the IRQ is all the locking the channel and OPL state need
+#define AUDIO_IRQ 30
+#define AUDIO_FILL_PERIOD_US (PRODUCER_BUFFER_SAMPLES * 500000ll / PICO_SOUND_SAMPLE_FREQ)
+static repeating_timer_t audio_timer;
+static bool audio_scheduler_running;
+static volatile bool in_audio_irq;
+static uint8_t audio_lock_depth;
+// when the buffers given so far will have finished playing; if we are past it when filling, the output ran dry
+static absolute_time_t audio_buffered_until;
+static volatile uint32_t audio_underruns; // see I_PicoSoundUnderruns
+#if DOOM_DEBUG_INFO
+static uint32_t audio_underruns_reported;
+#endif
+#endif
 
 static struct audio_format audio_format = {
         .format = AUDIO_BUFFER_FORMAT_PCM_S16,
@@ -297,20 +345,24 @@ static void I_Pico_UpdateSoundParams(int handle, int vol, int sep)
     if (right < 0) right = 0;
     else if (right > 255) right = 255;
 
+    I_PicoSoundLock();
     channels[handle].left = left;
     channels[handle].right = right;
+    I_PicoSoundUnlock();
 }
 
 static int I_Pico_StartSound(should_be_const sfxinfo_t *sfxinfo, int channel, int vol, int sep, int pitch)
 {
     if (!check_and_init_channel(channel)) return -1;
 
+    I_PicoSoundLock();
     stop_channel(channel);
     channel_t *ch = &channels[channel];
     if (!init_channel_for_sfx(ch, sfxinfo, pitch)) {
         assert(!is_channel_playing(channel)); // don't expect to have to mark it sotpped
     }
     I_Pico_UpdateSoundParams(channel, vol, sep);
+    I_PicoSoundUnlock();
     return channel;
 }
 
@@ -327,91 +379,288 @@ static boolean I_Pico_SoundIsPlaying(int channel)
     return is_channel_playing(channel);
 }
 
-static void I_Pico_UpdateSound(void)
-{
-    if (!sound_initialized) return;
+static mix_filter_t *filter_for_channel(const channel_t *channel) {
+#if SOUND_LOW_PASS
+    for(int i=0; i < MIX_FILTERS; i++) {
+        if (mix_filters[i].alpha256 == channel->alpha256) {
+            mix_filters[i].used = true;
+            return &mix_filters[i];
+        }
+    }
+    for(int i=0; i < MIX_FILTERS; i++) {
+        mix_filter_t *f = &mix_filters[i];
+        if (!f->used) {
+            if (f->alpha256 != channel->alpha256) {
+                f->alpha256 = channel->alpha256;
+                f->l = f->r = 0;
+            }
+            f->used = true;
+            return f;
+        }
+    }
+    // more distinct sample rates than filters; use the closest
+    mix_filter_t *best = &mix_filters[0];
+    for(int i=1; i < MIX_FILTERS; i++) {
+        if (abs(mix_filters[i].alpha256 - channel->alpha256) < abs(best->alpha256 - channel->alpha256)) {
+            best = &mix_filters[i];
+        }
+    }
+    return best;
+#else
+    mix_filters[0].used = true;
+    return &mix_filters[0];
+#endif
+}
 
-    // todo note this is called from D_Main around the game loop, which is fast enough now but may not be.
-    //  we can either poll more frequently, or use IRQ but then we have to be careful with threading (both OPL and channels)
-    // todo hopefully at least we can run the AI fast enough.
-    audio_buffer_t *buffer = take_audio_buffer(producer_pool, false);
-    if (buffer) {
-        if (music_generator) {
-            // todo think about volume; this already has a (<< 3) in it
-            music_generator(buffer);
-        } else {
-            memset(buffer->buffer->bytes, 0, buffer->buffer->size);
+// returns false if the channel has finished
+static bool __not_in_flash_func(mix_channel)(channel_t *channel, uint32_t *acc, int count) {
+    uint32_t vol = (channel->left / 2) | ((channel->right / 2) << 16);
+    uint32_t offset = channel->offset;
+    uint32_t step = channel->step;
+    while (count) {
+        uint32_t offset_end = channel->decompressed_size * 65536;
+        assert(offset < offset_end);
+        // only mix up to the end of the decoded block, so there is no need to check for it per sample
+        int n = MIN(count, (int)((offset_end - offset + step - 1) / step));
+        const int8_t *decompressed = channel->decompressed;
+        for(int s=0; s<n; s++) {
+            *acc++ += (uint32_t)(decompressed[offset >> 16] * (int32_t)vol);
+            offset += step;
         }
-        for(int ch=0; ch < NUM_SOUND_CHANNELS; ch++) {
-            if (is_channel_playing(ch)) {
-                channel_t *channel = &channels[ch];
-                assert(channel->decompressed_size);
-                int voll = channel->left/2;
-                int volr = channel->right/2;
-                uint offset_end = channel->decompressed_size * 65536;
-                assert(channel->offset < offset_end);
-                int16_t *samples = (int16_t *)buffer->buffer->bytes;
+        count -= n;
+        if (offset >= offset_end) {
+            offset -= offset_end;
+            decompress_buffer(channel);
+            if (offset >= channel->decompressed_size * 65536) {
+                return false;
+            }
+        }
+    }
+    channel->offset = offset;
+    return true;
+}
+
+static inline void fade_frame(int32_t *l, int32_t *r) {
+    if (fade_state == FS_SILENT) {
+        *l = *r = 0;
+    } else if (fade_state != FS_NONE) {
+        *l = (*l * (int)fade_level) >> 16;
+        *r = (*r * (int)fade_level) >> 16;
+        fade_level += fade_state == FS_FADE_IN ? FADE_STEP : -FADE_STEP;
+        if (!fade_level) {
+            fade_state = fade_state == FS_FADE_OUT ? FS_SILENT : FS_NONE;
+        }
+    }
+}
+
+static void __not_in_flash_func(mix_finish_chunk)(int16_t *samples, int count, mix_filter_t **filters, int filter_count) {
+    bool fading = fade_state != FS_NONE;
+    for(int s=0; s<count; s++) {
+        int32_t l = samples[0];
+        int32_t r = samples[1];
+        for(int i=0; i<filter_count; i++) {
+            mix_filter_t *f = filters[i];
+            uint32_t a = f->acc[s];
+            int32_t sl = (int16_t)a;
+            int32_t sr = (int16_t)((a - (uint32_t)sl) >> 16);
 #if SOUND_LOW_PASS
-                int alpha256 = channel->alpha256;
-                int beta256 = 256 - alpha256;
-                int sample = channel->decompressed[channel->offset >> 16];
+            f->l += (f->alpha256 * (sl - f->l)) >> 8;
+            f->r += (f->alpha256 * (sr - f->r)) >> 8;
+            sl = f->l;
+            sr = f->r;
 #endif
-                for(int s=0;s<buffer->max_sample_count;s++) {
-#if !SOUND_LOW_PASS
-                    int sample = channel->decompressed[channel->offset >> 16];
-#else
-                    // todo graham, note that since we are all at the same frequency (and it isn't the end
-                    //  of the world anyway, we could do this across all channels at once)
-                    sample = (beta256 * sample + alpha256 * channel->decompressed[channel->offset >> 16]) / 256;
+            l += sl;
+            r += sr;
+        }
+        if (fading) {
+            fade_frame(&l, &r);
+        }
+        *samples++ = (int16_t)l;
+        *samples++ = (int16_t)r;
+    }
+}
+
+static void mix_sfx(int16_t *samples, uint sample_count) {
+    mix_filter_t *channel_filters[NUM_SOUND_CHANNELS];
+    mix_filter_t *filters[MIX_FILTERS];
+    int filter_count = 0;
+    for(int i=0; i < MIX_FILTERS; i++) {
+        mix_filters[i].used = false;
+    }
+    for(int ch=0; ch < NUM_SOUND_CHANNELS; ch++) {
+        if (is_channel_playing(ch)) {
+            channel_filters[ch] = filter_for_channel(&channels[ch]);
+        }
+    }
+    for(int i=0; i < MIX_FILTERS; i++) {
+        if (mix_filters[i].used) {
+            filters[filter_count++] = &mix_filters[i];
+        } else {
+#if SOUND_LOW_PASS
+            // nothing went through this filter last buffer, so it starts again from silence
+            mix_filters[i].l = mix_filters[i].r = 0;
 #endif
-                    *samples++ += sample * voll;
-                    *samples++ += sample * volr;
-                    channel->offset += channel->step;
-                    if (channel->offset >= offset_end) {
-                        channel->offset -= offset_end;
-                        decompress_buffer(channel);
-                        offset_end = channel->decompressed_size * 65536;
-                        if (channel->offset >= offset_end) {
-                            stop_channel(ch);
-                            break;
-                        }
-                    }
-                }
+        }
+    }
+    if (!filter_count && fade_state == FS_NONE) return;
+
+    for(uint base=0; base < sample_count; base += MIX_CHUNK) {
+        int count = MIN(MIX_CHUNK, sample_count - base);
+        for(int i=0; i < filter_count; i++) {
+            memset(filters[i]->acc, 0, count * sizeof(uint32_t));
+        }
+        for(int ch=0; ch < NUM_SOUND_CHANNELS; ch++) {
+            if (is_channel_playing(ch) && !mix_channel(&channels[ch], channel_filters[ch]->acc, count)) {
+                stop_channel(ch);
             }
         }
-        buffer->sample_count = buffer->max_sample_count;
-        if (fade_state == FS_SILENT) {
+        mix_finish_chunk(samples + base * 2, count, filters, filter_count);
+    }
+}
+
+static void fill_audio_buffers(void) {
+    audio_buffer_t *buffer;
+    while ((buffer = take_audio_buffer(producer_pool, false))) {
+#if PICO_ON_DEVICE
+        absolute_time_t now = get_absolute_time();
+        if (absolute_time_diff_us(audio_buffered_until, now) > 0) {
+            if (!is_nil_time(audio_buffered_until)) audio_underruns++;
+            audio_buffered_until = now;
+        }
+        audio_buffered_until = delayed_by_us(audio_buffered_until, AUDIO_FILL_PERIOD_US * 2);
+#endif
+        if (music_generator) {
+            // todo think about volume; this already has a (<< 3) in it
+            music_generator(buffer);
+        } else {
             memset(buffer->buffer->bytes, 0, buffer->buffer->size);
-        } else if (fade_state != FS_NONE) {
-            int16_t *samples = (int16_t *)buffer->buffer->bytes;
-            int fade_step = fade_state == FS_FADE_IN ? FADE_STEP : -FADE_STEP;
-            int i;
-            for(i=0;i<buffer->sample_count * 2 && fade_level;i+=2) {
-                samples[i] = (samples[i] * (int)fade_level) >> 16;
-                samples[i+1] = (samples[i+1] * (int)fade_level) >> 16;
-                fade_level += fade_step;
-            }
-            if (!fade_level) {
-                if (fade_state == FS_FADE_OUT) {
-                    for(;i<buffer->sample_count * 2;i++) {
-                        samples[i] = 0;
-                    }
-                    fade_state = FS_SILENT;
-                } else {
-                    fade_state = FS_NONE;
-                }
-            }
         }
+        buffer->sample_count = buffer->max_sample_count;
+        mix_sfx((int16_t *)buffer->buffer->bytes, buffer->sample_count);
         give_audio_buffer(producer_pool, buffer);
     }
 }
 
+#if PICO_ON_DEVICE
+#if DOOM_TINY
+extern uint8_t restart_song_state;
+extern void RestartSong(void *unused);
+#endif
+
+static void audio_irq_handler(void) {
+    // we may have interrupted the renderer, and the OPL emulator uses the interpolators too
+    interp_hw_save_t interp0_save, interp1_save;
+    interp_save(interp0, &interp0_save);
+    interp_save(interp1, &interp1_save);
+    in_audio_irq = true;
+#if DOOM_TINY
+    // we may also be arbitrarily deep in the stack, so leave any song restart to I_UpdateSound
+    restart_song_state |= 1;
+#endif
+    fill_audio_buffers();
+#if DOOM_TINY
+    restart_song_state &= ~1;
+#endif
+    in_audio_irq = false;
+    interp_restore(interp0, &interp0_save);
+    interp_restore(interp1, &interp1_save);
+}
+
+static bool audio_timer_callback(repeating_timer_t *timer) {
+    irq_set_pending(AUDIO_IRQ);
+    return true;
+}
+
+static void start_audio_scheduler(void) {
+    irq_set_exclusive_handler(AUDIO_IRQ, audio_irq_handler);
+    irq_set_priority(AUDIO_IRQ, PICO_LOWEST_IRQ_PRIORITY);
+    audio_buffered_until = nil_time;
+    audio_scheduler_running = true;
+    irq_set_enabled(AUDIO_IRQ, true);
+    add_repeating_timer_us(-AUDIO_FILL_PERIOD_US, audio_timer_callback, NULL, &audio_timer);
+}
+
+void I_PicoSoundLock(void) {
+    // the IRQ itself calls into code which locks
+    if (!audio_scheduler_running || in_audio_irq) return;
+    irq_set_enabled(AUDIO_IRQ, false);
+    audio_lock_depth++;
+}
+
+void I_PicoSoundUnlock(void) {
+    if (!audio_scheduler_running || in_audio_irq) return;
+    assert(audio_lock_depth);
+    if (!--audio_lock_depth) {
+        // a fill that was due while we were locked happens now
+        irq_set_enabled(AUDIO_IRQ, true);
+    }
+}
+
+uint32_t I_PicoSoundUnderruns(void) {
+    return audio_underruns;
+}
+#else
+// the host has no audio IRQ; buffers are filled from I_UpdateSound in the game loop
+void I_PicoSoundLock(void) {
+}
+
+void I_PicoSoundUnlock(void) {
+}
+
+uint32_t I_PicoSoundUnderruns(void) {
+    return 0;
+}
+#endif
+
+static void I_Pico_UpdateSound(void)
+{
+    if (!sound_initialized) return;
+
+#if PICO_ON_DEVICE
+#if DOOM_TINY
+    if (restart_song_state & 2) {
+        I_PicoSoundLock();
+        RestartSong(NULL);
+        I_PicoSoundUnlock();
+    }
+#endif
+#if DOOM_DEBUG_INFO
+    uint32_t underruns = audio_underruns;
+    if (underruns != audio_underruns_reported) {
+        printf("audio underruns: %u\n", (uint)underruns);
+        audio_underruns_reported = underruns;
+    }
+#endif
+#else
+    fill_audio_buffers();
+#endif
+}
+
+#if PD_SFX_BENCH
+// mix the playing sfx directly into the given buffer rather than via the audio producer, for the offline sfx
+// benchmark; returns false once no channels are playing
+bool I_PicoSoundMixSfxOffline(int16_t *samples, unsigned int sample_count)
+{
+    memset(samples, 0, sample_count * 4);
+    mix_sfx(samples, sample_count);
+    for(int ch=0; ch < NUM_SOUND_CHANNELS; ch++) {
+        if (is_channel_playing(ch)) return true;
+    }
+    return false;
+}
+#endif
+
 static void I_Pico_ShutdownSound(void)
 {
     if (!sound_initialized)
     {
         return;
     }
+#if PICO_ON_DEVICE
+    cancel_repeating_timer(&audio_timer);
+    irq_set_enabled(AUDIO_IRQ, false);
+    audio_scheduler_running = false;
+#endif
     sound_initialized = false;
 }
 
@@ -421,7 +670,7 @@ static boolean I_Pico_InitSound(boolean _use_sfx_prefix)
     use_sfx_prefix = _use_sfx_prefix;
 
     // todo this will likely need adjustment - maybe with IRQs/double buffer & pull from audio we can make it quite small
-    producer_pool = audio_new_producer_pool(&producer_format, 2, 1024); // todo correct size
+    producer_pool = audio_new_producer_pool(&producer_format, 2, PRODUCER_BUFFER_SAMPLES); // todo correct size
 
     struct audio_i2s_config config = {
             .data_pin = PICO_AUDIO_I2S_DATA_PIN,
@@ -448,6 +697,9 @@ static boolean I_Pico_InitSound(boolean _use_sfx_prefix)
     audio_i2s_set_enabled(true);
 
     sound_initialized = true;
+#if PICO_ON_DEVICE
+    start_audio_scheduler();
+#endif
     return true;
 }
 
@@ -476,13 +728,17 @@ bool I_PicoSoundIsInitialized(void) {
 }
 
 void I_PicoSoundSetMusicGenerator(void (*generator)(audio_buffer_t *buffer)) {
+    I_PicoSoundLock();
     music_generator = generator;
+    I_PicoSoundUnlock();
 }
 
 #if PICO_ON_DEVICE
 void I_PicoSoundFade(bool in) {
+    I_PicoSoundLock();
     fade_state = in ? FS_FADE_IN : FS_FADE_OUT;
     fade_level = in ? FADE_STEP : 0x10000 - FADE_STEP;
+    I_PicoSoundUnlock();
 }
 
 bool I_PicoSoundFading(void) {
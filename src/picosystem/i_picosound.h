@@ -38,4 +38,12 @@ void I_PicoSoundSetMusicGenerator(void (*generator)(audio_buffer_t *buffer));
 bool I_PicoSoundIsInitialized(void);
 void I_PicoSoundFade(bool in);
 bool I_PicoSoundFading(void);
+// keep the audio IRQ from touching the sfx channel or OPL state; nests
+void I_PicoSoundLock(void);
+void I_PicoSoundUnlock(void);
+// the number of times the audio output has run dry
+uint32_t I_PicoSoundUnderruns(void);
+#if PD_SFX_BENCH
+bool I_PicoSoundMixSfxOffline(int16_t *samples, unsigned int sample_count);
+#endif
 #endif
@@ -65,8 +65,9 @@
 int debugline = 39;
 
 #if PICO_ON_DEVICE
-#define DISPLAYWIDTH 240
-#define DISPLAYHEIGHT 240
+// the column/page window set up in command_initialise
+#define DISPLAYWIDTH SCREENWIDTH
+#define DISPLAYHEIGHT SCREENHEIGHT
 #else
 
 #if FSAA
@@ -203,6 +204,8 @@ void I_SetPaletteNum(int doompalette)
 
 uint8_t display_frame_index;
 uint8_t display_overlay_index;
+static uint8_t display_overlay_sequence;
+static uint8_t display_overlay_renders; // overlay lists rendered since the last non saving update (the wipe renders several)
 uint8_t display_video_type;
 
 
@@ -212,6 +215,7 @@ uint32_t *wipe_linelookup; // offset of each line from start of screenbuffer (ca
 uint8_t next_video_type;
 uint8_t next_frame_index; // todo combine with video type?
 uint8_t next_overlay_index;
+uint8_t next_overlay_sequence;
 #if !DEMO1_ONLY
 uint8_t *next_video_scroll;
 uint8_t *video_scroll;
@@ -234,17 +238,27 @@ static inline uint8_t crapify_rgb(uint8_t r, uint8_t g, uint8_t b) {
 
 // this is not in flash as quite large and only once per frame
 void __noinline new_frame_init_overlays_palette_and_wipe() {
+    // whether vpatch_next/vpatch_starters are still those for the last overlays we displayed
+    static bool overlay_rows_valid;
     // re-initialize our overlay drawing
     if (display_video_type >= FIRST_VIDEO_TYPE_WITH_OVERLAYS) {
-        memset(vpatchlists->vpatch_next, 0, sizeof(vpatchlists->vpatch_next));
-        memset(vpatchlists->vpatch_starters, 0, sizeof(vpatchlists->vpatch_starters));
         memset(vpatchlists->vpatch_doff, 0, sizeof(vpatchlists->vpatch_doff));
+        // if the overlays are the same as the last ones displayed (the status bar usually is), we can keep the row lists
+        // built for them. the last ones are only still in the other list if exactly one frame was rendered since
         vpatchlist_t *overlays = vpatchlists->overlays[display_overlay_index];
-        // do it in reverse so our linked lists are in ascending order
-        for (int i = overlays->header.size - 1; i > 0; i--) {
-            assert(overlays[i].entry.y < count_of(vpatchlists->vpatch_starters));
-            vpatchlists->vpatch_next[i] = vpatchlists->vpatch_starters[overlays[i].entry.y];
-            vpatchlists->vpatch_starters[overlays[i].entry.y] = i;
+        const vpatchlist_t *prev_overlays = vpatchlists->overlays[display_overlay_index ^ 1];
+        bool overlays_unchanged = display_overlay_renders == 1 && overlays->header.size == prev_overlays->header.size &&
+                !memcmp(overlays + 1, prev_overlays + 1, (overlays->header.size - 1) * sizeof(vpatchlist_t));
+        if (!overlays_unchanged || !overlay_rows_valid) {
+            memset(vpatchlists->vpatch_next, 0, sizeof(vpatchlists->vpatch_next));
+            memset(vpatchlists->vpatch_starters, 0, sizeof(vpatchlists->vpatch_starters));
+            // do it in reverse so our linked lists are in ascending order
+            for (int i = overlays->header.size - 1; i > 0; i--) {
+                assert(overlays[i].entry.y < count_of(vpatchlists->vpatch_starters));
+                vpatchlists->vpatch_next[i] = vpatchlists->vpatch_starters[overlays[i].entry.y];
+                vpatchlists->vpatch_starters[overlays[i].entry.y] = i;
+            }
+            overlay_rows_valid = true;
         }
         if (next_pal != -1) {
             static const uint8_t *playpal;
@@ -333,6 +347,8 @@ void __noinline new_frame_init_overlays_palette_and_wipe() {
                 wipe_min = new_wipe_min;
             }
         }
+    } else {
+        overlay_rows_valid = false;
     }
 }
 
@@ -348,6 +364,8 @@ void I_FinishUpdate (void)
     display_overlay_index = next_overlay_index;
 
     if (display_video_type != VIDEO_TYPE_SAVING) {
+        display_overlay_renders = next_overlay_sequence - display_overlay_sequence;
+        display_overlay_sequence = next_overlay_sequence;
         // this stuff is large (so in flash) and not needed in save move
         new_frame_init_overlays_palette_and_wipe();
     }
@@ -357,6 +375,199 @@ void I_FinishUpdate (void)
 
 #pragma GCC pop_options
 
+// Greyscale on the (1 bit) OLED is done temporally: each frame is shown as a number of
+// sub-fields, each sent with its own contrast and held for its own period, and a pixel is lit
+// in the sub-fields given by the bits of its code. Codes are picked for every pixel by dithering
+// between the two codes whose (integrated) light output brackets the pixel's luminance, with
+// a threshold matrix that moves every frame.
+#define OLED_MAX_SUBFIELDS 4
+
+typedef struct {
+    uint8_t contrast;       // 0x81 level sent for this sub-field
+    uint8_t light;          // relative light output of the sub-field (nominal unless measured)
+    uint16_t period_us;     // time until the next sub-field starts
+} oled_subfield_t;
+
+typedef struct {
+    const char *name;
+    uint8_t num_subfields;
+    uint8_t park_lines;     // some oleds need 2 park lines, but that's not as robust
+    oled_subfield_t subfield[OLED_MAX_SUBFIELDS];
+} oled_calibration_t;
+
+#ifdef J_OLED_FRAME_PERIOD
+#define OLED_SUBFIELD_PERIOD J_OLED_FRAME_PERIOD
+#else
+#define OLED_SUBFIELD_PERIOD 5556
+#endif
+
+// Build with OLED_CALIBRATION to compare the entries on a panel. None of the light values
+// below have been measured: they are nominal binary weights, placeholders until a panel batch
+// is measured and given its own entry.
+static const oled_calibration_t oled_calibrations[] = {
+    // the original hand-tuned contrasts and park lines, with the old code's 4:2:1 weights
+    { "3 sub-field", 3, 1, {
+        { 0x7f, 4, OLED_SUBFIELD_PERIOD },
+        { 0x1f, 2, OLED_SUBFIELD_PERIOD },
+        { 0x07, 1, OLED_SUBFIELD_PERIOD },
+    }},
+    // unmeasured placeholder: as above, for panels that need 2 park lines
+    { "3 sub-field, 2 park lines", 3, 2, {
+        { 0x7f, 4, OLED_SUBFIELD_PERIOD },
+        { 0x1f, 2, OLED_SUBFIELD_PERIOD },
+        { 0x07, 1, OLED_SUBFIELD_PERIOD },
+    }},
+    // unmeasured placeholder: the contrast 0xff weight in particular is a guess
+    { "4 sub-field", 4, 1, {
+        { 0xff, 8, OLED_SUBFIELD_PERIOD * 3 / 4 },
+        { 0x7f, 4, OLED_SUBFIELD_PERIOD * 3 / 4 },
+        { 0x1f, 2, OLED_SUBFIELD_PERIOD * 3 / 4 },
+        { 0x07, 1, OLED_SUBFIELD_PERIOD * 3 / 4 },
+    }},
+};
+
+#ifndef OLED_PANEL_BATCH
+#define OLED_PANEL_BATCH 0
+#endif
+static_assert(OLED_PANEL_BATCH < count_of(oled_calibrations), "");
+
+static const oled_calibration_t *oled_cal;
+// light output of each code, i.e. the sum of the lit sub-fields'
+static uint16_t oled_code_light[1u << OLED_MAX_SUBFIELDS];
+// code -> a bit at the top of each sub-field's plane byte
+static uint32_t oled_code_plane_bits[1u << OLED_MAX_SUBFIELDS];
+// luminance -> lower code (bits 0-3), upper code (bits 4-7) and how far between them (bits 8-15)
+static uint16_t oled_shade_lut[256];
+// the same, by palette index for the frame being converted
+static uint16_t oled_palette_shade[256];
+
+static const uint8_t oled_dither_matrix[4][4] = {
+    {   8, 136,  40, 168 },
+    { 200,  72, 232, 104 },
+    {  56, 184,  24, 152 },
+    { 248, 120, 216,  88 },
+};
+// the matrix offset for successive frames, so each pixel also dithers over time
+static const uint8_t oled_dither_phase[4] = { 0x00, 0x22, 0x02, 0x20 };
+
+static uint8_t field_planes[OLED_MAX_SUBFIELDS][DISPLAYWIDTH*(DISPLAYHEIGHT/8)];
+
+static void oled_set_calibration(const oled_calibration_t *cal) {
+    uint codes = 1u << cal->num_subfields;
+    for (uint c = 0; c < codes; c++) {
+        uint light = 0;
+        uint32_t bits = 0;
+        for (uint i = 0; i < cal->num_subfields; i++) {
+            if (c & (1u << i)) {
+                light += cal->subfield[i].light;
+                bits |= 0x80u << (8 * i);
+            }
+        }
+        oled_code_light[c] = light;
+        oled_code_plane_bits[c] = bits;
+    }
+    uint max_light = oled_code_light[codes - 1];
+    for (uint lum = 0; lum < 256; lum++) {
+        // the pixel's light output, scaled by 255
+        uint target = lum * max_light;
+        uint lo = 0, hi = codes - 1;
+        for (uint c = 0; c < codes; c++) {
+            uint light = oled_code_light[c] * 255;
+            if (light <= target && light >= oled_code_light[lo] * 255) lo = c;
+            if (light >= target && light <= oled_code_light[hi] * 255) hi = c;
+        }
+        uint lo_light = oled_code_light[lo] * 255;
+        uint hi_light = oled_code_light[hi] * 255;
+        uint frac = hi_light > lo_light ? ((target - lo_light) * 255) / (hi_light - lo_light) : 0;
+        oled_shade_lut[lum] = (uint16_t)(lo | (hi << 4) | (frac << 8));
+    }
+    oled_cal = cal;
+}
+
+#if OLED_CALIBRATION
+// a smooth ramp over the top half and one bar per code over the bottom, to check the light
+// levels are even and that the sub-fields don't flicker
+static uint calibration_lum(int x, int y) {
+    if (y < DISPLAYHEIGHT / 2) {
+        return (x * 255) / (DISPLAYWIDTH - 1);
+    }
+    uint codes = 1u << oled_cal->num_subfields;
+    uint code = (x * codes) / DISPLAYWIDTH;
+    return (oled_code_light[code] * 255) / oled_code_light[codes - 1];
+}
+#endif
+
+//#define TESTCARD_BAR 1
+
+#if FSAA || TESTCARD_BAR || DEBUGLINE || OLED_CALIBRATION
+// debug/antialiased path; the luminance isn't just a function of the pixel's palette index here
+static uint pixel_lum(int x, int y) {
+#if OLED_CALIBRATION
+    return calibration_lum(x, y);
+#elif FSAA
+    uint8_t *pframe = &frame_buffer[display_frame_index][y*(SCREENWIDTH<<FSAA) + (x<<FSAA)];
+    uint lum = 0;
+    for (int aay=0; aay<(1<<FSAA); ++aay) {
+        for (int aax=0; aax<(1<<FSAA); ++aax) {
+            lum += palette[pframe[aay*SCREENWIDTH + aax]];
+        }
+    }
+    lum >>= (FSAA*2);
+#else
+    uint lum = palette[frame_buffer[display_frame_index][y*SCREENWIDTH + x]];
+#endif
+
+#if TESTCARD_BAR
+    if (x < 8)
+        lum = y*6;
+#endif
+
+#if DEBUGLINE
+    if (x < 6)
+        lum = (-(((y>>(5-x))&1)==0))&255;
+    if (y == debugline)
+        lum = 255;
+#endif
+    return lum;
+}
+#endif
+
+static inline uint32_t shade_plane_bits(uint shade, uint threshold) {
+    return oled_code_plane_bits[(shade >> 8) > threshold ? (shade >> 4) & 15 : shade & 15];
+}
+
+// Convert the displayed frame into the bit planes for all sub-fields in a single pass.
+// Called with vsync held, so the palette is stable.
+static void __not_in_flash_func(build_field_planes)(uint frame) {
+#if !(FSAA || TESTCARD_BAR || DEBUGLINE || OLED_CALIBRATION)
+    for (int i = 0; i < 256; i++) {
+        oled_palette_shade[i] = oled_shade_lut[palette[i]];
+    }
+    const uint8_t *frame_pixels = frame_buffer[display_frame_index];
+#endif
+    uint phase = oled_dither_phase[frame & 3];
+    uint num_subfields = oled_cal->num_subfields;
+    for (int p = 0; p < (DISPLAYHEIGHT / 8) ; ++p) {
+        for (int x = 0; x < DISPLAYWIDTH; ++x) {
+            uint mx = (x + (phase >> 4)) & 3;
+            uint32_t bits = 0;
+            for (int b = 0; b < 8; ++b) {
+                int y = (DISPLAYHEIGHT-1)-(p*8+b);
+                uint threshold = oled_dither_matrix[(y + (phase & 0xf)) & 3][mx];
+#if FSAA || TESTCARD_BAR || DEBUGLINE || OLED_CALIBRATION
+                uint shade = oled_shade_lut[pixel_lum(x, y)];
+#else
+                uint shade = oled_palette_shade[frame_pixels[y*SCREENWIDTH + x]];
+#endif
+                bits = (bits >> 1) | shade_plane_bits(shade, threshold);
+            }
+            for (uint i = 0; i < num_subfields; i++) {
+                field_planes[i][p*DISPLAYWIDTH+x] = (uint8_t)(bits >> (8 * i));
+            }
+        }
+    }
+}
+
 #if PICO_ON_DEVICE
 #define LOW_PRIO_IRQ 31
 #include "hardware/irq.h"
@@ -367,11 +578,6 @@ static void __not_in_flash_func(free_buffer_callback)() {
     *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISPR_OFFSET)) = 1u << LOW_PRIO_IRQ;
 }
 
-#define FRAME_PERIOD J_OLED_FRAME_PERIOD
-
-// some oleds need 2 park lines, but that's not as robust
-#define PARK_LINES 1
-
 static const uint8_t command_initialise[] = {
     0xAE,           //display off
     0xD5, 0xF0,     //set display clock divide
@@ -394,8 +600,8 @@ static const uint8_t command_initialise[] = {
     0xAF            // set display on
 };
 
-static const uint8_t command_park[] = {
-    0xA8, PARK_LINES - 1,        //set 2-line multiplex
+static uint8_t command_park[] = {
+    0xA8, 0,        //set park-line multiplex
     0xD3, 4         //set display offset off the... bottom?
 };
 
@@ -405,11 +611,8 @@ static uint8_t command_run[] = {
     0xA8, DISPLAYHEIGHT + 16 - 1,       //multiplex + overscan
 };
 
-static const uint8_t contrast[3] = {
-    0x7f, 0x1f, 0x07
-};
-
-uint8_t field_buffer[DISPLAYWIDTH*(DISPLAYHEIGHT/8)] = {};
+static uint field_dma_chan;
+static dma_channel_config field_dma_config;
 
 uint8_t byte_reverse(uint8_t b) {
    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
@@ -448,6 +651,37 @@ static void display_driver_init() {
     spi_write_blocking(spi0, command_initialise, sizeof(command_initialise));
 
     gpio_put(J_OLED_CS, 1);
+
+    field_dma_chan = dma_claim_unused_channel(true);
+    field_dma_config = dma_channel_get_default_config(field_dma_chan);
+    channel_config_set_transfer_data_size(&field_dma_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&field_dma_config, true);
+    channel_config_set_write_increment(&field_dma_config, false);
+    channel_config_set_dreq(&field_dma_config, spi_get_dreq(spi0, true));
+}
+
+static void __not_in_flash_func(send_field)(uint l) {
+    gpio_put(J_OLED_CS, 0);
+
+    gpio_put(J_OLED_DC, 0);
+    command_park[1] = oled_cal->park_lines - 1;
+    spi_write_blocking(spi0, command_park, sizeof(command_park));
+
+    gpio_put(J_OLED_DC, 1);
+    dma_channel_configure(field_dma_chan, &field_dma_config, &spi_get_hw(spi0)->dr,
+                          field_planes[l], sizeof(field_planes[l]), true);
+    dma_channel_wait_for_finish_blocking(field_dma_chan);
+    // the DMA is done once the last byte is in the FIFO; DC must not change until it is shifted out
+    while (spi_is_busy(spi0)) {
+        tight_loop_contents();
+    }
+    gpio_put(J_OLED_DC, 0);
+
+    // this also drains the RX FIFO (and clears the overrun) left over from the DMA
+    command_run[1] = oled_cal->subfield[l].contrast;
+    spi_write_blocking(spi0, command_run, sizeof(command_run));
+
+    gpio_put(J_OLED_CS, 1);
 }
 #else
 
@@ -477,15 +711,17 @@ static const scanvideo_mode_t bogus_mode = {
     .yscale = 1,
 };
 
-#define FRAME_PERIOD 5556
-
 extern SDL_Window *window;
 static void display_driver_init() {
-
+#if !PD_BENCH
+    // the benchmark build is headless, so we never set up the (SDL) display
     scanvideo_setup(&bogus_mode);
+#endif
 }
 
-static void simulate_display(uint dither) {
+// Show what the panel integrates over a frame: each pixel's light output summed over the
+// sub-fields it is lit in, taken from the same bit planes the device would send.
+static void simulate_display() {
     static bool first = true;
     if (texture_raw && first) {
         SDL_SetWindowSize(window, 640, 360);
@@ -493,42 +729,20 @@ static void simulate_display(uint dither) {
     }
 
     if (pico_access_surface) {
-        uint8_t* data = (uint8_t*)pico_access_surface->pixels;
+        uint w = MIN(DISPLAYWIDTH, pico_access_surface->w);
+        uint h = MIN(DISPLAYHEIGHT, pico_access_surface->h);
+        uint max_light = oled_code_light[(1u << oled_cal->num_subfields) - 1];
 
-        uint w = MIN(MIN(DISPLAYWIDTH, SCREENWIDTH), pico_access_surface->w);
-        uint h = MIN(MIN(DISPLAYHEIGHT, SCREENHEIGHT), pico_access_surface->h);
-        
         for (int y = 0; y < h; ++y) {
             uint16_t* row = (uint16_t*)((uint8_t*)pico_access_surface->pixels + pico_access_surface->pitch * y);
-            dither ^= 1;
+            uint offset = (((DISPLAYHEIGHT-1)-y) / 8) * DISPLAYWIDTH;
+            uint bit = ((DISPLAYHEIGHT-1)-y) & 7;
             for (int x = 0; x < w; ++x) {
-                dither ^= 1;
-
-#if FSAA
-                uint8_t *pframe = &frame_buffer[display_frame_index][y*(SCREENWIDTH<<FSAA) + (x<<FSAA)];
-                uint lum = 0;
-                for (int aay=0; aay<(1<<FSAA); ++aay) {
-                    for (int aax=0; aax<(1<<FSAA); ++aax) {
-                        lum += palette[pframe[aay*SCREENWIDTH + aax]];
-                    }
+                uint code = 0;
+                for (uint i = 0; i < oled_cal->num_subfields; i++) {
+                    code |= ((field_planes[i][offset + x] >> bit) & 1) << i;
                 }
-                lum >>= (FSAA*2);
-                pframe += (1<<FSAA);
-#else
-                uint8_t *pframe = &frame_buffer[display_frame_index][y*SCREENWIDTH + x];
-                uint lum = palette[*pframe];
-#endif
-
-                lum = (lum >> 5) + ((lum >> 4) & dither);
-                lum = MIN(lum, 7);
-
-#if DEBUGLINE
-                if (x < 6)
-                    lum = (-(((y>>(5-x))&1)==0))&7;
-                if (y == debugline)
-                    lum = 7;
-#endif
-                lum *= 36;
+                uint lum = (oled_code_light[code] * 255) / max_light;
                 row[x] = PICO_SCANVIDEO_PIXEL_FROM_RGB8(lum, lum, lum);
             }
         }
@@ -541,101 +755,57 @@ static void simulate_display(uint dither) {
 
 #endif
 
-//#define TESTCARD_BAR 1
-
 static void core1() {
+#if PD_BENCH
+    // the benchmark build is headless and times the renderer alone; with no display to pace it, core1 would spin
+    // converting frames nobody sees, contending with I_FinishUpdate for vsync, so it just stays parked
+    while (true) {
+        sleep_ms(1000);
+    }
+#endif
     absolute_time_t frame_time = get_absolute_time();
+#if PICO_ON_DEVICE
+    // we are parked while core 0 is writing save games to flash
+    multicore_lockout_victim_init();
+#endif
 
     uint l = 0;
-    uint dither = 0;
+    uint frame = 0;
+    oled_set_calibration(&oled_calibrations[OLED_PANEL_BATCH]);
+
+    sem_acquire_blocking(&vsync);
+    build_field_planes(frame);
+    sem_release(&vsync);
 
     while (true) {
+        uint period = oled_cal->subfield[l].period_us;
 #if PICO_ON_DEVICE
-        gpio_put(J_OLED_CS, 0);
-
-        gpio_put(J_OLED_DC, 0);
-        spi_write_blocking(spi0, command_park, sizeof(command_park));
-#endif
-
+        send_field(l);
+#else
         if (l == 0) {
-            sem_acquire_blocking(&vsync);
+            simulate_display();
         }
-
-#if PICO_ON_DEVICE
-        uint8_t level = 0x04 >> l;
-
-        for (int p = 0; p < (DISPLAYHEIGHT / 8) ; ++p) {
-            for (int x = 0; x < DISPLAYWIDTH; ++x) {
-                dither ^= 1;
-                uint8_t byte = 0;
-                for (int b = 0; b < 8; ++b) {
-                    dither ^= 1;
-
-                    int y = (DISPLAYHEIGHT-1)-(p*8+b);
-#if FSAA
-                    uint8_t *pframe = &frame_buffer[display_frame_index][y*(SCREENWIDTH<<FSAA) + (x<<FSAA)];
-                    uint lum = 0;
-                    for (int aay=0; aay<(1<<FSAA); ++aay) {
-                        for (int aax=0; aax<(1<<FSAA); ++aax) {
-                            lum += palette[pframe[aay*SCREENWIDTH + aax]];
-                        }
-                    }
-                    lum >>= (FSAA*2);
-                    pframe += (1<<FSAA);
-#else
-                    uint8_t *pframe = &frame_buffer[display_frame_index][y*SCREENWIDTH + x];
-                    uint lum = palette[*pframe];
 #endif
 
-#if TESTCARD_BAR
-                    if (x < 8)
-                        lum = y*6;
-#endif
-
-                    lum = (lum >> 5) + ((lum >> 4) & dither);
-                    lum = MIN(lum, 7);
-
-#if DEBUGLINE
-                    if (x < 6)
-                        lum = (-(((y>>(5-x))&1)==0))&7;
-                    if (y == debugline)
-                        lum = 7;
-#endif
-
-                    byte >>= 1;
-                    if (lum & level) {
-                        byte |= 0x80;
-                    }
-                }
-                field_buffer[p*DISPLAYWIDTH+x] = byte;
+        if (++l >= oled_cal->num_subfields) {
+            l = 0;
+            frame++;
+#if OLED_CALIBRATION
+            // step through the calibration entries every few seconds; pick the one whose test card looks even
+            if (!(frame & 0xff)) {
+                uint batch = ((frame >> 8) + OLED_PANEL_BATCH) % count_of(oled_calibrations);
+                oled_set_calibration(&oled_calibrations[batch]);
+                printf("OLED calibration %d: %s\n", batch, oled_cal->name);
             }
-        }
-        
-        command_run[1] = contrast[l];
-#else
-        simulate_display(dither);
 #endif
-
-        if (++l >= 3) {
-            l = 0;
-            dither ^= 1;
-        }
-
-        if (l == 0) {
+            // the planes are free once the last sub-field is sent; convert the next frame now, so
+            // every sub-field goes out at the start of its period, and release the frame buffer early
+            sem_acquire_blocking(&vsync);
+            build_field_planes(frame);
             sem_release(&vsync);
         }
 
-#if PICO_ON_DEVICE
-        gpio_put(J_OLED_DC, 1);
-        spi_write_blocking(spi0, field_buffer, sizeof(field_buffer));
-        gpio_put(J_OLED_DC, 0);
-
-        spi_write_blocking(spi0, command_run, sizeof(command_run));
-
-        gpio_put(J_OLED_CS, 1);
-#endif
-
-        frame_time = delayed_by_us(frame_time, FRAME_PERIOD);
+        frame_time = delayed_by_us(frame_time, period);
         sleep_until(frame_time);
     }
 }
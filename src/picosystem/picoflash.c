@@ -34,7 +34,8 @@ static void __no_inline_not_in_flash_func(flash_enable_xip_via_boot2)(const uint
 
 #define FLASH_BLOCK_SIZE (1u << 16)
 
-void __no_inline_not_in_flash_func(picoflash_sector_program)(uint32_t flash_offs, const uint8_t *data) {
+// erase the sector at flash_offs if erase is set, then program size bytes of data there
+static void __no_inline_not_in_flash_func(picoflash_op)(uint32_t flash_offs, bool erase, const uint8_t *data, uint32_t size) {
     rom_connect_internal_flash_fn connect_internal_flash = (rom_connect_internal_flash_fn)rom_func_lookup_inline(ROM_FUNC_CONNECT_INTERNAL_FLASH);
     rom_flash_exit_xip_fn flash_exit_xip = (rom_flash_exit_xip_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_EXIT_XIP);
     rom_flash_range_program_fn flash_range_program = (rom_flash_range_program_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_RANGE_PROGRAM);
@@ -48,8 +49,21 @@ void __no_inline_not_in_flash_func(picoflash_sector_program)(uint32_t flash_offs
 
     connect_internal_flash();
     flash_exit_xip();
-    flash_range_erase(flash_offs, FLASH_SECTOR_SIZE, FLASH_BLOCK_SIZE, FLASH_BLOCK_ERASE_CMD);
-    flash_range_program(flash_offs, data, FLASH_SECTOR_SIZE);
+    if (erase) flash_range_erase(flash_offs, FLASH_SECTOR_SIZE, FLASH_BLOCK_SIZE, FLASH_BLOCK_ERASE_CMD);
+    if (size) flash_range_program(flash_offs, data, size);
     flash_flush_cache(); // Note this is needed to remove CSn IO force as well as cache flushing
     flash_enable_xip_via_boot2(boot2_copyout);
 }
+
+void __no_inline_not_in_flash_func(picoflash_sector_program)(uint32_t flash_offs, const uint8_t *data) {
+    picoflash_op(flash_offs, true, data, FLASH_SECTOR_SIZE);
+}
+
+void __no_inline_not_in_flash_func(picoflash_sector_erase)(uint32_t flash_offs) {
+    picoflash_op(flash_offs, true, NULL, 0);
+}
+
+void __no_inline_not_in_flash_func(picoflash_page_program)(uint32_t flash_offs, const uint8_t *data, uint32_t size) {
+    assert(!(flash_offs & (FLASH_PAGE_SIZE - 1)) && !(size & (FLASH_PAGE_SIZE - 1)));
+    picoflash_op(flash_offs, false, data, size);
+}
@@ -9,5 +9,11 @@
 
 #define FLASH_SECTOR_SIZE (1u << 12)
 
+#define FLASH_PAGE_SIZE (1u << 8)
+
 // erase and write a 4K sector
 void picoflash_sector_program(uint32_t flash_offs, const uint8_t *data);
+// erase a 4K sector
+void picoflash_sector_erase(uint32_t flash_offs);
+// write whole 256 byte pages of an erased sector
+void picoflash_page_program(uint32_t flash_offs, const uint8_t *data, uint32_t size);
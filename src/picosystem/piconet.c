@@ -6,13 +6,16 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include "piconet.h"
 
 #if USE_PICO_NET
 
 boolean net_client_connected;
 
-#if PICO_ON_DEVICE
+// PICONET_SIM builds this file on the host against the simulated i2c bus in piconet_sim.cpp
+#if PICO_ON_DEVICE || PICONET_SIM
+#if !PICONET_SIM
 #include "hardware/irq.h"
 #include "hardware/dma.h"
 #include "hardware/timer.h"
@@ -20,6 +23,7 @@ boolean net_client_connected;
 #include "hardware/gpio.h"
 #include "pico/sync.h"
 #include "pico/binary_info.h"
+#endif
 #if DOOM_DEBUG_INFO
 #define piconet_assert(x) ({ if (!(x)) panic("DOH "__STRING(x)"\n");})
 #define piconet_warning printf
@@ -30,20 +34,33 @@ static inline void piconet_warning(const char *fmt, ...) {}
 static inline void piconet_info(const char *fmt, ...) {}
 #endif
 
-#define PICONET_VERSION 1
+// 2: tic messages carry a delta coded window of all unacknowledged tics, protected by a crc
+#define PICONET_VERSION 2
 
 // todo ditch client that causes abort (after a bit)
 
 #define PERIODIC_ALARM_NUM 1
 #define I2C_DMA_CHANNEL_READ 9
 #define I2C_DMA_CHANNEL_WRITE 10
-#define TO_HOST_LENGTH 32 // fixed size
+#define TO_HOST_LENGTH 40 // fixed size
 #define TO_CLIENT_LENGTH 128
 
 #define CLIENT_TIMEOUT_SHORT_US 100000 // long enough for an entire poll round
 #define CLIENT_TIMEOUT_LONG_US 1000000
 
+// in game the poll period adapts to the tic latency we see on the links: poll faster while tics take more than
+// POLL_LATENCY_TARGET_US to be acknowledged, and back off towards PERIOD_MS when they are going through quickly.
+// the period never drops below the time the last poll round actually took plus POLL_ROUND_MARGIN_US
+#define POLL_PERIOD_MIN_US 2000
+#define POLL_ROUND_MARGIN_US 500
+#define POLL_PERIOD_STEP_US 500
+#define POLL_LATENCY_TARGET_US (1000000 / TICRATE / 2)
+// the game runs each tic as soon as it is complete, so one arriving more than a tic after the previous one holds it
+// up; the extra half tic allows for the poll round not lining up with the tics
+#define STALL_US (1000000 * 3 / TICRATE / 2)
+
 #include "d_loop.h"
+#include "i_timer.h"
 #include "doom/doomstat.h"
 
 
@@ -61,15 +78,17 @@ typedef enum {
 // master uses this to queue stuff to send, clients use it to queue stuff from server
 // note that it is a bit of an overlap with d_loop ticcmds, however combining the two seems like a fair amount of effort
 
+typedef enum
+{
+    in_none,
+    in_lobby,
+    in_game
+} synced_status_t;
+
 // local view of the shared state
 static struct
 {
-    enum
-    {
-        in_none,
-        in_lobby,
-        in_game
-    } status;
+    synced_status_t status;
     // this was going to be a union, but we don't have anythuing for the other states, and keeping it around always makes game start simpler
     lobby_state_t lobby;
 } synced_state;
@@ -80,21 +99,26 @@ typedef struct {
     uint32_t last_rx_time;
     int last_acked_by_client_tic;
     int last_sent_by_client_tic;
+    int last_sent_to_client_tic; // highest tic we have sent (but not necessarily had acknowledged)
+    int stall_tic; // last tic we counted as stalled waiting for this client
+    piconet_link_stats_t link;
     uint8_t addr;
     uint8_t abort_count; // not sure this really helps
 } remote_client_t;
 
+typedef enum
+{
+    ps_begin,
+    ps_recv_clients,
+    ps_recv_poll,
+    ps_send_clients,
+    ps_send_poll,
+    ps_end
+} host_protocol_state_t;
+
 typedef struct
 {
-    enum
-    {
-        ps_begin,
-        ps_recv_clients,
-        ps_recv_poll,
-        ps_send_clients,
-        ps_send_poll,
-        ps_end
-    } protocol_state;
+    host_protocol_state_t protocol_state;
     // client number we are currently communicating iwth in m_recv_clients or m_send_clients
     int8_t client_num;
     // rotating poll address (looking for new clients) - used in game too so we can inform new clients what's going on
@@ -106,6 +130,10 @@ typedef struct
     int limit_tic; // tic we cannot receive data beyond or write over our local state
     // if non zero, error code for polling clients (they don't get to join)
     piconet_msg_type poll_error_response;
+    uint32_t round_start_time;
+    uint32_t round_us; // how long the last complete poll round took
+    uint32_t poll_period_us;
+    uint32_t tic_complete_time[BACKUPTICS]; // when each tic became complete, for measuring latency
     remote_client_t clients[NET_MAXPLAYERS];
 } host_state_t;
 
@@ -121,7 +149,12 @@ typedef struct
     int last_server_acked_tic;
     int last_local_tic;
     int last_received_from_server_tic;
+    int last_sent_to_server_tic; // highest tic we have sent (but not necessarily had acknowledged)
     int limit_tic;
+    int stall_tic; // last tic we counted as stalled waiting for the host
+    uint32_t last_received_time; // when last_received_from_server_tic last advanced
+    uint32_t local_tic_time[BACKUPTICS]; // when each local tic was made, for measuring latency
+    piconet_link_stats_t link;
 } client_state_t;
 
 static enum {
@@ -154,7 +187,9 @@ static __aligned(4) uint16_t large_buffer_16[TO_CLIENT_LENGTH+1];
 #define small_buffer_8 ((uint8_t*)small_buffer_16)
 #define large_buffer_8 ((uint8_t*)large_buffer_16)
 static critical_section_t critsec;
+#ifndef I2C_IRQ
 #define I2C_IRQ __CONCAT(I2C, __CONCAT(PICO_DEFAULT_I2C, _IRQ))
+#endif
 
 #define FAST 1
 
@@ -170,24 +205,26 @@ static critical_section_t critsec;
 #endif
 #define IN_GAME_CLIENT_ABORT_MAX 16
 
+typedef enum
+{
+    i2c_none,
+    i2c_send,
+    i2c_receive,
+    i2c_send_dma,
+    i2c_receive_dma,
+} i2c_activity_t;
+
 static struct {
     uint32_t client_id;
-    enum
-    {
-        i2c_none,
-        i2c_send,
-        i2c_receive,
-        i2c_send_dma,
-        i2c_receive_dma,
-    } activity;
+    i2c_activity_t activity;
     bool dma_active;
     uint8_t client_addr;
 } i2c_state;
 
 static void i2c_locked_cancel_dma() {
     if (i2c_state.dma_active) {
-        dma_hw->abort = I2C_DMA_CHANNEL_READ | I2C_DMA_CHANNEL_WRITE;
-        while (dma_hw->abort & (I2C_DMA_CHANNEL_READ | I2C_DMA_CHANNEL_WRITE)) tight_loop_contents();
+        dma_hw->abort = (1u << I2C_DMA_CHANNEL_READ) | (1u << I2C_DMA_CHANNEL_WRITE);
+        while (dma_hw->abort & ((1u << I2C_DMA_CHANNEL_READ) | (1u << I2C_DMA_CHANNEL_WRITE))) tight_loop_contents();
         i2c_state.dma_active = false;
     }
 }
@@ -223,33 +260,42 @@ typedef struct {
 } client_lobby_msg_t;
 static_assert(sizeof(client_lobby_msg_t) <= TO_HOST_LENGTH, "");
 
+// tic messages carry every tic the other side hasn't acknowledged yet (as many as fit), so a single lost or late
+// transfer doesn't hold anyone up; the next one that gets through fills the gap. the ticcmds are delta coded
+// against the previous tic's ticcmd for the same player (or zero for the first): a mask byte of which of the
+// ticcmd's 8 bytes changed, followed by those bytes. a flipped bit on the bus would otherwise silently desync the
+// game, so each tic message carries a crc of the whole message (bar the crc itself), and one which doesn't match is
+// dropped; the tics it carried are sent again in the next one
+static_assert(sizeof(ticcmd_t) == 8, "");
+
 typedef struct {
     client_packet_header_t hdr;
     int last_rx_tic; // last received from the server
-    int enclosed_tic; // -1 for none
-    ticcmd_t ticcmd;
+    int first_tic; // first enclosed tic, -1 for none
+    uint8_t tic_count;
+    uint16_t crc;
+    uint8_t cmd_data[TO_HOST_LENGTH - 20];
 } client_tic_msg_t;
-static_assert(sizeof(client_tic_msg_t) <= TO_HOST_LENGTH, "");
+static_assert(sizeof(client_tic_msg_t) == TO_HOST_LENGTH, "");
 
 typedef struct {
     host_packet_header_t hdr;
     lobby_state_t lobby_state;
 } host_lobby_msg_t;
-static_assert(sizeof(host_lobby_msg_t) <= count_of(large_buffer_16), "");
+// the local link stats at the end of the lobby state aren't sent
+#define LOBBY_SYNCED_SIZE offsetof(lobby_state_t, links)
+#define HOST_LOBBY_MSG_LENGTH (offsetof(host_lobby_msg_t, lobby_state) + LOBBY_SYNCED_SIZE)
+static_assert(HOST_LOBBY_MSG_LENGTH < count_of(large_buffer_16), "");
 
 typedef struct {
     client_packet_header_t hdr;
     int client_ack_tic; // last received from client
-    int enclosed_tic; // -1 for none
-} host_tic_msg_hdr_t;
-
-// if hdr.enclosed_tic != -1 then use this structure
-typedef struct {
-    host_tic_msg_hdr_t hdr;
-    ticcmd_set_t cmds;
+    int first_tic; // first enclosed tic, -1 for none
+    uint8_t tic_count;
+    uint16_t crc;
+    uint8_t cmd_data[TO_CLIENT_LENGTH - 20]; // NET_MAXPLAYERS ticcmds per tic
 } host_tic_msg_t;
-
-static_assert(sizeof(host_tic_msg_t) <= count_of(large_buffer_16), "");
+static_assert(sizeof(host_tic_msg_t) == TO_CLIENT_LENGTH, "");
 
 #if DOOM_DEBUG_INFO
 int foo_receive_count;
@@ -259,6 +305,66 @@ static uint32_t get_compat_hash() {
     return (PICONET_VERSION * 31 + whdheader->hash)&0xffffff;
 }
 
+// returns NULL if the ticcmd doesn't fit before end
+static uint8_t *encode_ticcmd(uint8_t *p, const uint8_t *end, const ticcmd_t *cmd, const ticcmd_t *prev) {
+    const uint8_t *c = (const uint8_t *)cmd;
+    const uint8_t *pc = (const uint8_t *)prev;
+    if (p == end) return NULL;
+    uint8_t *mask = p++;
+    *mask = 0;
+    for(int i=0;i<sizeof(ticcmd_t);i++) {
+        if (c[i] != pc[i]) {
+            if (p == end) return NULL;
+            *mask |= 1u << i;
+            *p++ = c[i];
+        }
+    }
+    return p;
+}
+
+// returns NULL if the data is truncated
+static const uint8_t *decode_ticcmd(const uint8_t *p, const uint8_t *end, ticcmd_t *cmd, const ticcmd_t *prev) {
+    uint8_t *c = (uint8_t *)cmd;
+    if (p == end) return NULL;
+    uint mask = *p++;
+    *cmd = *prev;
+    for(int i=0;i<sizeof(ticcmd_t);i++) {
+        if (mask & (1u << i)) {
+            if (p == end) return NULL;
+            c[i] = *p++;
+        }
+    }
+    return p;
+}
+
+// crc-16/ccitt, a nibble at a time to keep the table small
+static uint16_t crc16_update(uint16_t crc, const uint8_t *p, const uint8_t *end) {
+    static const uint16_t crc16_nibble_table[16] = {
+            0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+            0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+    while (p < end) {
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (*p >> 4)];
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (*p++ & 0xf)];
+    }
+    return crc;
+}
+
+// crc of the first len bytes of a client or host tic message, skipping the crc field
+#define tic_msg_crc(msg, len) crc16_update(crc16_update(0xffff, (const uint8_t *)(msg), (const uint8_t *)&(msg)->crc), \
+                                           (const uint8_t *)(&(msg)->crc + 1), (const uint8_t *)(msg) + (len))
+
+static const ticcmd_t no_ticcmd = {0};
+static const ticcmd_set_t no_ticcmd_set = {0};
+
+static void update_latency(piconet_link_stats_t *link, uint32_t sample_us) {
+    if (!link->latency_us) {
+        link->latency_us = sample_us;
+    } else {
+        link->latency_us += ((int32_t)(sample_us - link->latency_us)) / 8;
+    }
+}
+
 
 void i2c_irq_handler() {
     uint32_t status = i2c_get_hw(i2c_default)->intr_stat;
@@ -291,6 +397,7 @@ void i2c_irq_handler() {
                         // we don't want to skip the next up client
                         local_state.host.client_num--;
                     } else {
+                        local_state.host.clients[local_state.host.client_num].link.errors++;
                         if (++local_state.host.clients[local_state.host.client_num].abort_count > IN_GAME_CLIENT_ABORT_MAX) {
                             piconet_info("Lost client %d\n", local_state.host.client_num);
                             local_state.host.clients[local_state.host.client_num].id = 0;
@@ -304,6 +411,7 @@ void i2c_irq_handler() {
             }
         } else {
             piconet_debug("CLIENT ABORTED\n");
+            local_state.client.link.errors++;
         }
         i2c_state.activity = i2c_none;
     } else if (status & I2C_IC_INTR_STAT_R_RD_REQ_BITS) {
@@ -328,13 +436,28 @@ void i2c_irq_handler() {
                 client_tic_msg_t *tic_msg = (client_tic_msg_t *)pkt;
                 pkt->msg_type = piconet_msg_client_tic;
                 tic_msg->last_rx_tic = local_state.client.last_received_from_server_tic;
+                tic_msg->first_tic = -1;
+                tic_msg->tic_count = 0;
                 if (local_state.client.last_server_acked_tic < local_state.client.last_local_tic) {
-                    tic_msg->enclosed_tic = local_state.client.last_server_acked_tic + 1;
-                    tic_msg->ticcmd = ticdata[tic_msg->enclosed_tic % BACKUPTICS].cmds[consoleplayer];
-//                    printf("SEND TICK %d to server\n", tic_msg->enclosed_tic);
-                } else {
-                    tic_msg->enclosed_tic = -1;
+                    // send everything the host hasn't acknowledged that fits
+                    tic_msg->first_tic = local_state.client.last_server_acked_tic + 1;
+                    const ticcmd_t *prev = &no_ticcmd;
+                    uint8_t *p = tic_msg->cmd_data;
+                    for(int tic = tic_msg->first_tic; tic <= local_state.client.last_local_tic; tic++) {
+                        const ticcmd_t *cmd = &ticdata[tic % BACKUPTICS].cmds[consoleplayer];
+                        p = encode_ticcmd(p, tic_msg->cmd_data + sizeof(tic_msg->cmd_data), cmd, prev);
+                        if (!p) break;
+                        prev = cmd;
+                        tic_msg->tic_count++;
+                        if (tic <= local_state.client.last_sent_to_server_tic) {
+                            local_state.client.link.retransmits++;
+                        } else {
+                            local_state.client.last_sent_to_server_tic = tic;
+                        }
+                    }
+//                    printf("SEND TICS %d+%d to server\n", tic_msg->first_tic, tic_msg->tic_count);
                 }
+                tic_msg->crc = tic_msg_crc(tic_msg, TO_HOST_LENGTH);
             } else {
                 pkt->msg_type = piconet_msg_none;
             }
@@ -411,27 +534,54 @@ void i2c_irq_handler() {
                         }
                     } else if (pkt->msg_type == piconet_msg_client_tic) {
                         client_tic_msg_t *tic_msg = (client_tic_msg_t *)pkt;
-                        local_state.host.clients[local_state.host.client_num].abort_count = 0;
-                        if (local_state.host.protocol_state != ps_recv_clients || synced_state.status != in_game) {
+                        remote_client_t *client = &local_state.host.clients[local_state.host.client_num];
+                        client->abort_count = 0;
+                        if (tic_msg->crc != tic_msg_crc(tic_msg, TO_HOST_LENGTH)) {
+                            piconet_warning("CLIENT TICS crc mismatch\n");
+                            if (local_state.host.protocol_state == ps_recv_clients) client->link.corrupt++;
+                        } else if (local_state.host.protocol_state != ps_recv_clients || synced_state.status != in_game) {
                             piconet_warning("unexpected client tic ps %d ss %d\n", local_state.host.protocol_state, synced_state.status);
                         } else {
-//                            printf("CLIENT TIC enclosed %d ack %d\n", tic_msg->enclosed_tic, tic_msg->last_rx_tic);
-                            local_state.host.clients[local_state.host.client_num].last_rx_time = time_us_32();
-                            local_state.host.clients[local_state.host.client_num].last_acked_by_client_tic = tic_msg->last_rx_tic;
-                            if (tic_msg->enclosed_tic != -1) {
-                                //
-                                if (tic_msg->enclosed_tic > local_state.host.last_complete_tic &&
-                                    tic_msg->enclosed_tic < local_state.host.limit_tic) {
-//                                    printf("GOT TIC DATA FOR %d from client %d\n", tic_msg->enclosed_tic, local_state.host.client_num);
-//                                    printf("ticdata %d (slot %d) from %d %02x\n", tic_msg->enclosed_tic, tic_msg->enclosed_tic % BACKUPTICS, local_state.host.client_num, tic_msg->ticcmd.consistancy);
-                                    ticdata[tic_msg->enclosed_tic % BACKUPTICS].cmds[local_state.host.client_num] = tic_msg->ticcmd;
-                                    local_state.host.clients[local_state.host.client_num].last_sent_by_client_tic = tic_msg->enclosed_tic;
-                                    host_check_tic_advance_locked();
-                                } else {
-                                    piconet_warning("CLIENT TIC %d out of window %d->%d\n", tic_msg->enclosed_tic,
-                                                    local_state.host.last_complete_tic,
-                                                    local_state.host.limit_tic);
+//                            printf("CLIENT TICS %d+%d ack %d\n", tic_msg->first_tic, tic_msg->tic_count, tic_msg->last_rx_tic);
+                            uint32_t now = time_us_32();
+                            client->last_rx_time = now;
+                            if (tic_msg->last_rx_tic < client->last_acked_by_client_tic ||
+                                tic_msg->last_rx_tic > local_state.host.last_complete_tic) {
+                                // the client can't have received a tic we haven't completed
+                                piconet_warning("CLIENT ACK %d out of window %d->%d\n", tic_msg->last_rx_tic,
+                                                client->last_acked_by_client_tic, local_state.host.last_complete_tic);
+                            } else {
+                                if (tic_msg->last_rx_tic > client->last_acked_by_client_tic &&
+                                    tic_msg->last_rx_tic > local_state.host.last_complete_tic - BACKUPTICS) {
+                                    update_latency(&client->link, now - local_state.host.tic_complete_time[tic_msg->last_rx_tic % BACKUPTICS]);
                                 }
+                                client->last_acked_by_client_tic = tic_msg->last_rx_tic;
+                            }
+                            if (tic_msg->first_tic != -1) {
+                                const uint8_t *p = tic_msg->cmd_data;
+                                const uint8_t *end = tic_msg->cmd_data + sizeof(tic_msg->cmd_data);
+                                ticcmd_t cmd = no_ticcmd;
+                                for(int i = 0; i < tic_msg->tic_count; i++) {
+                                    int tic = tic_msg->first_tic + i;
+                                    p = decode_ticcmd(p, end, &cmd, &cmd);
+                                    if (!p) {
+                                        piconet_warning("CLIENT TICS truncated at %d\n", tic);
+                                        break;
+                                    }
+                                    // already have it from an earlier message
+                                    if (tic <= client->last_sent_by_client_tic) continue;
+                                    if (tic == client->last_sent_by_client_tic + 1 && tic < local_state.host.limit_tic) {
+//                                        printf("ticdata %d (slot %d) from %d %02x\n", tic, tic % BACKUPTICS, local_state.host.client_num, cmd.consistancy);
+                                        ticdata[tic % BACKUPTICS].cmds[local_state.host.client_num] = cmd;
+                                        client->last_sent_by_client_tic = tic;
+                                    } else {
+                                        piconet_warning("CLIENT TIC %d out of window %d->%d\n", tic,
+                                                        client->last_sent_by_client_tic,
+                                                        local_state.host.limit_tic);
+                                        break;
+                                    }
+                                }
+                                host_check_tic_advance_locked();
                             }
                         }
                     } else {
@@ -462,7 +612,7 @@ void i2c_irq_handler() {
                         if (hdr->msg_type == piconet_msg_host_lobby) {
                             if (synced_state.status == in_lobby) {
                                 host_lobby_msg_t *lobby_msg = (host_lobby_msg_t *) hdr;
-                                synced_state.lobby = lobby_msg->lobby_state;
+                                memcpy(&synced_state.lobby, &lobby_msg->lobby_state, LOBBY_SYNCED_SIZE);
                                 // update our player number
                                 local_state.client.player_num = -1;
                                 for (int i = 0; i < NET_MAXPLAYERS; i++) {
@@ -472,22 +622,52 @@ void i2c_irq_handler() {
                                 }
                             }
                         } else if (hdr->msg_type == piconet_msg_host_tic) {
-                            synced_state.status = in_game; // cause auto launch
                             host_tic_msg_t *tic_msg = (host_tic_msg_t *) hdr;
-                            if (tic_msg->hdr.enclosed_tic != -1) {
-                                local_state.client.last_server_acked_tic = tic_msg->hdr.client_ack_tic;
-                                if (tic_msg->hdr.enclosed_tic == local_state.client.last_received_from_server_tic + 1) {
-                                    if (tic_msg->hdr.enclosed_tic < local_state.client.limit_tic) {
-//                                        printf("  storing\n");
-                                        local_state.client.last_received_from_server_tic = tic_msg->hdr.enclosed_tic;
-                                        ticdata[tic_msg->hdr.enclosed_tic % BACKUPTICS] = tic_msg->cmds;
-//                                        printf("ticdata %d (slot %d) %02x %02x\n", tic_msg->hdr.enclosed_tic, tic_msg->hdr.enclosed_tic % BACKUPTICS, tic_msg->cmds.cmds[0].consistancy, tic_msg->cmds.cmds[1].consistancy);
-                                    } else {
-                                        // probably should not happen!
-                                        piconet_warning("no room for host TIC %d ack %d\n", tic_msg->hdr.enclosed_tic, tic_msg->hdr.client_ack_tic);
+                            if (local_state.client.rx_length < offsetof(host_tic_msg_t, cmd_data) ||
+                                local_state.client.rx_length > TO_CLIENT_LENGTH ||
+                                tic_msg->crc != tic_msg_crc(tic_msg, local_state.client.rx_length)) {
+                                piconet_warning("host TICS crc mismatch\n");
+                                local_state.client.link.corrupt++;
+                            } else {
+                                synced_state.status = in_game; // cause auto launch
+                                if (tic_msg->client_ack_tic > local_state.client.last_local_tic) {
+                                    piconet_warning("host ACK %d beyond our last tic %d\n", tic_msg->client_ack_tic, local_state.client.last_local_tic);
+                                } else if (tic_msg->client_ack_tic > local_state.client.last_server_acked_tic) {
+                                    if (tic_msg->client_ack_tic > local_state.client.last_local_tic - BACKUPTICS) {
+                                        update_latency(&local_state.client.link, local_state.client.last_rx_time -
+                                                       local_state.client.local_tic_time[tic_msg->client_ack_tic % BACKUPTICS]);
+                                    }
+                                    local_state.client.last_server_acked_tic = tic_msg->client_ack_tic;
+                                }
+                                if (tic_msg->first_tic != -1) {
+                                    const uint8_t *p = tic_msg->cmd_data;
+                                    const uint8_t *end = large_buffer_8 + local_state.client.rx_length;
+                                    ticcmd_set_t cmds = no_ticcmd_set;
+                                    for(int i = 0; i < tic_msg->tic_count; i++) {
+                                        int tic = tic_msg->first_tic + i;
+                                        for(int pl = 0; pl < NET_MAXPLAYERS && p; pl++) {
+                                            p = decode_ticcmd(p, end, &cmds.cmds[pl], &cmds.cmds[pl]);
+                                        }
+                                        if (!p) {
+                                            piconet_warning("host TICS truncated at %d\n", tic);
+                                            break;
+                                        }
+                                        // already have it from an earlier message
+                                        if (tic <= local_state.client.last_received_from_server_tic) continue;
+                                        if (tic != local_state.client.last_received_from_server_tic + 1) {
+                                            piconet_warning("  expected tic %d but got %d\n", local_state.client.last_received_from_server_tic + 1, tic);
+                                            break;
+                                        }
+                                        if (tic >= local_state.client.limit_tic) {
+                                            // probably should not happen!
+                                            piconet_warning("no room for host TIC %d ack %d\n", tic, tic_msg->client_ack_tic);
+                                            break;
+                                        }
+                                        local_state.client.last_received_from_server_tic = tic;
+                                        local_state.client.last_received_time = time_us_32();
+                                        ticdata[tic % BACKUPTICS] = cmds;
+//                                        printf("ticdata %d (slot %d) %02x %02x\n", tic, tic % BACKUPTICS, cmds.cmds[0].consistancy, cmds.cmds[1].consistancy);
                                     }
-                                } else {
-                                    piconet_warning("  expected tic %d but got %d\n", local_state.client.last_received_from_server_tic + 1, tic_msg->hdr.enclosed_tic);
                                 }
                             }
                         } else if (synced_state.status == in_lobby) {
@@ -583,27 +763,45 @@ static void host_advance_protocol_state_locked() {
                     // note we send lobby message until the client acknowledges the game start (by sending a tic)
                     if (local_state.host.clients[local_state.host.client_num].last_acked_by_client_seq != synced_state.lobby.seq) {
                         hdr->msg_type = piconet_msg_host_lobby;
-                        ((host_lobby_msg_t *) hdr)->lobby_state = synced_state.lobby;
+                        memcpy(&((host_lobby_msg_t *) hdr)->lobby_state, &synced_state.lobby, LOBBY_SYNCED_SIZE);
 //                        printf("SENDING UPDATED LOBBY (%d) TO CLIENT %d\n", (int) synced_state.lobby.seq,
 //                               local_state.host.client_num);
-                        len = sizeof(host_lobby_msg_t);
+                        len = HOST_LOBBY_MSG_LENGTH;
                     } else {
                         // just send dummy message
                     }
                 } else if (synced_state.status == in_game) {
                     hdr->msg_type = piconet_msg_host_tic;
-                    host_tic_msg_hdr_t *tichdr = (host_tic_msg_hdr_t *)hdr;
-                    tichdr->client_ack_tic = local_state.host.clients[local_state.host.client_num].last_sent_by_client_tic;
-                    if (local_state.host.clients[local_state.host.client_num].last_acked_by_client_tic < local_state.host.last_complete_tic) {
-                        tichdr->enclosed_tic = local_state.host.clients[local_state.host.client_num].last_acked_by_client_tic + 1;
-                        ((host_tic_msg_t *)tichdr)->cmds = ticdata[tichdr->enclosed_tic % BACKUPTICS];
-//                        printf("SENDING TIC %d to client %d\n", tichdr->enclosed_tic, local_state.host.client_num);
-                        len = sizeof(host_tic_msg_t);
-                    } else {
-//                        printf("NOT SENDING TIC to client %d acked = %d complete = %d\n", local_state.host.client_num, local_state.host.clients[local_state.host.client_num].last_acked_by_client_tic, local_state.host.last_complete_tic);
-                        tichdr->enclosed_tic = -1;
-                        len = sizeof(host_tic_msg_hdr_t);
+                    host_tic_msg_t *tic_msg = (host_tic_msg_t *)hdr;
+                    remote_client_t *client = &local_state.host.clients[local_state.host.client_num];
+                    tic_msg->client_ack_tic = client->last_sent_by_client_tic;
+                    tic_msg->first_tic = -1;
+                    tic_msg->tic_count = 0;
+                    uint8_t *p = tic_msg->cmd_data;
+                    if (client->last_acked_by_client_tic < local_state.host.last_complete_tic) {
+                        // send every complete tic the client hasn't acknowledged that fits
+                        tic_msg->first_tic = client->last_acked_by_client_tic + 1;
+                        const ticcmd_set_t *prev = &no_ticcmd_set;
+                        for(int tic = tic_msg->first_tic; tic <= local_state.host.last_complete_tic; tic++) {
+                            const ticcmd_set_t *cmds = &ticdata[tic % BACKUPTICS];
+                            uint8_t *next = p;
+                            for(int pl = 0; pl < NET_MAXPLAYERS && next; pl++) {
+                                next = encode_ticcmd(next, tic_msg->cmd_data + sizeof(tic_msg->cmd_data), &cmds->cmds[pl], &prev->cmds[pl]);
+                            }
+                            if (!next) break;
+                            p = next;
+                            prev = cmds;
+                            tic_msg->tic_count++;
+                            if (tic <= client->last_sent_to_client_tic) {
+                                client->link.retransmits++;
+                            } else {
+                                client->last_sent_to_client_tic = tic;
+                            }
+                        }
+//                        printf("SENDING TICS %d+%d to client %d\n", tic_msg->first_tic, tic_msg->tic_count, local_state.host.client_num);
                     }
+                    len = p - large_buffer_8;
+                    tic_msg->crc = tic_msg_crc(tic_msg, len);
                 }
                 if (!len) {
                     hdr->msg_type = piconet_msg_none;
@@ -620,21 +818,50 @@ static void host_advance_protocol_state_locked() {
             hdr->msg_type = local_state.host.poll_error_response;
             hdr->client_id = local_state.host.poll_client_id;
             host_send_locked(local_state.host.poll_addr, sizeof(host_packet_header_t));
-            local_state.host.poll_error_response = 0;
+            local_state.host.poll_error_response = piconet_msg_none;
             return;
         }
     }
     if (local_state.host.protocol_state == ps_send_poll) {
         local_state.host.protocol_state = ps_end;
+        local_state.host.round_us = time_us_32() - local_state.host.round_start_time;
     }
 }
 
+static uint32_t host_update_poll_period_locked() {
+    uint32_t period_us = local_state.host.poll_period_us;
+    if (synced_state.status != in_game) {
+        period_us = PERIOD_MS * 1000;
+    } else {
+        uint32_t latency_us = 0;
+        for(int i=1;i<NET_MAXPLAYERS;i++) {
+            if (local_state.host.clients[i].id && local_state.host.clients[i].link.latency_us > latency_us) {
+                latency_us = local_state.host.clients[i].link.latency_us;
+            }
+        }
+        if (latency_us > POLL_LATENCY_TARGET_US) {
+            period_us -= period_us / 4;
+        } else if (latency_us < POLL_LATENCY_TARGET_US / 2) {
+            period_us += POLL_PERIOD_STEP_US;
+        }
+        if (period_us > PERIOD_MS * 1000) period_us = PERIOD_MS * 1000;
+        // but no faster than we can get round everyone
+        uint32_t min_period_us = local_state.host.round_us + POLL_ROUND_MARGIN_US;
+        if (min_period_us < POLL_PERIOD_MIN_US) min_period_us = POLL_PERIOD_MIN_US;
+        if (period_us < min_period_us) period_us = min_period_us;
+    }
+    local_state.host.poll_period_us = period_us;
+    return period_us;
+}
+
 static void periodic_tick(uint timer) {
 //    printf("TICK\n");
     critical_section_enter_blocking(&critsec);
     if (i2c_state.activity != i2c_none) {
         piconet_warning("OOPS BAD STATE %d %08x\n", i2c_state.activity, (int)i2c_get_hw(i2c_default)->raw_intr_stat);
         i2c_state.activity = i2c_none;
+        // the last round didn't finish in time, so don't poll any faster than this
+        local_state.host.round_us = local_state.host.poll_period_us;
         hw_set_bits(&i2c_get_hw(i2c_default)->enable, I2C_IC_ENABLE_ABORT_BITS);
     }
     do {
@@ -647,9 +874,11 @@ static void periodic_tick(uint timer) {
         if (!found) break;
     } while (true);
     local_state.host.protocol_state = ps_begin;
+    local_state.host.round_start_time = time_us_32();
     host_advance_protocol_state_locked();
+    uint32_t period_us = host_update_poll_period_locked();
     critical_section_exit(&critsec);
-    bool missed = hardware_alarm_set_target(PERIODIC_ALARM_NUM, make_timeout_time_ms(PERIOD_MS));
+    bool missed = hardware_alarm_set_target(PERIODIC_ALARM_NUM, make_timeout_time_us(period_us));
 //    printf("SET TIMER %d %d\n", missed, timer_hw->ints & 1u << PERIODIC_ALARM_NUM);
 }
 
@@ -699,9 +928,12 @@ void piconet_start_host(int8_t deathmatch, int8_t epi, int8_t skill) {
     local_state.host.poll_addr = ADDR_LOW;
     local_state.host.clients[0].id = client_id;
     local_state.host.last_complete_tic = -1;
+    local_state.host.poll_period_us = PERIOD_MS * 1000;
     for(int i=0;i<NET_MAXPLAYERS;i++) {
         local_state.host.clients[i].last_sent_by_client_tic = -1;
         local_state.host.clients[i].last_acked_by_client_tic = -1;
+        local_state.host.clients[i].last_sent_to_client_tic = -1;
+        local_state.host.clients[i].stall_tic = -1;
     }
 
     i2c_get_hw(i2c_default)->enable = 0;
@@ -727,6 +959,7 @@ void piconet_start_client() {
     synced_state.status = in_lobby;
     role = role_client;
     local_state.client.last_local_tic = local_state.client.last_server_acked_tic = local_state.client.last_received_from_server_tic = -1;
+    local_state.client.last_sent_to_server_tic = local_state.client.stall_tic = -1;
     client_new_random_addr_locked();
     i2c_set_slave_mode(i2c_default, true, i2c_state.client_addr);
     i2c_get_hw(i2c_default)->enable = 0;
@@ -782,7 +1015,16 @@ int piconet_get_lobby_state(lobby_state_t *state) {
     } else {
         rc = -1;
     }
-    memcpy(state, &synced_state.lobby, sizeof(lobby_state_t));
+    memcpy(state, &synced_state.lobby, LOBBY_SYNCED_SIZE);
+    for(int i=0;i<NET_MAXPLAYERS;i++) {
+        if (role == role_host) {
+            state->links[i] = local_state.host.clients[i].link;
+        } else if (role == role_client && !i) {
+            state->links[i] = local_state.client.link;
+        } else {
+            memset(&state->links[i], 0, sizeof(piconet_link_stats_t));
+        }
+    }
     critical_section_exit(&critsec);
     return rc;
 }
@@ -805,6 +1047,7 @@ void piconet_new_local_tic(int tic) {
     if (role == role_client) {
         piconet_assert(tic == local_state.client.last_local_tic + 1);
         local_state.client.last_local_tic = tic;
+        local_state.client.local_tic_time[tic % BACKUPTICS] = time_us_32();
     } else {
         local_state.host.clients[0].last_sent_by_client_tic = tic;
         host_check_tic_advance_locked();
@@ -825,6 +1068,19 @@ int piconet_maybe_recv_tic(int fromtic) {
 #endif
         } else {
             uint32_t now = time_us_32();
+            if (local_state.host.clients[0].last_sent_by_client_tic > local_state.host.last_complete_tic &&
+                local_state.host.last_complete_tic >= 0 &&
+                now - local_state.host.tic_complete_time[local_state.host.last_complete_tic % BACKUPTICS] > STALL_US) {
+                // the next tic is overdue; count it against each client we don't have it from yet
+                for(int i=1;i<NET_MAXPLAYERS;i++) {
+                    remote_client_t *client = &local_state.host.clients[i];
+                    if (client->id && client->last_sent_by_client_tic <= local_state.host.last_complete_tic &&
+                        client->stall_tic != fromtic) {
+                        client->stall_tic = fromtic;
+                        client->link.stalls++;
+                    }
+                }
+            }
             for(int i=1;i<NET_MAXPLAYERS;i++) {
                 if (local_state.host.clients[i].id && now - local_state.host.clients[i].last_rx_time > CLIENT_TIMEOUT_SHORT_US) {
                     piconet_info("KICKING CLIENT %d out\n", i);
@@ -843,16 +1099,26 @@ int piconet_maybe_recv_tic(int fromtic) {
                    ticdata[fromtic%BACKUPTICS].cmds[1].angleturn, ticdata[fromtic%BACKUPTICS].cmds[1].forwardmove, ticdata[fromtic%BACKUPTICS].cmds[1].buttons, ticdata[fromtic%BACKUPTICS].cmds[1].consistancy,
                    local_state.client.limit_tic);
 #endif
-        } else if (time_us_32() - local_state.client.last_rx_time > CLIENT_TIMEOUT_SHORT_US) {
-            net_client_connected = false;
-            for(int i=0;i<NET_MAXPLAYERS;i++) {
-                if (i != consoleplayer) {
-                    for(int j=0;j<BACKUPTICS;j++) {
-                        ticdata[j].cmds[i].ingame = false;
+        } else {
+            if (local_state.client.last_local_tic > local_state.client.last_received_from_server_tic &&
+                local_state.client.last_received_from_server_tic >= 0 &&
+                time_us_32() - local_state.client.last_received_time > STALL_US &&
+                local_state.client.stall_tic != fromtic) {
+                // the next tic from the host is overdue
+                local_state.client.stall_tic = fromtic;
+                local_state.client.link.stalls++;
+            }
+            if (time_us_32() - local_state.client.last_rx_time > CLIENT_TIMEOUT_SHORT_US) {
+                net_client_connected = false;
+                for(int i=0;i<NET_MAXPLAYERS;i++) {
+                    if (i != consoleplayer) {
+                        for(int j=0;j<BACKUPTICS;j++) {
+                            ticdata[j].cmds[i].ingame = false;
+                        }
                     }
                 }
+                net_client_connected = false;
             }
-            net_client_connected = false;
         }
         local_state.client.limit_tic = fromtic + BACKUPTICS - 1;
     }
@@ -875,6 +1141,7 @@ static void host_check_tic_advance_locked() {
         }
         if (advance) {
             local_state.host.last_complete_tic++;
+            local_state.host.tic_complete_time[local_state.host.last_complete_tic % BACKUPTICS] = time_us_32();
 //            printf("ADVANCE TO %d\n", local_state.host.last_complete_tic);
             for(int i=0;i<NET_MAXPLAYERS;i++) {
                 ticdata[local_state.host.last_complete_tic % BACKUPTICS].cmds[i].ingame = local_state.host.clients[i].id != 0;
@@ -21,6 +21,16 @@ typedef enum {
     lobby_game_not_compatible,
 } piconet_lobby_status_t;
 
+// local view of the connection to another player; on the host there is one per client, on a client only the link
+// to the host (player 0) is used
+typedef struct {
+    uint32_t latency_us; // smoothed time from a tic being ready to send until it is acknowledged
+    uint16_t retransmits; // tics sent again because they hadn't been acknowledged yet
+    uint16_t stalls; // tics held up waiting for data over this link (arriving over 1.5 tics after the previous one)
+    uint16_t errors; // aborted i2c transfers
+    uint16_t corrupt; // tic messages dropped because their crc didn't match
+} piconet_link_stats_t;
+
 typedef struct {
     uint32_t compat_hash; // version and whd hash
     uint32_t seq;
@@ -30,6 +40,8 @@ typedef struct {
     int8_t epi;
     int8_t skill;
     lobby_player_t players[NET_MAXPLAYERS];
+    // everything above is sent from the host to the clients, the link stats are local and are not
+    piconet_link_stats_t links[NET_MAXPLAYERS];
 } lobby_state_t;
 
 // one time initialization (set pulls etc)
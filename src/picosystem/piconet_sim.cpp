@@ -0,0 +1,684 @@
+/*
+ * Copyright (c) 2022 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host side test/benchmark for piconet: a copy of piconet.c is built for each of 2-4 simulated boards, which share a
+// simulated i2c bus with configurable latency, dropped transfers and bit errors. each board runs the d_loop side of
+// a net game with deterministic ticcmds, and at the end we report the tic latency distributions, link stats, and
+// whether every board ran the same ticcmds (and the ones the players actually made).
+//
+// everything runs on one thread against a simulated microsecond clock, so a run is reproducible from its -seed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+extern "C" {
+#include "piconet.h"
+#include "d_loop.h"
+#include "i_timer.h"
+#include "doom/doomstat.h"
+#include "whddata.h"
+}
+#include "piconet_sim_hw.h"
+
+#define SIM_I2C_BAUD 800000
+#define SIM_BYTE_NS (9 * 1000000000ull / SIM_I2C_BAUD) // 8 data bits + ack
+#define SIM_STOP_NS (SIM_BYTE_NS / 9)
+
+sim_board sim_boards[SIM_MAX_BOARDS];
+uint64_t sim_time_us;
+
+// each board gets its own copy of piconet.c, along with the globals it shares with the rest of the game
+#define SIM_BOARD_GLOBALS(n) \
+    static sim_board *const sim_this_board = &sim_boards[n]; \
+    static ticcmd_set_t ticdata[BACKUPTICS]; \
+    static int consoleplayer; \
+    static char player_name[MAXPLAYERNAME]; \
+    static const whdheader_t sim_whdheader = {}; \
+    static const whdheader_t *whdheader = &sim_whdheader;
+
+namespace piconet_sim_0 {
+SIM_BOARD_GLOBALS(0)
+#include "piconet.c"
+}
+
+namespace piconet_sim_1 {
+SIM_BOARD_GLOBALS(1)
+#include "piconet.c"
+}
+
+namespace piconet_sim_2 {
+SIM_BOARD_GLOBALS(2)
+#include "piconet.c"
+}
+
+namespace piconet_sim_3 {
+SIM_BOARD_GLOBALS(3)
+#include "piconet.c"
+}
+
+// the piconet API (and the shared game state) of one board
+typedef struct {
+    void (*init)();
+    void (*start_host)(int8_t deathmatch, int8_t epi, int8_t skill);
+    void (*start_client)();
+    void (*stop)();
+    bool (*client_check_for_dropped_connection)();
+    void (*start_game)();
+    int (*get_lobby_state)(lobby_state_t *state);
+    void (*new_local_tic)(int tic);
+    int (*maybe_recv_tic)(int fromtic);
+    ticcmd_set_t *ticdata;
+    int *consoleplayer;
+    char *player_name;
+    boolean *net_client_connected;
+} sim_instance_t;
+
+#define SIM_INSTANCE(ns) { ns::piconet_init, ns::piconet_start_host, ns::piconet_start_client, ns::piconet_stop, \
+        ns::piconet_client_check_for_dropped_connection, ns::piconet_start_game, ns::piconet_get_lobby_state, \
+        ns::piconet_new_local_tic, ns::piconet_maybe_recv_tic, ns::ticdata, &ns::consoleplayer, ns::player_name, \
+        &ns::net_client_connected }
+
+static const sim_instance_t sim_instances[SIM_MAX_BOARDS] = {
+        SIM_INSTANCE(piconet_sim_0),
+        SIM_INSTANCE(piconet_sim_1),
+        SIM_INSTANCE(piconet_sim_2),
+        SIM_INSTANCE(piconet_sim_3),
+};
+
+static struct {
+    int players;
+    int seconds;
+    uint32_t latency_us; // bus setup time added to every transfer
+    double drop; // chance a transfer isn't acknowledged by its slave
+    double biterr; // chance of a flipped bit in each byte on the bus
+    uint32_t seed;
+} options = {
+        2, // players
+        60, // seconds
+        0, // latency_us
+        0, // drop
+        0, // biterr
+        1, // seed
+};
+
+static uint32_t rand_state;
+
+static uint32_t sim_rand() {
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static bool sim_chance(double p) {
+    return p > 0 && sim_rand() < p * 4294967296.0;
+}
+
+// --- i2c bus
+
+static struct {
+    enum {
+        bus_idle,
+        bus_address,
+        bus_data,
+        bus_stop,
+    } phase;
+    sim_board *master;
+    std::vector<sim_board *> slaves;
+    std::vector<uint16_t> cmds; // what the master's dma is writing to data_cmd
+    bool read;
+    bool stretched; // a slave is holding the clock until it has data
+    size_t pos;
+    uint64_t next_ns;
+    // faults are only injected once the game is running, so the lobby always forms
+    bool faults;
+} bus;
+
+static struct {
+    uint32_t transfers;
+    uint32_t bytes;
+    uint32_t nacks;
+    uint32_t drops;
+    uint32_t bit_errors;
+    uint32_t arb_lost;
+    uint32_t aborts;
+    uint64_t busy_ns;
+    uint64_t busy_start_ns;
+} bus_stats;
+
+static uint64_t sim_time_ns() {
+    return sim_time_us * 1000;
+}
+
+static uint32_t sim_raw_intr(sim_board *board) {
+    return board->raw_intr | (board->rx_fifo.empty() ? 0 : I2C_IC_INTR_STAT_R_RX_FULL_BITS);
+}
+
+static uint8_t sim_bus_byte(uint8_t byte) {
+    if (bus.faults && sim_chance(options.biterr)) {
+        byte ^= 1u << (sim_rand() & 7);
+        bus_stats.bit_errors++;
+    }
+    bus_stats.bytes++;
+    return byte;
+}
+
+static void sim_bus_end(bool aborted) {
+    for (sim_board *slave : bus.slaves) {
+        slave->raw_intr |= I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+        slave->tx_fifo.clear();
+    }
+    if (aborted) {
+        bus.master->raw_intr |= I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+        bus_stats.aborts++;
+    } else {
+        bus.master->raw_intr |= I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+        bus_stats.transfers++;
+    }
+    bus_stats.busy_ns += sim_time_ns() - bus_stats.busy_start_ns;
+    bus.slaves.clear();
+    bus.master = NULL;
+    bus.phase = bus.bus_idle;
+}
+
+static void sim_bus_start(sim_board *master, const uint16_t *cmds, uint32_t count) {
+    if (bus.phase != bus.bus_idle) {
+        // someone else has the bus (there is only ever one host, so this would be a second master)
+        master->raw_intr |= I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+        bus_stats.arb_lost++;
+        return;
+    }
+    bus.master = master;
+    bus.cmds.assign(cmds, cmds + count);
+    bus.read = count && (cmds[0] & I2C_IC_DATA_CMD_CMD_BITS);
+    bus.stretched = false;
+    bus.pos = 0;
+    bus.phase = bus.bus_address;
+    bus_stats.busy_start_ns = sim_time_ns();
+    bus.next_ns = sim_time_ns() + options.latency_us * 1000ull + SIM_BYTE_NS;
+}
+
+static void sim_bus_byte_done() {
+    sim_board *master = bus.master;
+    master->dma_regs.ch[I2C_DMA_CHANNEL_WRITE].read_addr += sizeof(uint16_t);
+    master->dma_regs.ch[I2C_DMA_CHANNEL_WRITE].transfer_count--;
+    if (++bus.pos == bus.cmds.size()) {
+        bus.phase = bus.bus_stop;
+        bus.next_ns += SIM_STOP_NS;
+    } else {
+        bus.next_ns += SIM_BYTE_NS;
+    }
+}
+
+static void sim_bus_step() {
+    while (bus.phase != bus.bus_idle && sim_time_ns() >= bus.next_ns) {
+        sim_board *master = bus.master;
+        if (bus.phase == bus.bus_address) {
+            for (int i = 0; i < options.players; i++) {
+                sim_board *board = &sim_boards[i];
+                if (board != master && board->enabled && board->slave && board->sar == master->tar) {
+                    bus.slaves.push_back(board);
+                }
+            }
+            if (bus.slaves.empty()) {
+                bus_stats.nacks++;
+                sim_bus_end(true);
+                continue;
+            }
+            if (bus.faults && sim_chance(options.drop)) {
+                bus_stats.drops++;
+                bus.slaves.clear();
+                sim_bus_end(true);
+                continue;
+            }
+            for (sim_board *slave : bus.slaves) {
+                slave->raw_intr |= I2C_IC_INTR_STAT_R_START_DET_BITS;
+            }
+            bus.phase = bus.bus_data;
+            if (bus.read) {
+                bus.stretched = true;
+            } else {
+                bus.next_ns += SIM_BYTE_NS;
+            }
+        } else if (bus.phase == bus.bus_data) {
+            if (bus.read) {
+                bool ready = true;
+                for (sim_board *slave : bus.slaves) {
+                    if (slave->tx_fifo.empty()) {
+                        slave->raw_intr |= I2C_IC_INTR_STAT_R_RD_REQ_BITS;
+                        ready = false;
+                    }
+                }
+                if (!ready) {
+                    bus.stretched = true;
+                    break;
+                }
+                if (bus.stretched) {
+                    // the byte is clocked out once the clock is released
+                    bus.stretched = false;
+                    bus.next_ns = sim_time_ns() + SIM_BYTE_NS;
+                    continue;
+                }
+                // open drain, so colliding slaves AND together
+                uint8_t byte = 0xff;
+                for (sim_board *slave : bus.slaves) {
+                    byte &= slave->tx_fifo.front();
+                    slave->tx_fifo.pop_front();
+                }
+                byte = sim_bus_byte(byte);
+                if (master->dma_regs.ch[I2C_DMA_CHANNEL_READ].transfer_count) {
+                    *(uint8_t *)master->dma_regs.ch[I2C_DMA_CHANNEL_READ].write_addr = byte;
+                    master->dma_regs.ch[I2C_DMA_CHANNEL_READ].write_addr++;
+                    master->dma_regs.ch[I2C_DMA_CHANNEL_READ].transfer_count--;
+                }
+            } else {
+                uint8_t byte = sim_bus_byte(bus.cmds[bus.pos]);
+                for (sim_board *slave : bus.slaves) {
+                    if (slave->rx_fifo.size() == SIM_I2C_FIFO_DEPTH) {
+                        slave->rx_overflows++;
+                    } else {
+                        slave->rx_fifo.push_back(byte | (bus.pos ? 0 : I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS));
+                    }
+                }
+            }
+            sim_bus_byte_done();
+        } else {
+            sim_bus_end(false);
+        }
+    }
+}
+
+uint32_t sim_i2c_read(sim_board *board, int reg) {
+    switch (reg) {
+        case sim_reg_intr_stat:
+            return sim_raw_intr(board) & board->intr_mask;
+        case sim_reg_raw_intr_stat:
+            return sim_raw_intr(board);
+        case sim_reg_intr_mask:
+            return board->intr_mask;
+        case sim_reg_data_cmd:
+            if (!board->rx_fifo.empty()) {
+                uint32_t val = board->rx_fifo.front();
+                board->rx_fifo.pop_front();
+                return val;
+            }
+            return 0;
+        case sim_reg_enable:
+            return board->enabled;
+        case sim_reg_tar:
+            return board->tar;
+        case sim_reg_sar:
+            return board->sar;
+        case sim_reg_con:
+            return board->con;
+    }
+    return 0;
+}
+
+void sim_i2c_write(sim_board *board, int reg, uint32_t value) {
+    switch (reg) {
+        case sim_reg_intr_mask:
+            board->intr_mask = value;
+            break;
+        case sim_reg_data_cmd:
+            if (board->tx_fifo.size() < SIM_I2C_FIFO_DEPTH) {
+                board->tx_fifo.push_back((uint8_t)value);
+            }
+            break;
+        case sim_reg_enable:
+            if (value & I2C_IC_ENABLE_ABORT_BITS) {
+                if (bus.master == board) sim_bus_end(true);
+            }
+            board->enabled = value & 1;
+            if (!board->enabled) {
+                // disabling drops whatever the block was doing, and its fifos and interrupt status with it
+                if (bus.master == board) sim_bus_end(true);
+                bus.slaves.erase(std::remove(bus.slaves.begin(), bus.slaves.end(), board), bus.slaves.end());
+                board->raw_intr = 0;
+                board->rx_fifo.clear();
+                board->tx_fifo.clear();
+            }
+            break;
+        case sim_reg_tar:
+            board->tar = value;
+            break;
+        case sim_reg_sar:
+            board->sar = value;
+            break;
+        case sim_reg_con:
+            board->con = value;
+            break;
+    }
+}
+
+void sim_i2c_set_bits(sim_board *board, int reg, uint32_t bits) {
+    sim_i2c_write(board, reg, sim_i2c_read(board, reg) | bits);
+}
+
+void sim_dma_abort(sim_board *board, uint32_t mask) {
+    for (int i = 0; i < SIM_DMA_CHANNELS; i++) {
+        if (mask & (1u << i)) board->dma_regs.ch[i].transfer_count = 0;
+    }
+}
+
+void sim_dma_configure(sim_board *board, unsigned int channel, uintptr_t write_addr, uintptr_t read_addr,
+                       uint32_t count, bool trigger) {
+    assert(channel < SIM_DMA_CHANNELS);
+    board->dma_regs.ch[channel].write_addr = write_addr;
+    board->dma_regs.ch[channel].read_addr = read_addr;
+    board->dma_regs.ch[channel].transfer_count = count;
+    // the only paced transfers piconet does are between memory and the i2c data_cmd register; feeding commands to
+    // it is what starts a transfer on the bus
+    if (trigger && write_addr == (uintptr_t)&board->i2c_regs.data_cmd && board->enabled && !board->slave) {
+        sim_bus_start(board, (const uint16_t *)read_addr, count);
+    }
+}
+
+bool sim_alarm_set_target(sim_board *board, unsigned int alarm_num, uint64_t target) {
+    assert(alarm_num == board->alarm_num);
+    if (target <= sim_time_us) {
+        board->alarm_armed = false;
+        return true;
+    }
+    board->alarm_target = target;
+    board->alarm_armed = true;
+    return false;
+}
+
+void sim_alarm_cancel(sim_board *board, unsigned int alarm_num) {
+    board->alarm_armed = false;
+}
+
+static void sim_deliver_irqs(sim_board *board) {
+    // a handler that doesn't clear the interrupt it is called for would hang the real thing too
+    for (int guard = 0; guard < 64 && board->i2c_irq_enabled && board->i2c_irq_handler; guard++) {
+        uint32_t status = sim_i2c_read(board, sim_reg_intr_stat);
+        if (!status) break;
+        board->i2c_irq_handler();
+        // acknowledge the interrupt the handler dispatched on, as it does by reading the clr_ registers
+        if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+            board->raw_intr &= ~I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+        } else if (status & I2C_IC_INTR_STAT_R_RD_REQ_BITS) {
+            board->raw_intr &= ~(I2C_IC_INTR_STAT_R_RD_REQ_BITS | I2C_IC_INTR_STAT_R_START_DET_BITS);
+        } else if (!(status & I2C_IC_INTR_STAT_R_RX_FULL_BITS)) {
+            board->raw_intr &= ~I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+        }
+    }
+}
+
+// --- the d_loop side of each board
+
+#define SIM_LATENCY_BUCKETS 1000 // 1ms buckets
+
+typedef struct {
+    const sim_instance_t *net;
+    enum {
+        game_off,
+        game_lobby,
+        game_running,
+        game_dropped,
+        game_refused,
+    } state;
+    uint64_t start_us;
+    uint32_t frame_phase_us;
+    uint64_t game_start_us;
+    uint64_t next_check_us;
+    int maketic, gametic, recvtic;
+    int nplayers;
+    std::vector<uint64_t> make_time;
+    std::vector<uint32_t> tic_hashes;
+    uint32_t latency_hist[SIM_LATENCY_BUCKETS + 1];
+    uint32_t max_latency_us;
+    uint32_t bad_cmds;
+    int first_bad_tic;
+} sim_game_t;
+
+static sim_game_t games[SIM_MAX_BOARDS];
+
+static uint32_t sim_hash(uint32_t h, uint32_t v) {
+    // murmur3 style mix
+    h ^= v * 0xcc9e2d51u;
+    h = (h << 13) | (h >> 19);
+    return h * 5 + 0xe6546b64u;
+}
+
+// the ticcmd a player makes for a tic; movement changes every few tics so the delta coding has work to do
+static ticcmd_t sim_ticcmd(int player, int tic) {
+    ticcmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    uint32_t slow = sim_hash(sim_hash(options.seed, player), tic / 8);
+    uint32_t fast = sim_hash(sim_hash(options.seed, player + NET_MAXPLAYERS), tic);
+    cmd.forwardmove = (signed char)((slow & 0xff) % 101 - 50);
+    cmd.sidemove = (signed char)(((slow >> 8) & 0xff) % 81 - 40);
+    cmd.angleturn = (short)((fast & 0x3ff) - 0x200);
+    cmd.buttons = (fast >> 16) % 35 ? 0 : 1;
+    cmd.consistancy = (byte)tic;
+    cmd.ingame = true;
+    return cmd;
+}
+
+static void sim_start_game(sim_game_t *game, int pnum, int nplayers) {
+    // M_NetGameStart() and D_StartPicoNetGame()
+    *game->net->consoleplayer = pnum;
+    game->nplayers = nplayers;
+    game->gametic = game->maketic = game->recvtic = 0;
+    *game->net->net_client_connected = true;
+    game->net->start_game();
+    game->game_start_us = sim_time_us;
+    game->state = game->game_running;
+}
+
+static void sim_run_tic(sim_game_t *game) {
+    const ticcmd_set_t *set = &game->net->ticdata[game->gametic % BACKUPTICS];
+    uint32_t h = 0;
+    for (int p = 0; p < NET_MAXPLAYERS; p++) {
+        const uint8_t *c = (const uint8_t *)&set->cmds[p];
+        for (int i = 0; i < sizeof(ticcmd_t); i++) h = sim_hash(h, c[i]);
+        if (p < game->nplayers) {
+            ticcmd_t expected = sim_ticcmd(p, game->gametic);
+            if (memcmp(&expected, &set->cmds[p], sizeof(ticcmd_t))) {
+                if (!game->bad_cmds++) game->first_bad_tic = game->gametic;
+            }
+        }
+    }
+    game->tic_hashes.push_back(h);
+    uint32_t latency_us = (uint32_t)(sim_time_us - game->make_time[game->gametic]);
+    game->latency_hist[std::min(latency_us / 1000, (uint32_t)SIM_LATENCY_BUCKETS)]++;
+    game->max_latency_us = std::max(game->max_latency_us, latency_us);
+    game->gametic++;
+}
+
+static void sim_game_frame(int num) {
+    sim_game_t *game = &games[num];
+    const sim_instance_t *net = game->net;
+    lobby_state_t ls;
+    if (game->state == game->game_off) {
+        if (sim_time_us < game->start_us) return;
+        if (!num) {
+            net->start_host(0, 1, 2);
+        } else {
+            net->start_client();
+            game->next_check_us = sim_time_us + 1000000;
+        }
+        game->state = game->game_lobby;
+    } else if (game->state == game->game_lobby) {
+        int pnum = net->get_lobby_state(&ls);
+        if (!num) {
+            // the host presses start a second after everyone has turned up
+            if (ls.nplayers != options.players) {
+                game->next_check_us = sim_time_us + 1000000;
+            } else if (sim_time_us >= game->next_check_us) {
+                sim_start_game(game, 0, ls.nplayers);
+            }
+        } else if (ls.status == lobby_game_started) {
+            if (pnum > 0) {
+                sim_start_game(game, pnum, ls.nplayers);
+            } else {
+                game->state = game->game_refused;
+            }
+        } else if (sim_time_us >= game->next_check_us) {
+            // the foyer menu checks once a second
+            net->client_check_for_dropped_connection();
+            game->next_check_us = sim_time_us + 1000000;
+        }
+    } else if (game->state == game->game_running) {
+        // BuildNewTic()
+        int target = (int)((sim_time_us - game->game_start_us) * TICRATE / 1000000);
+        while (game->maketic < target && game->maketic - game->gametic < BACKUPTICS) {
+            int tic = game->maketic;
+            net->ticdata[tic % BACKUPTICS].cmds[*net->consoleplayer] = sim_ticcmd(*net->consoleplayer, tic);
+            game->make_time.push_back(sim_time_us);
+            net->new_local_tic(tic);
+            game->maketic++;
+        }
+        // GetLowTic()
+        game->recvtic = net->maybe_recv_tic(game->recvtic);
+        if (!*net->net_client_connected) {
+            net->stop();
+            game->state = game->game_dropped;
+            return;
+        }
+        int lowtic = std::min(game->maketic, game->recvtic);
+        while (game->gametic < lowtic) {
+            sim_run_tic(game);
+        }
+    }
+}
+
+// --- reporting
+
+static uint32_t sim_percentile_ms(const sim_game_t *game, int percent) {
+    uint64_t total = 0;
+    for (int i = 0; i <= SIM_LATENCY_BUCKETS; i++) total += game->latency_hist[i];
+    if (!total) return 0;
+    uint64_t want = (total * percent + 99) / 100;
+    uint64_t sum = 0;
+    for (int i = 0; i <= SIM_LATENCY_BUCKETS; i++) {
+        sum += game->latency_hist[i];
+        if (sum >= want) return i + 1;
+    }
+    return SIM_LATENCY_BUCKETS;
+}
+
+static int sim_report() {
+    static const char *state_names[] = {"never started", "stuck in lobby", "ran", "dropped", "refused"};
+    int rc = 0;
+    printf("%d players, %ds, latency %uus, drop %.3f, bit errors %.5f, seed %u\n", options.players, options.seconds,
+           options.latency_us, options.drop, options.biterr, options.seed);
+    printf("bus: %u transfers, %u bytes, %u aborted (%u nacks, %u dropped, %u arbitration lost), %u bit errors, "
+           "%.1f%% busy\n", bus_stats.transfers, bus_stats.bytes, bus_stats.aborts, bus_stats.nacks, bus_stats.drops,
+           bus_stats.arb_lost, bus_stats.bit_errors, bus_stats.busy_ns / (options.seconds * 1e7));
+    for (int i = 0; i < options.players; i++) {
+        sim_game_t *game = &games[i];
+        lobby_state_t ls;
+        game->net->get_lobby_state(&ls);
+        printf("board %d (%s, %s): %d tics, latency p50 <%ums p90 <%ums p99 <%ums max %.1fms\n", i,
+               i ? "client" : "host", state_names[game->state], game->gametic, sim_percentile_ms(game, 50),
+               sim_percentile_ms(game, 90), sim_percentile_ms(game, 99), game->max_latency_us / 1000.0);
+        // the host has a link to each client, the clients just the one to the host
+        for (int l = i ? 0 : 1; l < (i ? 1 : options.players); l++) {
+            piconet_link_stats_t *link = &ls.links[l];
+            printf("    link to %d: latency %.1fms, %u retransmits, %u stalls, %u errors, %u corrupt\n", i ? 0 : l,
+                   link->latency_us / 1000.0, link->retransmits, link->stalls, link->errors, link->corrupt);
+        }
+        if (sim_boards[i].rx_overflows) {
+            printf("    %u bytes lost to rx fifo overflow\n", sim_boards[i].rx_overflows);
+        }
+        if (game->bad_cmds) {
+            printf("    %u tics with wrong ticcmds, first at tic %d\n", game->bad_cmds, game->first_bad_tic);
+            rc = 1;
+        }
+        if (game->state != game->game_running) {
+            rc = 1;
+        } else {
+            int expected = (int)((sim_time_us - game->game_start_us) * TICRATE / 1000000);
+            if (game->gametic + TICRATE < expected) {
+                printf("    fell behind, ran %d of %d tics\n", game->gametic, expected);
+                rc = 1;
+            }
+        }
+    }
+    // every board must have run the same ticcmds
+    size_t common = games[0].tic_hashes.size();
+    for (int i = 1; i < options.players; i++) common = std::min(common, games[i].tic_hashes.size());
+    for (size_t t = 0; t < common; t++) {
+        for (int i = 1; i < options.players; i++) {
+            if (games[i].tic_hashes[t] != games[0].tic_hashes[t]) {
+                printf("DESYNC: board %d differs from the host at tic %d\n", i, (int)t);
+                rc = 1;
+                t = common;
+                break;
+            }
+        }
+    }
+    printf("%s\n", rc ? "FAILED" : "OK");
+    return rc;
+}
+
+static void usage() {
+    printf("usage: piconet_sim [-players 2-4] [-seconds n] [-latency us] [-drop p] [-biterr p] [-seed n]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) usage();
+        if (!strcmp(argv[i], "-players")) options.players = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-seconds")) options.seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-latency")) options.latency_us = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-drop")) options.drop = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-biterr")) options.biterr = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-seed")) options.seed = strtoul(argv[++i], NULL, 0);
+        else usage();
+    }
+    if (options.players < 2 || options.players > SIM_MAX_BOARDS || options.seconds <= 0) usage();
+    rand_state = options.seed ? options.seed : 1;
+
+    for (int i = 0; i < options.players; i++) {
+        sim_board *board = &sim_boards[i];
+        board->num = i;
+        board->i2c_regs.intr_stat.board = board->i2c_regs.raw_intr_stat.board = board->i2c_regs.intr_mask.board = board;
+        board->i2c_regs.data_cmd.board = board->i2c_regs.enable.board = board->i2c_regs.tar.board = board;
+        board->i2c_regs.sar.board = board->i2c_regs.con.board = board;
+        board->dma_regs.abort.board = board;
+        games[i].net = &sim_instances[i];
+        snprintf(games[i].net->player_name, MAXPLAYERNAME, "SIM%d", i);
+        games[i].net->init();
+        // the clients are switched on at random times after the host (which also gives them different ids; note
+        // an id of zero means no client, so nobody can start at time zero)
+        games[i].start_us = i ? 100000 + sim_rand() % 500000 : 10000;
+        // and their game loops aren't in step with each other
+        games[i].frame_phase_us = sim_rand() % 1000;
+    }
+
+    uint64_t end_us = options.seconds * 1000000ull;
+    for (sim_time_us = 0; sim_time_us < end_us; sim_time_us++) {
+        for (int i = 0; i < options.players; i++) {
+            sim_board *board = &sim_boards[i];
+            if (board->alarm_armed && sim_time_us >= board->alarm_target) {
+                board->alarm_armed = false;
+                board->alarm_callback(board->alarm_num);
+            }
+        }
+        sim_bus_step();
+        for (int i = 0; i < options.players; i++) {
+            sim_deliver_irqs(&sim_boards[i]);
+        }
+        // the game loops poll piconet every millisecond while they wait for tics
+        bool running = true;
+        for (int i = 0; i < options.players; i++) {
+            if (sim_time_us % 1000 == games[i].frame_phase_us) sim_game_frame(i);
+            running &= games[i].state == games[i].game_running;
+        }
+        bus.faults = running;
+    }
+    return sim_report();
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+// the simulated hardware behind piconet_sim; each board has the subset of an RP2040's i2c block, dma and timer
+// that piconet.c uses, and all the boards share one i2c bus
+
+#include <stdint.h>
+#include <deque>
+
+#define SIM_MAX_BOARDS 4
+#define SIM_DMA_CHANNELS 12
+#define SIM_I2C_FIFO_DEPTH 16
+
+struct sim_board;
+
+enum {
+    sim_reg_intr_stat,
+    sim_reg_raw_intr_stat,
+    sim_reg_intr_mask,
+    sim_reg_data_cmd,
+    sim_reg_enable,
+    sim_reg_tar,
+    sim_reg_sar,
+    sim_reg_con,
+};
+
+uint32_t sim_i2c_read(sim_board *board, int reg);
+void sim_i2c_write(sim_board *board, int reg, uint32_t value);
+void sim_i2c_set_bits(sim_board *board, int reg, uint32_t bits);
+void sim_dma_abort(sim_board *board, uint32_t mask);
+
+// i2c register with side effects on access. note piconet reads the clr_ registers as a statement, which C++ doesn't
+// turn into an access of a class type, so those are plain fields, and the engine acknowledges the interrupt the
+// handler dispatched on when it returns instead
+template<int REG> struct sim_i2c_reg {
+    sim_board *board;
+    operator uint32_t() const { return sim_i2c_read(board, REG); }
+    sim_i2c_reg &operator=(uint32_t value) {
+        sim_i2c_write(board, REG, value);
+        return *this;
+    }
+};
+
+template<int REG> static inline void hw_set_bits(sim_i2c_reg<REG> *reg, uint32_t bits) {
+    sim_i2c_set_bits(reg->board, REG, bits);
+}
+
+typedef struct {
+    sim_i2c_reg<sim_reg_intr_stat> intr_stat;
+    sim_i2c_reg<sim_reg_raw_intr_stat> raw_intr_stat;
+    sim_i2c_reg<sim_reg_intr_mask> intr_mask;
+    sim_i2c_reg<sim_reg_data_cmd> data_cmd;
+    sim_i2c_reg<sim_reg_enable> enable;
+    sim_i2c_reg<sim_reg_tar> tar;
+    sim_i2c_reg<sim_reg_sar> sar;
+    sim_i2c_reg<sim_reg_con> con;
+    volatile uint32_t clr_tx_abrt;
+    volatile uint32_t clr_rd_req;
+    volatile uint32_t clr_start_det;
+    volatile uint32_t clr_stop_det;
+    volatile uint32_t tx_abrt_source;
+} sim_i2c_hw_t;
+
+struct sim_dma_abort_reg {
+    sim_board *board;
+    operator uint32_t() const { return 0; } // aborts complete immediately
+    sim_dma_abort_reg &operator=(uint32_t mask) {
+        sim_dma_abort(board, mask);
+        return *this;
+    }
+};
+
+typedef struct {
+    struct {
+        uintptr_t read_addr;
+        uintptr_t write_addr;
+        uint32_t transfer_count;
+    } ch[SIM_DMA_CHANNELS];
+    sim_dma_abort_reg abort;
+} sim_dma_hw_t;
+
+struct sim_board {
+    int num;
+    sim_i2c_hw_t i2c_regs;
+    sim_dma_hw_t dma_regs;
+    // i2c block
+    bool enabled;
+    bool slave;
+    uint32_t tar, sar, con;
+    uint32_t intr_mask;
+    uint32_t raw_intr; // excluding RX_FULL, which follows the rx fifo
+    std::deque<uint32_t> rx_fifo;
+    std::deque<uint8_t> tx_fifo;
+    uint32_t rx_overflows;
+    // nvic
+    bool i2c_irq_enabled;
+    void (*i2c_irq_handler)();
+    // timer
+    void (*alarm_callback)(unsigned int);
+    unsigned int alarm_num;
+    bool alarm_armed;
+    uint64_t alarm_target;
+};
+
+extern sim_board sim_boards[SIM_MAX_BOARDS];
+extern uint64_t sim_time_us;
+
+void sim_dma_configure(sim_board *board, unsigned int channel, uintptr_t write_addr, uintptr_t read_addr,
+                       uint32_t count, bool trigger);
+bool sim_alarm_set_target(sim_board *board, unsigned int alarm_num, uint64_t target);
+void sim_alarm_cancel(sim_board *board, unsigned int alarm_num);
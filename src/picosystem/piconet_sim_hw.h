@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2022 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+// stand-ins for the pico SDK hardware APIs used by piconet.c, on top of the simulated boards in piconet_sim.h.
+// they act on sim_this_board, which each board's namespace in piconet_sim.cpp defines before including piconet.c
+
+#include "piconet_sim.h"
+
+#ifndef __aligned
+#define __aligned(x) __attribute__((__aligned__(x)))
+#endif
+#ifndef count_of
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+#endif
+
+#define I2C_IC_INTR_STAT_R_RX_FULL_BITS 0x00000004u
+#define I2C_IC_INTR_STAT_R_RD_REQ_BITS 0x00000020u
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS 0x00000040u
+#define I2C_IC_INTR_STAT_R_STOP_DET_BITS 0x00000200u
+#define I2C_IC_INTR_STAT_R_START_DET_BITS 0x00000400u
+#define I2C_IC_RAW_INTR_STAT_START_DET_BITS 0x00000400u
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS 0x00000200u
+#define I2C_IC_DATA_CMD_CMD_BITS 0x00000100u
+#define I2C_IC_DATA_CMD_STOP_BITS 0x00000200u
+#define I2C_IC_DATA_CMD_RESTART_BITS 0x00000400u
+#define I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS 0x00000800u
+#define I2C_IC_ENABLE_ABORT_BITS 0x00000002u
+#define I2C_IC_CON_STOP_DET_IFADDRESSED_BITS 0x00000080u
+
+#define TIMER_IRQ_0 0
+#define I2C_IRQ 24
+#define GPIO_FUNC_I2C 3
+
+typedef sim_board i2c_inst_t;
+typedef struct { int unused; } critical_section_t;
+typedef struct { uint32_t ctrl; } dma_channel_config;
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+// everything runs on the one host thread, and interrupts are only delivered between calls into piconet
+#define critical_section_init(cs) ((void)(cs))
+#define critical_section_enter_blocking(cs) ((void)(cs))
+#define critical_section_exit(cs) ((void)(cs))
+#define tight_loop_contents() ((void)0)
+#define bi_decl_if_func_used(x)
+#define gpio_set_function(gpio, fn) ((void)0)
+#define gpio_pull_up(gpio) ((void)0)
+#define irq_set_priority(num, priority) ((void)0)
+
+#define i2c_default sim_this_board
+#define dma_hw (&sim_this_board->dma_regs)
+
+static inline uint32_t time_us_32() {
+    return (uint32_t)sim_time_us;
+}
+
+static inline uint64_t make_timeout_time_us(uint64_t us) {
+    return sim_time_us + us;
+}
+
+static inline uint64_t make_timeout_time_ms(uint32_t ms) {
+    return sim_time_us + ms * 1000ull;
+}
+
+static inline sim_i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) {
+    return &i2c->i2c_regs;
+}
+
+static inline unsigned int i2c_init(i2c_inst_t *i2c, unsigned int baudrate) {
+    i2c->enabled = true;
+    i2c->slave = false;
+    return baudrate;
+}
+
+static inline void i2c_set_slave_mode(i2c_inst_t *i2c, bool slave, uint8_t addr) {
+    i2c->slave = slave;
+    i2c->sar = addr;
+}
+
+static inline size_t i2c_get_write_available(i2c_inst_t *i2c) {
+    return SIM_I2C_FIFO_DEPTH - i2c->tx_fifo.size();
+}
+
+static inline unsigned int i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) {
+    return 0;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(unsigned int channel) {
+    dma_channel_config c = {0};
+    return c;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {}
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {}
+static inline void channel_config_set_dreq(dma_channel_config *c, unsigned int dreq) {}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->ctrl = size;
+}
+
+#define dma_channel_configure(channel, config, write_addr, read_addr, count, trigger) \
+    sim_dma_configure(sim_this_board, channel, (uintptr_t)(write_addr), (uintptr_t)(read_addr), count, trigger)
+#define hardware_alarm_set_callback(num, callback) \
+    (sim_this_board->alarm_num = (num), sim_this_board->alarm_callback = (callback))
+#define hardware_alarm_set_target(num, target) sim_alarm_set_target(sim_this_board, num, target)
+#define hardware_alarm_cancel(num) sim_alarm_cancel(sim_this_board, num)
+#define irq_set_exclusive_handler(num, handler) \
+    ((num) == I2C_IRQ ? (void)(sim_this_board->i2c_irq_handler = (handler)) : (void)0)
+#define irq_set_enabled(num, enabled) \
+    ((num) == I2C_IRQ ? (void)(sim_this_board->i2c_irq_enabled = (enabled)) : (void)0)
+
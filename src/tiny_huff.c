@@ -286,4 +286,23 @@ int __not_in_flash_func(th_make_prefix_length_table)(th_decoder decoder, uint8_t
     }
     return max_length;
 }
+
+void __not_in_flash_func(th_make_symbol_table)(th_decoder decoder, uint16_t *symbol_table) {
+    assert(th_use_symbol_table(decoder));
+    int max_length = (decoder[0] - 1) / 2;
+    const uint8_t *symbols = (const uint8_t *)(decoder + decoder[0]);
+    decoder++;
+    int code = 0;
+    memset(symbol_table, 0, 256 * sizeof(uint16_t));
+    for(int length=1; length<=max_length;length++) {
+        for(;code < decoder[TH_IDX_CEILING];code++) {
+            uint16_t entry = symbols[code - decoder[TH_IDX_OFFSET]] | (length << 8);
+            for(int i=0;i < (1u << (8-length)); i++) {
+                symbol_table[reverse8[i | (code << (8-length))]] = entry;
+            }
+        }
+        code <<= 1;
+        decoder += 2;
+    }
+}
 #pragma GCC pop_options
\ No newline at end of file
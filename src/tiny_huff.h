@@ -20,7 +20,7 @@ typedef const uint16_t *th_decoder;
 // symbol_offset: symbol bytes
 
 // slightly faster it seems
-#if !IS_WHD_GEN
+#if !defined(TH_USE_ACCUM) && !IS_WHD_GEN
 #define TH_USE_ACCUM 1
 #endif
 
@@ -286,6 +286,58 @@ static inline uint8_t th_decode_table_special(th_decoder decoder, const uint8_t
     } while (1);
 }
 
+// for decoders whose codes are all at most 8 bits long (which is common for flats and patches with few colors), a
+// 256 entry table of symbol | (length << 8) indexed by the next 8 bits of input can be used instead of the prefix
+// length table. this avoids the reverse/offset lookups, and lets us decode two symbols per refill. note that
+// whether to use it is decided purely from the code lengths, so the compressed data itself doesn't change
+#define TH_SYMBOL_TABLE_MAX_CODE_LENGTH 8
+static inline int th_use_symbol_table(th_decoder decoder) {
+    return decoder[0] > 1 && (decoder[0] - 1) / 2 <= TH_SYMBOL_TABLE_MAX_CODE_LENGTH;
+}
+
+void th_make_symbol_table(th_decoder decoder, uint16_t *symbol_table);
+
+static inline uint8_t th_decode_symbol_table(const uint16_t *symbol_table, th_bit_input *bi) {
+#if TH_USE_ACCUM
+    if (bi->bits < 8) th_fill_byte(bi);
+    uint entry = symbol_table[bi->accum & 0xff];
+    uint length = entry >> 8;
+    assert(length && length <= bi->bits);
+    bi->bits -= length;
+    bi->accum >>= length;
+#else
+    uint code = *bi->cur >> bi->bit;
+    if (bi->bit) {
+        code |= ((bi->cur[1] << 8) >> bi->bit);
+    }
+    uint entry = symbol_table[code & 0xff];
+    uint length = entry >> 8;
+    assert(length);
+    bi->bit += length;
+    bi->cur += bi->bit >> 3;
+    bi->bit &= 7;
+#endif
+    return (uint8_t)entry;
+}
+
+// decode two symbols, returned with the first in the low byte
+static inline uint th_decode_symbol_table_2(const uint16_t *symbol_table, th_bit_input *bi) {
+#if TH_USE_ACCUM
+    while (bi->bits < 16) th_fill_byte(bi);
+    uint entry0 = symbol_table[bi->accum & 0xff];
+    uint length = entry0 >> 8;
+    uint entry1 = symbol_table[(bi->accum >> length) & 0xff];
+    length += entry1 >> 8;
+    assert((entry0 >> 8) && (entry1 >> 8) && length <= bi->bits);
+    bi->bits -= length;
+    bi->accum >>= length;
+    return (entry0 & 0xffu) | ((entry1 & 0xffu) << 8);
+#else
+    uint rc = th_decode_symbol_table(symbol_table, bi);
+    return rc | (th_decode_symbol_table(symbol_table, bi) << 8);
+#endif
+}
+
 static inline uint16_t th_decode_table_special_16(th_decoder decoder, const uint8_t *prefix_lengths, th_bit_input *bi) {
     assert(decoder[0] > 1); // we should be called for the empty decoder case
 #if TH_USE_ACCUM
@@ -163,9 +163,63 @@ void V_SetPatchClipCallback(vpatchclipfunc_t func)
 //
 
 #if USE_WHD
+// the most recently begun patch lists, so we can tell whether entries emitted into a list are still there
+#define VPATCHLIST_HISTORY 8
+static struct {
+    const vpatchlist_t *patchlist;
+    uint32_t serial;
+} vpatchlist_history[VPATCHLIST_HISTORY];
+static uint32_t vpatchlist_serial;
+
 void V_BeginPatchList(vpatchlist_t *patchlist) {
     vpatchlist = patchlist;
     vpatchlist->header.size = 1;
+    vpatchlist_serial++;
+    vpatchlist_history[vpatchlist_serial % VPATCHLIST_HISTORY].patchlist = patchlist;
+    vpatchlist_history[vpatchlist_serial % VPATCHLIST_HISTORY].serial = vpatchlist_serial;
+}
+
+boolean V_ReusePatchSpan(vpatchspan_t *span, int key) {
+    assert(vpatchlist);
+    uint size = vpatchlist[0].header.size;
+    uint32_t age = vpatchlist_serial - span->serial;
+    if (span->serial && span->key == (int16_t)key && age && age < VPATCHLIST_HISTORY &&
+        size + span->count <= vpatchlist[0].header.max + 1u) {
+        const vpatchlist_t *src = vpatchlist_history[span->serial % VPATCHLIST_HISTORY].patchlist;
+        // the entries are only still there if the list hasn't been begun again since (other than as the current list)
+        uint32_t s;
+        for (s = span->serial + 1; s != vpatchlist_serial; s++) {
+            if (vpatchlist_history[s % VPATCHLIST_HISTORY].patchlist == src) break;
+        }
+        if (s == vpatchlist_serial) {
+            if (src != vpatchlist) {
+                memcpy(vpatchlist + size, src + span->start, span->count * sizeof(vpatchlist_t));
+                span->start = size;
+                vpatchlist[0].header.size = size + span->count;
+                span->serial = vpatchlist_serial;
+                return true;
+            } else if (span->start == size) {
+                // same list, and everything before us has been the same too, so the entries are already in place
+                vpatchlist[0].header.size = size + span->count;
+                span->serial = vpatchlist_serial;
+                return true;
+            }
+        }
+    }
+    span->serial = vpatchlist_serial;
+    span->key = key;
+    span->start = size;
+    return false;
+}
+
+void V_EndPatchSpan(vpatchspan_t *span) {
+    assert(vpatchlist);
+    if (vpatchlist[0].header.size > vpatchlist[0].header.max) {
+        // entries may have been dropped, so don't reuse them
+        span->serial = 0;
+    } else {
+        span->count = vpatchlist[0].header.size - span->start;
+    }
 }
 
 void V_EndPatchList(void) {
@@ -84,6 +84,19 @@ extern pre_wipe_state_t pre_wipe_state;
 void V_BeginPatchList(vpatchlist_t *patchlist);
 void V_EndPatchList(void);
 void V_DrawPatchList(const vpatchlist_t *patchlist);
+
+// a run of entries emitted into a patch list, which can be copied into a later list rather than emitted again if
+// the caller's state (key) is unchanged
+typedef struct {
+    uint32_t serial;    // of the V_BeginPatchList the entries were emitted after; 0 for none
+    int16_t key;
+    uint8_t start;
+    uint8_t count;
+} vpatchspan_t;
+// if the span's entries were emitted for the same key and are still intact, append them to the current patch list and
+// return true. otherwise return false, in which case the caller should emit the entries then call V_EndPatchSpan
+boolean V_ReusePatchSpan(vpatchspan_t *span, int key);
+void V_EndPatchSpan(vpatchspan_t *span);
 #endif
 void V_DrawPatch(int x, int y, vpatch_handle_large_t patch);
 void V_DrawPatchN(int x, int y, vpatch_handle_large_t patch, int repeat);
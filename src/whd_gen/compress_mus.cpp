@@ -18,7 +18,6 @@
 #endif
 statsomizer musx_decoder_space("MUSX Decoder Space");
 
-std::vector<uint8_t> decode_musx(std::vector<uint8_t> &data);
 
 const char *seq_event_name(seq_event event) {
     switch (event) {
@@ -11,4 +11,6 @@
 extern statsomizer musx_decoder_space;
 
 std::vector<uint8_t> compress_mus(std::pair<const int, lump> &e);
+// decodes (and so verifies) compressed MUSX data, returning the equivalent MUS score
+std::vector<uint8_t> decode_musx(std::vector<uint8_t> &data);
 
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 20222 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+// note this file is compiled with the bit accumulator that the device uses, rather than whd_gen's; it must only use
+// the inline decoding functions (and not pass a th_bit_input to anything compiled elsewhere)
+#define TH_USE_ACCUM 1
+#include "huff_bench.h"
+#include "tiny_huff.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+// repeat each decode, as a single lump only takes a few microseconds
+#define HUFF_BENCH_REPEATS 16
+
+struct huff_bench_stats {
+    uint64_t bytes;
+    uint64_t table_special_ns;
+    uint64_t chosen_ns;
+    // just the lumps which can use the symbol table
+    uint64_t symbol_table_bytes;
+    uint64_t symbol_table_special_ns;
+    uint64_t symbol_table_ns;
+    int lumps;
+    int symbol_table_lumps;
+};
+
+static std::map<std::string, huff_bench_stats> huff_bench_kinds;
+static volatile uint32_t huff_bench_sink;
+
+template<typename F> static uint64_t time_decode(const std::vector<uint8_t>& padded, uint32_t bit_offset, F decode) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < HUFF_BENCH_REPEATS; r++) {
+        th_bit_input bi;
+        th_bit_input_init_bit_offset(&bi, padded.data(), bit_offset);
+        huff_bench_sink = decode(&bi);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+}
+
+void huff_bench_record(const char *kind, const uint16_t *decoder, const std::vector<uint8_t>& data, uint32_t bit_offset,
+                       uint32_t count) {
+    if (decoder[0] <= 1 || !count) return; // nothing to decode
+    // the decoders may read a couple of bytes ahead
+    std::vector<uint8_t> padded(data);
+    padded.resize(data.size() + 4);
+    std::vector<uint8_t> expected(count), out(count + 1);
+
+    uint8_t prefix_lengths[256];
+    th_make_prefix_length_table(decoder, prefix_lengths);
+    uint64_t special_ns = time_decode(padded, bit_offset, [&](th_bit_input *bi) {
+        for (uint32_t i = 0; i < count; i++) {
+            expected[i] = th_decode_table_special(decoder, prefix_lengths, bi);
+        }
+        return expected[count - 1];
+    });
+    auto &stats = huff_bench_kinds[kind];
+    stats.bytes += count;
+    stats.table_special_ns += special_ns;
+    stats.lumps++;
+    if (!th_use_symbol_table(decoder)) {
+        stats.chosen_ns += special_ns;
+        return;
+    }
+    uint16_t symbol_table[256];
+    th_make_symbol_table(decoder, symbol_table);
+    uint64_t symbol_table_ns = time_decode(padded, bit_offset, [&](th_bit_input *bi) {
+        uint8_t *p = out.data();
+        for (uint32_t i = 0; i < count; i += 2) {
+            uint pixels = th_decode_symbol_table_2(symbol_table, bi);
+            *p++ = (uint8_t)pixels;
+            *p++ = (uint8_t)(pixels >> 8);
+        }
+        return out[count - 1];
+    });
+    if (memcmp(out.data(), expected.data(), count)) {
+        printf("HUFF BENCH: %s symbol table decode mismatch\n", kind);
+    }
+    stats.chosen_ns += symbol_table_ns;
+    stats.symbol_table_bytes += count;
+    stats.symbol_table_special_ns += special_ns;
+    stats.symbol_table_ns += symbol_table_ns;
+    stats.symbol_table_lumps++;
+}
+
+static double mb_per_s(uint64_t bytes, uint64_t ns) {
+    return ns ? (double)bytes * HUFF_BENCH_REPEATS * 1000.0 / (double)ns : 0.0;
+}
+
+void huff_bench_print_summary() {
+    for (const auto &e : huff_bench_kinds) {
+        const auto &s = e.second;
+        printf("HUFF BENCH %-8s lumps %d bytes %llu: table special %.1f MB/s, chosen %.1f MB/s\n", e.first.c_str(),
+               s.lumps, (unsigned long long)s.bytes, mb_per_s(s.bytes, s.table_special_ns), mb_per_s(s.bytes, s.chosen_ns));
+        printf("HUFF BENCH %-8s symbol table lumps %d bytes %llu: table special %.1f MB/s, symbol table %.1f MB/s\n",
+               e.first.c_str(), s.symbol_table_lumps, (unsigned long long)s.symbol_table_bytes,
+               mb_per_s(s.symbol_table_bytes, s.symbol_table_special_ns), mb_per_s(s.symbol_table_bytes, s.symbol_table_ns));
+    }
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 20222 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// micro-benchmark of the tiny_huff symbol decoders (as used on device, i.e. with TH_USE_ACCUM) against the pixel data
+// of each flat/patch as it is compressed. decoder is the decoder read from data, and bit_offset is where the
+// count symbols start
+void huff_bench_record(const char *kind, const uint16_t *decoder, const std::vector<uint8_t>& data, uint32_t bit_offset,
+                       uint32_t count);
+void huff_bench_print_summary();
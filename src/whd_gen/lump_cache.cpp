@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 20222 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include "lump_cache.h"
+#include "parallel.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <tuple>
+
+std::string lump_cache_dir;
+static std::atomic<int> lump_cache_hits, lump_cache_misses;
+// bump when the layout of an entry changes
+static const int lump_cache_format = 2;
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t size) {
+    const auto *p = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t lump_cache_key(const char *converter, int version, const std::string& name, const std::vector<uint8_t>& input) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = fnv1a(h, &lump_cache_format, sizeof(lump_cache_format));
+    h = fnv1a(h, converter, strlen(converter) + 1);
+    h = fnv1a(h, &version, sizeof(version));
+    h = fnv1a(h, name.c_str(), name.size() + 1);
+    uint64_t size = input.size();
+    h = fnv1a(h, &size, sizeof(size));
+    return fnv1a(h, input.data(), input.size());
+}
+
+static std::string lump_cache_filename(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.lump", (unsigned long long)key);
+    return lump_cache_dir + name;
+}
+
+lump_cache_capture::lump_cache_capture() : prev_log(item_log()), prev_stats(stat_capture()) {
+    if (lump_cache_dir.empty()) return;
+    if (!item_log()) item_log() = &own_log;
+    log_start = item_log()->size();
+    stat_capture() = &stats;
+}
+
+lump_cache_capture::~lump_cache_capture() {
+    if (lump_cache_dir.empty()) return;
+    if (!prev_log) fputs(own_log.c_str(), stdout);
+    item_log() = prev_log;
+    stat_capture() = prev_stats;
+}
+
+std::string lump_cache_capture::log() const {
+    return item_log()->substr(log_start);
+}
+
+bool lump_cache_get(uint64_t key, std::vector<uint8_t>& output) {
+    if (lump_cache_dir.empty()) return false;
+    FILE *f = fopen(lump_cache_filename(key).c_str(), "rb");
+    if (!f) {
+        lump_cache_misses++;
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::vector<uint8_t> entry(std::max(size, 0l));
+    bool ok = size >= 0 && fread(entry.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    // the entry is parsed in full before anything is replayed
+    size_t pos = 0;
+    std::string log;
+    int count = 0;
+    ok = ok && lump_cache_next(entry, pos, output) && lump_cache_next(entry, pos, log) &&
+         lump_cache_next(entry, pos, count) && count >= 0;
+    std::vector<std::pair<stat_update, int>> stats;
+    for (int i = 0; ok && i < count; i++) {
+        stat_update update;
+        int times;
+        ok = lump_cache_next(entry, pos, update.name) && lump_cache_next(entry, pos, update.index) &&
+             lump_cache_next(entry, pos, update.value) && lump_cache_next(entry, pos, times);
+        stats.emplace_back(update, times);
+    }
+    if (!ok || pos != entry.size()) {
+        lump_cache_misses++;
+        return false;
+    }
+    lump_cache_hits++;
+    item_printf("%s", log.c_str());
+    for (const auto &e : stats) {
+        auto stat = replayable_stat::find(e.first.name);
+        for (int i = 0; stat && i < e.second; i++) {
+            stat->replay(e.first.index, e.first.value);
+        }
+    }
+    return true;
+}
+
+void lump_cache_put(uint64_t key, const std::vector<uint8_t>& output, const lump_cache_capture& capture) {
+    if (lump_cache_dir.empty()) return;
+    std::vector<uint8_t> entry;
+    lump_cache_append(entry, output);
+    lump_cache_append(entry, capture.log());
+    // stats don't depend on the order of their updates, so repeated ones are stored once with a count
+    std::map<std::tuple<std::string, int, int>, int> stats;
+    for (const auto &update : capture.stats) {
+        stats[std::make_tuple(update.name, update.index, update.value)]++;
+    }
+    lump_cache_append(entry, (int)stats.size());
+    for (const auto &e : stats) {
+        lump_cache_append(entry, std::get<0>(e.first));
+        lump_cache_append(entry, std::get<1>(e.first));
+        lump_cache_append(entry, std::get<2>(e.first));
+        lump_cache_append(entry, e.second);
+    }
+    // write to a temporary file then rename, so a partially written entry is never seen
+    std::string filename = lump_cache_filename(key);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string tmp_filename = filename + suffix;
+    FILE *f = fopen(tmp_filename.c_str(), "wb");
+    if (!f) {
+        item_printf("warning: can't write lump cache file %s\n", tmp_filename.c_str());
+        return;
+    }
+    bool ok = fwrite(entry.data(), 1, entry.size(), f) == entry.size();
+    ok &= !fclose(f);
+    if (!ok || rename(tmp_filename.c_str(), filename.c_str())) {
+        item_printf("warning: can't write lump cache file %s\n", filename.c_str());
+        remove(tmp_filename.c_str());
+    }
+}
+
+void lump_cache_print_summary() {
+    if (lump_cache_dir.empty()) return;
+    printf("Lump cache %s: hits %d misses %d\n", lump_cache_dir.c_str(), lump_cache_hits.load(), lump_cache_misses.load());
+}
+
+void lump_cache_append(std::vector<uint8_t>& out, int value) {
+    const auto *p = (const uint8_t *)&value;
+    out.insert(out.end(), p, p + sizeof(value));
+}
+
+void lump_cache_append(std::vector<uint8_t>& out, const std::vector<uint8_t>& piece) {
+    lump_cache_append(out, (int)piece.size());
+    out.insert(out.end(), piece.begin(), piece.end());
+}
+
+void lump_cache_append(std::vector<uint8_t>& out, const std::string& piece) {
+    lump_cache_append(out, (int)piece.size());
+    out.insert(out.end(), piece.begin(), piece.end());
+}
+
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, int& value) {
+    if (in.size() - pos < sizeof(value)) return false;
+    memcpy(&value, in.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, std::vector<uint8_t>& piece) {
+    int size;
+    if (!lump_cache_next(in, pos, size) || size < 0 || in.size() - pos < (size_t)size) return false;
+    piece.assign(in.begin() + (long)pos, in.begin() + (long)(pos + size));
+    pos += size;
+    return true;
+}
+
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, std::string& piece) {
+    std::vector<uint8_t> bytes;
+    if (!lump_cache_next(in, pos, bytes)) return false;
+    piece.assign(bytes.begin(), bytes.end());
+    return true;
+}
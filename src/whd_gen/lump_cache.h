@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 20222 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "statsomizer.h"
+
+// content addressed cache of converted lump data (enabled with -cache <dir>), so that regenerating after a small
+// change to the input WAD only re-encodes the lumps which changed. the key covers the converter name and version as
+// well as the lump name and input data, so a converter's version must be bumped whenever its output changes. an entry
+// also holds what the converter logged and recorded in stats (see lump_cache_capture), which is replayed on a hit so
+// that a warm run logs and reports the same as a cold one
+extern std::string lump_cache_dir;
+
+// captures what this thread logs with item_printf and records in replayable stats while in scope (if the cache is
+// enabled); a converter which runs on a cache miss should do so inside one of these, and pass it to lump_cache_put
+struct lump_cache_capture {
+    lump_cache_capture();
+    ~lump_cache_capture();
+    std::string log() const;
+
+    std::vector<stat_update> stats;
+private:
+    std::string *prev_log;
+    std::vector<stat_update> *prev_stats;
+    std::string own_log; // used when not in a parallel_for item (whose log is otherwise written straight to stdout)
+    size_t log_start;
+};
+
+uint64_t lump_cache_key(const char *converter, int version, const std::string& name, const std::vector<uint8_t>& input);
+// these are thread safe. lump_cache_get replays the log and stats stored with the entry on a hit
+bool lump_cache_get(uint64_t key, std::vector<uint8_t>& output);
+void lump_cache_put(uint64_t key, const std::vector<uint8_t>& output, const lump_cache_capture& capture);
+void lump_cache_print_summary();
+
+// for converters whose cache key or entry is made up of several pieces (each piece is length prefixed)
+void lump_cache_append(std::vector<uint8_t>& out, const std::vector<uint8_t>& piece);
+void lump_cache_append(std::vector<uint8_t>& out, const std::string& piece);
+void lump_cache_append(std::vector<uint8_t>& out, int value);
+// these return false if the entry is truncated/malformed
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, std::vector<uint8_t>& piece);
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, std::string& piece);
+bool lump_cache_next(const std::vector<uint8_t>& in, size_t& pos, int& value);
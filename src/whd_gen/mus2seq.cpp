@@ -72,7 +72,7 @@ typedef struct
         } musheader;
 
 static_assert(sizeof(musheader)==14,"");
-static int channel_map[SEQ_MAX_CHANNEL_COUNT];
+static thread_local int channel_map[SEQ_MAX_CHANNEL_COUNT];
 
 // Allocate a free MIDI channel.
 
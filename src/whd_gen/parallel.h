@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 20222 Graham Sanderson
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// number of threads used by parallel_for (set by -j)
+extern unsigned int whd_gen_threads;
+
+// log of the parallel_for item being processed by this thread (null outside of parallel_for). not static, so that
+// there is one per thread rather than one per translation unit
+inline std::string *&item_log() {
+    static thread_local std::string *log;
+    return log;
+}
+
+// printf for code which may run inside parallel_for; each item's output is buffered and written out in item order,
+// so the log reads the same as a serial run
+static inline int __attribute__((format(printf, 1, 2))) item_printf(const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    int rc;
+    if (item_log()) {
+        char buf[256];
+        va_list va2;
+        va_copy(va2, va);
+        rc = vsnprintf(buf, sizeof(buf), fmt, va2);
+        va_end(va2);
+        if (rc < (int)sizeof(buf)) {
+            item_log()->append(buf, std::max(rc, 0));
+        } else {
+            std::vector<char> big(rc + 1);
+            vsnprintf(big.data(), big.size(), fmt, va);
+            item_log()->append(big.data(), rc);
+        }
+    } else {
+        rc = vprintf(fmt, va);
+    }
+    va_end(va);
+    return rc;
+}
+
+// writes out whatever this thread has buffered for its current item (so that it precedes a fatal error message)
+static inline void item_log_flush() {
+    if (item_log()) {
+        fputs(item_log()->c_str(), stdout);
+        item_log()->clear();
+    }
+}
+
+// calls fn(i) for each i in [0, count) from a pool of whd_gen_threads threads. fn must only touch state belonging
+// to item i (or stats, which are thread safe); callers collect results per item and apply them to the wad afterwards
+// in item order, so that the output doesn't depend on scheduling
+template<typename F> void parallel_for(size_t count, F fn) {
+    unsigned int thread_count = std::min((size_t)std::max(whd_gen_threads, 1u), count);
+    if (thread_count <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::string> logs(count);
+    std::vector<bool> done(count);
+    size_t next_log = 0;
+    std::mutex log_mutex;
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < count;) {
+            item_log() = &logs[i];
+            fn(i);
+            item_log() = nullptr;
+            // write out the logs of all items finished so far in order
+            std::lock_guard<std::mutex> lock(log_mutex);
+            done[i] = true;
+            for (; next_log < count && done[next_log]; next_log++) {
+                fputs(logs[next_log].c_str(), stdout);
+                std::string().swap(logs[next_log]);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < thread_count; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) t.join();
+}
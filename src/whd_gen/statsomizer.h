@@ -6,17 +6,83 @@
 #pragma once
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include <cstdio>
 
-struct statsomizer {
+struct stat_update {
+    std::string name;
+    int index, value;
+};
+
+// while set (by lump_cache_capture), updates this thread makes to stats are also appended here, so that they can be
+// stored in a lump cache entry and replayed when it is hit (not static, so all translation units share it)
+inline std::vector<stat_update> *&stat_capture() {
+    static thread_local std::vector<stat_update> *capture;
+    return capture;
+}
+
+// a stat which a lump cache hit can replay updates into; live stats are registered so they can be found by name
+struct replayable_stat {
     const std::string name;
 
-    explicit statsomizer(std::string name) : name(std::move(name)) { reset(); }
+    explicit replayable_stat(std::string name) : name(std::move(name)) { add_live(this); }
+    replayable_stat(const replayable_stat &other) : name(other.name) { add_live(this); }
+    virtual ~replayable_stat() {
+        std::lock_guard<std::mutex> lock(live_mutex());
+        live().erase(std::find(live().begin(), live().end(), this));
+    }
+
+    virtual void replay(int index, int value) = 0;
+
+    // the most recently constructed live stat with the given name (or null)
+    static replayable_stat *find(const std::string &name) {
+        std::lock_guard<std::mutex> lock(live_mutex());
+        auto it = std::find_if(live().rbegin(), live().rend(), [&](const replayable_stat *s) { return s->name == name; });
+        return it == live().rend() ? nullptr : *it;
+    }
+
+protected:
+    void captured(int index, int value) const {
+        if (stat_capture()) stat_capture()->push_back({name, index, value});
+    }
+
+private:
+    static void add_live(replayable_stat *stat) {
+        std::lock_guard<std::mutex> lock(live_mutex());
+        live().push_back(stat);
+    }
+    static std::vector<replayable_stat *> &live() {
+        static std::vector<replayable_stat *> stats;
+        return stats;
+    }
+    static std::mutex &live_mutex() {
+        static std::mutex m;
+        return m;
+    }
+};
 
+struct statsomizer : replayable_stat {
+    // keep_samples retains every recorded value so that percentile() can be used
+    explicit statsomizer(std::string name, bool keep_samples = false) : replayable_stat(std::move(name)), keep_samples(keep_samples) { reset(); }
+
+    // thread safe, as converters record stats from parallel_for workers
     void record(int value) {
-        total += value;
-        min = std::min(min, value);
-        max = std::max(max, value);
-        count++;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            total += value;
+            min = std::min(min, value);
+            max = std::max(max, value);
+            count++;
+            if (keep_samples) samples.push_back(value);
+        }
+        captured(0, value);
+    }
+
+    void replay(int index, int value) override {
+        record(value);
     }
 
     void record_print(int value) {
@@ -25,9 +91,31 @@ struct statsomizer {
                count ? ((int) (total / count)) : 0);
     }
 
+    // nearest rank percentile (0-100) of the recorded values; only valid with keep_samples
+    int percentile(int pct) const {
+        if (samples.empty()) return 0;
+        std::vector<int> sorted(samples);
+        size_t rank = (sorted.size() * (size_t)pct + 99) / 100;
+        if (rank) rank--;
+        std::nth_element(sorted.begin(), sorted.begin() + (long)rank, sorted.end());
+        return sorted[rank];
+    }
+
+    // the line printed by print_summary (for callers that need to direct it elsewhere)
+    std::string summary() const {
+        char buf[256];
+        if (keep_samples) {
+            snprintf(buf, sizeof(buf), "%20s: min=%d max=%d avg=%d p50=%d p99=%d count=%d total=%ld\n", name.c_str(), min, max,
+                   count ? ((int) (total / count)) : 0, percentile(50), percentile(99), count, total);
+        } else {
+            snprintf(buf, sizeof(buf), "%20s: min=%d max=%d avg=%d count=%d total=%ld\n", name.c_str(), min, max,
+                   count ? ((int) (total / count)) : 0, count, total);
+        }
+        return buf;
+    }
+
     void print_summary() const {
-        printf("%20s: min=%d max=%d avg=%d count=%d total=%ld\n", name.c_str(), min, max,
-               count ? ((int) (total / count)) : 0, count, total);
+        fputs(summary().c_str(), stdout);
     }
 
     void reset() {
@@ -35,8 +123,41 @@ struct statsomizer {
         count = 0;
         min = std::numeric_limits<int>::max();
         max = std::numeric_limits<int>::min();
+        samples.clear();
+    }
+
+    static std::mutex &mutex() {
+        static std::mutex m;
+        return m;
     }
 
     long total;
     int count, min, max;
+    bool keep_samples;
+    std::vector<int> samples;
+};
+
+// thread safe counters (or an array of them, e.g. indexed by which encoding won) which, like statsomizer, are
+// replayed on a lump cache hit
+struct stat_counts : replayable_stat {
+    explicit stat_counts(std::string name, int size = 1) : replayable_stat(std::move(name)), counts(size) {}
+
+    void add(int index = 0, int value = 1) {
+        counts[index] += value;
+        captured(index, value);
+    }
+
+    int operator[](int index) const {
+        return counts[index];
+    }
+
+    int size() const {
+        return (int)counts.size();
+    }
+
+    void replay(int index, int value) override {
+        if (index >= 0 && index < size()) add(index, value);
+    }
+
+    std::vector<std::atomic<int>> counts;
 };
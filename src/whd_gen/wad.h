@@ -90,6 +90,16 @@ struct wad {
         return false;
     }
 
+    // unlike get_lump(int) this doesn't add an entry for a missing lump, so may be called from parallel_for workers
+    bool find_lump(int num, lump& lump_out) const {
+        auto it = lumps.find(num);
+        if (it != lumps.end() && it->second.data.size()) {
+            lump_out = it->second;
+            return true;
+        }
+        return false;
+    }
+
     void update_lump(const lump& lump) {
         assert(lump.num>=0);
         if (to_lower(lumps[lump.num].name) != to_lower(lump.name)) {
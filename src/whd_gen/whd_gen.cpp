@@ -24,6 +24,9 @@
 #include <vector>
 #include "musx_decoder.h"
 #include "image_decoder.h"
+#include "huff_bench.h"
+#include "lump_cache.h"
+#include "parallel.h"
 
 //#define USE_PIXELS_ONLY_PATCH 1 // dont use c3 on patches
 #define USE_PIXELS_ONLY_FLAT 1 // dont use c3 on flats
@@ -40,6 +43,9 @@ typedef struct __packed {
 
 
 bool super_tiny = true;
+bool huff_bench = false;
+bool max_compression = false; // only covers texture column metadata
+unsigned int whd_gen_threads = std::thread::hardware_concurrency();
 
 using std::vector;
 
@@ -48,11 +54,19 @@ template<typename T, typename S> std::ostream &operator<<(std::ostream &os, cons
 #include "huff.h"
 #include "huff_sink.h"
 
-int dumped_patch_count, converted_patch_count, converted_patch_size;
-int bit_addressable_patch;
-std::vector<int> winners(16);
-std::vector<int> fwinners(4);
+// the converters run on parallel_for workers, so the counters they bump are thread safe (and other shared stats are
+// guarded); they are stat_counts so that they are replayed on a lump cache hit
+stat_counts dumped_patch_count("Dumped patches"), converted_patch_count("Converted patches"), converted_patch_size("Converted patch size");
+stat_counts bit_addressable_patch("Bit addressable patches");
+stat_counts winners("Patch encoding winners", 16);
+stat_counts fwinners("Flat encoding winners", 4);
 std::set<int> all_linedef_flags;
+std::mutex all_linedef_flags_mutex;
+
+static void record_linedef_flags(int flags) {
+    std::lock_guard<std::mutex> lock(all_linedef_flags_mutex);
+    all_linedef_flags.insert(flags);
+}
 
 statsomizer flat_have_same_savings("Flat same savings");
 statsomizer side_meta("Side meta");
@@ -72,6 +86,8 @@ static std::map<int,std::string> touched;
 static std::vector<int> cleared_lumps;
 static std::set<int> compressed;
 static std::set<std::string> name_required;
+// -max-compression: bytes of texture metadata saved over the default encoding
+static stat_counts max_compression_savings("Max compression savings");
 
 // map from thing in the lump to some stat buckets
 #if 0
@@ -718,6 +734,7 @@ const anim_range_t tex_animdefs[] = {
 };
 
 void __attribute__((noreturn)) fail(const char *msg, ...) {
+    item_log_flush(); // so the log of the item which failed precedes the error
     va_list va;
     va_start(va, msg);
     vprintf(msg, va);
@@ -769,7 +786,9 @@ T get_field_inc(const std::vector<uint8_t> &data, int &offset) {
 }
 
 static void usage() {
-    throw std::invalid_argument("usage: whd_gen <wad_in> <whd_out>");
+    throw std::invalid_argument("usage: whd_gen <wad_in> <whd_out> [-no-super-tiny] [-huff-bench] [-max-compression] [-j <threads>] [-cache <dir>]\n"
+                                "  -max-compression  search pass orders for the texture column metadata (textures only; flats,\n"
+                                "                    patches and levels are always encoded the default way)\n");
 }
 
 std::set<std::string> music_lumpnames = {
@@ -953,7 +972,6 @@ std::set<std::string> sfx_lumpnames = {
         "dsradio",
 };
 
-bool convert_sound(std::pair<const int, lump> &e);
 
 void dump_patch(const char *name, int num, lump &patch);
 
@@ -1073,8 +1091,8 @@ std::vector<int16_t> unpack_patch(lump &patch) {
     return pixels;
 }
 
-int opaque_pixels;
-int transparent_pixels;
+stat_counts opaque_pixels("Opaque pixels");
+stat_counts transparent_pixels("Transparent pixels");
 std::vector<std::vector<uint8_t>> to_merged_posts(const std::vector<int16_t>& pix, uint width, uint height, std::vector<int>& same, bool& have_same) {
     std::vector<std::vector<uint8_t>> merged_posts(width);
     same.clear();
@@ -1105,18 +1123,21 @@ std::vector<std::vector<uint8_t>> to_merged_posts(const std::vector<int16_t>& pi
         }
     }
 #endif
+    int opaque = 0, transparent = 0;
     for(int x=0;x<(int)width;x++) {
         if (!same[x]) {
             for(int y = 0; y < (int)(width * height); y += width) {
                 if (pix[x+y]>=0) {
                     merged_posts[x].push_back(pix[x+y]);
-                    opaque_pixels++;
+                    opaque++;
                 } else {
-                    transparent_pixels++;
+                    transparent++;
                 }
             }
         }
     }
+    opaque_pixels.add(0, opaque);
+    transparent_pixels.add(0, transparent);
     return merged_posts;
 }
 
@@ -1384,12 +1405,12 @@ uint consider_compress3(const std::string& name, const std::vector<std::vector<u
         if (!pass) {
             if (color_change_count == 0) { // very pointless but CYAN in doom2 is this
                 // this is simpler than adding special case in the decode
-                printf("warning: zero colors for compression, adding some dummies\n");
+                item_printf("warning: zero colors for compression, adding some dummies\n");
                 sink.output(std::make_pair(false, 0));
                 sink.output(std::make_pair(false, 1));
             } else if (color_change_count == 1) {
                 // this is simpler than adding special case in the decode
-                printf("warning: only one color for compression, adding a dummy\n");
+                item_printf("warning: only one color for compression, adding a dummy\n");
                 sink.output(std::make_pair(false, (uint8_t)(last_color + 1)));
             }
 
@@ -1446,7 +1467,7 @@ uint consider_compress3(const std::string& name, const std::vector<std::vector<u
         if (!std::equal(post.begin(), post.end(), posts[x].begin(), posts[x].end())) {
             if (post.size() == posts[x].size()) {
                 for(int i=0;i<(int)post.size();i++) {
-                    printf("%d %02x %02x %c\n", i, posts[x][i], post[i], posts[x][i] != post[i] ? '*' : ' ');
+                    item_printf("%d %02x %02x %c\n", i, posts[x][i], post[i], posts[x][i] != post[i] ? '*' : ' ');
                 }
             }
             fail("Post mismatcher %d %d vs %d\n", x, (int)post.size(), (int)posts[x].size());
@@ -1460,7 +1481,8 @@ uint consider_compress3(const std::string& name, const std::vector<std::vector<u
 }
 
 uint consider_compress_pixels_only(const std::string& name, const std::vector<std::vector<uint8_t>>& posts,
-                                   std::shared_ptr<byte_vector_bit_output>& decoder_output, std::vector<std::shared_ptr<byte_vector_bit_output>>& zposts, uint width, uint height, uint& decoder_size_out) {
+                                   std::shared_ptr<byte_vector_bit_output>& decoder_output, std::vector<std::shared_ptr<byte_vector_bit_output>>& zposts, uint width, uint height, uint& decoder_size_out,
+                                   const char *bench_kind = "patch") {
     symbol_sink<huffman_params<uint8_t>> raw_pixel_sink("Raw Pixel");
     sink_wrappers<std::shared_ptr<byte_vector_bit_output>> wrappers{raw_pixel_sink};
 
@@ -1489,12 +1511,12 @@ uint consider_compress_pixels_only(const std::string& name, const std::vector<st
         if (!pass) {
             if (color_change_count == 0) { // very pointless but CYAN in doom2 is this
                 // this is simpler than adding special case in the decode
-                printf("warning: zero colors for compression, adding some dummies");
+                item_printf("warning: zero colors for compression, adding some dummies");
                 raw_pixel_sink.output(0);
                 raw_pixel_sink.output(1);
             } else if (color_change_count == 1) {
                 // this is simpler than adding special case in the decode
-                printf("warning: only one color for compression, adding a dummy");
+                item_printf("warning: only one color for compression, adding a dummy");
                 raw_pixel_sink.output(last_color + 1);
             }
             wrappers.begin_output(decoder_output);
@@ -1537,6 +1559,11 @@ uint consider_compress_pixels_only(const std::string& name, const std::vector<st
     decoder_size_out = pos - buf;
     th_make_prefix_length_table(rp_decoder, tmp);
     assert(pos < buf + count_of(buf));
+    if (huff_bench) {
+        uint count = 0;
+        for (const auto &post : posts) count += post.size();
+        huff_bench_record(bench_kind, rp_decoder, result, (bi->cur - biv.data.data()) * 8 + bi->bit, count);
+    }
     std::vector<std::vector<uint8_t>> decoded(width);
     for(int x=0;x<(int)width;x++) {
         auto& post = decoded[x];
@@ -1546,10 +1573,10 @@ uint consider_compress_pixels_only(const std::string& name, const std::vector<st
             post.push_back(pix);
         }
         if (!std::equal(post.begin(), post.end(), posts[x].begin(), posts[x].end())) {
-            printf("Post mismatcher %d %d vs %d\n", x, (int)post.size(), (int)posts[x].size());
+            item_printf("Post mismatcher %d %d vs %d\n", x, (int)post.size(), (int)posts[x].size());
             if (post.size() == posts[x].size()) {
                 for(int i=0;i<(int)post.size();i++) {
-                    printf("%d %02x %02x %c\n", i, posts[x][i], post[i], posts[x][i] != post[i] ? '*' : ' ');
+                    item_printf("%d %02x %02x %c\n", i, posts[x][i], post[i], posts[x][i] != post[i] ? '*' : ' ');
                 }
             }
         }
@@ -1612,10 +1639,10 @@ uint consider_compress_data(const std::string& name, std::vector<uint8_t>& input
         decoded.push_back(pix);
     }
     if (!std::equal(decoded.begin(), decoded.end(), input.begin(), input.end())) {
-        printf("Post mismatcher  %d vs %d\n", (int)decoded.size(), (int)input.size());
+        item_printf("Post mismatcher  %d vs %d\n", (int)decoded.size(), (int)input.size());
         if (decoded.size() == input.size()) {
             for(int i=0; i < (int)decoded.size(); i++) {
-                printf("%d %02x %02x %c\n", i, input[i], decoded[i], input[i] != decoded[i] ? '*' : ' ');
+                item_printf("%d %02x %02x %c\n", i, input[i], decoded[i], input[i] != decoded[i] ? '*' : ' ');
             }
         }
         fail("post mismatched");
@@ -1643,6 +1670,13 @@ void patch_for_each_pixel(lump &patch, std::function<void(uint8_t)> callback) {
 symbol_stats<uint16_t> patch_run_stats;
 symbol_stats<uint16_t> patch_width_stats;
 symbol_stats<uint16_t> patch_height_stats;
+std::mutex patch_symbol_stats_mutex;
+
+// symbol_stats isn't thread safe, and patches are encoded on parallel_for workers
+static void add_patch_symbol_stat(symbol_stats<uint16_t> &stats, uint16_t value) {
+    std::lock_guard<std::mutex> lock(patch_symbol_stats_mutex);
+    stats.add(value);
+}
 
 const uint8_t bitcount8_table[256] = {
         0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
@@ -1655,11 +1689,21 @@ const uint8_t bitcount8_table[256] = {
         8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
         };
 
-void convert_patch(wad &wad, int num, lump &patch) {
+// bump when the encoded output of the respective converter changes, to invalidate lump cache entries
+#define SFX_CACHE_VERSION 1
+#define MUSX_CACHE_VERSION 1
+#define PATCH_CACHE_VERSION 1
+#define FLAT_CACHE_VERSION 1
+#define TEXTURE_CACHE_VERSION 1
+#define LEVEL_CACHE_VERSION 1
+
+// encodes a DOOM format patch, returning the new lump data. this only reads the patch (and records stats) so may be
+// called from parallel_for workers
+std::vector<uint8_t> encode_patch(wad &wad, int num, lump &patch) {
     dump_patch(patch.name.c_str(), num, patch);
     auto ph = get_field<patch_header>(patch.data, 0);
     auto pix = unpack_patch(patch);
-    converted_patch_count++;
+    converted_patch_count.add();
     assert(ph.height < 256);
 #if DEBUG_SAVE_PNG
     save_png(wad, "raw", patch.name, ph.width, ph.height, pix);
@@ -1826,9 +1870,9 @@ for(int y=0;y<ph.height-1;y++) {
     // todo put this back if we need 5K
 //    choose(3, consider_compress1(patch.name, posts, ph.width, ph.height, 2, 8));
 #endif
-    winners[choice]++;
+    winners.add(choice);
     cp_size.record(best);
-    converted_patch_size += ph.width * ph.height;
+    converted_patch_size.add(0, ph.width * ph.height);
 
     // ------------------
     // start with metadata without post pixels
@@ -1841,8 +1885,8 @@ for(int y=0;y<ph.height-1;y++) {
         int last = 0;
         orig_meta_size++;
         while (post[0] != 0xff) {
-            patch_run_stats.add(ph.height - last);
-            patch_run_stats.add(ph.height - post[0]);
+            add_patch_symbol_stat(patch_run_stats, ph.height - last);
+            add_patch_symbol_stat(patch_run_stats, ph.height - post[0]);
             last = post[0] + post[1];
             orig_meta_size+=2;
 
@@ -1851,7 +1895,7 @@ for(int y=0;y<ph.height-1;y++) {
         }
         if (last != ph.height) {
             assert( last < ph.height);
-            patch_run_stats.add(ph.height - last);
+            add_patch_symbol_stat(patch_run_stats, ph.height - last);
         }
         if ((int)posts[col].size() == ph.height || same[col]) {
             full_or_same_column_count++;
@@ -1907,7 +1951,7 @@ for(int y=0;y<ph.height-1;y++) {
 //                        assert(post[0] == 0xff);
                         if (post[0]==0xff) break;
                     }
-                    patch_run_stats.add(run);
+                    add_patch_symbol_stat(patch_run_stats, run);
                     col_metadata.emplace_back(run, bitwidth(ph.height-last)); // todo could shrink range by 1 after the first - doubt it makes much difference
                     last += run;
                     if (last >= ph.height) break;
@@ -1953,7 +1997,7 @@ for(int y=0;y<ph.height-1;y++) {
         metadata = write_meta(false);
         flags |= 4;
     } else {
-        bit_addressable_patch++;
+        bit_addressable_patch.add();
     }
 //    patch_meta_size.record(6 + 2 * ph.width + (extra?2:0) + metadata.bit_size()/8);
     patch_meta_size.record(6 + 2 * ph.width + (extra?2:0) + metadata.bit_size()/8);
@@ -2012,15 +2056,23 @@ for(int y=0;y<ph.height-1;y++) {
     auto c2 = output.get_output();
     p2.insert(p2.end(), c2.begin(), c2.end());
 #endif
-    printf("      encoding %d %d->%d ds %d\n", choice, (int)patch.data.size(), (int)p2.size(), best_decoder_size);
+    item_printf("      encoding %d %d->%d ds %d\n", choice, (int)patch.data.size(), (int)p2.size(), best_decoder_size);
+    return p2;
+}
+
+void apply_patch(wad &wad, int num, lump &patch, std::vector<uint8_t> data) {
     patch_orig_size.record(patch.data.size());
-    patch.data = p2;
+    patch.data = std::move(data);
     patch_new_size.record(patch.data.size());
     wad.update_lump(patch);
     compressed.insert(num);
     touched[num] = TOUCHED_PATCH;
 }
 
+void convert_patch(wad &wad, int num, lump &patch) {
+    apply_patch(wad, num, patch, encode_patch(wad, num, patch));
+}
+
 // use_runs = true to do runs of pixels, false to use 0 as transparent color
 void convert_vpatch(wad &wad, lump &patch, int max_colors, bool use_runs, std::set<int> colors, int shared_palette_handle, bool first) {
     touched[patch.num] = TOUCHED_VPATCH;
@@ -2249,12 +2301,10 @@ void convert_vpatches(wad &wad, const std::vector<std::string>& names, int max_c
 }
 
 void convert_patches(wad &wad, std::string from_name, std::string to_name) {
-    lump pnames;
     int start = wad.get_lump_index(from_name);
     int end = wad.get_lump_index(to_name);
-    std::set<int> pname_patches;
 
-    std::set<std::string> temp_hack;
+    std::vector<lump> patches;
     for (int num = start + 1; num < end; num++) {
         lump patch;
         if (wad.get_lump(num, patch)) {
@@ -2268,23 +2318,41 @@ void convert_patches(wad &wad, std::string from_name, std::string to_name) {
             // for now remove the data
             //wad.remove_lump(name);
 
-            convert_patch(wad, num, patch);
+            patches.push_back(patch);
         } else {
             printf("  %d - not found\n", num);
         }
     }
+    // encode in parallel, then apply the results in lump order
+    std::vector<std::vector<uint8_t>> encoded(patches.size());
+    parallel_for(patches.size(), [&](size_t i) {
+        auto &patch = patches[i];
+        uint64_t key = lump_cache_key("patch", PATCH_CACHE_VERSION, patch.name, patch.data);
+        if (!lump_cache_get(key, encoded[i])) {
+            lump_cache_capture capture;
+            encoded[i] = encode_patch(wad, patch.num, patch);
+            lump_cache_put(key, encoded[i], capture);
+        }
+    });
+    for (size_t i = 0; i < patches.size(); i++) {
+        apply_patch(wad, patches[i].num, patches[i], std::move(encoded[i]));
+    }
 }
 
 void dump_patch(const char *name, int num, lump &patch) {
     static std::set<int> dumped;
-    if (!dumped.insert(num).second) return;
-    dumped_patch_count++;
+    static std::mutex dumped_mutex;
+    {
+        std::lock_guard<std::mutex> lock(dumped_mutex);
+        if (!dumped.insert(num).second) return;
+    }
+    dumped_patch_count.add();
 #if 1
     const patch_header *ph = (const patch_header *)patch.data.data();
     patch_widths.record(ph->width);
     patch_heights.record(ph->height);
-    patch_width_stats.add(ph->width);
-    patch_height_stats.add(ph->height);
+    add_patch_symbol_stat(patch_width_stats, ph->width);
+    add_patch_symbol_stat(patch_height_stats, ph->height);
     patch_left_offsets.record(ph->leftoffset);
     patch_top_offsets.record(ph->topoffset);
     patch_sizes.record(ph->width * ph->height);
@@ -2351,19 +2419,34 @@ void dump_patch(const char *name, int num, lump &patch) {
     });
     auto c2 = output.get_output();
 #endif
-    printf("  %d %s - %dx%d +%d,%d colors %d\n", num, name, ph->width, ph->height, ph->leftoffset, ph->topoffset, (int)patch_color_set.size());
+    item_printf("  %d %s - %dx%d +%d,%d colors %d\n", num, name, ph->width, ph->height, ph->leftoffset, ph->topoffset, (int)patch_color_set.size());
     if (ph->width >= 256) {
-        printf("        wide\n");
+        item_printf("        wide\n");
     }
 }
 
-std::vector<int> convert_sidedefs(wad &wad, const texture_index &tex_index, lump &lump) {
+// what converting a level produces. levels are converted on parallel_for workers, and the results applied to the wad
+// in level order afterwards, since the WHD hash depends on that order
+struct level_result {
+    std::vector<lump> lumps;
+    std::vector<uint32_t> hash_counts;
+
+    void update_lump(const lump &l) {
+        lumps.push_back(l);
+    }
+
+    void hash(uint32_t count) {
+        hash_counts.push_back(count);
+    }
+};
+
+std::vector<int> convert_sidedefs(level_result &level, const texture_index &tex_index, lump &lump) {
     assert(lump.data.size() % sizeof(mapsidedef_t) == 0);
     int count = lump.data.size() / sizeof(mapsidedef_t);
-    printf("Converting %d sidedefs in lump %s\n", count, lump.name.c_str());
+    item_printf("Converting %d sidedefs in lump %s\n", count, lump.name.c_str());
     std::vector<int> sidedef_mapping;
     int offset = 0;
-    hash = hash * 31 + count;
+    level.hash(count);
     if (super_tiny) {
         std::vector<uint8_t> sides_z;
         for (int i = 0; i < count; i++) {
@@ -2548,7 +2631,7 @@ std::vector<int> convert_sidedefs(wad &wad, const texture_index &tex_index, lump
         }
         lump.data = whd_sides;
     }
-    wad.update_lump(lump);
+    level.update_lump(lump);
     return sidedef_mapping;
 }
 
@@ -2626,19 +2709,19 @@ static inline int line_tag(const uint8_t *lines, const uint8_t *l) {
     return tag;
 }
 
-std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>& sidedef_mapping, const std::vector<std::pair<int,int>>& vertexes) {
+std::vector<int> convert_linedefs(level_result &level, lump &lump, const std::vector<int>& sidedef_mapping, const std::vector<std::pair<int,int>>& vertexes) {
     assert(lump.data.size() % sizeof(maplinedef_t) == 0);
     int count = lump.data.size() / sizeof(maplinedef_t);
-    hash = hash * 31 + count;
+    level.hash(count);
     if (super_tiny) {
         compressed.insert(lump.num);
-        printf("Converting %d linedefs in lump %s\n", count, lump.name.c_str());
+        item_printf("Converting %d linedefs in lump %s\n", count, lump.name.c_str());
         int offset = 0;
         int max_side_num = 0;
         int max_v = 0;
         for (int i = 0; i < count; i++) {
             auto msd = get_field_inc<maplinedef_t>(lump.data, offset);
-            all_linedef_flags.insert(msd.flags);
+            record_linedef_flags(msd.flags);
             assert(msd.sidenum[0] >= 0);
             assert(msd.sidenum[1] == -1 || msd.sidenum[1] == msd.sidenum[0]+1);
             if (msd.sidenum[0] >= 0) {
@@ -2652,7 +2735,7 @@ std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>&
             max_v = std::max((int)msd.v1, max_v);
         }
         auto try_encode = [&](uint size_guess) {
-            printf("Guess %d\n", size_guess);
+            item_printf("Guess %d\n", size_guess);
             uint vmul = 65536 * max_v / size_guess;
             assert(vmul < 65536);
             uint smul = 65536 * max_side_num / size_guess;
@@ -2740,13 +2823,13 @@ std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>&
 
                 result[base+1] = flags >> 8;
             }
-            side_num_range.print_summary();
-            side_num_range_v.print_summary();
-            v1_range.print_summary();
-            v1_range_v.print_summary();
-            v2_range.print_summary();
-            v2_range_v.print_summary();
-            printf("%d -> %d\n", (int)lump.data.size(), (int)result.size());
+            item_printf("%s", side_num_range.summary().c_str());
+            item_printf("%s", side_num_range_v.summary().c_str());
+            item_printf("%s", v1_range.summary().c_str());
+            item_printf("%s", v1_range_v.summary().c_str());
+            item_printf("%s", v2_range.summary().c_str());
+            item_printf("%s", v2_range_v.summary().c_str());
+            item_printf("%d -> %d\n", (int)lump.data.size(), (int)result.size());
             return std::make_pair(result, offsets);
         };
         uint size_guess = 5 * count;
@@ -2769,7 +2852,7 @@ std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>&
         uint vmul = 65536 * max_v / size_guess;
         for (int i = 0; i < count; i++) {
             auto msd = get_field_inc<maplinedef_t>(lump.data, offset);
-            all_linedef_flags.insert(msd.flags);
+            record_linedef_flags(msd.flags);
             if (msd.sidenum[0] >= 0) {
                 msd.sidenum[0] = sidedef_mapping[msd.sidenum[0]];
                 max_side_num = std::max(max_side_num, (int)(uint16_t)msd.sidenum[0]);
@@ -2797,7 +2880,7 @@ std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>&
         tmp = vmul; append_field(lump.data, tmp);
         assert(last_encoding.first.size() < 65536);
         lump.data.insert(lump.data.end(), last_encoding.first.begin(), last_encoding.first.end());
-        wad.update_lump(lump);
+        level.update_lump(lump);
         line_scale.record(100 * lump.data.size() / count);
         return last_encoding.second;
     } else {
@@ -2810,12 +2893,12 @@ std::vector<int> convert_linedefs(wad &wad, lump &lump, const std::vector<int>&
     }
 }
 
-std::vector<int> convert_segs(wad &wad, lump &lump, const std::vector<int>& linedef_mapping) {
+std::vector<int> convert_segs(level_result &level, lump &lump, const std::vector<int>& linedef_mapping) {
     assert(lump.data.size() % sizeof(mapseg_t) == 0);
     int count = lump.data.size() / sizeof(mapseg_t);
-    hash = hash * 31 + count;
+    level.hash(count);
     std::vector<uint8_t> newdata;
-    printf("Converting %d segs in lump %s\n", count, lump.name.c_str());
+    item_printf("Converting %d segs in lump %s\n", count, lump.name.c_str());
     std::vector<int> rc;
     if (!super_tiny) {
         int offset = 0;
@@ -2879,16 +2962,16 @@ std::vector<int> convert_segs(wad &wad, lump &lump, const std::vector<int>& line
         rc.push_back(newdata.size()); // we need an end marker too
     }
     lump.data = newdata;
-    wad.update_lump(lump);
+    level.update_lump(lump);
     return rc;
 }
 
-std::vector<std::pair<int,int>> convert_vertexes(wad &wad, lump &lump) {
+std::vector<std::pair<int,int>> convert_vertexes(level_result &level, lump &lump) {
     // todo 4->3
     assert(lump.data.size() % sizeof(mapvertex_t) == 0);
     int count = lump.data.size() / sizeof(mapvertex_t);
-    hash = hash * 31 + count;
-    printf("Converting %d vertexes in lump %s\n", count, lump.name.c_str());
+    level.hash(count);
+    item_printf("Converting %d vertexes in lump %s\n", count, lump.name.c_str());
     int offset = 0;
     std::vector<std::pair<int,int>> vertexes;
     for (int i = 0; i < count; i++) {
@@ -2913,13 +2996,13 @@ enum {
     BOXRIGHT
 };        // bbox coordinates
 
-void convert_nodes(wad &wad, lump &lump) {
+void convert_nodes(level_result &level, lump &lump) {
     assert(lump.data.size() % sizeof(mapnode_t) == 0);
     int count = lump.data.size() / sizeof(mapnode_t);
-    hash = hash * 31 + count;
+    level.hash(count);
     if (super_tiny) {
         std::vector<uint8_t> newdata;
-        printf("Converting %d nodes in lump %s\n", count, lump.name.c_str());
+        item_printf("Converting %d nodes in lump %s\n", count, lump.name.c_str());
         int offset = 0;
         // TODO we could do without encoding children, it only saves 2 bytes per node, but still it works
         //  in all the WADs we care about for now
@@ -3072,16 +3155,16 @@ void convert_nodes(wad &wad, lump &lump) {
         for (int i = 0; i < count; i++) {
             append_field(lump.data, whdnodes[i]);
         }
-        wad.update_lump(lump);
+        level.update_lump(lump);
     }
 }
 
-void convert_sectors(wad &wad, lump &lump) {
+void convert_sectors(wad &wad, level_result &level, lump &lump) {
     assert(lump.data.size() % sizeof(mapsector_t) == 0);
     int count = lump.data.size() / sizeof(mapsector_t);
-    hash = hash * 31 + count;
+    level.hash(count);
     std::vector<uint8_t> newdata;
-    printf("Converting %d sidedefs in lump %s\n", count, lump.name.c_str());
+    item_printf("Converting %d sidedefs in lump %s\n", count, lump.name.c_str());
     int offset = 0;
     int fstart = wad.get_lump_index("f_start")+1;
 
@@ -3127,15 +3210,15 @@ void convert_sectors(wad &wad, lump &lump) {
         append_field(newdata, se);
     }
     lump.data = newdata;
-    wad.update_lump(lump);
+    level.update_lump(lump);
 }
 
-void convert_subsectors(wad &wad, lump &lump, const std::vector<int>& seg_mapping) {
+void convert_subsectors(level_result &level, lump &lump, const std::vector<int>& seg_mapping) {
     assert(lump.data.size() % sizeof(mapsubsector_t) == 0);
     int count = lump.data.size() / sizeof(mapsubsector_t);
-    hash = hash * 31 + count;
+    level.hash(count);
     std::vector<uint8_t> newdata;
-    printf("Converting %d subsectors in lump %s\n", count, lump.name.c_str());
+    item_printf("Converting %d subsectors in lump %s\n", count, lump.name.c_str());
     int offset = 0;
     int expected = 0;
     auto appender= [&](int val) {
@@ -3153,7 +3236,7 @@ void convert_subsectors(wad &wad, lump &lump, const std::vector<int>& seg_mappin
         assert((int) seg_mapping.size() == expected + 1);
         appender(seg_mapping[expected]);
     lump.data = newdata;
-    wad.update_lump(lump);
+    level.update_lump(lump);
 }
 
 statsomizer blockmap_empty("blockmap empty");
@@ -3183,7 +3266,7 @@ void write_word(std::vector<uint8_t> &bytes, size_t pos, size_t word) {
     bytes[pos + 3] = (word >> 24) & 0xff;
 }
 
-void convert_blockmap(wad &wad, lump &lump, const std::vector<int>& linedef_mapping) {
+void convert_blockmap(level_result &level, lump &lump, const std::vector<int>& linedef_mapping) {
     const short *bm = (const short *) lump.data.data();
     int w = bm[2];
     int h = bm[3];
@@ -3216,7 +3299,7 @@ void convert_blockmap(wad &wad, lump &lump, const std::vector<int>& linedef_mapp
                     for (int last = 0; bm[i] != -1; i++) {
                         int delta = bm[i] - last;
                         if (delta == 0) {
-                            printf("  duplicate %d\n", last);
+                            item_printf("  duplicate %d\n", last);
                             continue;
                         }
                         cell.push_back(linedef_mapping[bm[i]]);
@@ -3346,11 +3429,11 @@ void convert_blockmap(wad &wad, lump &lump, const std::vector<int>& linedef_mapp
             }
             const auto &cell = blockmap[y][x];
             if (!std::equal(check.begin(), check.end(), cell.begin(), cell.end())) {
-                printf("Expected: ");
-                for (auto &e : cell) printf("%d ", e);
-                printf("\nGot: ");
-                for (auto &e : check) printf("%d ", e);
-                printf("\n");
+                item_printf("Expected: ");
+                for (auto &e : cell) item_printf("%d ", e);
+                item_printf("\nGot: ");
+                for (auto &e : check) item_printf("%d ", e);
+                item_printf("\n");
                 fail("(Mismatched blockmap decoding at cell %d,%d)\n", x, y);
             }
         }
@@ -3358,7 +3441,7 @@ void convert_blockmap(wad &wad, lump &lump, const std::vector<int>& linedef_mapp
 #endif
     lump.data.resize(8); // keep the x,y,w,h
     lump.data.insert(lump.data.end(), new_bm.begin(), new_bm.end());
-    wad.update_lump(lump);
+    level.update_lump(lump);
 }
 
 
@@ -3565,6 +3648,10 @@ std::vector<uint8_t> optimize_column(std::string name, int col, std::vector<uint
             if (m0 & WHD_COL_SEG_MEMCPY) {
                 // memcpy
                 int from = cmds[i++];
+                if (from + length > height) {
+                    if (leniant) return std::vector<std::pair<int, int>>();
+                    assert(false);
+                }
                 if (!(m0 & WHD_COL_SEG_MEMCPY_IS_BACKWARDS)) {
                     for (int j = 0; j < length; j++) {
                         patch_and_y[y + j] = patch_and_y[from + j];
@@ -3592,25 +3679,25 @@ std::vector<uint8_t> optimize_column(std::string name, int col, std::vector<uint
             had_dump = true;
             dump_original();
         }
-        printf("Tex %s col %d: ", name.c_str(), col);
+        item_printf("Tex %s col %d: ", name.c_str(), col);
         va_list va;
         va_start(va, msg);
         vprintf(msg, va);
         va_end(va);
-        printf("\n");
+        item_printf("\n");
         int y= 0;
         for(int i=0;i<(int)segs_to_dump.size(); i++) {
             const auto &ey = segs_to_dump[i].first;
             const auto &ecmds = segs_to_dump[i].second;
             int length = ecmds[1];
-            printf("%d%s ", ey, y == ey ? " ":"*");
+            item_printf("%d%s ", ey, y == ey ? " ":"*");
             if (ecmds[0] & 0x80) {
-                printf("copy %s for %d from %d", ecmds[0]& WHD_COL_SEG_MEMCPY_IS_BACKWARDS ? "backwards" : "forwards", length, ecmds[2]);
+                item_printf("copy %s for %d from %d", ecmds[0]& WHD_COL_SEG_MEMCPY_IS_BACKWARDS ? "backwards" : "forwards", length, ecmds[2]);
             } else {
-                printf("%d for %d +/- %d,%d", ecmds[0]&0xf, length, ecmds[2], ecmds[3]);
+                item_printf("%d for %d +/- %d,%d", ecmds[0]&0xf, length, ecmds[2], ecmds[3]);
             }
-            if (ecmds[0] & WHD_COL_SEG_MEMCPY_SOURCE) printf(" (copyable)");
-            printf("\n");
+            if (ecmds[0] & WHD_COL_SEG_MEMCPY_SOURCE) item_printf(" (copyable)");
+            item_printf("\n");
             y = ey + length;
         }
     };
@@ -3618,101 +3705,105 @@ std::vector<uint8_t> optimize_column(std::string name, int col, std::vector<uint
         dump_segs(original_segs, "original");
     };
 #endif
+    auto original_result = draw_column(original_segs);
     // first try and find patches that have been split by one or more patches in front... these fragments can be drawn
     // as a single run, then the one or more patches drawn over the front. (funnily enough this is how things are
     // specified in the first place!!!)
-    auto segs = original_segs;
-    auto original_result = draw_column(original_segs);
-    for(int candidate=1; candidate < (int)segs.size(); ) {
-        bool candidate_removed = false;
-        for (int match=0; match < candidate && !candidate_removed; match++) {
-            if (segs[candidate].second[0] == segs[match].second[0] &&
-                segs[candidate].second[2] == segs[match].second[2]) {
-                // ^ we are the same column and xoffset
-                if (segs[candidate].second[3] == segs[match].second[3] + segs[candidate].first - segs[match].first) {
-                    // ^ we have what seems like an obscured piece.... can we just draw the top one bigger underneath?
-                    auto new_segs = std::vector<seg>();
-                    new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
-                    new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
-                    new_segs[match].second[1] = segs[candidate].first + segs[candidate].second[1] - segs[match].first;
-                    if (original_result == draw_column(new_segs)) {
-                        segs = new_segs;
+    auto coalesce_obscured = [&](std::vector<seg> &segs) {
+        for(int candidate=1; candidate < (int)segs.size(); ) {
+            bool candidate_removed = false;
+            for (int match=0; match < candidate && !candidate_removed; match++) {
+                if (!(segs[candidate].second[0] & WHD_COL_SEG_MEMCPY) &&
+                    segs[candidate].second[0] == segs[match].second[0] &&
+                    segs[candidate].second[2] == segs[match].second[2]) {
+                    // ^ we are the same column and xoffset
+                    if (segs[candidate].second[3] == segs[match].second[3] + segs[candidate].first - segs[match].first) {
+                        // ^ we have what seems like an obscured piece.... can we just draw the top one bigger underneath?
+                        auto new_segs = std::vector<seg>();
+                        new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
+                        new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
+                        new_segs[match].second[1] = segs[candidate].first + segs[candidate].second[1] - segs[match].first;
+                        if (original_result == draw_column(new_segs, true)) {
+                            segs = new_segs;
 #if DEBUG_TEXTURE_OPTIMIZATION
-                        dump_segs(segs, "coalesce same part of same obscured %d and %d", match, candidate);
+                            dump_segs(segs, "coalesce same part of same obscured %d and %d", match, candidate);
 #endif
-                        candidate_removed = true;
+                            candidate_removed = true;
+                        }
                     }
                 }
             }
+            if (!candidate_removed) candidate++;
         }
-        if (!candidate_removed) candidate++;
-    }
 
+    };
     // we often repeat patches vertically, so look to replace segments with memcpy from another one
-    for(int candidate=1; candidate < (int)segs.size(); candidate++) {
-        for (int match=0; match < candidate; match++) {
-            if (!(segs[candidate].second[0] & 0x80) && !(segs[match].second[0] & 0x80) &&
-                (segs[candidate].second[0] & 0xf) == (segs[match].second[0] & 0xf) &&
-                segs[candidate].second[2] == segs[match].second[2]) {
-                // ^ we are the same column and xoffset and neither is a memcpy
-                int to_data_top = segs[candidate].second[3];
-                int to_data_bottom = to_data_top + segs[candidate].second[1];
-                int from_data_top = segs[match].second[3];
-                int from_data_bottom = from_data_top + segs[match].second[1];
-                if (to_data_top >= from_data_top) {
-                    auto new_segs = std::vector<seg>();
-                    new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
-                    if (to_data_bottom <= from_data_bottom) {
-//                        printf("EASY COPY POSSIBILITY\n");
-                    } else {
-//                        printf("HARD COPY POSSIBILITY\n");
-                        new_segs[match].second[1] = to_data_bottom - from_data_top;
-                    }
-                    new_segs[match].second[0] |= WHD_COL_SEG_MEMCPY_SOURCE;
-                    new_segs.emplace_back(segs[candidate].first, std::vector<uint8_t>{
-                        0x80, segs[candidate].second[1], (uint8_t)(segs[match].first + to_data_top - from_data_top)
-                    });
-                    new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
-                    if (original_result == draw_column(new_segs)) {
-#if DEBUG_TEXTURE_OPTIMIZATION
-                        dump_segs(segs, "memcpy from %d to %d", match, candidate);
-#endif
-                        segs = new_segs;
-                    } else {
-                        new_segs[candidate].second[0] |= WHD_COL_SEG_MEMCPY_IS_BACKWARDS;
-                        if (original_result == draw_column(new_segs)) {
+    auto use_memcpy = [&](std::vector<seg> &segs) {
+        for(int candidate=1; candidate < (int)segs.size(); candidate++) {
+            for (int match=0; match < candidate; match++) {
+                if (!(segs[candidate].second[0] & 0x80) && !(segs[match].second[0] & 0x80) &&
+                    (segs[candidate].second[0] & 0xf) == (segs[match].second[0] & 0xf) &&
+                    segs[candidate].second[2] == segs[match].second[2]) {
+                    // ^ we are the same column and xoffset and neither is a memcpy
+                    int to_data_top = segs[candidate].second[3];
+                    int to_data_bottom = to_data_top + segs[candidate].second[1];
+                    int from_data_top = segs[match].second[3];
+                    int from_data_bottom = from_data_top + segs[match].second[1];
+                    if (to_data_top >= from_data_top) {
+                        auto new_segs = std::vector<seg>();
+                        new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
+                        if (to_data_bottom <= from_data_bottom) {
+    //                        printf("EASY COPY POSSIBILITY\n");
+                        } else {
+    //                        printf("HARD COPY POSSIBILITY\n");
+                            new_segs[match].second[1] = to_data_bottom - from_data_top;
+                        }
+                        new_segs[match].second[0] |= WHD_COL_SEG_MEMCPY_SOURCE;
+                        new_segs.emplace_back(segs[candidate].first, std::vector<uint8_t>{
+                            0x80, segs[candidate].second[1], (uint8_t)(segs[match].first + to_data_top - from_data_top)
+                        });
+                        new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
+                        if (original_result == draw_column(new_segs, true)) {
 #if DEBUG_TEXTURE_OPTIMIZATION
-                            dump_segs(segs, "backwards memcpy from %d to %d", match, candidate);
+                            dump_segs(segs, "memcpy from %d to %d", match, candidate);
 #endif
                             segs = new_segs;
-                        } else if (candidate > match + 1){
-                            // ok lets try doing the copy straight after
-                            new_segs.clear();
-                            new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + match + 1);
-                            if (to_data_bottom <= from_data_bottom) {
-//                                printf("EASY COPY POSSIBILITY\n");
-                            } else {
-//                                printf("HARD COPY POSSIBILITY\n");
-                                new_segs[match].second[1] = segs[candidate].first + segs[candidate].second[1] - segs[match].first;
-                            }
-                            new_segs[match].second[0] |= WHD_COL_SEG_MEMCPY_SOURCE;
-                            new_segs.emplace_back(segs[candidate].first, std::vector<uint8_t>{
-                                    0x80, segs[candidate].second[1], (uint8_t)(segs[match].first + to_data_top - from_data_top)
-                            });
-                            new_segs.insert(new_segs.end(), segs.begin() + match + 1 , segs.begin() + candidate);
-                            new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
-                            if (original_result == draw_column(new_segs)) {
+                        } else {
+                            new_segs[candidate].second[0] |= WHD_COL_SEG_MEMCPY_IS_BACKWARDS;
+                            if (original_result == draw_column(new_segs, true)) {
 #if DEBUG_TEXTURE_OPTIMIZATION
-                                dump_segs(segs, "memcpy from %d to %d but with the latter moved next to the former", match, candidate);
+                                dump_segs(segs, "backwards memcpy from %d to %d", match, candidate);
 #endif
                                 segs = new_segs;
-                            } else {
-                                new_segs[candidate].second[0] |= WHD_COL_SEG_MEMCPY_IS_BACKWARDS;
-                                if (original_result == draw_column(new_segs)) {
+                            } else if (candidate > match + 1){
+                                // ok lets try doing the copy straight after
+                                new_segs.clear();
+                                new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + match + 1);
+                                if (to_data_bottom <= from_data_bottom) {
+    //                                printf("EASY COPY POSSIBILITY\n");
+                                } else {
+    //                                printf("HARD COPY POSSIBILITY\n");
+                                    new_segs[match].second[1] = segs[candidate].first + segs[candidate].second[1] - segs[match].first;
+                                }
+                                new_segs[match].second[0] |= WHD_COL_SEG_MEMCPY_SOURCE;
+                                new_segs.emplace_back(segs[candidate].first, std::vector<uint8_t>{
+                                        0x80, segs[candidate].second[1], (uint8_t)(segs[match].first + to_data_top - from_data_top)
+                                });
+                                new_segs.insert(new_segs.end(), segs.begin() + match + 1 , segs.begin() + candidate);
+                                new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
+                                if (original_result == draw_column(new_segs, true)) {
 #if DEBUG_TEXTURE_OPTIMIZATION
-                                    dump_segs(segs, "memcpy backwards from %d to %d but with the latter moved next to the former", match, candidate);
+                                    dump_segs(segs, "memcpy from %d to %d but with the latter moved next to the former", match, candidate);
 #endif
                                     segs = new_segs;
+                                } else {
+                                    new_segs[candidate].second[0] |= WHD_COL_SEG_MEMCPY_IS_BACKWARDS;
+                                    if (original_result == draw_column(new_segs, true)) {
+#if DEBUG_TEXTURE_OPTIMIZATION
+                                        dump_segs(segs, "memcpy backwards from %d to %d but with the latter moved next to the former", match, candidate);
+#endif
+                                        segs = new_segs;
+                                    }
                                 }
                             }
                         }
@@ -3720,57 +3811,86 @@ std::vector<uint8_t> optimize_column(std::string name, int col, std::vector<uint
                 }
             }
         }
-    }
+    };
     // todo use flags here
     // we often have things like 16 of the same patch tiled vertically. this will now be 1 regular segment and 15 memcpy segments.
     //   we can often do better by collapsing this into fewer memcpys (in this case 1)
-    for(int candidate=2; candidate < (int)segs.size(); ) {
-        bool candidate_removed = false;
-        if (segs[candidate].second[0] & 128) {
-            for(int earlier=1; earlier<candidate; earlier++) {
-                if (segs[earlier].second[0] & 128) {
-                    // note candidates are not necessarily in monotonic y-order due to previous optimizations
-                    if ((segs[candidate].first > segs[earlier].first)) {
-                        // don't think too much just try it
-                        auto new_segs = std::vector<seg>();
-                        new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
-                        new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
-                        new_segs[earlier].second[1] += segs[candidate].second[1];
-                        // call with second arg = true (lenient) as we may produce an invalid memcpy here, but it is hard to check without doing the same work that draw_column does
-                        if (original_result == draw_column(new_segs, true)) {
-                            // hail mary success!
-                            segs = new_segs;
+    auto coalesce_memcpy = [&](std::vector<seg> &segs) {
+        for(int candidate=2; candidate < (int)segs.size(); ) {
+            bool candidate_removed = false;
+            if (segs[candidate].second[0] & 128) {
+                for(int earlier=1; earlier<candidate; earlier++) {
+                    if (segs[earlier].second[0] & 128) {
+                        // note candidates are not necessarily in monotonic y-order due to previous optimizations
+                        if ((segs[candidate].first > segs[earlier].first)) {
+                            // don't think too much just try it
+                            auto new_segs = std::vector<seg>();
+                            new_segs.insert(new_segs.end(), segs.begin(), segs.begin() + candidate);
+                            new_segs.insert(new_segs.end(), segs.begin() + candidate + 1, segs.end());
+                            new_segs[earlier].second[1] += segs[candidate].second[1];
+                            // call with second arg = true (lenient) as we may produce an invalid memcpy here, but it is hard to check without doing the same work that draw_column does
+                            if (original_result == draw_column(new_segs, true)) {
+                                // hail mary success!
+                                segs = new_segs;
 #if DEBUG_TEXTURE_OPTIMIZATION
-                            dump_segs(segs, "memcpy coalesce!");
+                                dump_segs(segs, "memcpy coalesce!");
 #endif
-                            candidate_removed = true;
-                            break;
+                                candidate_removed = true;
+                                break;
+                            }
                         }
                     }
                 }
             }
+            if (!candidate_removed) candidate++;
         }
-        if (!candidate_removed) candidate++;
-    }
-    if (segs != original_segs) {
-#if DEBUG_TEXTURE_OPTIMIZATION
-        dump_segs(segs, "optimized");
-#endif
-        assert(original_result == draw_column(segs));
-        cmds.clear();
-        y = 0;
+    };
+    auto encode = [&](const std::vector<seg> &segs) {
+        std::vector<uint8_t> encoded;
+        int y = 0;
         for(int i=0;i<(int)segs.size();i++) {
             const auto &ey = segs[i].first;
             const auto &ecmds = segs[i].second;
             int length = ecmds[1];
-            cmds.push_back(ecmds[0] | (y != ey ? 0x40 : 0));
-            cmds.push_back((length-1) | (i == (int)segs.size() - 1 ? 0x80 : 0));
+            encoded.push_back(ecmds[0] | (y != ey ? 0x40 : 0));
+            encoded.push_back((length-1) | (i == (int)segs.size() - 1 ? 0x80 : 0));
             if (y != ey) {
-                cmds.push_back(ey);
+                encoded.push_back(ey);
             }
-            cmds.insert(cmds.end(), ecmds.begin() + 2, ecmds.end());
+            encoded.insert(encoded.end(), ecmds.begin() + 2, ecmds.end());
             y = ey + length;
         }
+        return encoded;
+    };
+    const std::function<void(std::vector<seg>&)> passes[] = { coalesce_obscured, use_memcpy, coalesce_memcpy };
+    auto segs = original_segs;
+    for(const auto &pass : passes) pass(segs);
+    if (max_compression) {
+        // each pass is greedy and they interact, so try every pass order (repeating until nothing changes) and keep
+        // whichever gives the smallest column
+        size_t default_size = segs == original_segs ? cmds.size() : encode(segs).size();
+        size_t best_size = default_size;
+        int order[] = { 0, 1, 2 };
+        while (std::next_permutation(order, order + count_of(order))) {
+            auto try_segs = original_segs;
+            for(std::vector<seg> last; last != try_segs; ) {
+                last = try_segs;
+                for(int pass : order) passes[pass](try_segs);
+            }
+            size_t size = encode(try_segs).size();
+            if (size < best_size) {
+                best_size = size;
+                segs = try_segs;
+            }
+        }
+        max_compression_savings.add(0, (int)(default_size - best_size));
+    }
+    if (segs != original_segs) {
+#if DEBUG_TEXTURE_OPTIMIZATION
+        dump_segs(segs, "optimized");
+#endif
+        assert(original_result == draw_column(segs));
+        cmds = encode(segs);
         seg_count = segs.size();
     }
     return cmds;
@@ -3815,6 +3935,49 @@ std::vector<uint8_t> image_to_patch(std::vector<int> image, int w, int h) {
     return patch_data;
 }
 
+struct texture_item {
+    std::string name;
+    int index;
+    const lump *tex_lump;
+    int texture_start; // of the maptexture_t in tex_lump
+    int offset; // of the texture's mappatch_ts in tex_lump
+    maptexture_t mtexture;
+};
+
+struct texture_result {
+    whdtexture_t whd{0};
+    std::vector<uint8_t> metadata;
+    // pixels of an overly complex texture which is instead rendered as a single (new) patch
+    std::vector<int> synthetic_patch;
+};
+
+static std::vector<uint8_t> texture_result_to_cache(const texture_result &result) {
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> whd;
+    append_field(whd, result.whd);
+    lump_cache_append(out, whd);
+    lump_cache_append(out, result.metadata);
+    lump_cache_append(out, (int)result.synthetic_patch.size());
+    for (int p : result.synthetic_patch) {
+        lump_cache_append(out, p);
+    }
+    return out;
+}
+
+static bool texture_result_from_cache(const std::vector<uint8_t> &in, texture_result &result) {
+    size_t pos = 0;
+    std::vector<uint8_t> whd;
+    int count;
+    if (!lump_cache_next(in, pos, whd) || whd.size() != sizeof(whdtexture_t)) return false;
+    result.whd = get_field<whdtexture_t>(whd, 0);
+    if (!lump_cache_next(in, pos, result.metadata) || !lump_cache_next(in, pos, count)) return false;
+    result.synthetic_patch.resize(count);
+    for (auto &p : result.synthetic_patch) {
+        if (!lump_cache_next(in, pos, p)) return false;
+    }
+    return pos == in.size();
+}
+
 texture_index convert_textures(wad &wad) {
     lump pnames;
     std::vector<int> pname_lookup;
@@ -3854,6 +4017,7 @@ texture_index convert_textures(wad &wad) {
     int new_texture_count = special_textures.size();
     std::vector<uint8_t> all_metadata;
     std::map<std::string, int> orig_tex_numbers;
+    std::vector<texture_item> items;
     for (int i = 0; i < numtextures; i++, directory_offset += 4) {
         if (i == numtextures1) {
             tex_lump = &tex2_lump;
@@ -3864,6 +4028,7 @@ texture_index convert_textures(wad &wad) {
         if (offset > (int) tex_lump->data.size())
             fail("bad texture directory");
 
+        int texture_start = offset;
         auto mtexture = get_field_inc<maptexture_t>(tex_lump->data, offset);
         std::string name = to_lower(wad::wad_string(mtexture.name));
         orig_tex_numbers[name] = i;
@@ -3881,8 +4046,40 @@ texture_index convert_textures(wad &wad) {
             index = new_texture_count++;
         }
         tex_index.lookup[name] = index;
-        tex_index.textures.resize(new_texture_count);
-        auto &tex_whd = tex_index.textures[index].whd;
+        items.push_back({name, index, tex_lump, texture_start, offset, mtexture});
+    }
+    tex_index.textures.resize(new_texture_count);
+
+    // the per texture work (reading its patches and building the column metadata) is done in parallel, and the
+    // results applied in texture order afterwards
+    std::vector<texture_result> results(items.size());
+    parallel_for(items.size(), [&](size_t i) {
+        const auto &mtexture = items[i].mtexture;
+        const auto &name = items[i].name;
+        const lump *tex_lump = items[i].tex_lump;
+        int index = items[i].index;
+        int offset = items[i].offset;
+        auto &result = results[i];
+
+        std::vector<uint8_t> key_input(tex_lump->data.begin() + items[i].texture_start,
+                                       tex_lump->data.begin() + offset + mtexture.patchcount * sizeof(mappatch_t));
+        lump_cache_append(key_input, (int)max_compression);
+        for (int j = 0; j < mtexture.patchcount; j++) {
+            auto mpatch = get_field<mappatch_t>(tex_lump->data, offset + j * sizeof(mappatch_t));
+            int num = mpatch.patch < (int)pname_lookup.size() ? pname_lookup[mpatch.patch] : -1;
+            lump l;
+            wad.find_lump(num, l);
+            lump_cache_append(key_input, num);
+            lump_cache_append(key_input, l.data);
+        }
+        uint64_t key = lump_cache_key("texture", TEXTURE_CACHE_VERSION, name, key_input);
+        std::vector<uint8_t> cached;
+        if (lump_cache_get(key, cached) && texture_result_from_cache(cached, result)) {
+            return;
+        }
+        lump_cache_capture capture;
+
+        auto &tex_whd = result.whd;
         tex_whd.width = mtexture.width;
         int pow2 = 1u << (31 - __builtin_clz(tex_whd.width));
         // engine actually rounds down texture sizes to power of 2 (notably all textures are power of 2 except AASTINKY
@@ -3896,7 +4093,7 @@ texture_index convert_textures(wad &wad) {
         tex_whd.height = mtexture.height;
         tex_whd.patch0 = 0;
         tex_whd.patch_count = mtexture.patchcount;
-        printf("Texture %d %s %dx%d, %d patches\n", index, name.c_str(), mtexture.width, mtexture.height, mtexture.patchcount);
+        item_printf("Texture %d %s %dx%d, %d patches\n", index, name.c_str(), mtexture.width, mtexture.height, mtexture.patchcount);
         widths.record(mtexture.width);
         heights.record(mtexture.height);
         lump patch;
@@ -3904,12 +4101,8 @@ texture_index convert_textures(wad &wad) {
         std::vector<mappatch_t> mpatches;
 
 #if TEXTURE_PIXEL_STATS
-        static std::vector<int> pixel_usage;
-        static std::vector<int> column_usage;
-        pixel_usage.clear();
-        column_usage.clear();
-        pixel_usage.resize(tex_whd.width * tex_whd.height);
-        column_usage.resize(tex_whd.width);
+        std::vector<int> pixel_usage(tex_whd.width * tex_whd.height);
+        std::vector<int> column_usage(tex_whd.width);
 #endif
         int solid_patches = 0;
         std::vector<std::vector<int>> column_pixels(mtexture.width);
@@ -3922,7 +4115,7 @@ texture_index convert_textures(wad &wad) {
             if (pname_lookup[mpatch.patch] == -1) {
                 fail("Missing pname mapping for patch %d in texture %d\n", pname_lookup[j], j);
             }
-            if (wad.get_lump(pname_lookup[mpatch.patch], patch)) {
+            if (wad.find_lump(pname_lookup[mpatch.patch], patch)) {
                 patch_for_each_pixel(patch, [&](uint8_t pixel) {
                     colorCounts[pixel]++;
                 });
@@ -3974,7 +4167,7 @@ texture_index convert_textures(wad &wad) {
                 }
                 if (patch_solid) solid_patches++;
 #endif
-                printf("  Patch %d (%d): %d at %d,%d %dx%d solid = %d\n", j, pname_lookup[mpatch.patch], mpatch.patch,
+                item_printf("  Patch %d (%d): %d at %d,%d %dx%d solid = %d\n", j, pname_lookup[mpatch.patch], mpatch.patch,
                        mpatch.originx, mpatch.originy, ph->width, ph->height, patch_solid);
             } else {
                 // seems unlike!y!
@@ -4008,13 +4201,13 @@ texture_index convert_textures(wad &wad) {
             } else {
                 texture_single_patch00.record(0);
                 if (had_transparent) {
-                    printf("WARNING: Found a transparent not at offset 0,0 %s\n", name.c_str());
+                    item_printf("WARNING: Found a transparent not at offset 0,0 %s\n", name.c_str());
                 }
             }
         } else {
             texture_single_patch.record(0);
             if (had_transparent) {
-                printf("Found a transparent with > 1 patch\n");
+                item_printf("Found a transparent with > 1 patch\n");
             }
         }
         //tex_whd.approx_color = std::max_element(colorCounts.begin(), colorCounts.end()) - colorCounts.begin();
@@ -4029,7 +4222,7 @@ texture_index convert_textures(wad &wad) {
                 std::set<int> unique_col_patches;
                 int last = -1;
                 int run = 0;
-                int localp;
+                int localp = 0xff; // columns may start transparent
                 bool had_col_transparent = false;
                 for (int y = 0; y < tex_whd.height; y++) {
                     int p = pixel_patch[y * tex_whd.width + x];
@@ -4078,7 +4271,7 @@ texture_index convert_textures(wad &wad) {
                 }
                 if (had_col_transparent) {
                     if (col_patch_runs.size() != 4 && !col_patch_runs.empty()) {
-                        printf("WARNING: Can't mix transparency with anything but single patch column, will be undefined. tex=%s col %d\n", name.c_str(), x);
+                        item_printf("WARNING: Can't mix transparency with anything but single patch column, will be undefined. tex=%s col %d\n", name.c_str(), x);
                     }
                 }
                 if (col_patch_runs.size() == 4) {
@@ -4096,13 +4289,13 @@ texture_index convert_textures(wad &wad) {
                 max_unique_col_patches = std::max(max_unique_col_patches, (int)unique_col_patches.size());
             }
             assert(local_patches.size() && local_patches.size() <= tex_whd.patch_count);
-            printf("   local patch size %d\n", (int)local_patches.size());
+            item_printf("   local patch size %d\n", (int)local_patches.size());
             tex_whd.patch_count = local_patches.size();
             if (local_patches.size() > 16) {
                 fail("too many local patches %d\n", (int) local_patches.size());
             }
             for(int n=0;n<tex_whd.patch_count;n++) {
-                printf("      %d: %d\n", n, local_patches[n]);
+                item_printf("      %d: %d\n", n, local_patches[n]);
                 metadata.push_back(local_patches[n]&0xff);
                 metadata.push_back(local_patches[n]>>8);
             }
@@ -4187,34 +4380,44 @@ texture_index convert_textures(wad &wad) {
                 x = x2;
             }
         }
-        printf("  Solids %d/%d max segs %d max unique col patches %d\n", solid_patches, mtexture.patchcount, max_seg_count, max_unique_col_patches);
+        item_printf("  Solids %d/%d max segs %d max unique col patches %d\n", solid_patches, mtexture.patchcount, max_seg_count, max_unique_col_patches);
         if (tex_whd.patch_count && solid_patches != mtexture.patchcount) {
-            printf("warning: multi patch transparent texture tex=%s\n", name.c_str()); // todo is this actually allowed on a per column basis (i.e. mix compostie cols with transparent non composite cols?)
+            item_printf("warning: multi patch transparent texture tex=%s\n", name.c_str()); // todo is this actually allowed on a per column basis (i.e. mix compostie cols with transparent non composite cols?)
         }
         if (max_seg_count > WHD_MAX_COL_SEGS || max_unique_col_patches > WHD_MAX_COL_UNIQUE_PATCHES) {
+            // rendered as a new patch, which is allocated when the results are applied
+            result.synthetic_patch.resize(tex_whd.width * tex_whd.height);
+            for(uint x=0;x<tex_whd.width;x++) {
+                for (uint y = 0; y < tex_whd.height; y++) {
+                    result.synthetic_patch[x+y*tex_whd.width] = column_pixels[x][y];
+                }
+            }
+        } else {
+            result.metadata = std::move(metadata);
+        }
+        lump_cache_put(key, texture_result_to_cache(result), capture);
+    });
+    for (size_t i = 0; i < items.size(); i++) {
+        auto &result = results[i];
+        auto &tex_whd = tex_index.textures[items[i].index].whd;
+        tex_whd = result.whd;
+        if (!result.synthetic_patch.empty()) {
             auto new_patch = get_free_lump(wad);
             char lname[32];
             sprintf(lname, "_SYN%d", new_patch.num);
             new_patch.name = lname;
-            printf("warning: overly complex texture %s rendering as new patch %d\n", name.c_str(), new_patch.num);
+            printf("warning: overly complex texture %s rendering as new patch %d\n", items[i].name.c_str(), new_patch.num);
             tex_whd.patch_count = 0;
             tex_whd.patch0 = new_patch.num;
-            metadata.clear();
-            std::vector<int> pixels(tex_whd.width * tex_whd.height);
-            for(uint x=0;x<tex_whd.width;x++) {
-                for (uint y = 0; y < tex_whd.height; y++) {
-                    pixels[x+y*tex_whd.width] = column_pixels[x][y];
-                }
-            }
-            new_patch.data = image_to_patch(pixels, tex_whd.width, tex_whd.height);
+            new_patch.data = image_to_patch(result.synthetic_patch, tex_whd.width, tex_whd.height);
             convert_patch(wad, new_patch.num, new_patch);
         } else {
-            texture_col_metadata.record((int) metadata.size());
+            texture_col_metadata.record((int) result.metadata.size());
         }
         if (tex_whd.patch_count) {
-            assert(metadata.size());
+            assert(result.metadata.size());
             tex_whd.metdata_offset = all_metadata.size();
-            all_metadata.insert(all_metadata.end(), metadata.begin(), metadata.end());
+            all_metadata.insert(all_metadata.end(), result.metadata.begin(), result.metadata.end());
         }
     }
     static_assert(sizeof(whdtexture_t) == 6, ""); // want to check it is naturally aligned
@@ -4273,6 +4476,83 @@ statsomizer flat_under_colors[] = {
         statsomizer("256 color flat"),
         };
 
+// encodes a flat, returning the new lump data. this only reads the lump (and records stats) so may be called from
+// parallel_for workers
+static std::vector<uint8_t> encode_flat(lump &lump) {
+    assert(lump.data.size() == 64 * 64);
+    std::vector<int16_t> pix;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            pix.push_back(lump.data[y * 64 + x]);
+        }
+    }
+    uint best = std::numeric_limits<uint>::max();
+    std::vector<std::shared_ptr<byte_vector_bit_output>> zposts;
+    std::vector<std::shared_ptr<byte_vector_bit_output>> best_zposts;
+    std::shared_ptr<byte_vector_bit_output> decoder_output;
+    std::shared_ptr<byte_vector_bit_output> best_decoder_output;
+    uint decoder_size;
+    uint best_decoder_size;
+    int choice = 0;
+    auto choose = [&](int c, uint size) {
+        if (size < best) {
+            choice = c;
+            best = size;
+            best_zposts = zposts;
+            best_decoder_output = std::make_shared<byte_vector_bit_output>(*decoder_output);
+            best_decoder_size = decoder_size;
+        }
+        return size;
+    };
+    std::vector<int> same;
+    bool have_same;
+    auto posts = to_merged_posts(pix, 64, 64, same, have_same);
+    uint s1 = choose(0, consider_compress_pixels_only(lump.name, posts, decoder_output, zposts, 64, 64, decoder_size, "flat")); ((void)s1);
+#if !USE_PIXELS_ONLY_FLAT
+    uint s2 = choose(1, consider_compress3(lump.name, posts, decoder_output, zposts, 64, 64));
+#endif
+    if (best_decoder_size > WHD_FLAT_DECODER_MAX_SIZE) {
+        fail("flat decoder is too big %s %d", lump.name.c_str(), best_decoder_size);
+    }
+    fwinners.add(choice);
+    flat_rawsize.record(4096);
+    if (have_same) {
+        int savings = 0;
+        for (int i = 0; i < 64; i++) {
+            if (same[i]) {
+                savings += zposts[same[i] - 1]->bit_size();
+                savings -= 1 + bitcount8_table[i];
+            }
+        }
+        if (savings < 0) have_same = false;
+        flat_have_same_savings.record(have_same);
+    }
+    byte_vector_bit_output final_bo;
+#if !USE_PIXELS_ONLY_FLAT
+    assert(choice < 2);
+    final_bo.write(bit_sequence(choice, 1));
+#endif
+    decoder_output->write_to(final_bo);
+    final_bo.write(bit_sequence(have_same, 1));
+    for (int x = 0; x < 64; x++) {
+        if (have_same) {
+            final_bo.write(bit_sequence(same[x] != 0, 1));
+            if (same[x]) {
+                assert(!zposts[x]->bit_size());
+                assert(same[x] - 1 < x);
+                assert(!same[same[x] - 1]);
+                // todo down one
+                final_bo.write(bit_sequence(same[x] - 1, bitcount8_table[x]));
+            } else {
+                zposts[x]->write_to(final_bo);
+            }
+        } else {
+            zposts[x]->write_to(final_bo);
+        }
+    }
+    return final_bo.get_output();
+}
+
 void convert_flats(wad &wad) {
     int fstart = wad.get_lump_index("f_start");
     int fend = wad.get_lump_index("f_end");
@@ -4283,6 +4563,7 @@ void convert_flats(wad &wad) {
     std::vector<uint8_t> special_to_flat(special_flats.size());
     std::fill(special_to_flat.begin(), special_to_flat.end(), 0xff);
     std::vector<uint8_t> flat_to_special;
+    std::vector<lump> flats;
     for (int f = fstart+1; f < fend; f++) {
         // todo we only need flats mentioned in sectors (or well known)
         lump lump;
@@ -4295,94 +4576,37 @@ void convert_flats(wad &wad) {
             } else {
                 flat_to_special.push_back(0xff);
             }
-            std::set<uint8_t> colors;
-            for (const auto &p: lump.data) colors.insert(p);
-            assert(lump.data.size() == 64 * 64);
-            std::vector<int16_t> pix;
-            for (int y = 0; y < 64; y++) {
-                for (int x = 0; x < 64; x++) {
-                    pix.push_back(lump.data[y * 64 + x]);
-                }
-            }
-            uint best = std::numeric_limits<uint>::max();
-            std::vector<std::shared_ptr<byte_vector_bit_output>> zposts;
-            std::vector<std::shared_ptr<byte_vector_bit_output>> best_zposts;
-            std::shared_ptr<byte_vector_bit_output> decoder_output;
-            std::shared_ptr<byte_vector_bit_output> best_decoder_output;
-            uint decoder_size;
-            uint best_decoder_size;
-            int choice = 0;
-            auto choose = [&](int c, uint size) {
-                if (size < best) {
-                    choice = c;
-                    best = size;
-                    best_zposts = zposts;
-                    best_decoder_output = std::make_shared<byte_vector_bit_output>(*decoder_output);
-                    best_decoder_size = decoder_size;
-                }
-                return size;
-            };
-            std::vector<int> same;
-            bool have_same;
-            auto posts = to_merged_posts(pix, 64, 64, same, have_same);
-            uint s1 = choose(0, consider_compress_pixels_only(lump.name, posts, decoder_output, zposts, 64, 64, decoder_size)); ((void)s1);
-#if !USE_PIXELS_ONLY_FLAT
-            uint s2 = choose(1, consider_compress3(lump.name, posts, decoder_output, zposts, 64, 64));
-#endif
-            if (best_decoder_size > WHD_FLAT_DECODER_MAX_SIZE) {
-                fail("flat decoder is too big %s %d", lump.name.c_str(), best_decoder_size);
-            }
-            fwinners[choice]++;
-            flat_rawsize.record(4096);
-            if (have_same) {
-                int savings = 0;
-                for (int i = 0; i < 64; i++) {
-                    if (same[i]) {
-                        savings += zposts[same[i] - 1]->bit_size();
-                        savings -= 1 + bitcount8_table[i];
-                    }
-                }
-                if (savings < 0) have_same = false;
-                flat_have_same_savings.record(have_same);
-            }
-            byte_vector_bit_output final_bo;
-#if !USE_PIXELS_ONLY_FLAT
-            assert(choice < 2);
-            final_bo.write(bit_sequence(choice, 1));
-#endif
-            decoder_output->write_to(final_bo);
-            final_bo.write(bit_sequence(have_same, 1));
-            for (int x = 0; x < 64; x++) {
-                if (have_same) {
-                    final_bo.write(bit_sequence(same[x] != 0, 1));
-                    if (same[x]) {
-                        assert(!zposts[x]->bit_size());
-                        assert(same[x] - 1 < x);
-                        assert(!same[same[x] - 1]);
-                        // todo down one
-                        final_bo.write(bit_sequence(same[x] - 1, bitcount8_table[x]));
-                    } else {
-                        zposts[x]->write_to(final_bo);
-                    }
-                } else {
-                    zposts[x]->write_to(final_bo);
-                }
-            }
-            compressed.insert(f);
-            touched[f] = TOUCHED_FLAT;
-            lump.data = final_bo.get_output();
-            flat_c2size.record(lump.data.size());
-            wad.update_lump(lump);
-            flat_colors.record(colors.size());
-            uint x = colors.size();
-            if (x) x--;
-            x = 31 - __builtin_clz(x);
-            assert(x < 8);
-            flat_under_colors[x].record(colors.size());
+            flats.push_back(lump);
         } else {
             flat_to_special.push_back(0xff);
         }
     }
+    // encode in parallel, then apply the results in lump order
+    std::vector<std::vector<uint8_t>> encoded(flats.size());
+    parallel_for(flats.size(), [&](size_t i) {
+        uint64_t key = lump_cache_key("flat", FLAT_CACHE_VERSION, flats[i].name, flats[i].data);
+        if (!lump_cache_get(key, encoded[i])) {
+            lump_cache_capture capture;
+            encoded[i] = encode_flat(flats[i]);
+            lump_cache_put(key, encoded[i], capture);
+        }
+    });
+    for (size_t i = 0; i < flats.size(); i++) {
+        auto &lump = flats[i];
+        std::set<uint8_t> colors;
+        for (const auto &p: lump.data) colors.insert(p);
+        compressed.insert(lump.num);
+        touched[lump.num] = TOUCHED_FLAT;
+        lump.data = std::move(encoded[i]);
+        flat_c2size.record(lump.data.size());
+        wad.update_lump(lump);
+        flat_colors.record(colors.size());
+        uint x = colors.size();
+        if (x) x--;
+        x = 31 - __builtin_clz(x);
+        assert(x < 8);
+        flat_under_colors[x].record(colors.size());
+    }
     lump fstart_lump;
     wad.get_lump("f_start", fstart_lump);
     fstart_lump.data = special_to_flat;
@@ -4473,32 +4697,59 @@ typedef struct {
     unsigned short scorestart;
 } mus_header;
 
-void convert_music(std::pair<const int, lump> &e) {
-    touched[e.first] = TOUCHED_MUSIC;
-    name_required.insert(e.second.name);
 #if USE_MUSX
+// compresses a MUS track (thread safe, so may be called from parallel_for)
+static std::vector<uint8_t> encode_music(std::pair<const int, lump> &e) {
     auto &h = e.second.data;
-    if (h[0] == 'M' && h[1] == 'U' && h[2] == 'S' && h[3] == 26) {
-        auto new_mus = compress_mus(e);
-        int original_size = e.second.data.size();
-        h.clear();
-        h.push_back('M');
-        h.push_back('U');
-        h.push_back('S');
-        h.push_back('X');
-        printf("Compress %s MUS %d -> %d\n", e.second.name.c_str(), original_size, (int) new_mus.size());
-        mus_total1 += original_size;
-        mus_total2 += new_mus.size();
-        write_word(h, 4, new_mus.size());
-        h.insert(h.end(), new_mus.begin(), new_mus.end());
-        compressed.insert(e.first);
-    } else {
+    if (!(h.size() >= 4 && h[0] == 'M' && h[1] == 'U' && h[2] == 'S' && h[3] == 26)) {
         fail("Expected MUS track %s\n", e.second.name.c_str());
     }
+    std::vector<uint8_t> new_mus;
+    uint64_t key = lump_cache_key("musx", MUSX_CACHE_VERSION, e.second.name, h);
+    if (!lump_cache_get(key, new_mus)) {
+        lump_cache_capture capture;
+        new_mus = compress_mus(e);
+        lump_cache_put(key, new_mus, capture);
+    }
+    return new_mus;
+}
+
+static void apply_music(std::pair<const int, lump> &e, const std::vector<uint8_t> &new_mus) {
+    touched[e.first] = TOUCHED_MUSIC;
+    name_required.insert(e.second.name);
+    auto &h = e.second.data;
+    int original_size = e.second.data.size();
+    h.clear();
+    h.push_back('M');
+    h.push_back('U');
+    h.push_back('S');
+    h.push_back('X');
+    printf("Compress %s MUS %d -> %d\n", e.second.name.c_str(), original_size, (int) new_mus.size());
+    mus_total1 += original_size;
+    mus_total2 += new_mus.size();
+    write_word(h, 4, new_mus.size());
+    h.insert(h.end(), new_mus.begin(), new_mus.end());
+    compressed.insert(e.first);
+}
+
+void convert_music(wad &wad) {
+    std::vector<std::pair<const int, lump> *> tracks;
+    for (auto &e : wad.get_lumps()) {
+        if (music_lumpnames.find(to_lower(e.second.name)) != music_lumpnames.end()) {
+            tracks.push_back(&e);
+        }
+    }
+    std::vector<std::vector<uint8_t>> results(tracks.size());
+    parallel_for(tracks.size(), [&](size_t i) {
+        results[i] = encode_music(*tracks[i]);
+    });
+    for (size_t i = 0; i < tracks.size(); i++) {
+        apply_music(*tracks[i], results[i]);
+    }
+}
 #else
 #error no longer supported
 #endif
-}
 
 
 static int
@@ -4583,24 +4834,20 @@ adpcm_encode_data(const std::vector<int16_t> &in, std::vector<uint8_t> &out, int
     return 0;
 }
 
-bool convert_sound(std::pair<const int, lump> &e) {
-    auto &lump = e.second;
-    const int lumplen = lump.data.size();
-    const uint8_t *data = lump.data.data();
+static bool is_sound_lump(const lump &lump) {
     // Check the header, and ensure this is a valid sound
+    return lump.data.size() >= 8 && lump.data[0] == 0x03 && lump.data[1] == 0x00;
+}
 
-    if (lumplen < 8
-        || data[0] != 0x03 || data[1] != 0x00) {
-        // Invalid sound
-        return false;
-    }
-
-    name_required.insert(lump.name);
+// encode the sound into out; this only reads the lump so may be called from multiple threads
+static bool encode_sound(const lump &lump, std::vector<uint8_t> &out) {
+    const int lumplen = lump.data.size();
+    const uint8_t *data = lump.data.data();
     // 16 bit sample rate field, 32 bit length field
 
     int samplerate = (data[3] << 8) | data[2];
     if (samplerate != 11025) {
-        printf("oou %s %d\n", lump.name.c_str(), samplerate);
+        item_printf("oou %s %d\n", lump.name.c_str(), samplerate);
     }
     int length = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
@@ -4620,7 +4867,6 @@ bool convert_sound(std::pair<const int, lump> &e) {
     // The DMX sound library seems to skip the first 16 and last 16
     // bytes of the lump - reason unknown.
 
-    std::vector<uint8_t> out;
     out.insert(out.end(), data, data + 8); // copy the original header
     out[1] = 0x80; // something difference
 
@@ -4635,18 +4881,228 @@ bool convert_sound(std::pair<const int, lump> &e) {
     int num_channels = 1;
     int lookahead = LOOKAHEAD;
     int samples_per_block = (block_size - num_channels * 4) * (num_channels ^ 3) + 1;
-    if (adpcm_encode_data(in, out, num_channels, samples_per_block, lookahead,
+    return adpcm_encode_data(in, out, num_channels, samples_per_block, lookahead,
             //NOISE_SHAPING_DYNAMIC
                           NOISE_SHAPING_OFF // noise shaping sounds worse at this low frequency (and we low pass
             // after upscalinga at runtime later anyway)
-    ) < 0) {
-        return false;
+    ) >= 0;
+}
+
+void convert_sounds(wad &wad) {
+    std::vector<std::pair<const int, lump> *> sounds;
+    for (auto &e : wad.get_lumps()) {
+        if (sfx_lumpnames.find(to_lower(e.second.name)) != sfx_lumpnames.end()) {
+            sounds.push_back(&e);
+        }
+    }
+    // the ADPCM encode (with lookahead) dominates, so do that in parallel, then apply the results in lump order
+    std::vector<std::vector<uint8_t>> encoded(sounds.size());
+    std::vector<bool> ok(sounds.size());
+    parallel_for(sounds.size(), [&](size_t i) {
+        const auto &lump = sounds[i]->second;
+        if (!is_sound_lump(lump)) return;
+        uint64_t key = lump_cache_key("sfx", SFX_CACHE_VERSION * 256 + LOOKAHEAD, lump.name, lump.data);
+        if (lump_cache_get(key, encoded[i])) {
+            ok[i] = true;
+            return;
+        }
+        lump_cache_capture capture;
+        if (encode_sound(lump, encoded[i])) {
+            lump_cache_put(key, encoded[i], capture);
+            ok[i] = true;
+        }
+    });
+    for (size_t i = 0; i < sounds.size(); i++) {
+        auto &e = *sounds[i];
+        if (is_sound_lump(e.second)) {
+            name_required.insert(e.second.name);
+        }
+        if (ok[i]) {
+            compressed.insert(e.first);
+            sfx_orig_size.record(e.second.data.size());
+            e.second.data = std::move(encoded[i]);
+            sfx_new_size.record(e.second.data.size());
+        } else {
+            printf("Failed to convert sound %s\n", e.second.name.c_str());
+            // todo remove?
+        }
+        touched[e.first] = TOUCHED_SFX;
+    }
+}
+
+// converts the lumps of the level whose marker is at index; this only reads the wad so may be called from
+// parallel_for workers
+static void convert_level(wad &wad, const texture_index &tex_index, const std::string &name, int index, level_result &level) {
+    item_printf("Converting level %s\n", name.c_str());
+    lump l;
+    if (!wad.find_lump(index+ML_THINGS, l) || l.name != "THINGS") {
+        fail("missing THINGS for %s", name.c_str());
+    }
+    item_printf("Convert THINGS in lump %d\n", index+ML_THINGS);
+    // todo
+
+    if (!wad.find_lump(index+ML_SIDEDEFS, l) || l.name != "SIDEDEFS") {
+        fail("missing SIDEDEFS for %s", name.c_str());
+    }
+    item_printf("Convert SIDEDEF in lump %d\n", index+ML_SIDEDEFS);
+    auto sidedef_mapping = convert_sidedefs(level, tex_index, l);
+
+    if (!wad.find_lump(index+ML_VERTEXES, l) || l.name != "VERTEXES") {
+        fail("missing VERTEXES for %s", name.c_str());
+    }
+    item_printf("Convert VERTEXES in lump %d\n", index+ML_VERTEXES);
+    auto vertexes = convert_vertexes(level, l);
+
+    if (!wad.find_lump(index+ML_LINEDEFS, l) || l.name != "LINEDEFS") {
+        fail("missing LINEDEFS for %s", name.c_str());
+    }
+    item_printf("Convert LINEDEFS in lump %d\n", index+ML_LINEDEFS);
+    auto linedef_mapping = convert_linedefs(level, l, sidedef_mapping, vertexes);
+
+    if (!wad.find_lump(index+ML_SEGS, l) || l.name != "SEGS") {
+        fail("missing SEGS for %s", name.c_str());
+    }
+    item_printf("Convert SEGS in lump %d\n", index+ML_SEGS);
+    auto seg_mapping = convert_segs(level, l, linedef_mapping);
+
+    if (!wad.find_lump(index+ML_SSECTORS, l) || l.name != "SSECTORS") {
+        fail("missing SSECTORS for %s", name.c_str());
+    }
+    item_printf("Convert SSECTORS in lump %d\n", index+ML_SSECTORS);
+    convert_subsectors(level, l, seg_mapping);
+
+    if (!wad.find_lump(index+ML_NODES, l) || l.name != "NODES") {
+        fail("missing NODES for %s", name.c_str());
+    }
+    item_printf("Convert NODES in lump %d\n", index+ML_NODES);
+    convert_nodes(level, l);
+
+    if (!wad.find_lump(index+ML_SECTORS, l) || l.name != "SECTORS") {
+        fail("missing SECTORS for %s", name.c_str());
+    }
+    item_printf("Convert SECTORS in lump %d\n", index+ML_SECTORS);
+    convert_sectors(wad, level, l);
+
+    if (!wad.find_lump(index+ML_REJECT, l) || l.name != "REJECT") {
+        fail("missing REJECT for %s", name.c_str());
+    }
+    item_printf("Convert REJECT in lump %d\n", index+ML_REJECT);
+    // todo convert_reject(wad, l);
+
+    if (!wad.find_lump(index+ML_BLOCKMAP, l) || l.name != "BLOCKMAP") {
+        fail("missing BLOCKMAP for %s", name.c_str());
+    }
+    item_printf("Convert BLOCKMAP in lump %d\n", index+ML_BLOCKMAP);
+    convert_blockmap(level, l, linedef_mapping);
+}
+
+// cache entries store lump numbers relative to the level marker, so they stay valid if the level moves in the wad
+static std::vector<uint8_t> level_result_to_cache(const level_result &level, int index) {
+    std::vector<uint8_t> out;
+    lump_cache_append(out, (int)level.lumps.size());
+    for (const auto &l : level.lumps) {
+        lump_cache_append(out, l.num - index);
+        lump_cache_append(out, l.name);
+        lump_cache_append(out, l.data);
+    }
+    lump_cache_append(out, (int)level.hash_counts.size());
+    for (auto count : level.hash_counts) {
+        lump_cache_append(out, (int)count);
+    }
+    return out;
+}
+
+static bool level_result_from_cache(const std::vector<uint8_t> &in, int index, level_result &level) {
+    size_t pos = 0;
+    int count;
+    if (!lump_cache_next(in, pos, count)) return false;
+    level.lumps.resize(count);
+    for (auto &l : level.lumps) {
+        if (!lump_cache_next(in, pos, l.num) || !lump_cache_next(in, pos, l.name) || !lump_cache_next(in, pos, l.data)) return false;
+        l.num += index;
+    }
+    if (!lump_cache_next(in, pos, count)) return false;
+    level.hash_counts.resize(count);
+    for (auto &h : level.hash_counts) {
+        int v;
+        if (!lump_cache_next(in, pos, v)) return false;
+        h = v;
+    }
+    return pos == in.size();
+}
+
+void convert_levels(wad &wad, const texture_index &tex_index) {
+    std::vector<std::pair<std::string, int>> levels;
+    auto add_level = [&](const std::string &name) {
+        int index = wad.get_lump_index(name);
+        if (index >= 0) levels.emplace_back(name, index);
+    };
+    for(int e=1; e<=4; e++) {
+        for(int m=1; m<=9; m++) {
+            add_level("E"+std::to_string(e)+"M"+std::to_string(m));
+        }
+    }
+    for(int m=1; m<=32; m++) {
+        char name[10];
+        sprintf(name, "MAP%02d", m);
+        add_level(name);
+    }
+    // besides the level's own lumps, the conversion depends on the texture numbering, the lump numbering (for flats)
+    // and the output format
+    std::vector<uint8_t> shared_key;
+    lump_cache_append(shared_key, (int)super_tiny);
+    for (const auto &e : tex_index.lookup) {
+        lump_cache_append(shared_key, e.first);
+        lump_cache_append(shared_key, e.second);
+    }
+    for (const auto &e : wad.get_lumps()) {
+        lump_cache_append(shared_key, e.first);
+        lump_cache_append(shared_key, to_lower(e.second.name));
+    }
+    std::vector<level_result> results(levels.size());
+    parallel_for(levels.size(), [&](size_t i) {
+        int index = levels[i].second;
+        std::vector<uint8_t> key_input = shared_key;
+        for (int ml = ML_THINGS; ml <= ML_BLOCKMAP; ml++) {
+            lump l;
+            wad.find_lump(index + ml, l);
+            lump_cache_append(key_input, l.name);
+            lump_cache_append(key_input, l.data);
+        }
+        uint64_t key = lump_cache_key("level", LEVEL_CACHE_VERSION, levels[i].first, key_input);
+        std::vector<uint8_t> cached;
+        if (!lump_cache_get(key, cached) || !level_result_from_cache(cached, index, results[i])) {
+            lump_cache_capture capture;
+            results[i] = level_result();
+            convert_level(wad, tex_index, levels[i].first, index, results[i]);
+            lump_cache_put(key, level_result_to_cache(results[i], index), capture);
+        }
+    });
+    for (size_t i = 0; i < levels.size(); i++) {
+        int index = levels[i].second;
+        name_required.insert(levels[i].first);
+        touched[index] = TOUCHED_LEVEL;
+        touched[index+ML_THINGS] = TOUCHED_LEVEL_THINGS;
+        touched[index+ML_SIDEDEFS] = TOUCHED_LEVEL_SIDEDEFS;
+        touched[index+ML_VERTEXES] = TOUCHED_LEVEL_VERTEXES;
+        touched[index+ML_LINEDEFS] = TOUCHED_LEVEL_LINEDEFS;
+        touched[index+ML_SEGS] = TOUCHED_LEVEL_SEGS;
+        touched[index+ML_SSECTORS] = TOUCHED_LEVEL_SSECTORS;
+        touched[index+ML_NODES] = TOUCHED_LEVEL_NODES;
+        touched[index+ML_SECTORS] = TOUCHED_LEVEL_SECTORS;
+        touched[index+ML_REJECT] = TOUCHED_LEVEL_REJECT;
+        touched[index+ML_BLOCKMAP] = TOUCHED_LEVEL_BLOCKMAP;
+        compressed.insert(index+ML_SIDEDEFS);
+        compressed.insert(index+ML_NODES);
+        compressed.insert(index+ML_BLOCKMAP);
+        for (const auto &l : results[i].lumps) {
+            wad.update_lump(l);
+        }
+        // the hash is order dependent, so is accumulated here in level order
+        for (auto count : results[i].hash_counts) {
+            hash = hash * 31 + count;
+        }
     }
-    compressed.insert(e.first);
-    sfx_orig_size.record(e.second.data.size());
-    e.second.data = out;
-    sfx_new_size.record(e.second.data.size());
-    return true;
 }
 
 void ColorShiftPalette (byte *inpal, byte *outpal
@@ -4727,6 +5183,12 @@ int main(int argc, const char **argv) {
         if (!strcmp(argv[argn], "-no-super-tiny")) {
             super_tiny = false;
         }
+        if (!strcmp(argv[argn], "-huff-bench")) {
+            huff_bench = true;
+        }
+        if (!strcmp(argv[argn], "-max-compression")) {
+            max_compression = true;
+        }
         return argv[argn++];
     };
     try {
@@ -4738,7 +5200,17 @@ int main(int argc, const char **argv) {
         }
         printf("LUMPS ORIG SIZE %d\n", size);
         auto output_filename = next_arg();
-        next_arg(false); // check for more options
+        while (const char *opt = next_arg(false)) { // check for more options
+            if (!strcmp(opt, "-j")) {
+                whd_gen_threads = atoi(next_arg());
+            } else if (!strcmp(opt, "-cache")) {
+                lump_cache_dir = next_arg();
+            }
+        }
+        if (huff_bench) {
+            whd_gen_threads = 1; // keep timings free of contention
+            lump_cache_dir.clear(); // the timings are of the encoded lumps, so can't come from the cache
+        }
         const char *pos = std::max(strrchr(wad_name, '\\'), strrchr(wad_name, '/'));
         if (pos) pos++;
         else pos = wad_name;
@@ -4956,15 +5428,7 @@ int main(int argc, const char **argv) {
 
         convert_flats(wad);
         // filter again
-        for (auto &e : wad.get_lumps()) {
-            if (sfx_lumpnames.find(to_lower(e.second.name)) != sfx_lumpnames.end()) {
-                if (!convert_sound(e)) {
-                    printf("Failed to convert sound %s\n", e.second.name.c_str());
-                    // todo remove?
-                }
-                touched[e.first] = TOUCHED_SFX;
-            }
-        }
+        convert_sounds(wad);
         for (auto &e : wad.get_lumps()) {
             if (e.second.name.substr(0, 5) == "WIMAP") {
                 //dump_patch(e.second.name.c_str(), e.first, e.second);
@@ -5013,100 +5477,7 @@ int main(int argc, const char **argv) {
             }
         }
 
-        auto convert_level = [&](::wad& wad, std::string name) {
-            int index = wad.get_lump_index(name);
-            if (index >= 0) {
-                printf("Converting level %s\n", name.c_str());
-            } else {
-                return;
-            }
-            name_required.insert(name);
-            touched[index] = TOUCHED_LEVEL;
-
-            lump l;
-            if (!wad.get_lump(index+ML_THINGS, l) || l.name != "THINGS") {
-                fail("missing THINGS for %s", name.c_str());
-            }
-            printf("Convert THINGS in lump %d\n", index+ML_THINGS);
-            touched[index+ML_THINGS] = TOUCHED_LEVEL_THINGS;
-            // todo
-
-            if (!wad.get_lump(index+ML_SIDEDEFS, l) || l.name != "SIDEDEFS") {
-                fail("missing SIDEDEFS for %s", name.c_str());
-            }
-            printf("Convert SIDEDEF in lump %d\n", index+ML_SIDEDEFS);
-            compressed.insert(index+ML_SIDEDEFS);
-            touched[index+ML_SIDEDEFS] = TOUCHED_LEVEL_SIDEDEFS;
-            auto sidedef_mapping = convert_sidedefs(wad, tex_index, l);
-
-            if (!wad.get_lump(index+ML_VERTEXES, l) || l.name != "VERTEXES") {
-                fail("missing VERTEXES for %s", name.c_str());
-            }
-            printf("Convert VERTEXES in lump %d\n", index+ML_VERTEXES);
-            touched[index+ML_VERTEXES] = TOUCHED_LEVEL_VERTEXES;
-            auto vertexes = convert_vertexes(wad, l);
-
-            if (!wad.get_lump(index+ML_LINEDEFS, l) || l.name != "LINEDEFS") {
-                fail("missing LINEDEFS for %s", name.c_str());
-            }
-            printf("Convert LINEDEFS in lump %d\n", index+ML_LINEDEFS);
-            touched[index+ML_LINEDEFS] = TOUCHED_LEVEL_LINEDEFS;
-            auto linedef_mapping = convert_linedefs(wad, l, sidedef_mapping, vertexes);
-
-            if (!wad.get_lump(index+ML_SEGS, l) || l.name != "SEGS") {
-                fail("missing SEGS for %s", name.c_str());
-            }
-            printf("Convert SEGS in lump %d\n", index+ML_SEGS);
-            touched[index+ML_SEGS] = TOUCHED_LEVEL_SEGS;
-            auto seg_mapping = convert_segs(wad, l, linedef_mapping);
-
-            if (!wad.get_lump(index+ML_SSECTORS, l) || l.name != "SSECTORS") {
-                fail("missing SSECTORS for %s", name.c_str());
-            }
-            printf("Convert SSECTORS in lump %d\n", index+ML_SSECTORS);
-            touched[index+ML_SSECTORS] = TOUCHED_LEVEL_SSECTORS;
-            convert_subsectors(wad, l, seg_mapping);
-
-            if (!wad.get_lump(index+ML_NODES, l) || l.name != "NODES") {
-                fail("missing NODES for %s", name.c_str());
-            }
-            printf("Convert NODES in lump %d\n", index+ML_NODES);
-            compressed.insert(index+ML_NODES);
-            touched[index+ML_NODES] = TOUCHED_LEVEL_NODES;
-            convert_nodes(wad, l);
-
-            if (!wad.get_lump(index+ML_SECTORS, l) || l.name != "SECTORS") {
-                fail("missing SECTORS for %s", name.c_str());
-            }
-            printf("Convert SECTORS in lump %d\n", index+ML_SECTORS);
-            touched[index+ML_SECTORS] = TOUCHED_LEVEL_SECTORS;
-            convert_sectors(wad, l);
-
-            if (!wad.get_lump(index+ML_REJECT, l) || l.name != "REJECT") {
-                fail("missing REJECT for %s", name.c_str());
-            }
-            printf("Convert REJECT in lump %d\n", index+ML_REJECT);
-            // todo convert_reject(wad, l);
-            touched[index+ML_REJECT] = TOUCHED_LEVEL_REJECT;
-
-            if (!wad.get_lump(index+ML_BLOCKMAP, l) || l.name != "BLOCKMAP") {
-                fail("missing BLOCKMAP for %s", name.c_str());
-            }
-            printf("Convert BLOCKMAP in lump %d\n", index+ML_BLOCKMAP);
-            touched[index+ML_BLOCKMAP] = TOUCHED_LEVEL_BLOCKMAP;
-            compressed.insert(index+ML_BLOCKMAP);
-            convert_blockmap(wad, l, linedef_mapping);
-        };
-        for(int e=1; e<=4; e++) {
-            for(int m=1; m<=9; m++) {
-                convert_level(wad, "E"+std::to_string(e)+"M"+std::to_string(m));
-            }
-        }
-        for(int m=1; m<=32; m++) {
-            char name[10];
-            sprintf(name, "MAP%02d", m);
-            convert_level(wad, name);
-        }
+        convert_levels(wad, tex_index);
         for (auto &e : wad.get_lumps()) {
             auto it = std::find(level_data.begin(), level_data.end(), e.second.name);
             if (it != level_data.end()) {
@@ -5118,10 +5489,8 @@ int main(int argc, const char **argv) {
             }
         }
 
+        convert_music(wad);
         for (auto &e : wad.get_lumps()) {
-            if (music_lumpnames.find(to_lower(e.second.name)) != music_lumpnames.end()) {
-                convert_music(e);
-            }
             total_size += e.second.data.size();
             //printf("%s %08x\n", e.second.name.c_str(), (int)e.second.data.size());
         }
@@ -5236,7 +5605,7 @@ int main(int argc, const char **argv) {
 
         same_columns.print_summary();
 
-        for(i=0;i<(int)winners.size();i++) {
+        for(i=0;i<winners.size();i++) {
             printf("WIN %d %d\n", i, winners[i]);
         }
         patch_pixels.print_summary();
@@ -5248,9 +5617,9 @@ int main(int argc, const char **argv) {
         cp1_run.print_summary();
         cp1_raw_run.print_summary();
         cp_size.print_summary();
-        printf("Bit addressable %d\n", bit_addressable_patch);
-        printf("Dumped patches %d Converted patches %d Size %d\n", dumped_patch_count, converted_patch_count, converted_patch_size);
-        printf("Opaque %d Transparent %d total %d\n", opaque_pixels, transparent_pixels, opaque_pixels + transparent_pixels);
+        printf("Bit addressable %d\n", bit_addressable_patch[0]);
+        printf("Dumped patches %d Converted patches %d Size %d\n", dumped_patch_count[0], converted_patch_count[0], converted_patch_size[0]);
+        printf("Opaque %d Transparent %d total %d\n", opaque_pixels[0], transparent_pixels[0], opaque_pixels[0] + transparent_pixels[0]);
         flat_rawsize.print_summary();
         flat_c2size.print_summary();
         flat_have_same_savings.print_summary();
@@ -5258,9 +5627,11 @@ int main(int argc, const char **argv) {
         for (const auto &s : flat_under_colors) {
             s.print_summary();
         }
-        for(i=0;i<(int)fwinners.size();i++) {
+        for(i=0;i<fwinners.size();i++) {
             printf("FWIN %d %d\n", i, fwinners[i]);
         }
+        if (huff_bench) huff_bench_print_summary();
+        lump_cache_print_summary();
 
         color_runs.print_summary();
         side_meta.print_summary();
@@ -5296,6 +5667,10 @@ int main(int argc, const char **argv) {
             total += e.second;
         }
         printf("TOTAL %d (%dK)\n", total, (total+512)/1024);
+        if (max_compression) {
+            printf("MAX COMPRESSION SAVINGS -------------\n");
+            printf("%s: %d\n", TOUCHED_TEX_METADATA, max_compression_savings[0]);
+        }
 
         printf("WAD -------------\n");
         ltype_size.clear();
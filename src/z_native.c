@@ -491,6 +491,11 @@ int Z_FreeMemory(void)
     return -1;
 }
 
+int Z_LargestFree(void)
+{
+    return -1;
+}
+
 unsigned int Z_ZoneSize(void)
 {
     return 0;
@@ -97,6 +97,40 @@ static inline shortptr_t memblock_to_shortptr(memblock_t *mb) {
     return ptr_to_shortptr(mb);
 }
 
+#if Z_SIZE_CLASSES
+//
+// SEGREGATED FIT
+//
+// In addition to being in the block list, every free block is on the free list for its size class, linked through
+// its (otherwise unused) payload. Small classes are 8 bytes wide, larger ones a power of 2, so an allocation can
+// usually just take the head of the first non empty class that is big enough. The rover walk is still used if no free
+// block is big enough, as that is what purges PU_CACHE blocks.
+//
+#define Z_SMALL_CLASS_SHIFT 3
+#define Z_SMALL_CLASSES 32 // block sizes below 256 bytes
+#define Z_LARGE_CLASSES 16
+#define Z_SIZE_CLASS_COUNT (Z_SMALL_CLASSES + Z_LARGE_CLASSES)
+static_assert(Z_SIZE_CLASS_COUNT <= 64, "");
+
+#if PICO_ON_DEVICE
+typedef shortptr_t zfree_link_t;
+#define zfree_link(mb) ptr_to_shortptr(mb)
+#define zfree_block(l) ((memblock_t *)shortptr_to_ptr(l))
+#else
+// offset from mainzone, as two pointers may not fit in the smallest payload
+typedef uint32_t zfree_link_t;
+#define zfree_link(mb) ((mb) ? (zfree_link_t)((byte *)(mb) - (byte *)mainzone) : 0)
+#define zfree_block(l) ((l) ? (memblock_t *)((byte *)mainzone + (l)) : NULL)
+#endif
+
+typedef struct {
+    zfree_link_t next;
+    zfree_link_t prev;
+} zfree_t;
+
+#define memblock_zfree(mb) ((zfree_t *)((byte *)(mb) + sizeof(memblock_t)))
+#endif
+
 typedef struct
 {
     // total bytes malloced, including header
@@ -106,12 +140,70 @@ typedef struct
     memblock_t	blocklist;
     
     memblock_t*	rover;
-    
+
+#if Z_SIZE_CLASSES
+    zfree_link_t free_heads[Z_SIZE_CLASS_COUNT];
+    uint64_t free_classes; // bit set for each non empty free list
+#endif
 } memzone_t;
 
 
 
 static memzone_t *mainzone;
+
+#if Z_ZONE_STATS
+static struct {
+    uint32_t mallocs;
+    uint32_t walk_steps; // blocks (or free list entries) looked at by Z_Malloc
+    uint32_t max_walk_steps;
+    uint32_t rover_mallocs; // allocations which needed the rover walk
+    uint32_t purges;
+} zone_stats;
+#define ZONE_STATS_WALK_STEP() (walk_steps++)
+#else
+#define ZONE_STATS_WALK_STEP() ((void)0)
+#endif
+
+#if Z_SIZE_CLASSES
+static inline int Z_SizeClass(int size) {
+    if (size < (Z_SMALL_CLASSES << Z_SMALL_CLASS_SHIFT)) {
+        return size >> Z_SMALL_CLASS_SHIFT;
+    }
+    int c = Z_SMALL_CLASSES + (31 - __builtin_clz(size)) - (31 - __builtin_clz(Z_SMALL_CLASSES << Z_SMALL_CLASS_SHIFT));
+    return c < Z_SIZE_CLASS_COUNT ? c : Z_SIZE_CLASS_COUNT - 1;
+}
+
+static void Z_LinkFree(memblock_t *block) {
+    int c = Z_SizeClass(memblock_size(block));
+    zfree_t *zf = memblock_zfree(block);
+    zf->prev = 0;
+    zf->next = mainzone->free_heads[c];
+    if (zf->next) {
+        memblock_zfree(zfree_block(zf->next))->prev = zfree_link(block);
+    }
+    mainzone->free_heads[c] = zfree_link(block);
+    mainzone->free_classes |= 1ull << c;
+}
+
+// note this must be called before the block's size is changed
+static void Z_UnlinkFree(memblock_t *block) {
+    zfree_t *zf = memblock_zfree(block);
+    if (zf->prev) {
+        memblock_zfree(zfree_block(zf->prev))->next = zf->next;
+    } else {
+        int c = Z_SizeClass(memblock_size(block));
+        assert(mainzone->free_heads[c] == zfree_link(block));
+        mainzone->free_heads[c] = zf->next;
+        if (!zf->next) mainzone->free_classes &= ~(1ull << c);
+    }
+    if (zf->next) {
+        memblock_zfree(zfree_block(zf->next))->prev = zf->prev;
+    }
+}
+#else
+#define Z_LinkFree(block) ((void)0)
+#define Z_UnlinkFree(block) ((void)0)
+#endif
 #if !NO_ZONE_DEBUG
 static boolean zero_on_free;
 static boolean scan_on_free;
@@ -150,6 +242,11 @@ void Z_Init (void)
     block->tag = PU_FREE;
 
     set_memblock_size(block, mainzone->size - sizeof(memzone_t));
+#if Z_SIZE_CLASSES
+    memset(mainzone->free_heads, 0, sizeof(mainzone->free_heads));
+    mainzone->free_classes = 0;
+#endif
+    Z_LinkFree(block);
 
 #if !NO_ZONE_DEBUG
     // [Deliberately undocumented]
@@ -256,6 +353,7 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge with previous free block
+        Z_UnlinkFree(other);
         set_memblock_size(other, memblock_size(other) + memblock_size(block));
         other->sp_next = block->sp_next;
         memblock_next(other)->sp_prev = memblock_to_shortptr(other);
@@ -270,6 +368,7 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge the next free block onto the end
+        Z_UnlinkFree(other);
         set_memblock_size(block, memblock_size(other) + memblock_size(block));
         block->sp_next = other->sp_next;
         memblock_next(block)->sp_prev = memblock_to_shortptr(block);
@@ -277,6 +376,7 @@ void Z_Free (void* ptr)
         if (other == mainzone->rover)
             mainzone->rover = block;
     }
+    Z_LinkFree(block);
 }
 
 
@@ -307,66 +407,112 @@ Z_MallocNoUser
     memblock_t*	base;
     void *result;
 
+#if Z_ZONE_STATS
+    uint32_t walk_steps = 0;
+#endif
+#if Z_SIZE_CLASSES
+    // the payload must be able to hold the free list links once the block is freed
+    if (size < (int)sizeof(zfree_t)) size = sizeof(zfree_t);
+#endif
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
-    // scan through the block list,
-    // looking for the first free block
-    // of sufficient size,
-    // throwing out any purgable blocks along the way.
-
     // account for size of block header
     size += sizeof(memblock_t);
+
+#if Z_SIZE_CLASSES
+    // first fit within our own size class, which is the only one which may contain blocks that are too small,
+    // otherwise the head of the next non empty class
+    base = NULL;
+    int c = Z_SizeClass(size);
+    if (mainzone->free_classes & (1ull << c)) {
+        for (memblock_t *fb = zfree_block(mainzone->free_heads[c]); fb; fb = zfree_block(memblock_zfree(fb)->next)) {
+            ZONE_STATS_WALK_STEP();
+            if (memblock_size(fb) >= size) {
+                base = fb;
+                break;
+            }
+        }
+    }
+    if (!base && c + 1 < Z_SIZE_CLASS_COUNT) {
+        uint64_t larger = mainzone->free_classes & (~0ull << (c + 1));
+        if (larger) {
+            ZONE_STATS_WALK_STEP();
+            base = zfree_block(mainzone->free_heads[__builtin_ctzll(larger)]);
+            assert(memblock_size(base) >= size);
+        }
+    }
+    if (!base)
+#endif
+    {
+        // scan through the block list,
+        // looking for the first free block
+        // of sufficient size,
+        // throwing out any purgable blocks along the way.
+
+        // if there is a free block behind the rover,
+        //  back up over them
+        base = mainzone->rover;
     
-    // if there is a free block behind the rover,
-    //  back up over them
-    base = mainzone->rover;
-    
-    if (memblock_prev(base)->tag == PU_FREE)
-        base = memblock_prev(base);
+        if (memblock_prev(base)->tag == PU_FREE)
+            base = memblock_prev(base);
 	
-    rover = base;
-    start = memblock_prev(base);
+        rover = base;
+        start = memblock_prev(base);
 	
-    do
-    {
-        if (rover == start)
+#if Z_ZONE_STATS
+        zone_stats.rover_mallocs++;
+#endif
+        do
         {
-            // scanned all the way around the list
+            ZONE_STATS_WALK_STEP();
+            if (rover == start)
+            {
+                // scanned all the way around the list
 #if DOOM_TINY
-            panic("out of memory");
+                panic("out of memory");
 #else
-            I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+                I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
 #endif
-        }
+            }
 	
-        if (rover->tag != PU_FREE)
-        {
-            if (rover->tag < PU_PURGELEVEL)
+            if (rover->tag != PU_FREE)
             {
-                // hit a block that can't be purged,
-                // so move base past it
-                base = rover = memblock_next(rover);
+                if (rover->tag < PU_PURGELEVEL)
+                {
+                    // hit a block that can't be purged,
+                    // so move base past it
+                    base = rover = memblock_next(rover);
+                }
+                else
+                {
+                    // free the rover block (adding the size to base)
+
+                    // the rover can be the base block
+                    base = memblock_prev(base);
+#if Z_ZONE_STATS
+                    zone_stats.purges++;
+#endif
+                    Z_Free ((byte *)rover+sizeof(memblock_t));
+                    base = memblock_next(base);
+                    rover = memblock_next(base);
+                }
             }
             else
             {
-                // free the rover block (adding the size to base)
-
-                // the rover can be the base block
-                base = memblock_prev(base);
-                Z_Free ((byte *)rover+sizeof(memblock_t));
-                base = memblock_next(base);
-                rover = memblock_next(base);
+                rover = memblock_next(rover);
             }
-        }
-        else
-        {
-            rover = memblock_next(rover);
-        }
 
-    } while (base->tag != PU_FREE || memblock_size(base) < size);
+        } while (base->tag != PU_FREE || memblock_size(base) < size);
+    }
+
+#if Z_ZONE_STATS
+    zone_stats.mallocs++;
+    zone_stats.walk_steps += walk_steps;
+    if (walk_steps > zone_stats.max_walk_steps) zone_stats.max_walk_steps = walk_steps;
+#endif
 
-    
     // found a block big enough
+    Z_UnlinkFree(base);
     extra = memblock_size(base) - size;
     
     if (extra >  MINFRAGMENT)
@@ -385,6 +531,7 @@ Z_MallocNoUser
 
         base->sp_next = memblock_to_shortptr(newblock);
         set_memblock_size(base, size);
+        Z_LinkFree(newblock);
     }
 
 #if !NO_Z_MALLOC_USER_PTR
@@ -641,7 +788,74 @@ int Z_FreeMemory (void)
     return free;
 }
 
+//
+// Z_LargestFree
+// Size of the largest block Z_Malloc could currently return
+// (possibly by purging blocks)
+//
+int Z_LargestFree (void)
+{
+    memblock_t*		block;
+    int			run = 0;
+    int			largest = 0;
+
+    for (block = memblock_next(&mainzone->blocklist) ;
+         block != &mainzone->blocklist;
+         block = memblock_next(block))
+    {
+        if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+        {
+            run += memblock_size(block);
+            if (run > largest)
+                largest = run;
+        }
+        else
+        {
+            run = 0;
+        }
+    }
+
+    return largest > (int)sizeof(memblock_t) ? largest - (int)sizeof(memblock_t) : 0;
+}
+
 unsigned int Z_ZoneSize(void)
 {
     return mainzone->size;
 }
+
+#if Z_ZONE_STATS
+//
+// Z_ReportStats
+//
+void Z_ReportStats(void)
+{
+    memblock_t*		block;
+    int			free_bytes = 0, free_blocks = 0, largest_free = 0;
+    int			purgable_bytes = 0, used_blocks = 0;
+
+    for (block = memblock_next(&mainzone->blocklist) ;
+         block != &mainzone->blocklist;
+         block = memblock_next(block))
+    {
+        if (block->tag == PU_FREE)
+        {
+            free_bytes += memblock_size(block);
+            free_blocks++;
+            if (memblock_size(block) > largest_free) largest_free = memblock_size(block);
+        }
+        else
+        {
+            used_blocks++;
+            if (block->tag >= PU_PURGELEVEL) purgable_bytes += memblock_size(block);
+        }
+    }
+    printf("zone: %d used blocks, %d free bytes in %d blocks (largest %d, %d%% fragmented), %d purgable bytes\n",
+           used_blocks, free_bytes, free_blocks, largest_free,
+           free_bytes ? 100 - (int)(largest_free * 100ll / free_bytes) : 0, purgable_bytes);
+    printf("zone: %u mallocs, %u rover walks, %u purges, walk length avg %d.%02d max %u\n",
+           (unsigned)zone_stats.mallocs, (unsigned)zone_stats.rover_mallocs, (unsigned)zone_stats.purges,
+           zone_stats.mallocs ? (int)(zone_stats.walk_steps / zone_stats.mallocs) : 0,
+           zone_stats.mallocs ? (int)(zone_stats.walk_steps * 100ull / zone_stats.mallocs % 100) : 0,
+           (unsigned)zone_stats.max_walk_steps);
+}
+#endif
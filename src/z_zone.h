@@ -67,7 +67,12 @@ void    Z_CheckHeap (void);
 void    Z_ChangeTag2 (void *ptr, int tag, const char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
 int     Z_FreeMemory (void);
+int     Z_LargestFree (void);
 unsigned int Z_ZoneSize(void);
+#if Z_ZONE_STATS
+// print fragmentation and Z_Malloc walk length counters
+void    Z_ReportStats(void);
+#endif
 
 #if Z_MALOOC_EXTRA_DATA
 unsigned char *Z_ObjectExtra(void *ptr);